@@ -38,6 +38,8 @@
 #include "rsvg-mask.h"
 #include "rsvg-marker.h"
 #include "rsvg-cairo-render.h"
+#include "rsvg-buffer-pool.h"
+#include "rsvg-pattern-cache.h"
 
 #include <libxml/uri.h>
 #include <libxml/parser.h>
@@ -1246,6 +1248,9 @@ rsvg_drawing_ctx_free (RsvgDrawingCtx * handle)
     if (handle->pango_context != NULL)
         g_object_unref (handle->pango_context);
 
+    rsvg_buffer_pool_report (handle->buffer_pool);
+    rsvg_buffer_pool_unref (handle->buffer_pool);
+
     g_free (handle);
 }
 
@@ -1619,6 +1624,24 @@ rsvg_set_default_dpi_x_y (double dpi_x, double dpi_y)
         rsvg_internal_dpi_y = dpi_y;
 }
 
+/**
+ * rsvg_set_filter_threads:
+ * @n_threads: The number of threads to use
+ *
+ * Sets how many threads the per-pixel filter effects may share their work
+ * between. The default is 1, or the value of the RSVG_FILTER_THREADS
+ * environment variable if it is set. Threads are only used once GLib's
+ * thread system has been initialized with g_thread_init(); the output is
+ * the same whatever the setting.
+ *
+ * Since: 2.36
+ */
+void
+rsvg_set_filter_threads (int n_threads)
+{
+    rsvg_filter_set_threads (n_threads);
+}
+
 /**
  * rsvg_handle_set_dpi
  * @handle: An #RsvgHandle
@@ -1662,6 +1685,44 @@ rsvg_handle_set_dpi_x_y (RsvgHandle * handle, double dpi_x, double dpi_y)
         handle->priv->dpi_y = rsvg_internal_dpi_y;
     else
         handle->priv->dpi_y = dpi_y;
+
+    /* the tiles were drawn at the old resolution */
+    rsvg_pattern_cache_clear (handle->priv->pattern_cache);
+}
+
+/**
+ * rsvg_handle_set_filter_quality:
+ * @handle: An #RsvgHandle
+ * @quality: How closely filter effects have to be followed
+ *
+ * With %RSVG_FILTER_QUALITY_FAST, filter effects take these shortcuts:
+ *
+ * Gaussian blurs with a large standard deviation and turbulence with a
+ * low base frequency are worked out at a lower resolution and scaled up
+ * to the one they are drawn at.
+ *
+ * Colour matrices that feed straight into each other are multiplied into
+ * one, with the coefficients rounded.
+ *
+ * Convolution matrices whose entries don't fit fixed point exactly are
+ * summed in fixed point anyway.
+ *
+ * Drop shadows that flood SourceGraphic with a colour before blurring it,
+ * as Inkscape writes them, are worked out in one pass that puts the
+ * colour on after the blur.
+ *
+ * The result looks much the same and costs far less, at print
+ * resolutions above all, but is not exact. The default is
+ * %RSVG_FILTER_QUALITY_EXACT.
+ *
+ * Since: 2.36
+ */
+void
+rsvg_handle_set_filter_quality (RsvgHandle * handle, RsvgFilterQuality quality)
+{
+    g_return_if_fail (handle != NULL);
+
+    handle->priv->filter_quality = quality;
 }
 
 /**
@@ -2072,18 +2133,25 @@ rsvg_push_discrete_layer (RsvgDrawingCtx * ctx)
 void
 rsvg_render_path (RsvgDrawingCtx * ctx, const char *d)
 {
-    /* todo: store and use the bpath higher up */
     RsvgBpathDef *bpath_def;
 
     bpath_def = rsvg_parse_path (d);
     rsvg_bpath_def_art_finish (bpath_def);
 
-    ctx->render->render_path (ctx, bpath_def);
-    rsvg_render_markers (bpath_def, ctx);
+    rsvg_render_bpath (ctx, bpath_def);
 
     rsvg_bpath_def_free (bpath_def);
 }
 
+/* Renders an already parsed and finished path; @bpath_def is not modified,
+   so nodes can keep their compiled path around between draws. */
+void
+rsvg_render_bpath (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def)
+{
+    ctx->render->render_path (ctx, bpath_def);
+    rsvg_render_markers (bpath_def, ctx);
+}
+
 void
 rsvg_render_image (RsvgDrawingCtx * ctx, GdkPixbuf * pb, double x, double y, double w, double h)
 {
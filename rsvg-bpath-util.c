@@ -35,41 +35,54 @@
 /* This is adapted from gnome-canvas-bpath-util in libgnomeprint
    (originally developed as part of Gill). */
 
-RsvgBpathDef *
-rsvg_bpath_def_new (void)
+static int
+rsvg_bpath_code_n_coords (RsvgPathcode code)
+{
+    switch (code) {
+    case RSVG_MOVETO:
+    case RSVG_MOVETO_OPEN:
+    case RSVG_LINETO:
+        return 2;
+    case RSVG_CURVETO:
+        return 6;
+    case RSVG_END:
+    default:
+        return 0;
+    }
+}
+
+static RsvgBpathDef *
+rsvg_bpath_def_new_with_precision (gboolean single_precision)
 {
     RsvgBpathDef *bpd;
 
     bpd = g_new (RsvgBpathDef, 1);
-    bpd->n_bpath = 0;
-    bpd->n_bpath_max = 16;
+    bpd->n_codes = 0;
+    bpd->n_codes_max = 16;
+    bpd->codes = g_new (guint8, bpd->n_codes_max);
+    bpd->n_coords = 0;
+    bpd->n_coords_max = 32;
+    bpd->single_precision = single_precision;
+    if (single_precision)
+        bpd->coords = g_new (gfloat, bpd->n_coords_max);
+    else
+        bpd->coords = g_new (gdouble, bpd->n_coords_max);
     bpd->moveto_idx = -1;
-    bpd->bpath = g_new (RsvgBpath, bpd->n_bpath_max);
 
     return bpd;
 }
 
 RsvgBpathDef *
-rsvg_bpath_def_new_from (RsvgBpath * path)
+rsvg_bpath_def_new (void)
 {
-    RsvgBpathDef *bpd;
-    int i;
-
-    g_return_val_if_fail (path != NULL, NULL);
-
-    for (i = 0; path[i].code != RSVG_END; i++);
-    if (i <= 0)
-        return rsvg_bpath_def_new ();
-
-    bpd = g_new (RsvgBpathDef, 1);
-
-    bpd->n_bpath = i;
-    bpd->n_bpath_max = i;
-    bpd->moveto_idx = -1;
-    bpd->bpath = g_new (RsvgBpath, i);
+    return rsvg_bpath_def_new_with_precision (FALSE);
+}
 
-    memcpy (bpd->bpath, path, i * sizeof (RsvgBpath));
-    return bpd;
+/* Same as rsvg_bpath_def_new(), but coordinates are kept as floats. */
+RsvgBpathDef *
+rsvg_bpath_def_new_float (void)
+{
+    return rsvg_bpath_def_new_with_precision (TRUE);
 }
 
 void
@@ -77,125 +90,276 @@ rsvg_bpath_def_free (RsvgBpathDef * bpd)
 {
     g_return_if_fail (bpd != NULL);
 
-    g_free (bpd->bpath);
+    g_free (bpd->codes);
+    g_free (bpd->coords);
     g_free (bpd);
 }
 
+static void
+rsvg_bpath_def_append (RsvgBpathDef * bpd, RsvgPathcode code, const double *coords, int n_coords)
+{
+    int i;
+
+    if (bpd->n_codes == bpd->n_codes_max)
+        bpd->codes = g_realloc (bpd->codes, (bpd->n_codes_max <<= 1) * sizeof (guint8));
+    bpd->codes[bpd->n_codes++] = code;
+
+    if (bpd->n_coords + n_coords > bpd->n_coords_max) {
+        while (bpd->n_coords + n_coords > bpd->n_coords_max)
+            bpd->n_coords_max <<= 1;
+        bpd->coords = g_realloc (bpd->coords, bpd->n_coords_max *
+                                 (bpd->single_precision ? sizeof (gfloat) : sizeof (gdouble)));
+    }
+
+    if (bpd->single_precision) {
+        gfloat *dst = (gfloat *) bpd->coords + bpd->n_coords;
+        for (i = 0; i < n_coords; i++)
+            dst[i] = coords[i];
+    } else {
+        memcpy ((gdouble *) bpd->coords + bpd->n_coords, coords, n_coords * sizeof (gdouble));
+    }
+    bpd->n_coords += n_coords;
+}
+
+static double
+rsvg_bpath_def_coord (const RsvgBpathDef * bpd, int idx)
+{
+    if (bpd->single_precision)
+        return ((const gfloat *) bpd->coords)[idx];
+    return ((const gdouble *) bpd->coords)[idx];
+}
+
+RsvgBpathDef *
+rsvg_bpath_def_new_from (RsvgBpath * path)
+{
+    RsvgBpathDef *bpd;
+    int i;
+
+    g_return_val_if_fail (path != NULL, NULL);
+
+    bpd = rsvg_bpath_def_new ();
+
+    for (i = 0; path[i].code != RSVG_END; i++) {
+        double coords[6];
+
+        if (path[i].code == RSVG_CURVETO) {
+            coords[0] = path[i].x1;
+            coords[1] = path[i].y1;
+            coords[2] = path[i].x2;
+            coords[3] = path[i].y2;
+            coords[4] = path[i].x3;
+            coords[5] = path[i].y3;
+        } else {
+            coords[0] = path[i].x3;
+            coords[1] = path[i].y3;
+        }
+        if (path[i].code == RSVG_MOVETO || path[i].code == RSVG_MOVETO_OPEN)
+            bpd->moveto_idx = bpd->n_coords;
+        rsvg_bpath_def_append (bpd, path[i].code, coords,
+                               rsvg_bpath_code_n_coords (path[i].code));
+    }
+
+    return bpd;
+}
+
 void
 rsvg_bpath_def_moveto (RsvgBpathDef * bpd, double x, double y)
 {
-    RsvgBpath *bpath;
-    int n_bpath;
+    double coords[2];
 
     g_return_if_fail (bpd != NULL);
 
     /* if the last command was a moveto then change that last moveto instead of
        creating a new one */
-    bpath = bpd->bpath;
-    n_bpath = bpd->n_bpath;
-
-    if (n_bpath > 0)
-        if (bpath[n_bpath - 1].code == RSVG_MOVETO_OPEN) {
-            bpath[n_bpath - 1].x3 = x;
-            bpath[n_bpath - 1].y3 = y;
-            bpd->moveto_idx = n_bpath - 1;
-            return;
+    if (bpd->n_codes > 0 && bpd->codes[bpd->n_codes - 1] == RSVG_MOVETO_OPEN) {
+        int idx = bpd->n_coords - 2;
+
+        if (bpd->single_precision) {
+            ((gfloat *) bpd->coords)[idx] = x;
+            ((gfloat *) bpd->coords)[idx + 1] = y;
+        } else {
+            ((gdouble *) bpd->coords)[idx] = x;
+            ((gdouble *) bpd->coords)[idx + 1] = y;
         }
-
-    n_bpath = bpd->n_bpath++;
-
-    if (n_bpath == bpd->n_bpath_max)
-        bpd->bpath = g_realloc (bpd->bpath, (bpd->n_bpath_max <<= 1) * sizeof (RsvgBpath));
-    bpath = bpd->bpath;
-    bpath[n_bpath].code = RSVG_MOVETO_OPEN;
-    bpath[n_bpath].x3 = x;
-    bpath[n_bpath].y3 = y;
-    bpd->moveto_idx = n_bpath;
+        bpd->moveto_idx = idx;
+        return;
+    }
+
+    coords[0] = x;
+    coords[1] = y;
+    bpd->moveto_idx = bpd->n_coords;
+    rsvg_bpath_def_append (bpd, RSVG_MOVETO_OPEN, coords, 2);
 }
 
 void
 rsvg_bpath_def_lineto (RsvgBpathDef * bpd, double x, double y)
 {
-    RsvgBpath *bpath;
-    int n_bpath;
+    double coords[2];
 
     g_return_if_fail (bpd != NULL);
     g_return_if_fail (bpd->moveto_idx >= 0);
 
-    n_bpath = bpd->n_bpath++;
-
-    if (n_bpath == bpd->n_bpath_max)
-        bpd->bpath = g_realloc (bpd->bpath, (bpd->n_bpath_max <<= 1) * sizeof (RsvgBpath));
-    bpath = bpd->bpath;
-    bpath[n_bpath].code = RSVG_LINETO;
-    bpath[n_bpath].x3 = x;
-    bpath[n_bpath].y3 = y;
+    coords[0] = x;
+    coords[1] = y;
+    rsvg_bpath_def_append (bpd, RSVG_LINETO, coords, 2);
 }
 
 void
 rsvg_bpath_def_curveto (RsvgBpathDef * bpd, double x1, double y1, double x2, double y2, double x3,
                         double y3)
 {
-    RsvgBpath *bpath;
-    int n_bpath;
+    double coords[6];
 
     g_return_if_fail (bpd != NULL);
     g_return_if_fail (bpd->moveto_idx >= 0);
 
-    n_bpath = bpd->n_bpath++;
-
-    if (n_bpath == bpd->n_bpath_max)
-        bpd->bpath = g_realloc (bpd->bpath, (bpd->n_bpath_max <<= 1) * sizeof (RsvgBpath));
-    bpath = bpd->bpath;
-    bpath[n_bpath].code = RSVG_CURVETO;
-    bpath[n_bpath].x1 = x1;
-    bpath[n_bpath].y1 = y1;
-    bpath[n_bpath].x2 = x2;
-    bpath[n_bpath].y2 = y2;
-    bpath[n_bpath].x3 = x3;
-    bpath[n_bpath].y3 = y3;
+    coords[0] = x1;
+    coords[1] = y1;
+    coords[2] = x2;
+    coords[3] = y2;
+    coords[4] = x3;
+    coords[5] = y3;
+    rsvg_bpath_def_append (bpd, RSVG_CURVETO, coords, 6);
 }
 
-static void
-rsvg_bpath_def_replicate (RsvgBpathDef * bpd, int index)
+void
+rsvg_bpath_def_closepath (RsvgBpathDef * bpd)
 {
-    RsvgBpath *bpath;
-    int n_bpath;
+    double coords[2];
 
-    n_bpath = bpd->n_bpath++;
+    g_return_if_fail (bpd != NULL);
+    g_return_if_fail (bpd->moveto_idx >= 0);
+    g_return_if_fail (bpd->n_codes > 0);
 
-    if (n_bpath == bpd->n_bpath_max)
-        bpd->bpath = g_realloc (bpd->bpath, (bpd->n_bpath_max <<= 1) * sizeof (RsvgBpath));
-    bpath = bpd->bpath;
-    bpath[n_bpath] = bpath[index];
+    /* replicate the subpath's starting point as a closing moveto */
+    coords[0] = rsvg_bpath_def_coord (bpd, bpd->moveto_idx);
+    coords[1] = rsvg_bpath_def_coord (bpd, bpd->moveto_idx + 1);
+    bpd->moveto_idx = bpd->n_coords;
+    rsvg_bpath_def_append (bpd, RSVG_MOVETO, coords, 2);
 }
 
 void
-rsvg_bpath_def_closepath (RsvgBpathDef * bpd)
+rsvg_bpath_def_art_finish (RsvgBpathDef * bpd)
 {
-    RsvgBpath *bpath;
-
     g_return_if_fail (bpd != NULL);
-    g_return_if_fail (bpd->moveto_idx >= 0);
-    g_return_if_fail (bpd->n_bpath > 0);
 
-    rsvg_bpath_def_replicate (bpd, bpd->moveto_idx);
-    bpath = bpd->bpath;
+    rsvg_bpath_def_append (bpd, RSVG_END, NULL, 0);
 
-    bpath[bpd->n_bpath - 1].code = RSVG_MOVETO;
-    bpd->moveto_idx = bpd->n_bpath - 1;
+    /* the path is not appended to anymore, so drop the slack */
+    bpd->n_codes_max = bpd->n_codes;
+    bpd->codes = g_realloc (bpd->codes, bpd->n_codes_max * sizeof (guint8));
+    if (bpd->n_coords > 0) {
+        bpd->n_coords_max = bpd->n_coords;
+        bpd->coords = g_realloc (bpd->coords, bpd->n_coords_max *
+                                 (bpd->single_precision ? sizeof (gfloat) : sizeof (gdouble)));
+    }
 }
 
-void
-rsvg_bpath_def_art_finish (RsvgBpathDef * bpd)
+/* Returns @bpd, or a copy of it keeping its coordinates as floats if that
+   moves none of them by more than a millionth of the path's extent, in
+   which case @bpd is freed. For paths kept on their nodes, where memory
+   matters more than precision no one can see. */
+RsvgBpathDef *
+rsvg_bpath_def_compact (RsvgBpathDef * bpd)
 {
-    int n_bpath;
+    RsvgBpathDef *compact;
+    double lo, hi, tolerance;
+    int i, c;
 
-    g_return_if_fail (bpd != NULL);
+    g_return_val_if_fail (bpd != NULL, NULL);
+
+    if (bpd->single_precision || bpd->n_coords == 0)
+        return bpd;
+
+    lo = hi = rsvg_bpath_def_coord (bpd, 0);
+    for (i = 1; i < bpd->n_coords; i++) {
+        double v = rsvg_bpath_def_coord (bpd, i);
+
+        lo = MIN (lo, v);
+        hi = MAX (hi, v);
+    }
+    tolerance = (hi - lo) / (1 << 20);
+
+    for (i = 0; i < bpd->n_coords; i++) {
+        double v = rsvg_bpath_def_coord (bpd, i);
 
-    n_bpath = bpd->n_bpath++;
+        if (fabs ((gfloat) v - v) > tolerance)
+            return bpd;
+    }
 
-    if (n_bpath == bpd->n_bpath_max)
-        bpd->bpath = g_realloc (bpd->bpath, (bpd->n_bpath_max <<= 1) * sizeof (RsvgBpath));
-    bpd->bpath[n_bpath].code = RSVG_END;
+    compact = rsvg_bpath_def_new_float ();
+    for (i = 0, c = 0; i < bpd->n_codes; i++) {
+        RsvgPathcode code = bpd->codes[i];
+        int n = rsvg_bpath_code_n_coords (code);
+
+        if (code != RSVG_END)
+            rsvg_bpath_def_append (compact, code, (const double *) bpd->coords + c, n);
+        c += n;
+    }
+    compact->moveto_idx = bpd->moveto_idx;
+    rsvg_bpath_def_art_finish (compact);
+
+    rsvg_bpath_def_free (bpd);
+    return compact;
+}
+
+/* Fetches the end point of the last segment with coordinates. Returns
+   FALSE for a path without any. */
+gboolean
+rsvg_bpath_def_get_last_point (const RsvgBpathDef * bpd, double *x, double *y)
+{
+    g_return_val_if_fail (bpd != NULL, FALSE);
+
+    if (bpd->n_coords < 2)
+        return FALSE;
+
+    *x = rsvg_bpath_def_coord (bpd, bpd->n_coords - 2);
+    *y = rsvg_bpath_def_coord (bpd, bpd->n_coords - 1);
+    return TRUE;
+}
+
+void
+rsvg_bpath_iter_init (RsvgBpathIter * iter, const RsvgBpathDef * bpd)
+{
+    iter->bpd = bpd;
+    iter->code = 0;
+    iter->coord = 0;
+}
+
+/* Expands the next segment into @segment. Returns FALSE once every
+   segment, including the final RSVG_END, has been handed out. */
+gboolean
+rsvg_bpath_iter_next (RsvgBpathIter * iter, RsvgBpath * segment)
+{
+    const RsvgBpathDef *bpd = iter->bpd;
+    int i = iter->coord;
+
+    if (iter->code >= bpd->n_codes)
+        return FALSE;
+
+    segment->code = bpd->codes[iter->code++];
+
+    switch (segment->code) {
+    case RSVG_CURVETO:
+        segment->x1 = rsvg_bpath_def_coord (bpd, i);
+        segment->y1 = rsvg_bpath_def_coord (bpd, i + 1);
+        segment->x2 = rsvg_bpath_def_coord (bpd, i + 2);
+        segment->y2 = rsvg_bpath_def_coord (bpd, i + 3);
+        segment->x3 = rsvg_bpath_def_coord (bpd, i + 4);
+        segment->y3 = rsvg_bpath_def_coord (bpd, i + 5);
+        iter->coord += 6;
+        break;
+    case RSVG_MOVETO:
+    case RSVG_MOVETO_OPEN:
+    case RSVG_LINETO:
+        segment->x3 = rsvg_bpath_def_coord (bpd, i);
+        segment->y3 = rsvg_bpath_def_coord (bpd, i + 1);
+        iter->coord += 2;
+        break;
+    case RSVG_END:
+        segment->x3 = segment->y3 = 0.;
+        break;
+    }
+
+    return TRUE;
 }
@@ -38,6 +38,8 @@ typedef enum {
     RSVG_END
 } RsvgPathcode;
 
+/* A single expanded segment, as handed out by rsvg_bpath_iter_next().
+   MOVETO, MOVETO_OPEN and LINETO only set x3/y3. */
 typedef struct _RsvgBpath RsvgBpath;
 struct _RsvgBpath {
     /*< public > */
@@ -50,16 +52,33 @@ struct _RsvgBpath {
     double y3;
 };
 
+/* Paths are stored packed: one byte of RsvgPathcode per segment and only
+   the coordinates that segment needs (2 for moveto/lineto, 6 for curveto,
+   none for end), either as doubles or, for large documents where memory
+   matters more than precision, as floats. */
 typedef struct _RsvgBpathDef RsvgBpathDef;
 
 struct _RsvgBpathDef {
-    RsvgBpath *bpath;
-    int n_bpath;
-    int n_bpath_max;
-    int moveto_idx;
+    guint8 *codes;
+    int n_codes;
+    int n_codes_max;
+    gpointer coords;
+    int n_coords;
+    int n_coords_max;
+    gboolean single_precision;
+    int moveto_idx;             /* index in coords of the current subpath's moveto */
+};
+
+typedef struct _RsvgBpathIter RsvgBpathIter;
+
+struct _RsvgBpathIter {
+    const RsvgBpathDef *bpd;
+    int code;
+    int coord;
 };
 
 RsvgBpathDef *rsvg_bpath_def_new        (void);
+RsvgBpathDef *rsvg_bpath_def_new_float  (void);
 RsvgBpathDef *rsvg_bpath_def_new_from   (RsvgBpath * bpath);
 
 void rsvg_bpath_def_free        (RsvgBpathDef * bpd);
@@ -71,6 +90,12 @@ void rsvg_bpath_def_curveto     (RsvgBpathDef * bpd,
 void rsvg_bpath_def_closepath   (RsvgBpathDef * bpd);
 
 void rsvg_bpath_def_art_finish  (RsvgBpathDef * bpd);
+RsvgBpathDef *rsvg_bpath_def_compact (RsvgBpathDef * bpd);
+
+gboolean rsvg_bpath_def_get_last_point  (const RsvgBpathDef * bpd, double *x, double *y);
+
+void     rsvg_bpath_iter_init   (RsvgBpathIter * iter, const RsvgBpathDef * bpd);
+gboolean rsvg_bpath_iter_next   (RsvgBpathIter * iter, RsvgBpath * segment);
 
 G_END_DECLS
 
@@ -0,0 +1,276 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-buffer-pool.c : Recycled pixel buffers for layers and filters
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include "rsvg-buffer-pool.h"
+#include <string.h>
+
+/* Sizes are rounded up to one of four steps between each power of two and
+   the next, so that a buffer serves any request down to a fifth smaller
+   than it. The smallest is a page. */
+#define RSVG_BUFFER_POOL_MIN_SHIFT 12
+#define RSVG_BUFFER_POOL_CLASSES (4 * (GLIB_SIZEOF_SIZE_T * 8 - RSVG_BUFFER_POOL_MIN_SHIFT) + 1)
+
+/* how much a pool holds on to between uses */
+#define RSVG_BUFFER_POOL_MAX_PER_CLASS 4
+#define RSVG_BUFFER_POOL_MAX_BYTES (128 * 1024 * 1024)
+
+typedef union _RsvgBufferHeader RsvgBufferHeader;
+
+/* what sits in front of every buffer, so it can find its way back */
+union _RsvgBufferHeader {
+    struct {
+        RsvgBufferPool *pool;
+        guint size_class;
+        RsvgBufferHeader *next; /* in the free list of its class */
+    } info;
+    gdouble align[4];           /* keeps the buffer as aligned as malloc does */
+};
+
+struct _RsvgBufferPool {
+    gint ref_count;             /* one for each holder and each buffer out */
+    GStaticMutex lock;
+    gboolean recycle;
+    RsvgBufferHeader *free[RSVG_BUFFER_POOL_CLASSES];
+    guint n_free[RSVG_BUFFER_POOL_CLASSES];
+    RsvgBufferPoolStats stats;
+};
+
+typedef enum {
+    RSVG_BUFFER_POOL_UNSET,
+    RSVG_BUFFER_POOL_PER_CONTEXT,
+    RSVG_BUFFER_POOL_PER_THREAD,
+    RSVG_BUFFER_POOL_OFF
+} RsvgBufferPoolMode;
+
+static RsvgBufferPoolMode buffer_pool_mode = RSVG_BUFFER_POOL_UNSET;
+G_LOCK_DEFINE_STATIC (buffer_pool_mode);
+static GStaticPrivate thread_pool = G_STATIC_PRIVATE_INIT;
+
+static guint
+rsvg_buffer_pool_size_class (gsize size)
+{
+    guint shift = RSVG_BUFFER_POOL_MIN_SHIFT;
+    gsize step;
+
+    if (size <= (gsize) 1 << shift)
+        return 0;
+
+    while (size > (gsize) 2 << shift)
+        shift++;
+    step = (gsize) 1 << (shift - 2);
+
+    return 4 * (shift - RSVG_BUFFER_POOL_MIN_SHIFT) + (size - ((gsize) 1 << shift) + step - 1) / step;
+}
+
+static gsize
+rsvg_buffer_pool_class_size (guint size_class)
+{
+    guint shift;
+
+    if (size_class == 0)
+        return (gsize) 1 << RSVG_BUFFER_POOL_MIN_SHIFT;
+
+    shift = RSVG_BUFFER_POOL_MIN_SHIFT + (size_class - 1) / 4;
+    return ((gsize) 1 << shift) + ((size_class - 1) % 4 + 1) * ((gsize) 1 << (shift - 2));
+}
+
+RsvgBufferPool *
+rsvg_buffer_pool_new (void)
+{
+    RsvgBufferPool *pool;
+
+    pool = g_new0 (RsvgBufferPool, 1);
+    pool->ref_count = 1;
+    g_static_mutex_init (&pool->lock);
+    pool->recycle = TRUE;
+
+    return pool;
+}
+
+RsvgBufferPool *
+rsvg_buffer_pool_ref (RsvgBufferPool * pool)
+{
+    g_atomic_int_inc (&pool->ref_count);
+    return pool;
+}
+
+void
+rsvg_buffer_pool_unref (RsvgBufferPool * pool)
+{
+    guint c;
+
+    if (!g_atomic_int_dec_and_test (&pool->ref_count))
+        return;
+
+    for (c = 0; c < RSVG_BUFFER_POOL_CLASSES; c++)
+        while (pool->free[c]) {
+            RsvgBufferHeader *header = pool->free[c];
+
+            pool->free[c] = header->info.next;
+            g_free (header);
+        }
+
+    g_static_mutex_free (&pool->lock);
+    g_free (pool);
+}
+
+RsvgBufferPool *
+rsvg_buffer_pool_get_default (void)
+{
+    RsvgBufferPoolMode mode;
+    RsvgBufferPool *pool;
+
+    G_LOCK (buffer_pool_mode);
+    if (buffer_pool_mode == RSVG_BUFFER_POOL_UNSET) {
+        const char *value = g_getenv ("RSVG_BUFFER_POOL");
+
+        if (value && !strcmp (value, "thread"))
+            buffer_pool_mode = RSVG_BUFFER_POOL_PER_THREAD;
+        else if (value && !strcmp (value, "off"))
+            buffer_pool_mode = RSVG_BUFFER_POOL_OFF;
+        else
+            buffer_pool_mode = RSVG_BUFFER_POOL_PER_CONTEXT;
+    }
+    mode = buffer_pool_mode;
+    G_UNLOCK (buffer_pool_mode);
+
+    if (mode == RSVG_BUFFER_POOL_PER_THREAD) {
+        /* left for the next drawing on this thread, and freed with it */
+        pool = g_static_private_get (&thread_pool);
+        if (pool == NULL) {
+            pool = rsvg_buffer_pool_new ();
+            g_static_private_set (&thread_pool, pool, (GDestroyNotify) rsvg_buffer_pool_unref);
+        }
+        return rsvg_buffer_pool_ref (pool);
+    }
+
+    pool = rsvg_buffer_pool_new ();
+    pool->recycle = mode != RSVG_BUFFER_POOL_OFF;
+    return pool;
+}
+
+void
+rsvg_buffer_pool_get_stats (RsvgBufferPool * pool, RsvgBufferPoolStats * stats)
+{
+    g_static_mutex_lock (&pool->lock);
+    *stats = pool->stats;
+    g_static_mutex_unlock (&pool->lock);
+}
+
+void
+rsvg_buffer_pool_report (RsvgBufferPool * pool)
+{
+    RsvgBufferPoolStats stats;
+
+    if (g_getenv ("RSVG_BUFFER_POOL_STATS") == NULL)
+        return;
+
+    rsvg_buffer_pool_get_stats (pool, &stats);
+    g_printerr ("buffer pool: %u hits, %u misses, %u dropped, %" G_GSIZE_FORMAT
+                " bytes allocated, %" G_GSIZE_FORMAT " bytes cached\n",
+                stats.hits, stats.misses, stats.dropped,
+                stats.bytes_allocated, stats.bytes_cached);
+}
+
+guchar *
+rsvg_buffer_pool_alloc (RsvgBufferPool * pool, gsize size)
+{
+    RsvgBufferHeader *header = NULL;
+    guint size_class;
+    gsize class_size;
+
+    if (size > G_MAXSIZE / 4)
+        return NULL;
+
+    size_class = rsvg_buffer_pool_size_class (size);
+    class_size = rsvg_buffer_pool_class_size (size_class);
+
+    if (pool) {
+        g_static_mutex_lock (&pool->lock);
+        header = pool->free[size_class];
+        if (header) {
+            pool->free[size_class] = header->info.next;
+            pool->n_free[size_class]--;
+            pool->stats.bytes_cached -= class_size;
+            pool->stats.hits++;
+        }
+        g_static_mutex_unlock (&pool->lock);
+    }
+
+    if (header == NULL) {
+        header = g_try_malloc (sizeof (RsvgBufferHeader) + class_size);
+        if (header == NULL)
+            return NULL;
+        header->info.size_class = size_class;
+
+        if (pool) {
+            g_static_mutex_lock (&pool->lock);
+            pool->stats.misses++;
+            pool->stats.bytes_allocated += class_size;
+            g_static_mutex_unlock (&pool->lock);
+        }
+    }
+
+    header->info.pool = pool ? rsvg_buffer_pool_ref (pool) : NULL;
+    header->info.next = NULL;
+
+    return (guchar *) (header + 1);
+}
+
+void
+rsvg_buffer_pool_free (gpointer buffer)
+{
+    RsvgBufferHeader *header;
+    RsvgBufferPool *pool;
+    guint size_class;
+    gsize class_size;
+
+    if (buffer == NULL)
+        return;
+
+    header = (RsvgBufferHeader *) buffer - 1;
+    pool = header->info.pool;
+    if (pool == NULL) {
+        g_free (header);
+        return;
+    }
+
+    size_class = header->info.size_class;
+    class_size = rsvg_buffer_pool_class_size (size_class);
+
+    g_static_mutex_lock (&pool->lock);
+    if (pool->recycle &&
+        pool->n_free[size_class] < RSVG_BUFFER_POOL_MAX_PER_CLASS &&
+        pool->stats.bytes_cached + class_size <= RSVG_BUFFER_POOL_MAX_BYTES) {
+        header->info.next = pool->free[size_class];
+        pool->free[size_class] = header;
+        pool->n_free[size_class]++;
+        pool->stats.bytes_cached += class_size;
+        header = NULL;
+    } else
+        pool->stats.dropped++;
+    g_static_mutex_unlock (&pool->lock);
+
+    g_free (header);
+    rsvg_buffer_pool_unref (pool);
+}
@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-buffer-pool.h : Recycled pixel buffers for layers and filters
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef RSVG_BUFFER_POOL_H
+#define RSVG_BUFFER_POOL_H
+
+#include "rsvg-private.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+    guint hits;                 /* requests a recycled buffer served */
+    guint misses;               /* requests that had to allocate */
+    guint dropped;              /* buffers freed on return as the pool was full */
+    gsize bytes_allocated;      /* allocated on misses so far */
+    gsize bytes_cached;         /* held for reuse now */
+} RsvgBufferPoolStats;
+
+RsvgBufferPool *rsvg_buffer_pool_new        (void);
+RsvgBufferPool *rsvg_buffer_pool_ref        (RsvgBufferPool * pool);
+void            rsvg_buffer_pool_unref      (RsvgBufferPool * pool);
+
+/* A reference to the pool a new drawing context should take its buffers
+   from: its own, or the calling thread's if RSVG_BUFFER_POOL is "thread".
+   If it is "off", nothing is kept for reuse. */
+RsvgBufferPool *rsvg_buffer_pool_get_default (void);
+
+void            rsvg_buffer_pool_get_stats  (RsvgBufferPool * pool, RsvgBufferPoolStats * stats);
+
+/* Prints the statistics if RSVG_BUFFER_POOL_STATS is set. */
+void            rsvg_buffer_pool_report     (RsvgBufferPool * pool);
+
+/* A buffer of at least @size bytes whose contents are undefined, or NULL
+   if there is no memory for it. @pool may be NULL, for a buffer that is
+   just freed when given back. */
+guchar         *rsvg_buffer_pool_alloc      (RsvgBufferPool * pool, gsize size);
+
+/* Gives @buffer back to the pool it came from. It can be the destroy
+   function of cairo user data. */
+void            rsvg_buffer_pool_free       (gpointer buffer);
+
+G_END_DECLS
+
+#endif                          /* RSVG_BUFFER_POOL_H */
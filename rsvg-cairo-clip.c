@@ -33,6 +33,7 @@
 #include "rsvg-styles.h"
 #include "rsvg-bpath-util.h"
 #include "rsvg-path.h"
+#include "rsvg-pattern-cache.h"
 
 #include <math.h>
 #include <string.h>
@@ -43,6 +44,7 @@ struct RsvgCairoClipRender {
     RsvgRender super;
     cairo_t *cr;
     RsvgCairoRender *parent;
+    gboolean drew_text;
 };
 
 static void
@@ -65,8 +67,8 @@ rsvg_cairo_clip_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_de
     RsvgCairoClipRender *render = (RsvgCairoClipRender *) ctx->render;
     RsvgState *state = rsvg_current_state (ctx);
     cairo_t *cr;
-    RsvgBpath *bpath;
-    int i;
+    RsvgBpathIter iter;
+    RsvgBpath bpath;
 
     cr = render->cr;
 
@@ -77,21 +79,20 @@ rsvg_cairo_clip_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_de
     else                        /* state->fill_rule == FILL_RULE_NONZERO */
         cairo_set_fill_rule (((RsvgCairoRender *) ctx->render)->cr, CAIRO_FILL_RULE_WINDING);
 
-    for (i = 0; i < bpath_def->n_bpath; i++) {
-        bpath = &bpath_def->bpath[i];
-
-        switch (bpath->code) {
+    rsvg_bpath_iter_init (&iter, bpath_def);
+    while (rsvg_bpath_iter_next (&iter, &bpath)) {
+        switch (bpath.code) {
         case RSVG_MOVETO:
             cairo_close_path (cr);
             /* fall-through */
         case RSVG_MOVETO_OPEN:
-            cairo_move_to (cr, bpath->x3, bpath->y3);
+            cairo_move_to (cr, bpath.x3, bpath.y3);
             break;
         case RSVG_CURVETO:
-            cairo_curve_to (cr, bpath->x1, bpath->y1, bpath->x2, bpath->y2, bpath->x3, bpath->y3);
+            cairo_curve_to (cr, bpath.x1, bpath.y1, bpath.x2, bpath.y2, bpath.x3, bpath.y3);
             break;
         case RSVG_LINETO:
-            cairo_line_to (cr, bpath->x3, bpath->y3);
+            cairo_line_to (cr, bpath.x3, bpath.y3);
             break;
         case RSVG_END:
             break;
@@ -99,6 +100,16 @@ rsvg_cairo_clip_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_de
     }
 }
 
+static void
+rsvg_cairo_clip_render_pango_layout (RsvgDrawingCtx * ctx, PangoLayout * layout, double x, double y)
+{
+    RsvgCairoClipRender *render = (RsvgCairoClipRender *) ctx->render;
+
+    /* text is not only added to the path, so the outline can't be kept */
+    render->drew_text = TRUE;
+    rsvg_cairo_render_pango_layout (ctx, layout, x, y);
+}
+
 static void
 rsvg_cairo_clip_render_image (RsvgDrawingCtx * ctx,
                               const GdkPixbuf * pixbuf,
@@ -136,7 +147,7 @@ rsvg_cairo_clip_render_new (cairo_t * cr, RsvgCairoRender *parent)
 
     cairo_render->super.free = rsvg_cairo_clip_render_free;
     cairo_render->super.create_pango_context = rsvg_cairo_create_pango_context;
-    cairo_render->super.render_pango_layout = rsvg_cairo_render_pango_layout;
+    cairo_render->super.render_pango_layout = rsvg_cairo_clip_render_pango_layout;
     cairo_render->super.render_image = rsvg_cairo_clip_render_image;
     cairo_render->super.render_path = rsvg_cairo_clip_render_path;
     cairo_render->super.pop_discrete_layer = rsvg_cairo_clip_pop_discrete_layer;
@@ -149,13 +160,119 @@ rsvg_cairo_clip_render_new (cairo_t * cr, RsvgCairoRender *parent)
     return &cairo_render->super;
 }
 
+/* whether @path is just an axis-aligned rectangle, and if so, which */
+static gboolean
+rsvg_cairo_clip_path_is_rect (const cairo_path_t * path, RsvgClipOutline * outline)
+{
+    double x[5], y[5];
+    int i, n = 0;
+    gboolean closed = FALSE;
+
+    for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+        const cairo_path_data_t *data = &path->data[i];
+
+        switch (data->header.type) {
+        case CAIRO_PATH_MOVE_TO:
+            if (n == 0) {
+                x[0] = data[1].point.x;
+                y[0] = data[1].point.y;
+                n = 1;
+                break;
+            }
+            /* cairo moves back to where a closed subpath began */
+            if (closed && data[1].point.x == x[0] && data[1].point.y == y[0])
+                break;
+            return FALSE;
+        case CAIRO_PATH_LINE_TO:
+            if (n == 0 || closed)
+                return FALSE;
+            if (data[1].point.x == x[n - 1] && data[1].point.y == y[n - 1])
+                break;
+            if (n == 5)
+                return FALSE;
+            x[n] = data[1].point.x;
+            y[n] = data[1].point.y;
+            n++;
+            break;
+        case CAIRO_PATH_CLOSE_PATH:
+            closed = TRUE;
+            break;
+        default:
+            return FALSE;
+        }
+    }
+
+    if (n == 5 && x[4] == x[0] && y[4] == y[0])
+        n = 4;
+    if (n != 4)
+        return FALSE;
+
+    if (!(x[0] == x[1] && y[1] == y[2] && x[2] == x[3] && y[3] == y[0]) &&
+        !(y[0] == y[1] && x[1] == x[2] && y[2] == y[3] && x[3] == x[0]))
+        return FALSE;
+
+    outline->x = MIN (x[0], x[2]);
+    outline->y = MIN (y[0], y[2]);
+    outline->w = fabs (x[2] - x[0]);
+    outline->h = fabs (y[2] - y[0]);
+    return TRUE;
+}
+
+static void
+rsvg_cairo_clip_apply_outline (cairo_t * cr, const RsvgClipOutline * outline)
+{
+    cairo_identity_matrix (cr);
+    if (outline->is_rect) {
+        cairo_rectangle (cr, outline->x, outline->y, outline->w, outline->h);
+    } else {
+        cairo_set_fill_rule (cr, outline->fill_rule);
+        cairo_append_path (cr, outline->path);
+    }
+    cairo_clip (cr);
+}
+
+/* Only userSpaceOnUse clips are kept, as the outline of the others
+   changes with the bounding box of every element they clip. */
 void
 rsvg_cairo_clip (RsvgDrawingCtx * ctx, RsvgClipPath * clip, RsvgBbox * bbox)
 {
     RsvgCairoRender *save = (RsvgCairoRender *) ctx->render;
+    RsvgCairoClipRender *clip_render;
     double affinesave[6];
     int i;
-    ctx->render = rsvg_cairo_clip_render_new (save->cr, save);
+    gboolean cacheable;
+    RsvgClipKey key;
+    RsvgClipOutline outline;
+
+    cacheable = clip->units == userSpaceOnUse
+        && ctx->pattern_cache != NULL && ctx->drawsub_stack == NULL;
+
+    if (cacheable) {
+        RsvgState *state = rsvg_current_state (ctx);
+        gboolean nest = save->cr != save->initial_cr;
+        const RsvgClipOutline *cached;
+
+        key.clip = (RsvgNode *) clip;
+        for (i = 0; i < 6; i++)
+            key.affine[i] = state->affine[i];
+        if (!nest) {
+            key.affine[4] += save->offset_x;
+            key.affine[5] += save->offset_y;
+        }
+        key.vb_w = ctx->vb.w;
+        key.vb_h = ctx->vb.h;
+        key.font_size = _rsvg_css_normalize_font_size (state, ctx);
+        key.clip_rule = state->clip_rule;
+
+        cached = rsvg_pattern_cache_lookup_clip (ctx->pattern_cache, &key);
+        if (cached) {
+            rsvg_cairo_clip_apply_outline (save->cr, cached);
+            return;
+        }
+    }
+
+    clip_render = (RsvgCairoClipRender *) rsvg_cairo_clip_render_new (save->cr, save);
+    ctx->render = &clip_render->super;
 
     /* Horribly dirty hack to have the bbox premultiplied to everything */
     if (clip->units == objectBoundingBox) {
@@ -179,7 +296,24 @@ rsvg_cairo_clip (RsvgDrawingCtx * ctx, RsvgClipPath * clip, RsvgBbox * bbox)
         for (i = 0; i < 6; i++)
             clip->super.state->affine[i] = affinesave[i];
 
-    g_free (ctx->render);
-    cairo_clip (save->cr);
     ctx->render = &save->super;
+    cacheable = cacheable && !clip_render->drew_text;
+    g_free (clip_render);
+
+    if (cacheable) {
+        cairo_identity_matrix (save->cr);
+        outline.path = cairo_copy_path (save->cr);
+        outline.fill_rule = cairo_get_fill_rule (save->cr);
+        if (outline.path->status == CAIRO_STATUS_SUCCESS) {
+            outline.is_rect = rsvg_cairo_clip_path_is_rect (outline.path, &outline);
+            if (outline.is_rect) {
+                cairo_path_destroy (outline.path);
+                outline.path = NULL;
+            }
+            rsvg_pattern_cache_insert_clip (ctx->pattern_cache, &key, &outline);
+        } else
+            cairo_path_destroy (outline.path);
+    }
+
+    cairo_clip (save->cr);
 }
@@ -36,14 +36,58 @@
 #include "rsvg-filter.h"
 #include "rsvg-structure.h"
 #include "rsvg-image.h"
+#include "rsvg-buffer-pool.h"
+#include "rsvg-pattern-cache.h"
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <pango/pangocairo.h>
 
 static const cairo_user_data_key_t surface_pixel_data_key;
 
+/* What a node was found to draw into, for sizing the layers pushed while
+   it is drawn. Everything drawn inside the node, in its own layer or in
+   those of its descendants, falls within its extents. */
+typedef struct {
+    RsvgNode *node;             /* NULL for a pattern, which has a space of its own */
+    gboolean bounded;           /* FALSE if a filter could draw anywhere */
+    RsvgIRect extents;          /* in canvas pixels */
+    gboolean elide;             /* its layer can be left out, see rsvg_cairo_begin_node() */
+} RsvgCairoLayerHint;
+
+typedef struct {
+    RsvgIRect extents;          /* the canvas area it covers */
+    gboolean elided;            /* drawn straight into the layer below instead */
+    guint8 opacity;             /* render->opacity to go back to when popped */
+} RsvgCairoLayer;
+
+static void
+rsvg_cairo_push_layer_hint (RsvgCairoRender * render, RsvgNode * node, gboolean bounded,
+                            RsvgIRect extents, gboolean elide)
+{
+    RsvgCairoLayerHint *hint = g_new (RsvgCairoLayerHint, 1);
+
+    hint->node = node;
+    hint->bounded = bounded;
+    hint->extents = extents;
+    hint->elide = elide;
+    render->layer_hints = g_slist_prepend (render->layer_hints, hint);
+}
+
+static void
+rsvg_cairo_pop_layer_hint (RsvgCairoRender * render)
+{
+    g_free (render->layer_hints->data);
+    render->layer_hints = g_slist_delete_link (render->layer_hints, render->layer_hints);
+
+    /* what was measured for the nodes in the outermost one is no use
+       outside it */
+    if (render->layer_hints == NULL && render->measurements != NULL)
+        g_hash_table_remove_all (render->measurements);
+}
+
 static void
 _rsvg_cairo_set_shape_antialias (cairo_t * cr, ShapeRenderingProperty aa)
 {
@@ -138,20 +182,14 @@ rsvg_pixmap_destroy (gchar * pixels, gpointer data)
 
 static void
 _pattern_add_rsvg_color_stops (cairo_pattern_t * pattern,
-                               GPtrArray * stops, guint32 current_color_rgb, guint8 opacity)
+                               const RsvgGradientStops * stops, guint8 opacity)
 {
-    gsize i;
-    RsvgGradientStop *stop;
-    RsvgNode *node;
+    guint i;
     guint32 rgba;
 
-    for (i = 0; i < stops->len; i++) {
-        node = (RsvgNode *) g_ptr_array_index (stops, i);
-        if (RSVG_NODE_TYPE (node) != RSVG_NODE_TYPE_STOP)
-            continue;
-        stop = (RsvgGradientStop *) node;
-        rgba = stop->rgba;
-        cairo_pattern_add_color_stop_rgba (pattern, stop->offset,
+    for (i = 0; i < stops->n_stops; i++) {
+        rgba = stops->stops[i].rgba;
+        cairo_pattern_add_color_stop_rgba (pattern, stops->stops[i].offset,
                                            ((rgba >> 24) & 0xff) / 255.0,
                                            ((rgba >> 16) & 0xff) / 255.0,
                                            ((rgba >> 8) & 0xff) / 255.0,
@@ -159,36 +197,19 @@ _pattern_add_rsvg_color_stops (cairo_pattern_t * pattern,
     }
 }
 
+/* Sets @pattern, made for the gradient of @key, as the source, with the
+   bounding box folded into its matrix if it needs it. Otherwise the
+   pattern does not change between uses, and is kept for the next. */
 static void
-_set_source_rsvg_linear_gradient (RsvgDrawingCtx * ctx,
-                                  RsvgLinearGradient * linear,
-                                  guint32 current_color_rgb, guint8 opacity, RsvgBbox bbox)
+_set_source_rsvg_gradient (RsvgDrawingCtx * ctx, cairo_pattern_t * pattern, RsvgGradientKey * key,
+                           const double affine[6], gboolean obj_bbox, RsvgGradientSpread spread,
+                           const RsvgGradientStops * stops, guint8 opacity, RsvgBbox bbox)
 {
     cairo_t *cr = ((RsvgCairoRender *) ctx->render)->cr;
-    cairo_pattern_t *pattern;
     cairo_matrix_t matrix;
-    RsvgLinearGradient statlinear;
-    statlinear = *linear;
-    linear = &statlinear;
-    rsvg_linear_gradient_fix_fallback (linear);
-
-    if (linear->has_current_color)
-        current_color_rgb = linear->current_color;
-
-    if (linear->obj_bbox)
-        _rsvg_push_view_box (ctx, 1., 1.);
-    pattern = cairo_pattern_create_linear (_rsvg_css_normalize_length (&linear->x1, ctx, 'h'),
-                                           _rsvg_css_normalize_length (&linear->y1, ctx, 'v'),
-                                           _rsvg_css_normalize_length (&linear->x2, ctx, 'h'),
-                                           _rsvg_css_normalize_length (&linear->y2, ctx, 'v'));
-
-    if (linear->obj_bbox)
-        _rsvg_pop_view_box (ctx);
 
-    cairo_matrix_init (&matrix,
-                       linear->affine[0], linear->affine[1],
-                       linear->affine[2], linear->affine[3], linear->affine[4], linear->affine[5]);
-    if (linear->obj_bbox) {
+    cairo_matrix_init (&matrix, affine[0], affine[1], affine[2], affine[3], affine[4], affine[5]);
+    if (obj_bbox) {
         cairo_matrix_t bboxmatrix;
         cairo_matrix_init (&bboxmatrix, bbox.w, 0, 0, bbox.h, bbox.x, bbox.y);
         cairo_matrix_multiply (&matrix, &matrix, &bboxmatrix);
@@ -196,17 +217,72 @@ _set_source_rsvg_linear_gradient (RsvgDrawingCtx * ctx,
     cairo_matrix_invert (&matrix);
     cairo_pattern_set_matrix (pattern, &matrix);
 
-    if (linear->spread == RSVG_GRADIENT_REFLECT)
+    if (spread == RSVG_GRADIENT_REFLECT)
         cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REFLECT);
-    else if (linear->spread == RSVG_GRADIENT_REPEAT)
+    else if (spread == RSVG_GRADIENT_REPEAT)
         cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
 
-    _pattern_add_rsvg_color_stops (pattern, linear->super.children, current_color_rgb, opacity);
+    _pattern_add_rsvg_color_stops (pattern, stops, opacity);
+
+    if (!obj_bbox && ctx->pattern_cache)
+        rsvg_pattern_cache_insert_gradient (ctx->pattern_cache, key, pattern);
 
     cairo_set_source (cr, pattern);
     cairo_pattern_destroy (pattern);
 }
 
+/* The cairo pattern kept for a userSpaceOnUse gradient with @key, which
+   only needs setting as the source, or NULL. */
+static cairo_pattern_t *
+_lookup_rsvg_gradient (RsvgDrawingCtx * ctx, gboolean obj_bbox, RsvgGradientKey * key)
+{
+    if (obj_bbox || ctx->pattern_cache == NULL)
+        return NULL;
+    return rsvg_pattern_cache_lookup_gradient (ctx->pattern_cache, key);
+}
+
+static void
+_set_source_rsvg_linear_gradient (RsvgDrawingCtx * ctx,
+                                  RsvgLinearGradient * linear,
+                                  guint32 current_color_rgb, guint8 opacity, RsvgBbox bbox)
+{
+    cairo_t *cr = ((RsvgCairoRender *) ctx->render)->cr;
+    cairo_pattern_t *pattern;
+    RsvgGradientKey key;
+    RsvgGradientStops *stops;
+
+    /* the fallbacks are folded in once, when the document is loaded */
+    if (linear->resolved == NULL)
+        rsvg_paint_server_resolve (&linear->super);
+
+    key.gradient = &linear->super;
+    key.opacity = opacity;
+    stops = linear->stops;
+    linear = linear->resolved;
+
+    if (linear->obj_bbox)
+        _rsvg_push_view_box (ctx, 1., 1.);
+    key.coords[0] = _rsvg_css_normalize_length (&linear->x1, ctx, 'h');
+    key.coords[1] = _rsvg_css_normalize_length (&linear->y1, ctx, 'v');
+    key.coords[2] = _rsvg_css_normalize_length (&linear->x2, ctx, 'h');
+    key.coords[3] = _rsvg_css_normalize_length (&linear->y2, ctx, 'v');
+    key.coords[4] = key.coords[5] = 0;
+    if (linear->obj_bbox)
+        _rsvg_pop_view_box (ctx);
+
+    pattern = _lookup_rsvg_gradient (ctx, linear->obj_bbox, &key);
+    if (pattern) {
+        cairo_set_source (cr, pattern);
+        cairo_pattern_destroy (pattern);
+        return;
+    }
+
+    pattern = cairo_pattern_create_linear (key.coords[0], key.coords[1],
+                                           key.coords[2], key.coords[3]);
+    _set_source_rsvg_gradient (ctx, pattern, &key, linear->affine, linear->obj_bbox, linear->spread,
+                               stops, opacity, bbox);
+}
+
 static void
 _set_source_rsvg_radial_gradient (RsvgDrawingCtx * ctx,
                                   RsvgRadialGradient * radial,
@@ -214,47 +290,40 @@ _set_source_rsvg_radial_gradient (RsvgDrawingCtx * ctx,
 {
     cairo_t *cr = ((RsvgCairoRender *) ctx->render)->cr;
     cairo_pattern_t *pattern;
-    cairo_matrix_t matrix;
-    RsvgRadialGradient statradial;
-    statradial = *radial;
-    radial = &statradial;
-    rsvg_radial_gradient_fix_fallback (radial);
+    RsvgGradientKey key;
+    RsvgGradientStops *stops;
+
+    /* the fallbacks are folded in once, when the document is loaded */
+    if (radial->resolved == NULL)
+        rsvg_paint_server_resolve (&radial->super);
 
-    if (radial->has_current_color)
-        current_color_rgb = radial->current_color;
+    key.gradient = &radial->super;
+    key.opacity = opacity;
+    stops = radial->stops;
+    radial = radial->resolved;
 
     if (radial->obj_bbox)
         _rsvg_push_view_box (ctx, 1., 1.);
-
-    pattern = cairo_pattern_create_radial (_rsvg_css_normalize_length (&radial->fx, ctx, 'h'),
-                                           _rsvg_css_normalize_length (&radial->fy, ctx, 'v'), 0.0,
-                                           _rsvg_css_normalize_length (&radial->cx, ctx, 'h'),
-                                           _rsvg_css_normalize_length (&radial->cy, ctx, 'v'),
-                                           _rsvg_css_normalize_length (&radial->r, ctx, 'o'));
+    key.coords[0] = _rsvg_css_normalize_length (&radial->fx, ctx, 'h');
+    key.coords[1] = _rsvg_css_normalize_length (&radial->fy, ctx, 'v');
+    key.coords[2] = _rsvg_css_normalize_length (&radial->cx, ctx, 'h');
+    key.coords[3] = _rsvg_css_normalize_length (&radial->cy, ctx, 'v');
+    key.coords[4] = _rsvg_css_normalize_length (&radial->r, ctx, 'o');
+    key.coords[5] = 0;
     if (radial->obj_bbox)
         _rsvg_pop_view_box (ctx);
 
-    cairo_matrix_init (&matrix,
-                       radial->affine[0], radial->affine[1],
-                       radial->affine[2], radial->affine[3], radial->affine[4], radial->affine[5]);
-    if (radial->obj_bbox) {
-        cairo_matrix_t bboxmatrix;
-        cairo_matrix_init (&bboxmatrix, bbox.w, 0, 0, bbox.h, bbox.x, bbox.y);
-        cairo_matrix_multiply (&matrix, &matrix, &bboxmatrix);
+    pattern = _lookup_rsvg_gradient (ctx, radial->obj_bbox, &key);
+    if (pattern) {
+        cairo_set_source (cr, pattern);
+        cairo_pattern_destroy (pattern);
+        return;
     }
 
-    cairo_matrix_invert (&matrix);
-    cairo_pattern_set_matrix (pattern, &matrix);
-
-    if (radial->spread == RSVG_GRADIENT_REFLECT)
-        cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REFLECT);
-    else if (radial->spread == RSVG_GRADIENT_REPEAT)
-        cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
-
-    _pattern_add_rsvg_color_stops (pattern, radial->super.children, current_color_rgb, opacity);
-
-    cairo_set_source (cr, pattern);
-    cairo_pattern_destroy (pattern);
+    pattern = cairo_pattern_create_radial (key.coords[0], key.coords[1], 0.0,
+                                           key.coords[2], key.coords[3], key.coords[4]);
+    _set_source_rsvg_gradient (ctx, pattern, &key, radial->affine, radial->obj_bbox, radial->spread,
+                               stops, opacity, bbox);
 }
 
 static void
@@ -283,18 +352,26 @@ _set_source_rsvg_pattern (RsvgDrawingCtx * ctx,
                           RsvgPattern * rsvg_pattern, guint8 opacity, RsvgBbox bbox)
 {
     RsvgCairoRender *render = (RsvgCairoRender *) ctx->render;
-    RsvgPattern local_pattern = *rsvg_pattern;
+    RsvgPattern *pattern_node = rsvg_pattern;
     cairo_t *cr_render, *cr_pattern;
     cairo_pattern_t *pattern;
     cairo_surface_t *surface;
     cairo_matrix_t matrix;
     int i;
+    guint8 render_opacity;
     double affine[6], caffine[6], bbwscale, bbhscale, scwscale, schscale;
     double taffine[6], patternw, patternh, patternx, patterny;
     int pw, ph;
-
-    rsvg_pattern = &local_pattern;
-    rsvg_pattern_fix_fallback (rsvg_pattern);
+    RsvgIRect pattern_extents = { 0, 0, 0, 0 };
+    RsvgPatternTileKey key;
+    gboolean cacheable;
+    RsvgNode *owner;
+    RsvgState *state;
+
+    /* the fallbacks are folded in once, when the document is loaded */
+    if (rsvg_pattern->resolved == NULL)
+        rsvg_paint_server_resolve (&rsvg_pattern->super);
+    rsvg_pattern = rsvg_pattern->resolved;
     cr_render = render->cr;
     _rsvg_affine_identity (affine);
     _rsvg_affine_identity (caffine);
@@ -333,10 +410,6 @@ _set_source_rsvg_pattern (RsvgDrawingCtx * ctx,
     scwscale = (double) pw / (double) (patternw * bbwscale);
     schscale = (double) ph / (double) (patternh * bbhscale);
 
-    surface = cairo_surface_create_similar (cairo_get_target (cr_render),
-                                            CAIRO_CONTENT_COLOR_ALPHA, pw, ph);
-    cr_pattern = cairo_create (surface);
-
     /* Create the pattern coordinate system */
     if (rsvg_pattern->obj_bbox) {
         /* subtract the pattern origin */
@@ -384,22 +457,65 @@ _set_source_rsvg_pattern (RsvgDrawingCtx * ctx,
         _rsvg_affine_multiply (affine, scalematrix, affine);
     }
 
-    /* Draw to another surface */
-    render->cr = cr_pattern;
-
-    /* Set up transformations to be determined by the contents units */
-    rsvg_state_push (ctx);
-    for (i = 0; i < 6; i++)
-        rsvg_current_state (ctx)->personal_affine[i] =
-            rsvg_current_state (ctx)->affine[i] = caffine[i];
-
-    /* Draw everything */
-    _rsvg_node_draw_children ((RsvgNode *) rsvg_pattern, ctx, 2);
-    /* Return to the original coordinate system */
-    rsvg_state_pop (ctx);
+    /* As the contents don't inherit from the element using the pattern,
+       the tile depends on nothing but the pattern and how it is scaled,
+       so one drawn for an earlier use, even in an earlier render, will
+       do. Vector targets get a tile of their own kind each time. */
+    cacheable = ctx->pattern_cache != NULL && ctx->drawsub_stack == NULL
+        && cairo_surface_get_type (cairo_get_target (cr_render)) == CAIRO_SURFACE_TYPE_IMAGE;
+    surface = NULL;
+    if (cacheable) {
+        key.pattern = pattern_node;
+        key.width = pw;
+        key.height = ph;
+        for (i = 0; i < 6; i++)
+            key.affine[i] = caffine[i];
+        key.vb_w = ctx->vb.w;
+        key.vb_h = ctx->vb.h;
+        key.filter_quality = ctx->filter_quality;
+        surface = rsvg_pattern_cache_lookup (ctx->pattern_cache, &key);
+    }
 
-    /* Set the render to draw where it used to */
-    render->cr = cr_render;
+    if (surface == NULL) {
+        surface = cairo_surface_create_similar (cairo_get_target (cr_render),
+                                                CAIRO_CONTENT_COLOR_ALPHA, pw, ph);
+        cr_pattern = cairo_create (surface);
+
+        /* Draw to another surface, at the opacity of the pattern alone */
+        render->cr = cr_pattern;
+        render_opacity = render->opacity;
+        render->opacity = 0xFF;
+
+        /* The contents inherit their style from where they are defined, not
+           from the element using the pattern. With xlink:href they can belong
+           to a pattern other than this one. */
+        owner = (RsvgNode *) rsvg_pattern;
+        if (owner->children->len)
+            owner = ((RsvgNode *) g_ptr_array_index (owner->children, 0))->parent;
+
+        /* Set up transformations to be determined by the contents units */
+        rsvg_state_push (ctx);
+        state = rsvg_current_state (ctx);
+        rsvg_state_reinit (state);
+        rsvg_state_reconstruct (state, owner);
+        for (i = 0; i < 6; i++)
+            state->personal_affine[i] = state->affine[i] = caffine[i];
+
+        /* Draw everything, in layers that know nothing of the canvas */
+        rsvg_cairo_push_layer_hint (render, NULL, FALSE, pattern_extents, FALSE);
+        _rsvg_node_draw_children (owner, ctx, 2);
+        rsvg_cairo_pop_layer_hint (render);
+        /* Return to the original coordinate system */
+        rsvg_state_pop (ctx);
+
+        /* Set the render to draw where it used to */
+        render->cr = cr_render;
+        render->opacity = render_opacity;
+        cairo_destroy (cr_pattern);
+
+        if (cacheable)
+            rsvg_pattern_cache_insert (ctx->pattern_cache, &key, surface);
+    }
 
     pattern = cairo_pattern_create_for_surface (surface);
     cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
@@ -414,7 +530,6 @@ _set_source_rsvg_pattern (RsvgDrawingCtx * ctx,
     cairo_set_source (cr_render, pattern);
 
     cairo_pattern_destroy (pattern);
-    cairo_destroy (cr_pattern);
     cairo_surface_destroy (surface);
     if (rsvg_pattern->obj_cbbox || rsvg_pattern->vbox.active)
         _rsvg_pop_view_box (ctx);
@@ -526,14 +641,39 @@ rsvg_cairo_render_pango_layout (RsvgDrawingCtx * ctx, PangoLayout * layout, doub
     }
 }
 
+static void
+rsvg_cairo_append_path (cairo_t * cr, const RsvgBpathDef * bpath_def)
+{
+    RsvgBpathIter iter;
+    RsvgBpath bpath;
+
+    rsvg_bpath_iter_init (&iter, bpath_def);
+    while (rsvg_bpath_iter_next (&iter, &bpath)) {
+        switch (bpath.code) {
+        case RSVG_MOVETO:
+            cairo_close_path (cr);
+            /* fall-through */
+        case RSVG_MOVETO_OPEN:
+            cairo_move_to (cr, bpath.x3, bpath.y3);
+            break;
+        case RSVG_CURVETO:
+            cairo_curve_to (cr, bpath.x1, bpath.y1, bpath.x2, bpath.y2, bpath.x3, bpath.y3);
+            break;
+        case RSVG_LINETO:
+            cairo_line_to (cr, bpath.x3, bpath.y3);
+            break;
+        case RSVG_END:
+            break;
+        }
+    }
+}
+
 void
 rsvg_cairo_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def)
 {
     RsvgCairoRender *render = (RsvgCairoRender *) ctx->render;
     RsvgState *state = rsvg_current_state (ctx);
     cairo_t *cr;
-    RsvgBpath *bpath;
-    int i;
     int need_tmpbuf = 0;
     RsvgBbox bbox;
     double backup_tolerance;
@@ -561,26 +701,7 @@ rsvg_cairo_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def)
     cairo_set_dash (cr, state->dash.dash, state->dash.n_dash,
                     _rsvg_css_normalize_length (&state->dash.offset, ctx, 'o'));
 
-    for (i = 0; i < bpath_def->n_bpath; i++) {
-        bpath = &bpath_def->bpath[i];
-
-        switch (bpath->code) {
-        case RSVG_MOVETO:
-            cairo_close_path (cr);
-            /* fall-through */
-        case RSVG_MOVETO_OPEN:
-            cairo_move_to (cr, bpath->x3, bpath->y3);
-            break;
-        case RSVG_CURVETO:
-            cairo_curve_to (cr, bpath->x1, bpath->y1, bpath->x2, bpath->y2, bpath->x3, bpath->y3);
-            break;
-        case RSVG_LINETO:
-            cairo_line_to (cr, bpath->x3, bpath->y3);
-            break;
-        case RSVG_END:
-            break;
-        }
-    }
+    rsvg_cairo_append_path (cr, bpath_def);
 
     rsvg_bbox_init (&bbox, state->affine);
 
@@ -621,7 +742,7 @@ rsvg_cairo_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def)
             cairo_set_fill_rule (cr, CAIRO_FILL_RULE_WINDING);
 
         if (!need_tmpbuf)
-            opacity = (state->fill_opacity * state->opacity) / 255;
+            opacity = (state->fill_opacity * state->opacity) / 255 * render->opacity / 255;
         else
             opacity = state->fill_opacity;
 
@@ -639,7 +760,7 @@ rsvg_cairo_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def)
     if (state->stroke != NULL) {
         int opacity;
         if (!need_tmpbuf)
-            opacity = (state->stroke_opacity * state->opacity) / 255;
+            opacity = (state->stroke_opacity * state->opacity) / 255 * render->opacity / 255;
         else
             opacity = state->stroke_opacity;
 
@@ -772,29 +893,34 @@ rsvg_cairo_render_image (RsvgDrawingCtx * ctx, const GdkPixbuf * pixbuf,
     }
 #endif
 
-    cairo_paint (render->cr);
+    if (render->opacity != 0xFF)
+        cairo_paint_with_alpha (render->cr, render->opacity / 255.0);
+    else
+        cairo_paint (render->cr);
     cairo_surface_destroy (surface);
 
     rsvg_bbox_insert (&render->bbox, &bbox);
 }
 
 static void
-rsvg_cairo_generate_mask (cairo_t * cr, RsvgMask * self, RsvgDrawingCtx * ctx, RsvgBbox * bbox)
+rsvg_cairo_generate_mask (cairo_t * cr, RsvgMask * self, RsvgDrawingCtx * ctx, RsvgBbox * bbox,
+                          RsvgIRect * extents)
 {
     cairo_surface_t *surface;
     cairo_t *mask_cr, *save_cr;
     RsvgCairoRender *render = (RsvgCairoRender *) ctx->render;
     RsvgState *state = rsvg_current_state (ctx);
     guint8 *pixels;
-    guint32 width = render->width, height = render->height;
+    guint32 width = extents->x1 - extents->x0, height = extents->y1 - extents->y0;
     guint32 rowstride = width * 4, row, i;
     double affinesave[6];
     double sx, sy, sw, sh;
     gboolean nest = cr != render->initial_cr;
 
-    pixels = g_try_malloc0 (height * rowstride);
+    pixels = rsvg_buffer_pool_alloc (ctx->buffer_pool, (gsize) height * rowstride);
     if (pixels == NULL)
           return;
+    memset (pixels, 0, (gsize) height * rowstride);
 
     if (self->maskunits == objectBoundingBox)
         _rsvg_push_view_box (ctx, 1, 1);
@@ -809,7 +935,9 @@ rsvg_cairo_generate_mask (cairo_t * cr, RsvgMask * self, RsvgDrawingCtx * ctx, R
 
     surface = cairo_image_surface_create_for_data (pixels,
                                                    CAIRO_FORMAT_ARGB32, width, height, rowstride);
-    cairo_surface_set_user_data (surface, &surface_pixel_data_key, pixels, (cairo_destroy_func_t) g_free);
+    cairo_surface_set_user_data (surface, &surface_pixel_data_key, pixels, rsvg_buffer_pool_free);
+    /* it only has to cover the layer it masks */
+    cairo_surface_set_device_offset (surface, -extents->x0, -extents->y0);
 
     mask_cr = cairo_create (surface);
     save_cr = render->cr;
@@ -878,6 +1006,568 @@ rsvg_cairo_push_early_clips (RsvgDrawingCtx * ctx)
 
 }
 
+/* whether drawing in @state needs a layer of its own */
+static gboolean
+rsvg_cairo_state_needs_layer (RsvgState * state)
+{
+    gboolean lateclip = FALSE;
+
+    if (state->clip_path_ref)
+        if (((RsvgClipPath *) state->clip_path_ref)->units == objectBoundingBox)
+            lateclip = TRUE;
+
+    return state->opacity != 0xFF
+        || state->filter || state->mask || lateclip || (state->comp_op != RSVG_COMP_OP_SRC_OVER)
+        || (state->enable_background != RSVG_ENABLE_BACKGROUND_ACCUMULATE);
+}
+
+/* whether the layer for @state would only be there to lower the opacity
+   of what is drawn in it */
+static gboolean
+rsvg_cairo_state_needs_layer_for_opacity (RsvgState * state)
+{
+    if (state->clip_path_ref)
+        if (((RsvgClipPath *) state->clip_path_ref)->units == objectBoundingBox)
+            return FALSE;
+
+    return state->opacity != 0xFF
+        && !state->filter && !state->mask && (state->comp_op == RSVG_COMP_OP_SRC_OVER)
+        && (state->enable_background == RSVG_ENABLE_BACKGROUND_ACCUMULATE);
+}
+
+/* What measuring a node found, kept for a node nested in the one being
+   measured, for when rsvg_cairo_begin_node() comes to it. The node can
+   be drawn more than once, so it is told apart by what it is drawn from
+   and where. */
+typedef struct {
+    RsvgNode *caller;           /* the node before it in ctx->ptrs */
+    int dominate;
+    double affine[6];           /* the one it is drawn with */
+    gboolean valid;             /* FALSE if it was met twice and measured differently */
+    gboolean bounded;
+    RsvgIRect extents;
+    gboolean disjoint;
+} RsvgCairoMeasurement;
+
+/* A renderer that draws nothing and just gathers the extents of what
+   would have been drawn. It starts like RsvgCairoRender, so that the
+   pango helpers can find its cairo_t. */
+typedef struct {
+    RsvgRender super;
+    cairo_t *cr;                /* only ever given paths to measure */
+    RsvgBbox bbox;              /* in canvas pixels */
+    gboolean unbounded;
+
+    /* what rsvg_cairo_begin_node() needs to know to leave a layer out */
+    GArray *marks;              /* the extents of each fill, stroke and image */
+    gboolean overlaps;          /* something needs a layer, or may overlap itself */
+    gint depth;                 /* layers pushed and not yet popped */
+
+    /* The above are for the innermost node being measured. Those for the
+       nodes around it are kept in frames, and what is found for it is
+       added to them when it ends. */
+    GSList *frames;
+    gint base;                  /* the depth it began at */
+    gboolean base_layer;        /* a layer it pushed at that depth needs to be one */
+    guint first_mark;           /* the first of the marks that are its own */
+    GHashTable *measurements;   /* where what was found for each is kept */
+} RsvgCairoMeasureRender;
+
+/* the measuring of the node around a nested one, to go back to */
+typedef struct {
+    RsvgNode *node;             /* the nested one */
+    RsvgCairoMeasurement *measurement;
+    RsvgBbox bbox;
+    gboolean unbounded;
+    gboolean overlaps;
+    gint base;
+    gboolean base_layer;
+    guint first_mark;
+} RsvgCairoMeasureFrame;
+
+static void
+rsvg_cairo_measure_round (RsvgBbox * bbox, RsvgIRect * rect)
+{
+    /* with a pixel to spare for antialiasing */
+    rect->x0 = floor (bbox->x) - 1;
+    rect->y0 = floor (bbox->y) - 1;
+    rect->x1 = ceil (bbox->x + bbox->w) + 1;
+    rect->y1 = ceil (bbox->y + bbox->h) + 1;
+}
+
+static void
+rsvg_cairo_measure_add (RsvgCairoMeasureRender * render, RsvgBbox * bbox)
+{
+    RsvgBbox canvas;
+    RsvgIRect mark;
+
+    rsvg_bbox_insert (&render->bbox, bbox);
+
+    rsvg_bbox_init (&canvas, render->bbox.affine);
+    rsvg_bbox_insert (&canvas, bbox);
+    rsvg_cairo_measure_round (&canvas, &mark);
+    g_array_append_val (render->marks, mark);
+}
+
+static int
+rsvg_cairo_compare_marks (const void *a, const void *b)
+{
+    return ((const RsvgIRect *) a)->x0 - ((const RsvgIRect *) b)->x0;
+}
+
+/* whether any two of @marks from @first on touch a pixel in common */
+static gboolean
+rsvg_cairo_marks_overlap (GArray * marks, guint first)
+{
+    RsvgIRect *own = &g_array_index (marks, RsvgIRect, first);
+    guint n = marks->len - first;
+    guint i, j;
+
+    if (n < 2)
+        return FALSE;
+
+    /* those of the nodes around only care which marks there are, not
+       in what order */
+    qsort (own, n, sizeof (RsvgIRect), rsvg_cairo_compare_marks);
+
+    for (i = 0; i < n; i++) {
+        RsvgIRect *a = &own[i];
+
+        for (j = i + 1; j < n; j++) {
+            RsvgIRect *b = &own[j];
+
+            if (b->x0 >= a->x1)
+                break;
+            if (b->y0 < a->y1 && a->y0 < b->y1)
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Whether @node pushes a layer of its own that is worth sizing. A
+   filtered one needs the whole canvas for it anyway. */
+static gboolean
+rsvg_cairo_node_wants_hint (RsvgNode * node)
+{
+    RsvgState *state = node->state;
+
+    if (state->filter)
+        return FALSE;
+    return rsvg_cairo_state_needs_layer (state) || state->clip_path_ref;
+}
+
+/* A group made translucent by a layer of its own can instead have each
+   thing in it drawn at the lower opacity, if none of them overlap and
+   none needs a layer itself: a group of one fill, most often. Shapes
+   already fold their opacity in when they can. */
+static gboolean
+rsvg_cairo_node_could_elide (RsvgNode * node)
+{
+    switch (RSVG_NODE_TYPE (node)) {
+    case RSVG_NODE_TYPE_GROUP:
+    case RSVG_NODE_TYPE_SWITCH:
+    case RSVG_NODE_TYPE_USE:
+    case RSVG_NODE_TYPE_IMAGE:
+        return rsvg_cairo_state_needs_layer_for_opacity (node->state);
+    default:
+        return FALSE;
+    }
+}
+
+/* the node that the one being drawn is drawn from */
+static RsvgNode *
+rsvg_cairo_node_caller (RsvgDrawingCtx * ctx)
+{
+    RsvgNode *caller = NULL;
+    GSList *l;
+
+    for (l = ctx->ptrs; l && l->next; l = l->next)
+        caller = l->data;
+    return caller;
+}
+
+static void
+rsvg_cairo_free_measurements (gpointer data)
+{
+    GSList *list = data;
+
+    g_slist_foreach (list, (GFunc) g_free, NULL);
+    g_slist_free (list);
+}
+
+/* the one kept for @node drawn as it is about to be, if any */
+static RsvgCairoMeasurement *
+rsvg_cairo_find_measurement (GHashTable * measurements, RsvgNode * node, RsvgNode * caller,
+                             int dominate, double affine[6])
+{
+    GSList *l;
+    int i;
+
+    if (measurements == NULL)
+        return NULL;
+
+    for (l = g_hash_table_lookup (measurements, node); l; l = l->next) {
+        RsvgCairoMeasurement *m = l->data;
+
+        if (m->caller != caller || m->dominate != dominate)
+            continue;
+        for (i = 0; i < 6; i++)
+            if (m->affine[i] != affine[i])
+                break;
+        if (i == 6)
+            return m;
+    }
+    return NULL;
+}
+
+static void
+rsvg_cairo_keep_measurement (GHashTable * measurements, RsvgNode * node,
+                             RsvgCairoMeasurement * m)
+{
+    RsvgCairoMeasurement *old;
+    GSList *list;
+
+    old = rsvg_cairo_find_measurement (measurements, node, m->caller, m->dominate, m->affine);
+    if (old != NULL) {
+        /* drawn the same way, but inheriting something else */
+        if (old->bounded != m->bounded || old->disjoint != m->disjoint
+            || old->extents.x0 != m->extents.x0 || old->extents.y0 != m->extents.y0
+            || old->extents.x1 != m->extents.x1 || old->extents.y1 != m->extents.y1)
+            old->valid = FALSE;
+        g_free (m);
+        return;
+    }
+
+    m->valid = TRUE;
+    list = g_hash_table_lookup (measurements, node);
+    if (list == NULL)
+        g_hash_table_insert (measurements, node, g_slist_prepend (NULL, m));
+    else
+        g_slist_insert (list, m, 1);
+}
+
+static void
+rsvg_cairo_measure_render_pango_layout (RsvgDrawingCtx * ctx, PangoLayout * layout,
+                                        double x, double y)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+    RsvgState *state = rsvg_current_state (ctx);
+    PangoRectangle ink;
+    RsvgBbox bbox;
+    double margin = 0;
+
+    if (state->fill == NULL && state->stroke == NULL)
+        return;
+    if (state->stroke != NULL)
+        margin = _rsvg_css_normalize_length (&state->stroke_width, ctx, 'h') / 2 * state->miter_limit;
+
+    pango_layout_get_extents (layout, &ink, NULL);
+
+    rsvg_bbox_init (&bbox, state->affine);
+    bbox.x = x + ink.x / (double) PANGO_SCALE - margin;
+    bbox.y = y + ink.y / (double) PANGO_SCALE - margin;
+    bbox.w = ink.width / (double) PANGO_SCALE + 2 * margin;
+    bbox.h = ink.height / (double) PANGO_SCALE + 2 * margin;
+    bbox.virgin = 0;
+    rsvg_bbox_insert (&render->bbox, &bbox);
+
+    /* the glyphs are drawn one by one, and can overlap */
+    render->overlaps = TRUE;
+}
+
+static void
+rsvg_cairo_measure_render_path (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+    RsvgState *state = rsvg_current_state (ctx);
+    cairo_t *cr = render->cr;
+    cairo_matrix_t matrix;
+    RsvgBbox bbox;
+
+    if (state->fill == NULL && state->stroke == NULL)
+        return;
+
+    /* when rsvg_cairo_render_path() would push a layer */
+    if ((state->fill != NULL && state->stroke != NULL && state->opacity != 0xff)
+        || state->clip_path_ref || state->mask || state->filter
+        || (state->comp_op != RSVG_COMP_OP_SRC_OVER))
+        render->overlaps = TRUE;
+    /* patterns are painted without the opacity a left out layer hands
+       down, so the layer has to stay */
+    if ((state->fill != NULL && state->fill->type == RSVG_PAINT_SERVER_PATTERN)
+        || (state->stroke != NULL && state->stroke->type == RSVG_PAINT_SERVER_PATTERN))
+        render->overlaps = TRUE;
+    /* shapes push their own filter layer rather than a discrete one, and
+       the filter can draw anywhere in its region */
+    if (state->filter)
+        render->unbounded = TRUE;
+
+    cairo_matrix_init (&matrix, state->affine[0], state->affine[1], state->affine[2],
+                       state->affine[3], state->affine[4], state->affine[5]);
+    cairo_set_matrix (cr, &matrix);
+    cairo_set_line_width (cr, _rsvg_css_normalize_length (&state->stroke_width, ctx, 'h'));
+    cairo_set_miter_limit (cr, state->miter_limit);
+    cairo_set_line_cap (cr, (cairo_line_cap_t) state->cap);
+    cairo_set_line_join (cr, (cairo_line_join_t) state->join);
+
+    rsvg_cairo_append_path (cr, bpath_def);
+
+    /* as rsvg_cairo_render_path() works out its bounding box, without
+       the dashes, which only ever take away */
+    rsvg_bbox_init (&bbox, state->affine);
+    bbox.virgin = 0;
+    if (state->fill != NULL) {
+        cairo_fill_extents (cr, &bbox.x, &bbox.y, &bbox.w, &bbox.h);
+        bbox.w -= bbox.x;
+        bbox.h -= bbox.y;
+        rsvg_cairo_measure_add (render, &bbox);
+    }
+    if (state->stroke != NULL) {
+        cairo_stroke_extents (cr, &bbox.x, &bbox.y, &bbox.w, &bbox.h);
+        bbox.w -= bbox.x;
+        bbox.h -= bbox.y;
+        rsvg_cairo_measure_add (render, &bbox);
+    }
+
+    cairo_new_path (cr);
+}
+
+static void
+rsvg_cairo_measure_render_image (RsvgDrawingCtx * ctx, const GdkPixbuf * pixbuf,
+                                 double x, double y, double w, double h)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+    RsvgBbox bbox;
+
+    rsvg_bbox_init (&bbox, rsvg_current_state (ctx)->affine);
+    bbox.x = x;
+    bbox.y = y;
+    bbox.w = w;
+    bbox.h = h;
+    bbox.virgin = 0;
+    rsvg_cairo_measure_add (render, &bbox);
+}
+
+static void
+rsvg_cairo_measure_push_discrete_layer (RsvgDrawingCtx * ctx)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+    RsvgState *state = rsvg_current_state (ctx);
+
+    if (state->filter)
+        render->unbounded = TRUE;
+
+    /* the first is the measured node's own */
+    if (rsvg_cairo_state_needs_layer (state)) {
+        if (render->depth > render->base)
+            render->overlaps = TRUE;
+        else
+            render->base_layer = TRUE;
+    }
+    render->depth++;
+}
+
+static void
+rsvg_cairo_measure_pop_discrete_layer (RsvgDrawingCtx * ctx)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+
+    render->depth--;
+}
+
+static void
+rsvg_cairo_measure_add_clipping_rect (RsvgDrawingCtx * ctx, double x, double y, double w, double h)
+{
+}
+
+static void
+rsvg_cairo_measure_result (RsvgCairoMeasureRender * render, gboolean * bounded,
+                           RsvgIRect * extents)
+{
+    *bounded = !render->unbounded;
+    if (render->bbox.virgin)
+        extents->x0 = extents->y0 = extents->x1 = extents->y1 = 0;
+    else
+        rsvg_cairo_measure_round (&render->bbox, extents);
+}
+
+/* Nested nodes that rsvg_cairo_begin_node() would measure are measured
+   on the way, bottom up, and what is found is kept for when it comes
+   to them. */
+static void
+rsvg_cairo_measure_begin_node (RsvgDrawingCtx * ctx, RsvgNode * node, int dominate)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+    RsvgCairoMeasureFrame *frame;
+    RsvgCairoMeasurement *m;
+    int i;
+
+    if (!rsvg_cairo_node_wants_hint (node))
+        return;
+
+    m = g_new0 (RsvgCairoMeasurement, 1);
+    m->caller = rsvg_cairo_node_caller (ctx);
+    m->dominate = dominate;
+    for (i = 0; i < 6; i++)
+        m->affine[i] = rsvg_current_state (ctx)->affine[i];
+
+    frame = g_new (RsvgCairoMeasureFrame, 1);
+    frame->node = node;
+    frame->measurement = m;
+    frame->bbox = render->bbox;
+    frame->unbounded = render->unbounded;
+    frame->overlaps = render->overlaps;
+    frame->base = render->base;
+    frame->base_layer = render->base_layer;
+    frame->first_mark = render->first_mark;
+    render->frames = g_slist_prepend (render->frames, frame);
+
+    rsvg_bbox_init (&render->bbox, frame->bbox.affine);
+    render->unbounded = FALSE;
+    render->overlaps = FALSE;
+    render->base = render->depth;
+    render->base_layer = FALSE;
+    render->first_mark = render->marks->len;
+}
+
+static void
+rsvg_cairo_measure_end_node (RsvgDrawingCtx * ctx, RsvgNode * node)
+{
+    RsvgCairoMeasureRender *render = (RsvgCairoMeasureRender *) ctx->render;
+    RsvgCairoMeasureFrame *frame;
+    RsvgCairoMeasurement *m;
+    RsvgBbox bbox;
+
+    if (render->frames == NULL
+        || ((RsvgCairoMeasureFrame *) render->frames->data)->node != node)
+        return;
+    frame = render->frames->data;
+    render->frames = g_slist_delete_link (render->frames, render->frames);
+
+    m = frame->measurement;
+    rsvg_cairo_measure_result (render, &m->bounded, &m->extents);
+    m->disjoint = rsvg_cairo_node_could_elide (node)
+        && !render->unbounded && !render->overlaps
+        && !rsvg_cairo_marks_overlap (render->marks, render->first_mark);
+    rsvg_cairo_keep_measurement (render->measurements, node, m);
+
+    /* all it found is in the node around it too, and a layer it pushed
+       for itself is one pushed inside that node's own */
+    bbox = render->bbox;
+    render->bbox = frame->bbox;
+    rsvg_bbox_insert (&render->bbox, &bbox);
+    render->unbounded = render->unbounded || frame->unbounded;
+    if (render->base_layer) {
+        if (render->base > frame->base)
+            render->overlaps = TRUE;
+        else
+            frame->base_layer = TRUE;
+    }
+    render->overlaps = render->overlaps || frame->overlaps;
+    render->base = frame->base;
+    render->base_layer = frame->base_layer;
+    render->first_mark = frame->first_mark;
+    g_free (frame);
+}
+
+/* Draws @node as rsvg_node_draw() is about to, with nothing but the
+   measuring renderer, and returns whether it found bounds for it. If
+   @disjoint is given, it is set to whether what is drawn could go
+   straight into the layer below without anything in it overlapping. */
+static gboolean
+rsvg_cairo_measure_node (RsvgDrawingCtx * ctx, RsvgNode * node, int dominate, RsvgIRect * extents,
+                         gboolean * disjoint)
+{
+    RsvgCairoRender *owner = (RsvgCairoRender *) ctx->render;
+    RsvgCairoMeasureRender measure;
+    RsvgRender *save = ctx->render;
+    GSList *drawsub_stack = ctx->drawsub_stack;
+    cairo_surface_t *surface;
+    double identity[6];
+    gboolean bounded;
+
+    if (owner->measurements == NULL)
+        owner->measurements = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                                     rsvg_cairo_free_measurements);
+
+    memset (&measure, 0, sizeof (measure));
+    measure.super.create_pango_context = rsvg_cairo_create_pango_context;
+    measure.super.render_pango_layout = rsvg_cairo_measure_render_pango_layout;
+    measure.super.render_path = rsvg_cairo_measure_render_path;
+    measure.super.render_image = rsvg_cairo_measure_render_image;
+    measure.super.pop_discrete_layer = rsvg_cairo_measure_pop_discrete_layer;
+    measure.super.push_discrete_layer = rsvg_cairo_measure_push_discrete_layer;
+    measure.super.add_clipping_rect = rsvg_cairo_measure_add_clipping_rect;
+    measure.super.get_image_of_node = NULL;
+    measure.super.begin_node = rsvg_cairo_measure_begin_node;
+    measure.super.end_node = rsvg_cairo_measure_end_node;
+    measure.measurements = owner->measurements;
+
+    surface = cairo_image_surface_create (CAIRO_FORMAT_A8, 1, 1);
+    measure.cr = cairo_create (surface);
+    cairo_surface_destroy (surface);
+    cairo_set_tolerance (measure.cr, 1.0);
+
+    _rsvg_affine_identity (identity);
+    rsvg_bbox_init (&measure.bbox, identity);
+    measure.marks = g_array_new (FALSE, FALSE, sizeof (RsvgIRect));
+
+    ctx->render = &measure.super;
+    rsvg_state_push (ctx);
+    node->draw (node, ctx, dominate);
+    rsvg_state_pop (ctx);
+    ctx->render = save;
+    ctx->drawsub_stack = drawsub_stack;
+
+    cairo_destroy (measure.cr);
+
+    if (disjoint)
+        *disjoint = !measure.unbounded && !measure.overlaps
+            && !rsvg_cairo_marks_overlap (measure.marks, 0);
+    g_array_free (measure.marks, TRUE);
+
+    rsvg_cairo_measure_result (&measure, &bounded, extents);
+    return bounded;
+}
+
+void
+rsvg_cairo_begin_node (RsvgDrawingCtx * ctx, RsvgNode * node, int dominate)
+{
+    RsvgCairoRender *render = (RsvgCairoRender *) ctx->render;
+    RsvgCairoMeasurement *m;
+    RsvgIRect extents;
+    gboolean bounded, could_elide, elide = FALSE;
+
+    /* only nodes that push a layer of their own are worth measuring */
+    if (!rsvg_cairo_node_wants_hint (node))
+        return;
+    could_elide = rsvg_cairo_node_could_elide (node);
+
+    /* one nested in a node measured already was measured with it */
+    m = rsvg_cairo_find_measurement (render->measurements, node, rsvg_cairo_node_caller (ctx),
+                                     dominate, rsvg_current_state (ctx)->affine);
+    if (m != NULL && m->valid) {
+        rsvg_cairo_push_layer_hint (render, node, m->bounded, m->extents,
+                                    could_elide && m->disjoint);
+        return;
+    }
+
+    bounded = rsvg_cairo_measure_node (ctx, node, dominate, &extents,
+                                       could_elide ? &elide : NULL);
+    rsvg_cairo_push_layer_hint (render, node, bounded, extents, elide);
+}
+
+void
+rsvg_cairo_end_node (RsvgDrawingCtx * ctx, RsvgNode * node)
+{
+    RsvgCairoRender *render = (RsvgCairoRender *) ctx->render;
+
+    if (render->layer_hints
+        && ((RsvgCairoLayerHint *) render->layer_hints->data)->node == node)
+        rsvg_cairo_pop_layer_hint (render);
+}
+
 static void
 rsvg_cairo_push_render_stack (RsvgDrawingCtx * ctx)
 {
@@ -888,54 +1578,82 @@ rsvg_cairo_push_render_stack (RsvgDrawingCtx * ctx)
     cairo_t *child_cr;
     RsvgBbox *bbox;
     RsvgState *state = rsvg_current_state (ctx);
-    gboolean lateclip = FALSE;
+    RsvgCairoLayerHint *hint = render->layer_hints ? render->layer_hints->data : NULL;
+    RsvgCairoLayer *layer;
+    RsvgIRect *extents;
 
-    if (rsvg_current_state (ctx)->clip_path_ref)
-        if (((RsvgClipPath *) rsvg_current_state (ctx)->clip_path_ref)->units == objectBoundingBox)
-            lateclip = TRUE;
+    if (!rsvg_cairo_state_needs_layer (state))
+        return;
 
-    if (state->opacity == 0xFF
-        && !state->filter && !state->mask && !lateclip && (state->comp_op == RSVG_COMP_OP_SRC_OVER)
-        && (state->enable_background == RSVG_ENABLE_BACKGROUND_ACCUMULATE))
+    layer = g_new (RsvgCairoLayer, 1);
+    layer->elided = FALSE;
+    layer->opacity = render->opacity;
+    extents = &layer->extents;
+    extents->x0 = extents->y0 = 0;
+    extents->x1 = render->width;
+    extents->y1 = render->height;
+
+    if (hint && hint->elide && hint->node == g_slist_last (ctx->ptrs)->data
+        && rsvg_cairo_state_needs_layer_for_opacity (state)) {
+        /* nothing in it overlaps, so what would be drawn into it is drawn
+           straight into the layer below, at the opacity it would have
+           been painted with */
+        layer->elided = TRUE;
+        render->opacity = render->opacity * state->opacity / 255;
+        render->layer_stack = g_list_prepend (render->layer_stack, layer);
+
+        bbox = g_new (RsvgBbox, 1);
+        *bbox = render->bbox;
+        render->bb_stack = g_list_prepend (render->bb_stack, bbox);
+        rsvg_bbox_init (&render->bbox, state->affine);
         return;
-    if (!state->filter)
+    }
+
+    if (!state->filter) {
+        /* Only as big as what will be drawn in it, with a device offset
+           so that it is drawn to and painted from in canvas coordinates.
+           A filter's layer has to cover the whole canvas, as the filter
+           can draw anywhere in its region. */
+        if (hint && hint->bounded) {
+            extents->x0 = CLAMP (hint->extents.x0, 0, extents->x1);
+            extents->y0 = CLAMP (hint->extents.y0, 0, extents->y1);
+            extents->x1 = CLAMP (hint->extents.x1, extents->x0, extents->x1);
+            extents->y1 = CLAMP (hint->extents.y1, extents->y0, extents->y1);
+            /* nothing to draw still needs somewhere to draw it */
+            extents->x1 = MAX (extents->x1, extents->x0 + 1);
+            extents->y1 = MAX (extents->y1, extents->y0 + 1);
+        }
+
         surface = cairo_surface_create_similar (cairo_get_target (render->cr),
                                                 CAIRO_CONTENT_COLOR_ALPHA,
-                                                render->width, render->height);
-    else {
+                                                extents->x1 - extents->x0,
+                                                extents->y1 - extents->y0);
+        cairo_surface_set_device_offset (surface, -extents->x0, -extents->y0);
+    } else {
         guchar *pixels;
         int rowstride = render->width * 4;
-        GdkPixbuf *pixbuf;
 
-        pixels = g_try_malloc0 (render->width * render->height * 4);
-        if (pixels == NULL)
+        /* the filter reads this surface's pixels directly */
+        pixels = rsvg_buffer_pool_alloc (ctx->buffer_pool, (gsize) render->height * rowstride);
+        if (pixels == NULL) {
+            g_free (layer);
             return; /* not really correct, but the best we can do here */
-
-        /* The pixbuf takes ownership of @pixels */
-        pixbuf = gdk_pixbuf_new_from_data (pixels,
-                                           GDK_COLORSPACE_RGB,
-                                           TRUE,
-                                           8,
-                                           render->width,
-                                           render->height,
-                                           rowstride,
-                                           (GdkPixbufDestroyNotify) rsvg_pixmap_destroy,
-                                           NULL);
-        render->pixbuf_stack = g_list_prepend (render->pixbuf_stack, pixbuf);
+        }
+        memset (pixels, 0, (gsize) render->height * rowstride);
 
         surface = cairo_image_surface_create_for_data (pixels,
                                                        CAIRO_FORMAT_ARGB32,
                                                        render->width, render->height, rowstride);
-        /* Also keep a reference to the pixbuf which owns the pixels */
+        /* The surface gives its pixels back to the pool */
         cairo_surface_set_user_data (surface, &surface_pixel_data_key,
-                                     g_object_ref (pixbuf),
-                                     (cairo_destroy_func_t) g_object_unref);
+                                     pixels, rsvg_buffer_pool_free);
     }
     child_cr = cairo_create (surface);
     cairo_surface_destroy (surface);
 
     render->cr_stack = g_list_prepend (render->cr_stack, render->cr);
     render->cr = child_cr;
+    render->layer_stack = g_list_prepend (render->layer_stack, layer);
 
     bbox = g_new (RsvgBbox, 1);
     *bbox = render->bbox;
@@ -959,46 +1677,55 @@ rsvg_cairo_pop_render_stack (RsvgDrawingCtx * ctx)
     cairo_surface_t *surface = NULL;
     RsvgState *state = rsvg_current_state (ctx);
     gboolean nest;
+    RsvgIRect roi = { 0, 0, 0, 0 };
+    RsvgCairoLayer *layer;
 
     if (rsvg_current_state (ctx)->clip_path_ref)
         if (((RsvgClipPath *) rsvg_current_state (ctx)->clip_path_ref)->units == objectBoundingBox)
             lateclip = TRUE;
 
-    if (state->opacity == 0xFF
-        && !state->filter && !state->mask && !lateclip && (state->comp_op == RSVG_COMP_OP_SRC_OVER)
-        && (state->enable_background == RSVG_ENABLE_BACKGROUND_ACCUMULATE))
+    if (!rsvg_cairo_state_needs_layer (state))
         return;
 
-    if (state->filter) {
-        GdkPixbuf *pixbuf = render->pixbuf_stack->data;
-        GdkPixbuf *output;
-
-        render->pixbuf_stack = g_list_remove (render->pixbuf_stack, pixbuf);
+    layer = render->layer_stack->data;
+    render->layer_stack = g_list_delete_link (render->layer_stack, render->layer_stack);
 
+    if (layer->elided) {
+        render->opacity = layer->opacity;
 
-        output = rsvg_filter_render (state->filter, pixbuf, ctx, &render->bbox, "2103");
-        g_object_unref (pixbuf);
+        rsvg_bbox_insert ((RsvgBbox *) render->bb_stack->data, &render->bbox);
+        render->bbox = *((RsvgBbox *) render->bb_stack->data);
+        g_free (render->bb_stack->data);
+        render->bb_stack = g_list_delete_link (render->bb_stack, render->bb_stack);
 
-        surface = cairo_image_surface_create_for_data (gdk_pixbuf_get_pixels (output),
-                                                       CAIRO_FORMAT_ARGB32,
-                                                       gdk_pixbuf_get_width (output),
-                                                       gdk_pixbuf_get_height (output),
-                                                       gdk_pixbuf_get_rowstride (output));
-        cairo_surface_set_user_data (surface, &surface_pixel_data_key,
-                                     output,
-                                     (cairo_destroy_func_t) g_object_unref);
+        g_free (layer);
+        return;
+    }
 
-    } else
+    /* a filter region that misses the canvas leaves nothing to paint */
+    if (state->filter)
+        surface = rsvg_filter_render (state->filter, cairo_get_target (child_cr),
+                                      ctx, &render->bbox, &roi);
+    else
         surface = cairo_get_target (child_cr);
 
     render->cr = (cairo_t *) render->cr_stack->data;
     render->cr_stack = g_list_delete_link (render->cr_stack, render->cr_stack);
 
+    /* the layer this one is painted into may be part of the cached background */
+    if (render->bg_below && g_list_length (render->cr_stack) < render->bg_below_depth) {
+        cairo_surface_destroy (render->bg_below);
+        render->bg_below = NULL;
+    }
+
     nest = render->cr != render->initial_cr;
     cairo_identity_matrix (render->cr);
-    cairo_set_source_surface (render->cr, surface,
-                              nest ? 0 : render->offset_x,
-                              nest ? 0 : render->offset_y);
+    if (surface)
+        cairo_set_source_surface (render->cr, surface,
+                                  (nest ? 0 : render->offset_x) + roi.x0,
+                                  (nest ? 0 : render->offset_y) + roi.y0);
+    else
+        cairo_set_source_rgba (render->cr, 0, 0, 0, 0);
 
     if (lateclip)
         rsvg_cairo_clip (ctx, rsvg_current_state (ctx)->clip_path_ref, &render->bbox);
@@ -1006,7 +1733,7 @@ rsvg_cairo_pop_render_stack (RsvgDrawingCtx * ctx)
     _rsvg_cairo_set_operator (render->cr, state->comp_op);
 
     if (state->mask) {
-        rsvg_cairo_generate_mask (render->cr, state->mask, ctx, &render->bbox);
+        rsvg_cairo_generate_mask (render->cr, state->mask, ctx, &render->bbox, &layer->extents);
     } else if (state->opacity != 0xFF)
         cairo_paint_with_alpha (render->cr, (double) state->opacity / 255.0);
     else
@@ -1021,9 +1748,10 @@ rsvg_cairo_pop_render_stack (RsvgDrawingCtx * ctx)
     g_free (render->bb_stack->data);
     render->bb_stack = g_list_delete_link (render->bb_stack, render->bb_stack);
 
-    if (state->filter) {
+    if (state->filter && surface) {
         cairo_surface_destroy (surface);
     }
+    g_free (layer);
 }
 
 void
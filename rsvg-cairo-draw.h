@@ -43,6 +43,8 @@ void         rsvg_cairo_push_discrete_layer	    (RsvgDrawingCtx *ctx);
 void         rsvg_cairo_pop_discrete_layer      (RsvgDrawingCtx *ctx);
 void         rsvg_cairo_add_clipping_rect       (RsvgDrawingCtx *ctx,
                                                  double x, double y, double width, double height);
+void         rsvg_cairo_begin_node              (RsvgDrawingCtx *ctx, RsvgNode *node, int dominate);
+void         rsvg_cairo_end_node                (RsvgDrawingCtx *ctx, RsvgNode *node);
 
 GdkPixbuf   *rsvg_cairo_get_image_of_node       (RsvgDrawingCtx *ctx, RsvgNode *drawable, 
                                                  double width, double height);
@@ -37,6 +37,7 @@
 #include "rsvg-cairo-render.h"
 #include "rsvg-styles.h"
 #include "rsvg-structure.h"
+#include "rsvg-buffer-pool.h"
 
 static void
 rsvg_cairo_render_free (RsvgRender * self)
@@ -45,6 +46,10 @@ rsvg_cairo_render_free (RsvgRender * self)
 
     /* TODO */
 
+    if (me->bg_below)
+        cairo_surface_destroy (me->bg_below);
+    if (me->measurements)
+        g_hash_table_destroy (me->measurements);
     g_free (me);
 }
 
@@ -62,6 +67,8 @@ rsvg_cairo_render_new (cairo_t * cr, double width, double height)
     cairo_render->super.push_discrete_layer = rsvg_cairo_push_discrete_layer;
     cairo_render->super.add_clipping_rect = rsvg_cairo_add_clipping_rect;
     cairo_render->super.get_image_of_node = rsvg_cairo_get_image_of_node;
+    cairo_render->super.begin_node = rsvg_cairo_begin_node;
+    cairo_render->super.end_node = rsvg_cairo_end_node;
     cairo_render->width = width;
     cairo_render->height = height;
     cairo_render->offset_x = 0;
@@ -70,7 +77,7 @@ rsvg_cairo_render_new (cairo_t * cr, double width, double height)
     cairo_render->cr = cr;
     cairo_render->cr_stack = NULL;
     cairo_render->bb_stack = NULL;
-    cairo_render->pixbuf_stack = NULL;
+    cairo_render->opacity = 0xFF;
 
     return cairo_render;
 }
@@ -148,11 +155,14 @@ rsvg_cairo_new_drawing_ctx (cairo_t * cr, RsvgHandle * handle)
     draw->base_uri = g_strdup (handle->priv->base_uri);
     draw->dpi_x = handle->priv->dpi_x;
     draw->dpi_y = handle->priv->dpi_y;
+    draw->filter_quality = handle->priv->filter_quality;
     draw->vb.w = data.em;
     draw->vb.h = data.ex;
     draw->pango_context = NULL;
     draw->drawsub_stack = NULL;
     draw->ptrs = NULL;
+    draw->buffer_pool = rsvg_buffer_pool_get_default ();
+    draw->pattern_cache = handle->priv->pattern_cache;
 
     rsvg_state_push (draw);
     state = rsvg_current_state (draw);
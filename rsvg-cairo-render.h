@@ -47,7 +47,23 @@ struct _RsvgCairoRender {
 
     RsvgBbox bbox;
     GList *bb_stack;
-    GList *pixbuf_stack;
+    GList *layer_stack;         /* an RsvgCairoLayer for each one pushed */
+
+    /* how far the nodes being drawn reach, innermost first */
+    GSList *layer_hints;
+    /* what was found for nodes nested in the outermost one measured, so
+       that they need not be measured again */
+    GHashTable *measurements;
+    /* the opacity of the layers left out around what is being drawn,
+       which it is drawn at instead */
+    guint8 opacity;
+
+    /* The layers below the one a filtered element is drawn into, as
+       BackgroundImage last composited them. Nothing can draw into them
+       until that layer is popped, so filters at the same level reuse it. */
+    cairo_surface_t *bg_below;
+    RsvgIRect bg_below_roi;
+    guint bg_below_depth;       /* how many layers it holds */
 };
 
 RsvgCairoRender *rsvg_cairo_render_new		(cairo_t * cr, double width, double height);
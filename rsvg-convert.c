@@ -134,6 +134,7 @@ main (int argc, char **argv)
     char *format = NULL;
     char *output = NULL;
     int keep_aspect_ratio = FALSE;
+    gboolean fast_filters = FALSE;
     guint32 background_color = 0;
     char *background_color_str = NULL;
     char *base_uri = NULL;
@@ -170,6 +171,9 @@ main (int argc, char **argv)
          N_("output filename [optional; defaults to stdout]"), NULL},
         {"keep-aspect-ratio", 'a', 0, G_OPTION_ARG_NONE, &keep_aspect_ratio,
          N_("whether to preserve the aspect ratio [optional; defaults to FALSE]"), NULL},
+        {"fast-filters", 0, 0, G_OPTION_ARG_NONE, &fast_filters,
+         N_("approximate filter effects where that is much faster [optional; defaults to FALSE]"),
+         NULL},
         {"background-color", 'b', 0, G_OPTION_ARG_STRING, &background_color_str,
          N_("set the background color [optional; defaults to None]"), N_("[black, white, #abccee, #aaa...]")},
         {"version", 'v', 0, G_OPTION_ARG_NONE, &bVersion, N_("show version information"), NULL},
@@ -241,6 +245,9 @@ main (int argc, char **argv)
         if (base_uri)
             rsvg_handle_set_base_uri (rsvg, base_uri);
 
+        if (fast_filters)
+            rsvg_handle_set_filter_quality (rsvg, RSVG_FILTER_QUALITY_FAST);
+
         /* in the case of multi-page output, all subsequent SVGs are scaled to the first's size */
         rsvg_handle_set_size_callback (rsvg, rsvg_cairo_size_callback, &dimensions, NULL);
 
@@ -28,6 +28,7 @@
 #include "rsvg-defs.h"
 #include "rsvg-styles.h"
 #include "rsvg-image.h"
+#include "rsvg-paint-server.h"
 
 #include <glib.h>
 
@@ -186,6 +187,8 @@ rsvg_defs_add_resolver (RsvgDefs * defs, RsvgNode ** tochange, const gchar * nam
 void
 rsvg_defs_resolve_all (RsvgDefs * defs)
 {
+    guint i;
+
     while (defs->toresolve) {
         RsvgResolutionPending *data;
         data = defs->toresolve->data;
@@ -195,4 +198,9 @@ rsvg_defs_resolve_all (RsvgDefs * defs)
         defs->toresolve = g_slist_delete_link (defs->toresolve, defs->toresolve);
 
     }
+
+    /* now that every reference is known, so is what each gradient and
+       pattern takes from the ones it refers to */
+    for (i = 0; i < defs->unnamed->len; i++)
+        rsvg_paint_server_resolve (g_ptr_array_index (defs->unnamed, i));
 }
@@ -0,0 +1,733 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-blur.c : Blur kernels used by feGaussianBlur
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include "rsvg-filter-blur.h"
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define RSVG_HAVE_SSE2 1
+#include <emmintrin.h>
+#if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) || defined(__clang__)
+#define RSVG_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+/*
+ * The reference implementation, for pixels of @bpp bytes. It keeps a few
+ * long standing quirks that the other kernels reproduce exactly: every
+ * output is sum / kw with integer division, even near the edges where fewer
+ * than kw pixels were summed, and the leading edge of the window writes up
+ * to kw / 2 pixels before bounds.x0 (bounds.y0 for the vertical pass).
+ */
+static void
+rsvg_box_blur_scalar (guchar * in_pixels, guchar * output_pixels, gint rowstride, gint bpp,
+                      gint kw, gint kh, RsvgIRect boundarys, guint channels)
+{
+    gint ch;
+    gint x, y;
+    gint sum;
+    guchar *intermediate;
+
+    intermediate = g_new (guchar, MAX (MAX (kw, kh), 1));
+
+    if (kw >= 1) {
+        for (ch = 0; ch < bpp; ch++) {
+            if (!(channels & (1 << ch)))
+                continue;
+            for (y = boundarys.y0; y < boundarys.y1; y++) {
+                sum = 0;
+                for (x = boundarys.x0; x < boundarys.x0 + kw; x++) {
+                    sum += (intermediate[x % kw] = in_pixels[bpp * x + y * rowstride + ch]);
+
+                    if (x - kw / 2 >= 0 && x - kw / 2 < boundarys.x1)
+                        output_pixels[bpp * (x - kw / 2) + y * rowstride + ch] = sum / kw;
+                }
+                for (x = boundarys.x0 + kw; x < boundarys.x1; x++) {
+                    sum -= intermediate[x % kw];
+                    sum += (intermediate[x % kw] = in_pixels[bpp * x + y * rowstride + ch]);
+                    output_pixels[bpp * (x - kw / 2) + y * rowstride + ch] = sum / kw;
+                }
+                for (x = boundarys.x1; x < boundarys.x1 + kw; x++) {
+                    sum -= intermediate[x % kw];
+
+                    if (x - kw / 2 >= 0 && x - kw / 2 < boundarys.x1)
+                        output_pixels[bpp * (x - kw / 2) + y * rowstride + ch] = sum / kw;
+                }
+            }
+        }
+        in_pixels = output_pixels;
+    }
+
+    if (kh >= 1) {
+        for (ch = 0; ch < bpp; ch++) {
+            if (!(channels & (1 << ch)))
+                continue;
+
+            for (x = boundarys.x0; x < boundarys.x1; x++) {
+                sum = 0;
+
+                for (y = boundarys.y0; y < boundarys.y0 + kh; y++) {
+                    sum += (intermediate[y % kh] = in_pixels[bpp * x + y * rowstride + ch]);
+
+                    if (y - kh / 2 >= 0 && y - kh / 2 < boundarys.y1)
+                        output_pixels[bpp * x + (y - kh / 2) * rowstride + ch] = sum / kh;
+                }
+                for (; y < boundarys.y1; y++) {
+                    sum -= intermediate[y % kh];
+                    sum += (intermediate[y % kh] = in_pixels[bpp * x + y * rowstride + ch]);
+                    output_pixels[bpp * x + (y - kh / 2) * rowstride + ch] = sum / kh;
+                }
+                for (; y < boundarys.y1 + kh; y++) {
+                    sum -= intermediate[y % kh];
+
+                    if (y - kh / 2 >= 0 && y - kh / 2 < boundarys.y1)
+                        output_pixels[bpp * x + (y - kh / 2) * rowstride + ch] = sum / kh;
+                }
+            }
+        }
+    }
+
+    g_free (intermediate);
+}
+
+#ifdef RSVG_HAVE_SSE2
+
+/*
+ * The vector kernels keep one 32 bit lane per channel, so a whole pixel is
+ * summed at once, and run the vertical pass row by row over an array of
+ * column sums instead of walking down each column. Since the passes may
+ * work in place, the rows that are still needed are copied aside first.
+ *
+ * There is no vector integer division, so sum / k is estimated as
+ * sum * (1.0f / k) and then nudged by one where the estimate is off. Every
+ * value involved stays below 2^24 and is exact in a float as long as k is
+ * below 65536, which rsvg_box_blur checks before picking these kernels.
+ */
+
+static guint32
+rsvg_box_blur_channel_mask (guint channels)
+{
+    guchar bytes[4];
+    guint32 mask;
+    gint ch;
+
+    for (ch = 0; ch < 4; ch++)
+        bytes[ch] = (channels & (1 << ch)) ? 0xff : 0;
+    memcpy (&mask, bytes, 4);
+
+    return mask;
+}
+
+static void
+rsvg_box_blur_put (guchar * dst, guint32 value, guint32 mask)
+{
+    guint32 old;
+
+    memcpy (&old, dst, 4);
+    old = (old & ~mask) | (value & mask);
+    memcpy (dst, &old, 4);
+}
+
+static __m128i
+rsvg_box_blur_load_sse2 (const guchar * src)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    guint32 value;
+
+    memcpy (&value, src, 4);
+    return _mm_unpacklo_epi16 (_mm_unpacklo_epi8 (_mm_cvtsi32_si128 (value), zero), zero);
+}
+
+static guint32
+rsvg_box_blur_pack_sse2 (__m128i value)
+{
+    value = _mm_packs_epi32 (value, value);
+    return _mm_cvtsi128_si32 (_mm_packus_epi16 (value, value));
+}
+
+static __m128i
+rsvg_box_blur_div_sse2 (__m128i sum, __m128 rcp, __m128 k)
+{
+    __m128 n, prod;
+    __m128i q;
+
+    n = _mm_cvtepi32_ps (sum);
+    q = _mm_cvttps_epi32 (_mm_mul_ps (n, rcp));
+    prod = _mm_mul_ps (_mm_cvtepi32_ps (q), k);
+
+    /* the comparisons give all ones, that is -1, where they hold */
+    q = _mm_add_epi32 (q, _mm_castps_si128 (_mm_cmpgt_ps (prod, n)));
+    q = _mm_sub_epi32 (q, _mm_castps_si128 (_mm_cmple_ps (_mm_add_ps (prod, k), n)));
+
+    return q;
+}
+
+/* @src is a copy of pixels x0 to x1 of the row, @dst the row itself */
+static void
+rsvg_box_blur_row_sse2 (const guchar * src, guchar * dst, gint x0, gint x1, gint kw,
+                        guint32 mask)
+{
+    __m128 rcp = _mm_set1_ps (1.0f / kw);
+    __m128 k = _mm_set1_ps ((float) kw);
+    __m128i sum = _mm_setzero_si128 ();
+    __m128i q;
+    gint x;
+
+    for (x = x0; x < x0 + kw; x++) {
+        sum = _mm_add_epi32 (sum, rsvg_box_blur_load_sse2 (src + 4 * (x - x0)));
+        if (x - kw / 2 >= 0 && x - kw / 2 < x1) {
+            q = rsvg_box_blur_div_sse2 (sum, rcp, k);
+            rsvg_box_blur_put (dst + 4 * (x - kw / 2), rsvg_box_blur_pack_sse2 (q), mask);
+        }
+    }
+    for (; x < x1; x++) {
+        sum = _mm_add_epi32 (sum, rsvg_box_blur_load_sse2 (src + 4 * (x - x0)));
+        sum = _mm_sub_epi32 (sum, rsvg_box_blur_load_sse2 (src + 4 * (x - kw - x0)));
+        q = rsvg_box_blur_div_sse2 (sum, rcp, k);
+        rsvg_box_blur_put (dst + 4 * (x - kw / 2), rsvg_box_blur_pack_sse2 (q), mask);
+    }
+    for (; x < x1 + kw; x++) {
+        sum = _mm_sub_epi32 (sum, rsvg_box_blur_load_sse2 (src + 4 * (x - kw - x0)));
+        if (x - kw / 2 >= 0 && x - kw / 2 < x1) {
+            q = rsvg_box_blur_div_sse2 (sum, rcp, k);
+            rsvg_box_blur_put (dst + 4 * (x - kw / 2), rsvg_box_blur_pack_sse2 (q), mask);
+        }
+    }
+}
+
+/* adds @add and takes away @sub, either of which may be NULL, to the
+   @n values of @colsum */
+static void
+rsvg_box_blur_accumulate_sse2 (gint32 * colsum, const guchar * add, const guchar * sub, gint n)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    gint i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo, hi, s;
+        gint j;
+
+        lo = _mm_setzero_si128 ();
+        hi = _mm_setzero_si128 ();
+        if (add) {
+            s = _mm_loadu_si128 ((const __m128i *) (add + i));
+            lo = _mm_unpacklo_epi8 (s, zero);
+            hi = _mm_unpackhi_epi8 (s, zero);
+        }
+        if (sub) {
+            s = _mm_loadu_si128 ((const __m128i *) (sub + i));
+            lo = _mm_sub_epi16 (lo, _mm_unpacklo_epi8 (s, zero));
+            hi = _mm_sub_epi16 (hi, _mm_unpackhi_epi8 (s, zero));
+        }
+
+        /* sign extend the 16 bit differences */
+        for (j = 0; j < 2; j++) {
+            __m128i d = j ? hi : lo;
+            __m128i sign = _mm_cmplt_epi16 (d, zero);
+            __m128i *dst = (__m128i *) (colsum + i + 8 * j);
+
+            _mm_storeu_si128 (dst, _mm_add_epi32 (_mm_loadu_si128 (dst),
+                                                  _mm_unpacklo_epi16 (d, sign)));
+            _mm_storeu_si128 (dst + 1, _mm_add_epi32 (_mm_loadu_si128 (dst + 1),
+                                                      _mm_unpackhi_epi16 (d, sign)));
+        }
+    }
+    for (; i < n; i++)
+        colsum[i] += (add ? add[i] : 0) - (sub ? sub[i] : 0);
+}
+
+static void
+rsvg_box_blur_store_sse2 (const gint32 * colsum, guchar * dst, gint n, gint kh, guint32 mask)
+{
+    __m128 rcp = _mm_set1_ps (1.0f / kh);
+    __m128 k = _mm_set1_ps ((float) kh);
+    gint x;
+
+    for (x = 0; x < n; x++) {
+        __m128i q = rsvg_box_blur_div_sse2 (_mm_loadu_si128 ((const __m128i *) (colsum + 4 * x)),
+                                            rcp, k);
+        rsvg_box_blur_put (dst + 4 * x, rsvg_box_blur_pack_sse2 (q), mask);
+    }
+}
+
+#ifdef RSVG_HAVE_AVX2
+
+/* two pixels, one per 128 bit half */
+__attribute__ ((target ("avx2")))
+static __m256i
+rsvg_box_blur_load_avx2 (const guchar * a, const guchar * b)
+{
+    guint32 va, vb;
+
+    memcpy (&va, a, 4);
+    memcpy (&vb, b, 4);
+    return _mm256_cvtepu8_epi32 (_mm_set_epi32 (0, 0, vb, va));
+}
+
+__attribute__ ((target ("avx2")))
+static void
+rsvg_box_blur_pack_avx2 (__m256i value, guint32 * a, guint32 * b)
+{
+    value = _mm256_packs_epi32 (value, value);
+    value = _mm256_packus_epi16 (value, value);
+    *a = _mm_cvtsi128_si32 (_mm256_castsi256_si128 (value));
+    *b = _mm_cvtsi128_si32 (_mm256_extracti128_si256 (value, 1));
+}
+
+__attribute__ ((target ("avx2")))
+static __m256i
+rsvg_box_blur_div_avx2 (__m256i sum, __m256 rcp, __m256 k)
+{
+    __m256 n, prod;
+    __m256i q;
+
+    n = _mm256_cvtepi32_ps (sum);
+    q = _mm256_cvttps_epi32 (_mm256_mul_ps (n, rcp));
+    prod = _mm256_mul_ps (_mm256_cvtepi32_ps (q), k);
+
+    q = _mm256_add_epi32 (q, _mm256_castps_si256 (_mm256_cmp_ps (prod, n, _CMP_GT_OQ)));
+    q = _mm256_sub_epi32 (q, _mm256_castps_si256 (_mm256_cmp_ps (_mm256_add_ps (prod, k), n,
+                                                                 _CMP_LE_OQ)));
+
+    return q;
+}
+
+__attribute__ ((target ("avx2")))
+static void
+rsvg_box_blur_put_avx2 (__m256i q, guchar * a, guchar * b, guint32 mask)
+{
+    guint32 va, vb;
+
+    rsvg_box_blur_pack_avx2 (q, &va, &vb);
+    rsvg_box_blur_put (a, va, mask);
+    rsvg_box_blur_put (b, vb, mask);
+}
+
+/* rsvg_box_blur_row_sse2() for two rows at once */
+__attribute__ ((target ("avx2")))
+static void
+rsvg_box_blur_rows_avx2 (const guchar * src_a, const guchar * src_b,
+                         guchar * dst_a, guchar * dst_b,
+                         gint x0, gint x1, gint kw, guint32 mask)
+{
+    __m256 rcp = _mm256_set1_ps (1.0f / kw);
+    __m256 k = _mm256_set1_ps ((float) kw);
+    __m256i sum = _mm256_setzero_si256 ();
+    __m256i q;
+    gint x, i;
+
+    for (x = x0; x < x0 + kw; x++) {
+        i = 4 * (x - x0);
+        sum = _mm256_add_epi32 (sum, rsvg_box_blur_load_avx2 (src_a + i, src_b + i));
+        if (x - kw / 2 >= 0 && x - kw / 2 < x1) {
+            q = rsvg_box_blur_div_avx2 (sum, rcp, k);
+            rsvg_box_blur_put_avx2 (q, dst_a + 4 * (x - kw / 2), dst_b + 4 * (x - kw / 2), mask);
+        }
+    }
+    for (; x < x1; x++) {
+        i = 4 * (x - x0);
+        sum = _mm256_add_epi32 (sum, rsvg_box_blur_load_avx2 (src_a + i, src_b + i));
+        i = 4 * (x - kw - x0);
+        sum = _mm256_sub_epi32 (sum, rsvg_box_blur_load_avx2 (src_a + i, src_b + i));
+        q = rsvg_box_blur_div_avx2 (sum, rcp, k);
+        rsvg_box_blur_put_avx2 (q, dst_a + 4 * (x - kw / 2), dst_b + 4 * (x - kw / 2), mask);
+    }
+    for (; x < x1 + kw; x++) {
+        i = 4 * (x - kw - x0);
+        sum = _mm256_sub_epi32 (sum, rsvg_box_blur_load_avx2 (src_a + i, src_b + i));
+        if (x - kw / 2 >= 0 && x - kw / 2 < x1) {
+            q = rsvg_box_blur_div_avx2 (sum, rcp, k);
+            rsvg_box_blur_put_avx2 (q, dst_a + 4 * (x - kw / 2), dst_b + 4 * (x - kw / 2), mask);
+        }
+    }
+}
+
+__attribute__ ((target ("avx2")))
+static void
+rsvg_box_blur_accumulate_avx2 (gint32 * colsum, const guchar * add, const guchar * sub, gint n)
+{
+    gint i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_setzero_si256 ();
+        __m256i *dst = (__m256i *) (colsum + i);
+
+        if (add)
+            d = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (add + i)));
+        if (sub)
+            d = _mm256_sub_epi32 (d, _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)
+                                                                            (sub + i))));
+        _mm256_storeu_si256 (dst, _mm256_add_epi32 (_mm256_loadu_si256 (dst), d));
+    }
+    for (; i < n; i++)
+        colsum[i] += (add ? add[i] : 0) - (sub ? sub[i] : 0);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+rsvg_box_blur_store_avx2 (const gint32 * colsum, guchar * dst, gint n, gint kh, guint32 mask)
+{
+    __m256 rcp = _mm256_set1_ps (1.0f / kh);
+    __m256 k = _mm256_set1_ps ((float) kh);
+    gint x;
+
+    for (x = 0; x + 2 <= n; x += 2) {
+        __m256i q = rsvg_box_blur_div_avx2 (_mm256_loadu_si256 ((const __m256i *) (colsum + 4 * x)),
+                                            rcp, k);
+        rsvg_box_blur_put_avx2 (q, dst + 4 * x, dst + 4 * x + 4, mask);
+    }
+    if (x < n)
+        rsvg_box_blur_store_sse2 (colsum + 4 * x, dst + 4 * x, n - x, kh, mask);
+}
+
+#endif                          /* RSVG_HAVE_AVX2 */
+
+static void
+rsvg_box_blur_vector (gboolean avx2, guchar * in_pixels, guchar * output_pixels, gint rowstride,
+                      gint kw, gint kh, RsvgIRect bounds, guint channels)
+{
+    guint32 mask = rsvg_box_blur_channel_mask (channels);
+    gint width = bounds.x1 - bounds.x0;
+    gint n = 4 * width;
+    gint y;
+
+    if (width <= 0 || bounds.y1 <= bounds.y0 || !channels)
+        return;
+
+    if (kw >= 1) {
+        guchar *rows = g_new (guchar, 2 * n);
+
+        for (y = bounds.y0; y < bounds.y1; y++) {
+            guchar *src = in_pixels + y * rowstride + 4 * bounds.x0;
+            guchar *dst = output_pixels + y * rowstride;
+
+            memcpy (rows, src, n);
+#ifdef RSVG_HAVE_AVX2
+            if (avx2 && y + 1 < bounds.y1) {
+                memcpy (rows + n, src + rowstride, n);
+                rsvg_box_blur_rows_avx2 (rows, rows + n, dst, dst + rowstride,
+                                         bounds.x0, bounds.x1, kw, mask);
+                y++;
+                continue;
+            }
+#endif
+            rsvg_box_blur_row_sse2 (rows, dst, bounds.x0, bounds.x1, kw, mask);
+        }
+
+        g_free (rows);
+        in_pixels = output_pixels;
+    }
+
+    if (kh >= 1) {
+        /* the last kh source rows, since the rows they came from may be
+           overwritten by the time they leave the window */
+        guchar *ring = g_new (guchar, (gsize) kh * n);
+        gint32 *colsum = g_new0 (gint32, n);
+
+        for (y = bounds.y0; y < bounds.y1 + kh; y++) {
+            guchar *slot = ring + (gsize) ((y - bounds.y0) % kh) * n;
+            const guchar *add = NULL, *sub = NULL;
+
+            if (y < bounds.y1)
+                add = in_pixels + y * rowstride + 4 * bounds.x0;
+            if (y >= bounds.y0 + kh)
+                sub = slot;
+
+#ifdef RSVG_HAVE_AVX2
+            if (avx2)
+                rsvg_box_blur_accumulate_avx2 (colsum, add, sub, n);
+            else
+#endif
+                rsvg_box_blur_accumulate_sse2 (colsum, add, sub, n);
+            if (add)
+                memcpy (slot, add, n);
+
+            if (y - kh / 2 >= 0 && y - kh / 2 < bounds.y1) {
+                guchar *dst = output_pixels + (y - kh / 2) * rowstride + 4 * bounds.x0;
+#ifdef RSVG_HAVE_AVX2
+                if (avx2)
+                    rsvg_box_blur_store_avx2 (colsum, dst, width, kh, mask);
+                else
+#endif
+                    rsvg_box_blur_store_sse2 (colsum, dst, width, kh, mask);
+            }
+        }
+
+        g_free (ring);
+        g_free (colsum);
+    }
+}
+
+#endif                          /* RSVG_HAVE_SSE2 */
+
+gboolean
+rsvg_box_blur_kernel_supported (RsvgBoxBlurKernel kernel)
+{
+    switch (kernel) {
+    case RSVG_BOX_BLUR_SCALAR:
+        return TRUE;
+#ifdef RSVG_HAVE_SSE2
+    case RSVG_BOX_BLUR_SSE2:
+        return TRUE;
+#endif
+#ifdef RSVG_HAVE_AVX2
+    case RSVG_BOX_BLUR_AVX2:
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("avx2") != 0;
+#endif
+    default:
+        return FALSE;
+    }
+}
+
+RsvgBoxBlurKernel
+rsvg_box_blur_best_kernel (void)
+{
+    static gint best = -1;
+
+    if (best < 0) {
+        if (rsvg_box_blur_kernel_supported (RSVG_BOX_BLUR_AVX2))
+            best = RSVG_BOX_BLUR_AVX2;
+        else if (rsvg_box_blur_kernel_supported (RSVG_BOX_BLUR_SSE2))
+            best = RSVG_BOX_BLUR_SSE2;
+        else
+            best = RSVG_BOX_BLUR_SCALAR;
+    }
+
+    return (RsvgBoxBlurKernel) best;
+}
+
+void
+rsvg_box_blur (RsvgBoxBlurKernel kernel, guchar * in, guchar * out, gint rowstride,
+               gint kw, gint kh, RsvgIRect bounds, guint channels)
+{
+    if (kw > bounds.x1 - bounds.x0)
+        kw = bounds.x1 - bounds.x0;
+
+    if (kh > bounds.y1 - bounds.y0)
+        kh = bounds.y1 - bounds.y0;
+
+#ifdef RSVG_HAVE_SSE2
+    if (kernel != RSVG_BOX_BLUR_SCALAR && kw < 65536 && kh < 65536) {
+        rsvg_box_blur_vector (kernel == RSVG_BOX_BLUR_AVX2, in, out, rowstride,
+                              kw, kh, bounds, channels);
+        return;
+    }
+#endif
+
+    rsvg_box_blur_scalar (in, out, rowstride, 4, kw, kh, bounds, channels);
+}
+
+void
+rsvg_box_blur_alpha (guchar * in, guchar * out, gint rowstride,
+                     gint kw, gint kh, RsvgIRect bounds)
+{
+    if (kw > bounds.x1 - bounds.x0)
+        kw = bounds.x1 - bounds.x0;
+
+    if (kh > bounds.y1 - bounds.y0)
+        kh = bounds.y1 - bounds.y0;
+
+    rsvg_box_blur_scalar (in, out, rowstride, 1, kw, kh, bounds, 1);
+}
+
+/*
+ * The recursive Gaussian of Young and van Vliet, "Recursive implementation
+ * of the Gaussian filter", Signal Processing 44 (1995). A third order causal
+ * filter runs forwards along each line and again backwards, giving a close
+ * approximation of a Gaussian for deviations above a pixel or so at a fixed
+ * cost of a few multiply-adds per pixel and channel.
+ */
+
+#define RSVG_IIR_BLUR_STRIP 32
+
+typedef struct {
+    gfloat B, b1, b2, b3;
+    gint pad;                   /* zeros past the end for the backward pass to settle */
+} RsvgIirCoefs;
+
+static void
+rsvg_iir_coefs (gdouble sigma, RsvgIirCoefs * coefs)
+{
+    gdouble q, b0, b1, b2, b3;
+
+    if (sigma >= 2.5)
+        q = 0.98711 * sigma - 0.96330;
+    else
+        q = 3.97156 - 4.14554 * sqrt (1 - 0.26891 * MAX (sigma, 0.5));
+
+    b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+    b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+    b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+    b3 = 0.422205 * q * q * q;
+
+    coefs->B = 1 - (b1 + b2 + b3) / b0;
+    coefs->b1 = b1 / b0;
+    coefs->b2 = b2 / b0;
+    coefs->b3 = b3 / b0;
+    coefs->pad = ceil (3 * sigma) + 3;
+}
+
+/* filters @length samples, @stride floats apart, of @lanes lines side by
+   side, in place */
+static void
+rsvg_iir_line (gfloat * buf, gint length, gint stride, gint lanes, const RsvgIirCoefs * coefs)
+{
+    gfloat B = coefs->B, b1 = coefs->b1, b2 = coefs->b2, b3 = coefs->b3;
+    gint i, l;
+
+    for (i = 0; i < length; i++) {
+        gfloat *cur = buf + i * stride;
+
+        for (l = 0; l < lanes; l++) {
+            gfloat w1 = i >= 1 ? cur[l - stride] : 0;
+            gfloat w2 = i >= 2 ? cur[l - 2 * stride] : 0;
+            gfloat w3 = i >= 3 ? cur[l - 3 * stride] : 0;
+
+            cur[l] = B * cur[l] + b1 * w1 + b2 * w2 + b3 * w3;
+        }
+    }
+
+    for (i = length - 1; i >= 0; i--) {
+        gfloat *cur = buf + i * stride;
+
+        for (l = 0; l < lanes; l++) {
+            gfloat w1 = i + 1 < length ? cur[l + stride] : 0;
+            gfloat w2 = i + 2 < length ? cur[l + 2 * stride] : 0;
+            gfloat w3 = i + 3 < length ? cur[l + 3 * stride] : 0;
+
+            cur[l] = B * cur[l] + b1 * w1 + b2 * w2 + b3 * w3;
+        }
+    }
+}
+
+static guchar
+rsvg_iir_to_byte (gfloat value)
+{
+    gint v = (gint) (value + 0.5f);
+
+    return CLAMP (v, 0, 255);
+}
+
+static void
+rsvg_iir_blur_horizontal (guchar * in, guchar * out, gint rowstride, gint bpp,
+                          gdouble sigma, RsvgIRect bounds, guint channels)
+{
+    RsvgIirCoefs coefs;
+    gint width = bounds.x1 - bounds.x0;
+    gint length, x, y, ch;
+    gfloat *buf;
+
+    rsvg_iir_coefs (sigma, &coefs);
+    length = width + coefs.pad;
+    buf = g_new (gfloat, bpp * length);
+
+    for (y = bounds.y0; y < bounds.y1; y++) {
+        guchar *src = in + y * rowstride + bpp * bounds.x0;
+        guchar *dst = out + y * rowstride + bpp * bounds.x0;
+
+        for (x = 0; x < bpp * width; x++)
+            buf[x] = src[x];
+        memset (buf + bpp * width, 0, bpp * coefs.pad * sizeof (gfloat));
+
+        rsvg_iir_line (buf, length, bpp, bpp, &coefs);
+
+        for (x = 0; x < width; x++)
+            for (ch = 0; ch < bpp; ch++)
+                if (channels & (1 << ch))
+                    dst[bpp * x + ch] = rsvg_iir_to_byte (buf[bpp * x + ch]);
+    }
+
+    g_free (buf);
+}
+
+/* works on strips of columns so that each step of the recursion runs along
+   a row of memory rather than down a column */
+static void
+rsvg_iir_blur_vertical (guchar * in, guchar * out, gint rowstride, gint bpp,
+                        gdouble sigma, RsvgIRect bounds, guint channels)
+{
+    RsvgIirCoefs coefs;
+    gint height = bounds.y1 - bounds.y0;
+    gint length, x0, x, y, ch, lanes;
+    gfloat *buf;
+
+    rsvg_iir_coefs (sigma, &coefs);
+    length = height + coefs.pad;
+    buf = g_new (gfloat, (gsize) length * bpp * RSVG_IIR_BLUR_STRIP);
+
+    for (x0 = bounds.x0; x0 < bounds.x1; x0 += RSVG_IIR_BLUR_STRIP) {
+        lanes = bpp * MIN (RSVG_IIR_BLUR_STRIP, bounds.x1 - x0);
+
+        for (y = 0; y < height; y++) {
+            guchar *src = in + (bounds.y0 + y) * rowstride + bpp * x0;
+            for (x = 0; x < lanes; x++)
+                buf[y * lanes + x] = src[x];
+        }
+        memset (buf + height * lanes, 0, (gsize) coefs.pad * lanes * sizeof (gfloat));
+
+        rsvg_iir_line (buf, length, lanes, lanes, &coefs);
+
+        for (y = 0; y < height; y++) {
+            guchar *dst = out + (bounds.y0 + y) * rowstride + bpp * x0;
+            for (x = 0; x < lanes; x += bpp)
+                for (ch = 0; ch < bpp; ch++)
+                    if (channels & (1 << ch))
+                        dst[x + ch] = rsvg_iir_to_byte (buf[y * lanes + x + ch]);
+        }
+    }
+
+    g_free (buf);
+}
+
+static void
+rsvg_iir_blur_pixels (guchar * in, guchar * out, gint rowstride, gint bpp,
+                      gdouble sx, gdouble sy, RsvgIRect bounds, guint channels)
+{
+    if (bounds.x1 <= bounds.x0 || bounds.y1 <= bounds.y0 || !channels)
+        return;
+
+    if (sx > 0) {
+        rsvg_iir_blur_horizontal (in, out, rowstride, bpp, sx, bounds, channels);
+        in = out;
+    }
+
+    if (sy > 0)
+        rsvg_iir_blur_vertical (in, out, rowstride, bpp, sy, bounds, channels);
+}
+
+void
+rsvg_iir_blur (guchar * in, guchar * out, gint rowstride,
+               gdouble sx, gdouble sy, RsvgIRect bounds, guint channels)
+{
+    rsvg_iir_blur_pixels (in, out, rowstride, 4, sx, sy, bounds, channels);
+}
+
+void
+rsvg_iir_blur_alpha (guchar * in, guchar * out, gint rowstride,
+                     gdouble sx, gdouble sy, RsvgIRect bounds)
+{
+    rsvg_iir_blur_pixels (in, out, rowstride, 1, sx, sy, bounds, 1);
+}
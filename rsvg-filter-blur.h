@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-blur.h : Blur kernels used by feGaussianBlur
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef RSVG_FILTER_BLUR_H
+#define RSVG_FILTER_BLUR_H
+
+#include "rsvg-private.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+    RSVG_BOX_BLUR_SCALAR,
+    RSVG_BOX_BLUR_SSE2,
+    RSVG_BOX_BLUR_AVX2
+} RsvgBoxBlurKernel;
+
+gboolean            rsvg_box_blur_kernel_supported  (RsvgBoxBlurKernel kernel);
+RsvgBoxBlurKernel   rsvg_box_blur_best_kernel       (void);
+
+/* Blurs @bounds of @in into @out, which may be the same buffer, with a kw
+   wide horizontal and a kh high vertical box. Bit i of @channels enables
+   byte i of every pixel. All kernels give exactly the same output. */
+void                rsvg_box_blur                   (RsvgBoxBlurKernel kernel,
+                                                     guchar * in, guchar * out, gint rowstride,
+                                                     gint kw, gint kh, RsvgIRect bounds,
+                                                     guint channels);
+
+/* A true Gaussian blur of @bounds with standard deviations @sx and @sy in
+   pixels, made with a recursive filter whose cost does not depend on the
+   deviation. An axis with a deviation of 0 is left alone. Pixels outside
+   @bounds count as transparent and are not written. */
+void                rsvg_iir_blur                   (guchar * in, guchar * out, gint rowstride,
+                                                     gdouble sx, gdouble sy, RsvgIRect bounds,
+                                                     guint channels);
+
+/* The same two blurs for images of one byte per pixel, as used for alpha
+   alone. They give the bytes the ones above give in the alpha channel. */
+void                rsvg_box_blur_alpha             (guchar * in, guchar * out, gint rowstride,
+                                                     gint kw, gint kh, RsvgIRect bounds);
+void                rsvg_iir_blur_alpha             (guchar * in, guchar * out, gint rowstride,
+                                                     gdouble sx, gdouble sy, RsvgIRect bounds);
+
+G_END_DECLS
+
+#endif                          /* RSVG_FILTER_BLUR_H */
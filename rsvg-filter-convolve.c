@@ -0,0 +1,416 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-convolve.c : Fixed point kernels used by feConvolveMatrix
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include "rsvg-filter-convolve.h"
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define RSVG_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* The weights have to fit in 16 bits for the vector kernels, which
+   multiply them with the pixels in pairs. */
+#define RSVG_CONVOLVE_MAX_WEIGHT 32767
+#define RSVG_CONVOLVE_MAX_SHIFT 16
+
+static gint
+rsvg_convolve_gcd (gint a, gint b)
+{
+    while (b) {
+        gint t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Looks for the column and row whose product the weights are. The column
+   through the first weight that is not 0, divided by what its entries
+   have in common, is the column if there is one at all, and the row is
+   then the row through that weight divided by the column's entry. */
+static void
+rsvg_convolve_fixed_factor (RsvgConvolveFixed * fixed)
+{
+    gint ox = fixed->orderx, oy = fixed->ordery;
+    gint *column, *row;
+    gint pr, pc, i, j, g;
+
+    if (ox < 2 || oy < 2)
+        return;
+
+    for (i = 0; i < ox * oy; i++)
+        if (fixed->weights[i])
+            break;
+    if (i == ox * oy)
+        return;
+    pr = i / ox;
+    pc = i % ox;
+
+    column = g_new (gint, oy);
+    row = g_new (gint, ox);
+
+    g = 0;
+    for (i = 0; i < oy; i++)
+        g = rsvg_convolve_gcd (g, abs (fixed->weights[i * ox + pc]));
+    for (i = 0; i < oy; i++)
+        column[i] = fixed->weights[i * ox + pc] / g;
+
+    for (j = 0; j < ox; j++) {
+        if (fixed->weights[pr * ox + j] % column[pr])
+            goto not_separable;
+        row[j] = fixed->weights[pr * ox + j] / column[pr];
+    }
+
+    for (i = 0; i < oy; i++)
+        for (j = 0; j < ox; j++)
+            if (fixed->weights[i * ox + j] != column[i] * row[j])
+                goto not_separable;
+
+    fixed->column = column;
+    fixed->row = row;
+    return;
+
+  not_separable:
+    g_free (column);
+    g_free (row);
+}
+
+gboolean
+rsvg_convolve_fixed_init (RsvgConvolveFixed * fixed, const gdouble * matrix,
+                          gint orderx, gint ordery)
+{
+    gdouble largest = 0, total = 0;
+    gint taps = orderx * ordery;
+    gint i, j, shift;
+
+    fixed->orderx = orderx;
+    fixed->ordery = ordery;
+    fixed->weights = fixed->row = fixed->column = NULL;
+
+    if (orderx < 1 || ordery < 1)
+        return FALSE;
+
+    for (i = 0; i < taps; i++) {
+        largest = MAX (largest, fabs (matrix[i]));
+        total += fabs (matrix[i]);
+    }
+
+    /* a little room for the rounding of every weight */
+    for (shift = RSVG_CONVOLVE_MAX_SHIFT; shift >= 0; shift--)
+        if (ldexp (largest, shift) <= RSVG_CONVOLVE_MAX_WEIGHT &&
+            255 * (ldexp (total, shift) + taps) <= G_MAXINT)
+            break;
+    if (shift < 0)
+        return FALSE;
+
+    fixed->shift = shift;
+    fixed->exact = TRUE;
+    fixed->weights = g_new (gint, taps);
+
+    for (i = 0; i < ordery; i++)
+        for (j = 0; j < orderx; j++) {
+            gdouble w = ldexp (matrix[(ordery - i - 1) * orderx + orderx - j - 1], shift);
+
+            fixed->weights[i * orderx + j] = floor (w + 0.5);
+            if (fixed->weights[i * orderx + j] != w)
+                fixed->exact = FALSE;
+        }
+
+    rsvg_convolve_fixed_factor (fixed);
+
+    return TRUE;
+}
+
+void
+rsvg_convolve_fixed_free (RsvgConvolveFixed * fixed)
+{
+    g_free (fixed->weights);
+    g_free (fixed->row);
+    g_free (fixed->column);
+    fixed->weights = fixed->row = fixed->column = NULL;
+}
+
+void
+rsvg_convolve_naive (const RsvgConvolveFixed * fixed,
+                     const guchar * in, gint in_stride, gint * out,
+                     gint width, gint height, gint dx, gint dy)
+{
+    gint x, y, c, i, j, sum;
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            for (c = 0; c < 4; c++) {
+                sum = 0;
+                for (i = 0; i < fixed->ordery; i++)
+                    for (j = 0; j < fixed->orderx; j++)
+                        sum += fixed->weights[i * fixed->orderx + j] *
+                            in[(y + i * dy) * in_stride + (x + j * dx) * 4 + c];
+                out[(y * width + x) * 4 + c] = sum;
+            }
+}
+
+/* out[k] = the sum over the taps t of weights[t] * src[t][k] */
+static void
+rsvg_convolve_bytes_scalar (const guchar ** src, const gint * weights, gint taps,
+                            gint * out, gint n)
+{
+    gint k, t, sum;
+
+    for (k = 0; k < n; k++) {
+        sum = 0;
+        for (t = 0; t < taps; t++)
+            sum += weights[t] * src[t][k];
+        out[k] = sum;
+    }
+}
+
+static void
+rsvg_convolve_ints_scalar (const gint ** src, const gint * weights, gint taps,
+                           gint * out, gint n)
+{
+    gint k, t, sum;
+
+    for (k = 0; k < n; k++) {
+        sum = 0;
+        for (t = 0; t < taps; t++)
+            sum += weights[t] * src[t][k];
+        out[k] = sum;
+    }
+}
+
+#ifdef RSVG_HAVE_SSE2
+
+/* Two taps at a time: the bytes of both are widened to 16 bits and
+   interleaved, so that one multiply-add gives four of the sums their
+   share of the pair. @pairs holds eight weights for each pair, the two
+   alternately, the second 0 for an odd tap out. */
+static void
+rsvg_convolve_bytes_sse2 (const guchar ** src, const gint16 * pairs, gint taps,
+                          gint * out, gint n)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    gint k, t;
+
+    for (k = 0; k + 8 <= n; k += 8) {
+        __m128i lo = zero, hi = zero;
+
+        for (t = 0; t < taps; t += 2) {
+            const guchar *second = src[t + 1 < taps ? t + 1 : t];
+            __m128i a, b, w;
+
+            a = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (src[t] + k)), zero);
+            b = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (second + k)), zero);
+            w = _mm_loadu_si128 ((const __m128i *) (pairs + 4 * t));
+            lo = _mm_add_epi32 (lo, _mm_madd_epi16 (_mm_unpacklo_epi16 (a, b), w));
+            hi = _mm_add_epi32 (hi, _mm_madd_epi16 (_mm_unpackhi_epi16 (a, b), w));
+        }
+
+        _mm_storeu_si128 ((__m128i *) (out + k), lo);
+        _mm_storeu_si128 ((__m128i *) (out + k + 4), hi);
+    }
+
+    for (; k < n; k++) {
+        gint sum = 0;
+
+        for (t = 0; t < taps; t++)
+            sum += pairs[4 * (t & ~1) + (t & 1)] * src[t][k];
+        out[k] = sum;
+    }
+}
+
+/* the low 32 bits of the products, which SSE2 has no one instruction for */
+static __m128i
+rsvg_convolve_mullo_sse2 (__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32 (a, b);
+    __m128i odd = _mm_mul_epu32 (_mm_srli_si128 (a, 4), _mm_srli_si128 (b, 4));
+
+    return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)),
+                               _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+static void
+rsvg_convolve_ints_sse2 (const gint ** src, const gint * weights, gint taps,
+                         gint * out, gint n)
+{
+    gint k, t;
+
+    for (k = 0; k + 4 <= n; k += 4) {
+        __m128i sum = _mm_setzero_si128 ();
+
+        for (t = 0; t < taps; t++)
+            sum = _mm_add_epi32 (sum, rsvg_convolve_mullo_sse2 (
+                _mm_loadu_si128 ((const __m128i *) (src[t] + k)), _mm_set1_epi32 (weights[t])));
+
+        _mm_storeu_si128 ((__m128i *) (out + k), sum);
+    }
+
+    for (; k < n; k++) {
+        gint sum = 0;
+
+        for (t = 0; t < taps; t++)
+            sum += weights[t] * src[t][k];
+        out[k] = sum;
+    }
+}
+
+#endif
+
+gboolean
+rsvg_convolve_kernel_supported (RsvgConvolveKernel kernel)
+{
+    switch (kernel) {
+    case RSVG_CONVOLVE_SCALAR:
+        return TRUE;
+#ifdef RSVG_HAVE_SSE2
+    case RSVG_CONVOLVE_SSE2:
+        return TRUE;
+#endif
+    default:
+        return FALSE;
+    }
+}
+
+RsvgConvolveKernel
+rsvg_convolve_best_kernel (void)
+{
+    if (rsvg_convolve_kernel_supported (RSVG_CONVOLVE_SSE2))
+        return RSVG_CONVOLVE_SSE2;
+    return RSVG_CONVOLVE_SCALAR;
+}
+
+typedef struct {
+    RsvgConvolveKernel kernel;
+    gint16 *pairs;
+} RsvgConvolveTaps;
+
+static void
+rsvg_convolve_taps_init (RsvgConvolveTaps * taps, RsvgConvolveKernel kernel,
+                         const gint * weights, gint n)
+{
+    gint t, l;
+
+    taps->kernel = kernel;
+    taps->pairs = NULL;
+    if (kernel == RSVG_CONVOLVE_SCALAR)
+        return;
+
+    taps->pairs = g_new (gint16, 4 * (n + 1));
+    for (t = 0; t < n; t += 2)
+        for (l = 0; l < 8; l += 2) {
+            taps->pairs[4 * t + l] = weights[t];
+            taps->pairs[4 * t + l + 1] = t + 1 < n ? weights[t + 1] : 0;
+        }
+}
+
+static void
+rsvg_convolve_taps_bytes (RsvgConvolveTaps * taps, const guchar ** src, const gint * weights,
+                          gint n, gint * out, gint length)
+{
+#ifdef RSVG_HAVE_SSE2
+    if (taps->kernel == RSVG_CONVOLVE_SSE2) {
+        rsvg_convolve_bytes_sse2 (src, taps->pairs, n, out, length);
+        return;
+    }
+#endif
+    rsvg_convolve_bytes_scalar (src, weights, n, out, length);
+}
+
+static void
+rsvg_convolve_taps_ints (RsvgConvolveTaps * taps, const gint ** src, const gint * weights,
+                         gint n, gint * out, gint length)
+{
+#ifdef RSVG_HAVE_SSE2
+    if (taps->kernel == RSVG_CONVOLVE_SSE2) {
+        rsvg_convolve_ints_sse2 (src, weights, n, out, length);
+        return;
+    }
+#endif
+    rsvg_convolve_ints_scalar (src, weights, n, out, length);
+}
+
+static void
+rsvg_convolve_taps_free (RsvgConvolveTaps * taps)
+{
+    g_free (taps->pairs);
+}
+
+/* A separable matrix is two passes, along the rows into sums for every row
+   the taps reach and then down the columns of those. Both passes are in
+   integers, so the sums come out exactly as they would in one. */
+void
+rsvg_convolve (RsvgConvolveKernel kernel, const RsvgConvolveFixed * fixed,
+               const guchar * in, gint in_stride, gint * out,
+               gint width, gint height, gint dx, gint dy)
+{
+    gint ox = fixed->orderx, oy = fixed->ordery;
+    gint n = 4 * width;
+    RsvgConvolveTaps taps;
+    const guchar **bytes;
+    gint x, y, i, j;
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    bytes = g_new (const guchar *, ox * oy);
+
+    if (fixed->row) {
+        gint rows = height + (oy - 1) * dy;
+        gint *sums = g_new (gint, (gsize) rows * n);
+        const gint **ints = g_new (const gint *, oy);
+
+        rsvg_convolve_taps_init (&taps, kernel, fixed->row, ox);
+        for (y = 0; y < rows; y++) {
+            for (j = 0; j < ox; j++)
+                bytes[j] = in + y * in_stride + j * dx * 4;
+            rsvg_convolve_taps_bytes (&taps, bytes, fixed->row, ox, sums + (gsize) y * n, n);
+        }
+        rsvg_convolve_taps_free (&taps);
+
+        rsvg_convolve_taps_init (&taps, kernel, fixed->column, oy);
+        for (y = 0; y < height; y++) {
+            for (i = 0; i < oy; i++)
+                ints[i] = sums + (gsize) (y + i * dy) * n;
+            rsvg_convolve_taps_ints (&taps, ints, fixed->column, oy, out + (gsize) y * n, n);
+        }
+        rsvg_convolve_taps_free (&taps);
+
+        g_free (sums);
+        g_free (ints);
+    } else {
+        rsvg_convolve_taps_init (&taps, kernel, fixed->weights, ox * oy);
+        for (y = 0; y < height; y++) {
+            x = 0;
+            for (i = 0; i < oy; i++)
+                for (j = 0; j < ox; j++)
+                    bytes[x++] = in + (y + i * dy) * in_stride + j * dx * 4;
+            rsvg_convolve_taps_bytes (&taps, bytes, fixed->weights, ox * oy,
+                                      out + (gsize) y * n, n);
+        }
+        rsvg_convolve_taps_free (&taps);
+    }
+
+    g_free (bytes);
+}
@@ -0,0 +1,75 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-convolve.h : Fixed point kernels used by feConvolveMatrix
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef RSVG_FILTER_CONVOLVE_H
+#define RSVG_FILTER_CONVOLVE_H
+
+#include "rsvg-private.h"
+
+G_BEGIN_DECLS
+
+/* A kernel matrix in fixed point, each weight being the matrix entry times
+   2^shift. The weights run in the order the taps are visited, so that
+   weights[i * orderx + j] multiplies the pixel i rows down and j columns
+   right of the first one, which is the matrix turned half way round. */
+typedef struct {
+    gint orderx, ordery;
+    gint shift;
+    /* the weights are the matrix entries exactly, without rounding */
+    gboolean exact;
+    gint *weights;
+    /* when the weights are the products column[i] * row[j], else NULL */
+    gint *row, *column;
+} RsvgConvolveFixed;
+
+typedef enum {
+    RSVG_CONVOLVE_SCALAR,
+    RSVG_CONVOLVE_SSE2
+} RsvgConvolveKernel;
+
+gboolean            rsvg_convolve_kernel_supported  (RsvgConvolveKernel kernel);
+RsvgConvolveKernel  rsvg_convolve_best_kernel       (void);
+
+/* Puts the orderx x ordery @matrix in fixed point, with as many fraction
+   bits as will keep the sums of 8 bit pixels in 32 bits, and looks for a
+   row and column it is the product of. Returns FALSE, leaving @fixed
+   empty, for a matrix too large to fit at all. */
+gboolean    rsvg_convolve_fixed_init    (RsvgConvolveFixed * fixed, const gdouble * matrix,
+                                         gint orderx, gint ordery);
+void        rsvg_convolve_fixed_free    (RsvgConvolveFixed * fixed);
+
+/* Fills @out with the weighted sums of each byte of width x height pixels
+   of four bytes, 4 * width to a row. @in holds the pixels the taps reach,
+   (orderx - 1) * dx more columns and (ordery - 1) * dy more rows, the
+   taps being dx columns and dy rows apart. All kernels give exactly the
+   same sums. */
+void        rsvg_convolve               (RsvgConvolveKernel kernel, const RsvgConvolveFixed * fixed,
+                                         const guchar * in, gint in_stride, gint * out,
+                                         gint width, gint height, gint dx, gint dy);
+
+/* the same, visiting every tap of every pixel */
+void        rsvg_convolve_naive         (const RsvgConvolveFixed * fixed,
+                                         const guchar * in, gint in_stride, gint * out,
+                                         gint width, gint height, gint dx, gint dy);
+
+G_END_DECLS
+
+#endif                          /* RSVG_FILTER_CONVOLVE_H */
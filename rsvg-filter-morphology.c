@@ -0,0 +1,187 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-morphology.c : Erode and dilate kernels used by feMorphology
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include "rsvg-filter-morphology.h"
+#include <string.h>
+
+#define RSVG_MORPHOLOGY_STRIP 16
+
+void
+rsvg_morphology_naive (const guchar * in_pixels, guchar * output_pixels, gint rowstride,
+                       gint width, gint height, gint kx, gint ky,
+                       RsvgIRect boundarys, gboolean dilate)
+{
+    guchar ch, extreme, val;
+    gint x, y, i, j;
+
+    for (y = boundarys.y0; y < boundarys.y1; y++)
+        for (x = boundarys.x0; x < boundarys.x1; x++)
+            for (ch = 0; ch < 4; ch++) {
+                extreme = dilate ? 0 : 255;
+                for (i = -ky; i < ky + 1; i++)
+                    for (j = -kx; j < kx + 1; j++) {
+                        if (y + i >= height || y + i < 0 || x + j >= width || x + j < 0)
+                            continue;
+
+                        val = in_pixels[(y + i) * rowstride + (x + j) * 4 + ch];
+
+                        if (dilate) {
+                            if (extreme < val)
+                                extreme = val;
+                        } else {
+                            if (extreme > val)
+                                extreme = val;
+                        }
+                    }
+                output_pixels[y * rowstride + x * 4 + ch] = extreme;
+            }
+}
+
+/*
+ * The van Herk / Gil-Werman algorithm. The padded line is cut into blocks
+ * of the window size 2k + 1; g holds the extreme of each block up to every
+ * sample and h the extreme from every sample to the end of its block. Any
+ * window then covers the tail of one block and the head of the next, so
+ * its extreme is that of one h and one g, whatever the radius.
+ *
+ * @src holds length + 2k samples of @lanes bytes, @src_stride bytes apart,
+ * and @dst gets length samples.
+ */
+static void
+rsvg_morphology_line (const guchar * src, gint src_stride, guchar * dst, gint dst_stride,
+                      gint lanes, gint length, gint k, gboolean dilate,
+                      guchar * g, guchar * h)
+{
+    gint w = 2 * k + 1;
+    gint m = length + 2 * k;
+    gint t, l;
+
+    for (t = 0; t < m; t++) {
+        const guchar *s = src + t * src_stride;
+        guchar *gt = g + t * lanes;
+
+        if (t % w == 0)
+            memcpy (gt, s, lanes);
+        else if (dilate)
+            for (l = 0; l < lanes; l++)
+                gt[l] = MAX (gt[l - lanes], s[l]);
+        else
+            for (l = 0; l < lanes; l++)
+                gt[l] = MIN (gt[l - lanes], s[l]);
+    }
+
+    for (t = m - 1; t >= 0; t--) {
+        const guchar *s = src + t * src_stride;
+        guchar *ht = h + t * lanes;
+
+        if (t % w == w - 1 || t == m - 1)
+            memcpy (ht, s, lanes);
+        else if (dilate)
+            for (l = 0; l < lanes; l++)
+                ht[l] = MAX (ht[l + lanes], s[l]);
+        else
+            for (l = 0; l < lanes; l++)
+                ht[l] = MIN (ht[l + lanes], s[l]);
+    }
+
+    for (t = 0; t < length; t++) {
+        const guchar *ht = h + t * lanes;
+        const guchar *gt = g + (t + w - 1) * lanes;
+        guchar *d = dst + t * dst_stride;
+
+        if (dilate)
+            for (l = 0; l < lanes; l++)
+                d[l] = MAX (ht[l], gt[l]);
+        else
+            for (l = 0; l < lanes; l++)
+                d[l] = MIN (ht[l], gt[l]);
+    }
+}
+
+/* The window is a rectangle, so its extreme is the extreme down each column
+   of the extremes along each row: a horizontal pass into a buffer covering
+   the rows the vertical pass reads, then the vertical pass over strips of
+   columns. Pixels outside the buffer are padded with the value that never
+   wins, which is the same as leaving them out. */
+void
+rsvg_morphology (const guchar * in_pixels, guchar * output_pixels, gint rowstride,
+                 gint width, gint height, gint kx, gint ky,
+                 RsvgIRect bounds, gboolean dilate)
+{
+    guchar identity = dilate ? 0 : 255;
+    gint out_width = bounds.x1 - bounds.x0;
+    gint out_height = bounds.y1 - bounds.y0;
+    gint rows, row_bytes, padded, x, y, x0, x1;
+    guchar *rowbuf, *hpass, *g, *h;
+
+    if (out_width <= 0 || out_height <= 0)
+        return;
+
+    if (kx < 0 || ky < 0) {
+        /* nothing is in reach */
+        for (y = bounds.y0; y < bounds.y1; y++)
+            memset (output_pixels + y * rowstride + 4 * bounds.x0, identity, 4 * out_width);
+        return;
+    }
+
+    rows = out_height + 2 * ky;
+    row_bytes = 4 * out_width;
+    padded = MAX (out_width + 2 * kx, rows);
+
+    rowbuf = g_new (guchar, 4 * (out_width + 2 * kx));
+    hpass = g_new (guchar, (gsize) rows * row_bytes);
+    g = g_new (guchar, (gsize) padded * 4 * RSVG_MORPHOLOGY_STRIP);
+    h = g_new (guchar, (gsize) padded * 4 * RSVG_MORPHOLOGY_STRIP);
+
+    /* the source columns within reach that exist */
+    x0 = MAX (bounds.x0 - kx, 0);
+    x1 = MIN (bounds.x1 + kx, width);
+
+    for (y = 0; y < rows; y++) {
+        gint sy = bounds.y0 - ky + y;
+        guchar *dst = hpass + (gsize) y * row_bytes;
+
+        if (sy < 0 || sy >= height || x1 <= x0) {
+            memset (dst, identity, row_bytes);
+            continue;
+        }
+
+        memset (rowbuf, identity, 4 * (out_width + 2 * kx));
+        memcpy (rowbuf + 4 * (x0 - (bounds.x0 - kx)), in_pixels + sy * rowstride + 4 * x0,
+                4 * (x1 - x0));
+        rsvg_morphology_line (rowbuf, 4, dst, 4, 4, out_width, kx, dilate, g, h);
+    }
+
+    for (x = 0; x < out_width; x += RSVG_MORPHOLOGY_STRIP) {
+        gint lanes = 4 * MIN (RSVG_MORPHOLOGY_STRIP, out_width - x);
+
+        rsvg_morphology_line (hpass + 4 * x, row_bytes,
+                              output_pixels + bounds.y0 * rowstride + 4 * (bounds.x0 + x),
+                              rowstride, lanes, out_height, ky, dilate, g, h);
+    }
+
+    g_free (rowbuf);
+    g_free (hpass);
+    g_free (g);
+    g_free (h);
+}
@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-morphology.h : Erode and dilate kernels used by feMorphology
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef RSVG_FILTER_MORPHOLOGY_H
+#define RSVG_FILTER_MORPHOLOGY_H
+
+#include "rsvg-private.h"
+
+G_BEGIN_DECLS
+
+/* Sets every pixel of @bounds in @out to the minimum (or with @dilate the
+   maximum) of each channel over the pixels of @in at most kx columns and
+   ky rows away. Only pixels inside the width x height buffer take part.
+   @in and @out must not overlap. */
+void    rsvg_morphology         (const guchar * in, guchar * out, gint rowstride,
+                                 gint width, gint height, gint kx, gint ky,
+                                 RsvgIRect bounds, gboolean dilate);
+
+/* the same, visiting the whole neighbourhood of every pixel */
+void    rsvg_morphology_naive   (const guchar * in, guchar * out, gint rowstride,
+                                 gint width, gint height, gint kx, gint ky,
+                                 RsvgIRect bounds, gboolean dilate);
+
+G_END_DECLS
+
+#endif                          /* RSVG_FILTER_MORPHOLOGY_H */
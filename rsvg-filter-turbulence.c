@@ -0,0 +1,583 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-turbulence.c : Noise kernels used by feTurbulence
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include "rsvg-filter-turbulence.h"
+#include <math.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define RSVG_HAVE_SSE2 1
+#include <emmintrin.h>
+#if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) || defined(__clang__)
+#define RSVG_HAVE_AVX 1
+#include <immintrin.h>
+#endif
+#endif
+
+/* Produces results in the range [1, 2**31 - 2].
+   Algorithm is: r = (a * r) mod m
+   where a = 16807 and m = 2**31 - 1 = 2147483647
+   See [Park & Miller], CACM vol. 31 no. 10 p. 1195, Oct. 1988
+   To test: the algorithm should produce the result 1043618065
+   as the 10,000th generated number if the original seed is 1.
+*/
+#define feTurbulence_RAND_m 2147483647  /* 2**31 - 1 */
+#define feTurbulence_RAND_a 16807       /* 7**5; primitive root of m */
+#define feTurbulence_RAND_q 127773      /* m / a */
+#define feTurbulence_RAND_r 2836        /* m % a */
+#define feTurbulence_BSize RSVG_TURBULENCE_BSIZE
+#define feTurbulence_BM 0xff
+#define feTurbulence_PerlinN 0x1000
+
+struct feTurbulence_StitchInfo {
+    int nWidth;                 /* How much to subtract to wrap for stitching. */
+    int nHeight;
+    int nWrapX;                 /* Minimum value to wrap. */
+    int nWrapY;
+};
+
+/* the lattice cell a point falls in, shared by all four channels */
+typedef struct {
+    int b00, b10, b01, b11;
+    double rx0, rx1, ry0, ry1, sx, sy;
+} feTurbulence_Cell;
+
+static long
+feTurbulence_setup_seed (int lSeed)
+{
+    if (lSeed <= 0)
+        lSeed = -(lSeed % (feTurbulence_RAND_m - 1)) + 1;
+    if (lSeed > feTurbulence_RAND_m - 1)
+        lSeed = feTurbulence_RAND_m - 1;
+    return lSeed;
+}
+
+static long
+feTurbulence_random (int lSeed)
+{
+    long result;
+
+    result =
+        feTurbulence_RAND_a * (lSeed % feTurbulence_RAND_q) -
+        feTurbulence_RAND_r * (lSeed / feTurbulence_RAND_q);
+    if (result <= 0)
+        result += feTurbulence_RAND_m;
+    return result;
+}
+
+void
+rsvg_turbulence_init (RsvgTurbulence * turbulence, gint seed)
+{
+    double s;
+    int i, j, k, lSeed;
+
+    lSeed = feTurbulence_setup_seed (seed);
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < feTurbulence_BSize; i++) {
+            double (*g)[4] = turbulence->gradient[i];
+
+            turbulence->lattice[i] = i;
+            for (j = 0; j < 2; j++)
+                g[j][k] =
+                    (double) (((lSeed =
+                                feTurbulence_random (lSeed)) % (feTurbulence_BSize +
+                                                                feTurbulence_BSize)) -
+                              feTurbulence_BSize) / feTurbulence_BSize;
+            s = (double) (sqrt (g[0][k] * g[0][k] + g[1][k] * g[1][k]));
+            g[0][k] /= s;
+            g[1][k] /= s;
+        }
+    }
+
+    while (--i) {
+        k = turbulence->lattice[i];
+        turbulence->lattice[i] = turbulence->lattice[j =
+                                                     (lSeed =
+                                                      feTurbulence_random (lSeed)) %
+                                                     feTurbulence_BSize];
+        turbulence->lattice[j] = k;
+    }
+
+    for (i = 0; i < feTurbulence_BSize + 2; i++) {
+        turbulence->lattice[feTurbulence_BSize + i] = turbulence->lattice[i];
+        for (j = 0; j < 2; j++)
+            for (k = 0; k < 4; k++)
+                turbulence->gradient[feTurbulence_BSize + i][j][k] =
+                    turbulence->gradient[i][j][k];
+    }
+}
+
+void
+rsvg_turbulence_stitch_frequencies (RsvgTurbulence * turbulence,
+                                    gdouble fTileWidth, gdouble fTileHeight)
+{
+    if (!turbulence->stitch)
+        return;
+
+    /* When stitching tiled turbulence, the frequencies must be adjusted
+       so that the tile borders will be continuous. */
+    if (turbulence->base_freq_x != 0.0) {
+        double fLoFreq = (double) (floor (fTileWidth * turbulence->base_freq_x)) / fTileWidth;
+        double fHiFreq = (double) (ceil (fTileWidth * turbulence->base_freq_x)) / fTileWidth;
+        if (turbulence->base_freq_x / fLoFreq < fHiFreq / turbulence->base_freq_x)
+            turbulence->base_freq_x = fLoFreq;
+        else
+            turbulence->base_freq_x = fHiFreq;
+    }
+
+    if (turbulence->base_freq_y != 0.0) {
+        double fLoFreq = (double) (floor (fTileHeight * turbulence->base_freq_y)) / fTileHeight;
+        double fHiFreq = (double) (ceil (fTileHeight * turbulence->base_freq_y)) / fTileHeight;
+        if (turbulence->base_freq_y / fLoFreq < fHiFreq / turbulence->base_freq_y)
+            turbulence->base_freq_y = fLoFreq;
+        else
+            turbulence->base_freq_y = fHiFreq;
+    }
+}
+
+#define feTurbulence_s_curve(t) ( t * t * (3. - 2. * t) )
+#define feTurbulence_lerp(t, a, b) ( a + t * (b - a) )
+
+static void
+feTurbulence_find_cell (const RsvgTurbulence * turbulence, const double vec[2],
+                        const struct feTurbulence_StitchInfo *pStitchInfo, feTurbulence_Cell * cell)
+{
+    int bx0, bx1, by0, by1, i, j;
+    double t;
+
+    t = vec[0] + feTurbulence_PerlinN;
+    bx0 = (int) t;
+    bx1 = bx0 + 1;
+    cell->rx0 = t - (int) t;
+    cell->rx1 = cell->rx0 - 1.0f;
+    t = vec[1] + feTurbulence_PerlinN;
+    by0 = (int) t;
+    by1 = by0 + 1;
+    cell->ry0 = t - (int) t;
+    cell->ry1 = cell->ry0 - 1.0f;
+
+    /* If stitching, adjust lattice points accordingly. */
+    if (pStitchInfo != NULL) {
+        if (bx0 >= pStitchInfo->nWrapX)
+            bx0 -= pStitchInfo->nWidth;
+        if (bx1 >= pStitchInfo->nWrapX)
+            bx1 -= pStitchInfo->nWidth;
+        if (by0 >= pStitchInfo->nWrapY)
+            by0 -= pStitchInfo->nHeight;
+        if (by1 >= pStitchInfo->nWrapY)
+            by1 -= pStitchInfo->nHeight;
+    }
+
+    bx0 &= feTurbulence_BM;
+    bx1 &= feTurbulence_BM;
+    by0 &= feTurbulence_BM;
+    by1 &= feTurbulence_BM;
+    i = turbulence->lattice[bx0];
+    j = turbulence->lattice[bx1];
+    cell->b00 = turbulence->lattice[i + by0];
+    cell->b10 = turbulence->lattice[j + by0];
+    cell->b01 = turbulence->lattice[i + by1];
+    cell->b11 = turbulence->lattice[j + by1];
+    cell->sx = (double) (feTurbulence_s_curve (cell->rx0));
+    cell->sy = (double) (feTurbulence_s_curve (cell->ry0));
+}
+
+/* the noise of channel @ch in @cell */
+static double
+feTurbulence_noise2 (const RsvgTurbulence * turbulence, const feTurbulence_Cell * cell, int ch)
+{
+    const double (*q)[4];
+    double a, b, u, v;
+
+    q = turbulence->gradient[cell->b00];
+    u = cell->rx0 * q[0][ch] + cell->ry0 * q[1][ch];
+    q = turbulence->gradient[cell->b10];
+    v = cell->rx1 * q[0][ch] + cell->ry0 * q[1][ch];
+    a = feTurbulence_lerp (cell->sx, u, v);
+    q = turbulence->gradient[cell->b01];
+    u = cell->rx0 * q[0][ch] + cell->ry1 * q[1][ch];
+    q = turbulence->gradient[cell->b11];
+    v = cell->rx1 * q[0][ch] + cell->ry1 * q[1][ch];
+    b = feTurbulence_lerp (cell->sx, u, v);
+
+    return feTurbulence_lerp (cell->sy, a, b);
+}
+
+static void
+feTurbulence_stitch_init (const RsvgTurbulence * turbulence, struct feTurbulence_StitchInfo *stitch,
+                          double fTileX, double fTileY, double fTileWidth, double fTileHeight)
+{
+    stitch->nWidth = (int) (fTileWidth * turbulence->base_freq_x + 0.5f);
+    stitch->nWrapX = fTileX * turbulence->base_freq_x + feTurbulence_PerlinN + stitch->nWidth;
+    stitch->nHeight = (int) (fTileHeight * turbulence->base_freq_y + 0.5f);
+    stitch->nWrapY = fTileY * turbulence->base_freq_y + feTurbulence_PerlinN + stitch->nHeight;
+}
+
+static void
+feTurbulence_stitch_next (struct feTurbulence_StitchInfo *stitch)
+{
+    /* Update stitch values. Subtracting PerlinN before the multiplication and
+       adding it afterward simplifies to subtracting it once. */
+    stitch->nWidth *= 2;
+    stitch->nWrapX = 2 * stitch->nWrapX - feTurbulence_PerlinN;
+    stitch->nHeight *= 2;
+    stitch->nWrapY = 2 * stitch->nWrapY - feTurbulence_PerlinN;
+}
+
+/* the sum over the octaves of channel @ch at @point, as it has always been
+   worked out */
+static double
+feTurbulence_turbulence (const RsvgTurbulence * turbulence, int ch, const double *point,
+                         double fTileX, double fTileY, double fTileWidth, double fTileHeight)
+{
+    struct feTurbulence_StitchInfo stitch;
+    struct feTurbulence_StitchInfo *pStitchInfo = NULL; /* Not stitching when NULL. */
+    feTurbulence_Cell cell;
+    double fSum = 0.0f, vec[2], ratio = 1.;
+    int nOctave;
+
+    if (turbulence->stitch) {
+        pStitchInfo = &stitch;
+        feTurbulence_stitch_init (turbulence, &stitch, fTileX, fTileY, fTileWidth, fTileHeight);
+    }
+
+    vec[0] = point[0] * turbulence->base_freq_x;
+    vec[1] = point[1] * turbulence->base_freq_y;
+
+    for (nOctave = 0; nOctave < turbulence->octaves; nOctave++) {
+        feTurbulence_find_cell (turbulence, vec, pStitchInfo, &cell);
+        if (turbulence->fractal_sum)
+            fSum += (double) (feTurbulence_noise2 (turbulence, &cell, ch) / ratio);
+        else
+            fSum += (double) (fabs (feTurbulence_noise2 (turbulence, &cell, ch)) / ratio);
+
+        vec[0] *= 2;
+        vec[1] *= 2;
+        ratio *= 2;
+
+        if (pStitchInfo != NULL)
+            feTurbulence_stitch_next (&stitch);
+    }
+
+    return fSum;
+}
+
+/* The four channels at once, sharing the lattice lookups. The arithmetic
+   is the same as feTurbulence_noise2() per channel, operation for
+   operation, so the sums come out bit for bit the same. */
+static void
+feTurbulence_turbulence4_scalar (const RsvgTurbulence * turbulence, const double *point,
+                                 double fTileX, double fTileY, double fTileWidth,
+                                 double fTileHeight, double sum[4])
+{
+    struct feTurbulence_StitchInfo stitch;
+    struct feTurbulence_StitchInfo *pStitchInfo = NULL;
+    feTurbulence_Cell cell;
+    double vec[2], ratio = 1.;
+    int nOctave, ch;
+
+    if (turbulence->stitch) {
+        pStitchInfo = &stitch;
+        feTurbulence_stitch_init (turbulence, &stitch, fTileX, fTileY, fTileWidth, fTileHeight);
+    }
+
+    vec[0] = point[0] * turbulence->base_freq_x;
+    vec[1] = point[1] * turbulence->base_freq_y;
+    for (ch = 0; ch < 4; ch++)
+        sum[ch] = 0.0f;
+
+    for (nOctave = 0; nOctave < turbulence->octaves; nOctave++) {
+        feTurbulence_find_cell (turbulence, vec, pStitchInfo, &cell);
+        for (ch = 0; ch < 4; ch++) {
+            double noise = feTurbulence_noise2 (turbulence, &cell, ch);
+
+            sum[ch] += (turbulence->fractal_sum ? noise : fabs (noise)) / ratio;
+        }
+
+        vec[0] *= 2;
+        vec[1] *= 2;
+        ratio *= 2;
+
+        if (pStitchInfo != NULL)
+            feTurbulence_stitch_next (&stitch);
+    }
+}
+
+#ifdef RSVG_HAVE_SSE2
+
+/* Channels 0 and 1 go in one register and 2 and 3 in another. */
+static void
+feTurbulence_turbulence4_sse2 (const RsvgTurbulence * turbulence, const double *point,
+                               double fTileX, double fTileY, double fTileWidth,
+                               double fTileHeight, double sum[4])
+{
+    struct feTurbulence_StitchInfo stitch;
+    struct feTurbulence_StitchInfo *pStitchInfo = NULL;
+    feTurbulence_Cell cell;
+    const __m128d sign = _mm_set1_pd (-0.0);
+    __m128d sum_lo = _mm_setzero_pd (), sum_hi = _mm_setzero_pd ();
+    double vec[2], ratio = 1.;
+    int nOctave, half;
+
+    if (turbulence->stitch) {
+        pStitchInfo = &stitch;
+        feTurbulence_stitch_init (turbulence, &stitch, fTileX, fTileY, fTileWidth, fTileHeight);
+    }
+
+    vec[0] = point[0] * turbulence->base_freq_x;
+    vec[1] = point[1] * turbulence->base_freq_y;
+
+    for (nOctave = 0; nOctave < turbulence->octaves; nOctave++) {
+        __m128d rx0, rx1, ry0, ry1, sx, sy, r;
+
+        feTurbulence_find_cell (turbulence, vec, pStitchInfo, &cell);
+        rx0 = _mm_set1_pd (cell.rx0);
+        rx1 = _mm_set1_pd (cell.rx1);
+        ry0 = _mm_set1_pd (cell.ry0);
+        ry1 = _mm_set1_pd (cell.ry1);
+        sx = _mm_set1_pd (cell.sx);
+        sy = _mm_set1_pd (cell.sy);
+        r = _mm_set1_pd (ratio);
+
+        for (half = 0; half < 4; half += 2) {
+            const double (*q)[4];
+            __m128d a, b, u, v, noise;
+
+            q = turbulence->gradient[cell.b00];
+            u = _mm_add_pd (_mm_mul_pd (rx0, _mm_loadu_pd (&q[0][half])),
+                            _mm_mul_pd (ry0, _mm_loadu_pd (&q[1][half])));
+            q = turbulence->gradient[cell.b10];
+            v = _mm_add_pd (_mm_mul_pd (rx1, _mm_loadu_pd (&q[0][half])),
+                            _mm_mul_pd (ry0, _mm_loadu_pd (&q[1][half])));
+            a = _mm_add_pd (u, _mm_mul_pd (sx, _mm_sub_pd (v, u)));
+            q = turbulence->gradient[cell.b01];
+            u = _mm_add_pd (_mm_mul_pd (rx0, _mm_loadu_pd (&q[0][half])),
+                            _mm_mul_pd (ry1, _mm_loadu_pd (&q[1][half])));
+            q = turbulence->gradient[cell.b11];
+            v = _mm_add_pd (_mm_mul_pd (rx1, _mm_loadu_pd (&q[0][half])),
+                            _mm_mul_pd (ry1, _mm_loadu_pd (&q[1][half])));
+            b = _mm_add_pd (u, _mm_mul_pd (sx, _mm_sub_pd (v, u)));
+            noise = _mm_add_pd (a, _mm_mul_pd (sy, _mm_sub_pd (b, a)));
+
+            if (!turbulence->fractal_sum)
+                noise = _mm_andnot_pd (sign, noise);
+            noise = _mm_div_pd (noise, r);
+            if (half)
+                sum_hi = _mm_add_pd (sum_hi, noise);
+            else
+                sum_lo = _mm_add_pd (sum_lo, noise);
+        }
+
+        vec[0] *= 2;
+        vec[1] *= 2;
+        ratio *= 2;
+
+        if (pStitchInfo != NULL)
+            feTurbulence_stitch_next (&stitch);
+    }
+
+    _mm_storeu_pd (sum, sum_lo);
+    _mm_storeu_pd (sum + 2, sum_hi);
+}
+
+#endif
+
+#ifdef RSVG_HAVE_AVX
+
+/* All four channels in one register. The sum is kept in memory and the
+   upper halves cleared before the lattice lookup in each octave, which is
+   plain SSE code: running it with them dirty costs more than the whole
+   octave. */
+__attribute__ ((target ("avx")))
+static void
+feTurbulence_turbulence4_avx (const RsvgTurbulence * turbulence, const double *point,
+                              double fTileX, double fTileY, double fTileWidth,
+                              double fTileHeight, double sum[4])
+{
+    struct feTurbulence_StitchInfo stitch;
+    struct feTurbulence_StitchInfo *pStitchInfo = NULL;
+    feTurbulence_Cell cell;
+    double vec[2], ratio = 1.;
+    int nOctave;
+
+    if (turbulence->stitch) {
+        pStitchInfo = &stitch;
+        feTurbulence_stitch_init (turbulence, &stitch, fTileX, fTileY, fTileWidth, fTileHeight);
+    }
+
+    vec[0] = point[0] * turbulence->base_freq_x;
+    vec[1] = point[1] * turbulence->base_freq_y;
+    sum[0] = sum[1] = sum[2] = sum[3] = 0.0f;
+
+    for (nOctave = 0; nOctave < turbulence->octaves; nOctave++) {
+        const double (*q)[4];
+        __m256d rx0, rx1, ry0, ry1, sx, a, b, u, v, noise;
+
+        _mm256_zeroupper ();
+        feTurbulence_find_cell (turbulence, vec, pStitchInfo, &cell);
+        rx0 = _mm256_set1_pd (cell.rx0);
+        rx1 = _mm256_set1_pd (cell.rx1);
+        ry0 = _mm256_set1_pd (cell.ry0);
+        ry1 = _mm256_set1_pd (cell.ry1);
+        sx = _mm256_set1_pd (cell.sx);
+
+        q = turbulence->gradient[cell.b00];
+        u = _mm256_add_pd (_mm256_mul_pd (rx0, _mm256_loadu_pd (q[0])),
+                           _mm256_mul_pd (ry0, _mm256_loadu_pd (q[1])));
+        q = turbulence->gradient[cell.b10];
+        v = _mm256_add_pd (_mm256_mul_pd (rx1, _mm256_loadu_pd (q[0])),
+                           _mm256_mul_pd (ry0, _mm256_loadu_pd (q[1])));
+        a = _mm256_add_pd (u, _mm256_mul_pd (sx, _mm256_sub_pd (v, u)));
+        q = turbulence->gradient[cell.b01];
+        u = _mm256_add_pd (_mm256_mul_pd (rx0, _mm256_loadu_pd (q[0])),
+                           _mm256_mul_pd (ry1, _mm256_loadu_pd (q[1])));
+        q = turbulence->gradient[cell.b11];
+        v = _mm256_add_pd (_mm256_mul_pd (rx1, _mm256_loadu_pd (q[0])),
+                           _mm256_mul_pd (ry1, _mm256_loadu_pd (q[1])));
+        b = _mm256_add_pd (u, _mm256_mul_pd (sx, _mm256_sub_pd (v, u)));
+        noise = _mm256_add_pd (a, _mm256_mul_pd (_mm256_set1_pd (cell.sy), _mm256_sub_pd (b, a)));
+
+        if (!turbulence->fractal_sum)
+            noise = _mm256_andnot_pd (_mm256_set1_pd (-0.0), noise);
+        _mm256_storeu_pd (sum, _mm256_add_pd (_mm256_loadu_pd (sum),
+                                              _mm256_div_pd (noise, _mm256_set1_pd (ratio))));
+
+        vec[0] *= 2;
+        vec[1] *= 2;
+        ratio *= 2;
+
+        if (pStitchInfo != NULL)
+            feTurbulence_stitch_next (&stitch);
+    }
+}
+
+#endif
+
+gboolean
+rsvg_turbulence_kernel_supported (RsvgTurbulenceKernel kernel)
+{
+    switch (kernel) {
+    case RSVG_TURBULENCE_SCALAR:
+        return TRUE;
+#ifdef RSVG_HAVE_SSE2
+    case RSVG_TURBULENCE_SSE2:
+        return TRUE;
+#endif
+#ifdef RSVG_HAVE_AVX
+    case RSVG_TURBULENCE_AVX:
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("avx") != 0;
+#endif
+    default:
+        return FALSE;
+    }
+}
+
+RsvgTurbulenceKernel
+rsvg_turbulence_best_kernel (void)
+{
+    static gint best = -1;
+
+    if (best < 0) {
+        if (rsvg_turbulence_kernel_supported (RSVG_TURBULENCE_AVX))
+            best = RSVG_TURBULENCE_AVX;
+        else if (rsvg_turbulence_kernel_supported (RSVG_TURBULENCE_SSE2))
+            best = RSVG_TURBULENCE_SSE2;
+        else
+            best = RSVG_TURBULENCE_SCALAR;
+    }
+
+    return (RsvgTurbulenceKernel) best;
+}
+
+static guchar
+feTurbulence_to_byte (const RsvgTurbulence * turbulence, double cr)
+{
+    if (turbulence->fractal_sum)
+        cr = ((cr * 255.) + 255.) / 2.;
+    else
+        cr = (cr * 255.);
+
+    return (guchar) CLAMP (cr, 0., 255.);
+}
+
+void
+rsvg_turbulence_row (RsvgTurbulenceKernel kernel, const RsvgTurbulence * turbulence,
+                     const gdouble affine[6], RsvgIRect tile,
+                     gint x, gint y, gint step, gint n, guchar * out)
+{
+    gdouble tile_width = tile.x1 - tile.x0;
+    gdouble tile_height = tile.y1 - tile.y0;
+    gint i, ch;
+
+    for (i = 0; i < n; i++, x += step) {
+        double point[2], sum[4];
+
+        point[0] = affine[0] * x + affine[2] * y + affine[4];
+        point[1] = affine[1] * x + affine[3] * y + affine[5];
+
+        switch (kernel) {
+#ifdef RSVG_HAVE_AVX
+        case RSVG_TURBULENCE_AVX:
+            feTurbulence_turbulence4_avx (turbulence, point, x - tile.x0, y - tile.y0,
+                                          tile_width, tile_height, sum);
+            break;
+#endif
+#ifdef RSVG_HAVE_SSE2
+        case RSVG_TURBULENCE_SSE2:
+            feTurbulence_turbulence4_sse2 (turbulence, point, x - tile.x0, y - tile.y0,
+                                           tile_width, tile_height, sum);
+            break;
+#endif
+        default:
+            feTurbulence_turbulence4_scalar (turbulence, point, x - tile.x0, y - tile.y0,
+                                             tile_width, tile_height, sum);
+            break;
+        }
+
+        for (ch = 0; ch < 4; ch++)
+            out[4 * i + ch] = feTurbulence_to_byte (turbulence, sum[ch]);
+    }
+}
+
+void
+rsvg_turbulence_row_naive (const RsvgTurbulence * turbulence, const gdouble affine[6],
+                           RsvgIRect tile, gint x, gint y, gint step, gint n, guchar * out)
+{
+    gdouble tile_width = tile.x1 - tile.x0;
+    gdouble tile_height = tile.y1 - tile.y0;
+    gint i, ch;
+
+    for (i = 0; i < n; i++, x += step) {
+        double point[2];
+
+        point[0] = affine[0] * x + affine[2] * y + affine[4];
+        point[1] = affine[1] * x + affine[3] * y + affine[5];
+
+        for (ch = 0; ch < 4; ch++)
+            out[4 * i + ch] =
+                feTurbulence_to_byte (turbulence,
+                                      feTurbulence_turbulence (turbulence, ch, point,
+                                                               x - tile.x0, y - tile.y0,
+                                                               tile_width, tile_height));
+    }
+}
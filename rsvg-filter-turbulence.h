@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-filter-turbulence.h : Noise kernels used by feTurbulence
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef RSVG_FILTER_TURBULENCE_H
+#define RSVG_FILTER_TURBULENCE_H
+
+#include "rsvg-private.h"
+
+G_BEGIN_DECLS
+
+#define RSVG_TURBULENCE_BSIZE 0x100
+
+typedef struct {
+    gint lattice[RSVG_TURBULENCE_BSIZE + RSVG_TURBULENCE_BSIZE + 2];
+    /* the x components of the gradients of the four channels at each
+       lattice point, then the y components, so that one lookup serves
+       all four */
+    gdouble gradient[RSVG_TURBULENCE_BSIZE + RSVG_TURBULENCE_BSIZE + 2][2][4];
+
+    gdouble base_freq_x, base_freq_y;
+    gint octaves;
+    gboolean fractal_sum;
+    gboolean stitch;
+} RsvgTurbulence;
+
+typedef enum {
+    RSVG_TURBULENCE_SCALAR,
+    RSVG_TURBULENCE_SSE2,
+    RSVG_TURBULENCE_AVX
+} RsvgTurbulenceKernel;
+
+gboolean                rsvg_turbulence_kernel_supported    (RsvgTurbulenceKernel kernel);
+RsvgTurbulenceKernel    rsvg_turbulence_best_kernel         (void);
+
+/* Fills in the lattice and gradients for @seed. */
+void    rsvg_turbulence_init                (RsvgTurbulence * turbulence, gint seed);
+
+/* Moves the base frequencies to the nearest ones that fit a whole number
+   of lattice cells into the tile, if stitching. Doing it again changes
+   nothing. */
+void    rsvg_turbulence_stitch_frequencies  (RsvgTurbulence * turbulence,
+                                             gdouble tile_width, gdouble tile_height);
+
+/* Works out @n pixels of row @y, starting at column @x and @step columns
+   apart, and stores them in @out as unpremultiplied RGBA bytes. @affine
+   takes pixels to noise space and @tile is the area stitching wraps. All
+   kernels give exactly the same output. */
+void    rsvg_turbulence_row                 (RsvgTurbulenceKernel kernel,
+                                             const RsvgTurbulence * turbulence,
+                                             const gdouble affine[6], RsvgIRect tile,
+                                             gint x, gint y, gint step, gint n, guchar * out);
+
+/* the same, working the channels out one by one */
+void    rsvg_turbulence_row_naive           (const RsvgTurbulence * turbulence,
+                                             const gdouble affine[6], RsvgIRect tile,
+                                             gint x, gint y, gint step, gint n, guchar * out);
+
+G_END_DECLS
+
+#endif                          /* RSVG_FILTER_TURBULENCE_H */
@@ -27,11 +27,17 @@
 
 #include "rsvg-private.h"
 #include "rsvg-filter.h"
+#include "rsvg-buffer-pool.h"
+#include "rsvg-filter-blur.h"
+#include "rsvg-filter-convolve.h"
+#include "rsvg-filter-morphology.h"
+#include "rsvg-filter-turbulence.h"
 #include "rsvg-styles.h"
 #include "rsvg-image.h"
 #include "rsvg-css.h"
 #include "rsvg-cairo-render.h"
 #include <string.h>
+#include <stdlib.h>
 
 #include <math.h>
 
@@ -39,10 +45,38 @@
 /*************************************************************/
 /*************************************************************/
 
+/* Filters work on the premultiplied pixels of cairo's ARGB32 image
+   surfaces, which hold blue, green, red and alpha in that order of bytes
+   on little-endian machines. The byte of channel i of an RGBA colour is
+   RSVG_FILTER_CHANNEL (i). */
+#define RSVG_FILTER_CHANNEL(i) ((i) == 3 ? 3 : 2 - (i))
+#define RSVG_FILTER_ALPHA 3
+
+/* An image in that layout, four bytes to a pixel and 4 * width to a row.
+   The pixels come from the drawing context's buffer pool. */
+typedef struct {
+    guchar *pixels;
+    gint width, height, rowstride;
+    gint ref_count;
+} RsvgFilterImage;
+
+/* A one byte per pixel image, width bytes to a row. Results that only ever
+   held alpha, SourceAlpha blurred and offset for a drop shadow say, are kept
+   in one of these instead of an image with three empty channels. */
+typedef struct {
+    guchar *pixels;
+    gint width, height;
+    gint ref_count;
+} RsvgFilterAlpha;
+
 typedef struct _RsvgFilterPrimitiveOutput RsvgFilterPrimitiveOutput;
 
+/* At least one of result and alpha is set. Where alpha is, it is the whole
+   result, and result, if set too, is the same image spread out to RGBA for
+   the primitives that want that. */
 struct _RsvgFilterPrimitiveOutput {
-    GdkPixbuf *result;
+    RsvgFilterImage *result;
+    RsvgFilterAlpha *alpha;
     RsvgIRect bounds;
     gboolean Rused;
     gboolean Gused;
@@ -54,14 +88,15 @@ typedef struct _RsvgFilterContext RsvgFilterContext;
 
 struct _RsvgFilterContext {
     gint width, height;
+    RsvgIRect roi;              /* part of the source being filtered, in source pixels */
     RsvgFilter *filter;
     GHashTable *results;
-    GdkPixbuf *source;
-    GdkPixbuf *bg;
+    RsvgFilterImage *source;
+    RsvgFilterImage *bg;
+    RsvgFilterImage *bg_alpha;  /* BackgroundAlpha, made once it is asked for */
     RsvgFilterPrimitiveOutput lastresult;
     double affine[6];
     double paffine[6];
-    int channelmap[4];
     RsvgDrawingCtx *ctx;
 };
 
@@ -74,8 +109,169 @@ struct _RsvgFilterPrimitive {
     GString *result;
 
     void (*render) (RsvgFilterPrimitive * self, RsvgFilterContext * ctx);
+    /* area of the input read while rendering @bounds, NULL if it is @bounds itself */
+    RsvgIRect (*get_input_bounds) (RsvgFilterPrimitive * self, RsvgFilterContext * ctx,
+                                   RsvgIRect bounds);
+    /* appends the names of the results read to @names, NULL if it is just @in */
+    void (*get_inputs) (RsvgFilterPrimitive * self, GPtrArray * names);
+    /* for pointwise primitives, works out @n pixels of the result from the
+       same pixels of the inputs named by get_inputs; NULL for the others */
+    void (*render_span) (RsvgFilterPrimitive * self, RsvgFilterContext * ctx, guchar * out,
+                         const guchar * in, const guchar * in2, gint n);
+};
+
+/*************************************************************/
+/*************************************************************/
+
+/* Per-pixel primitives hand their inner loop to rsvg_filter_run_bands(),
+   which cuts the bounds into bands of rows and runs them on a pool of
+   worker threads. Every band writes only its own rows of the output, so
+   the result is the same however many threads there are. */
+
+typedef struct _RsvgFilterBands RsvgFilterBands;
+
+struct _RsvgFilterBands {
+    RsvgFilterPrimitive *self;
+    RsvgFilterContext *ctx;
+    RsvgIRect bounds;
+    guchar *in_pixels;
+    guchar *in2_pixels;
+    guchar *output_pixels;
+    gint rowstride;
+    gpointer data;              /* whatever else the primitive set up */
 };
 
+typedef void (*RsvgFilterBandFunc) (RsvgFilterBands * bands, gint y0, gint y1);
+
+typedef struct {
+    RsvgFilterBandFunc func;
+    RsvgFilterBands *bands;
+    gint y0, y1;
+    GMutex *lock;
+    GCond *done;
+    gint *pending;
+} RsvgFilterBandTask;
+
+#define RSVG_FILTER_MIN_BAND_ROWS 16
+
+static gint filter_threads = 0;        /* 0 until set or read from the environment */
+static GThreadPool *filter_pool = NULL;
+G_LOCK_DEFINE_STATIC (filter_pool);
+
+void
+rsvg_filter_set_threads (gint n_threads)
+{
+    G_LOCK (filter_pool);
+    filter_threads = MAX (n_threads, 1);
+    if (filter_pool && filter_threads > 1)
+        g_thread_pool_set_max_threads (filter_pool, filter_threads - 1, NULL);
+    G_UNLOCK (filter_pool);
+}
+
+static void
+rsvg_filter_band_task_run (gpointer data, gpointer user_data)
+{
+    RsvgFilterBandTask *task = data;
+
+    task->func (task->bands, task->y0, task->y1);
+
+    g_mutex_lock (task->lock);
+    if (--*task->pending == 0)
+        g_cond_signal (task->done);
+    g_mutex_unlock (task->lock);
+}
+
+/* the pool to hand bands to and how many threads to use, NULL if serial */
+static GThreadPool *
+rsvg_filter_get_pool (gint * n_threads)
+{
+    GThreadPool *pool = NULL;
+
+    G_LOCK (filter_pool);
+    if (filter_threads == 0) {
+        const char *value = g_getenv ("RSVG_FILTER_THREADS");
+
+        filter_threads = value ? MAX (atoi (value), 1) : 1;
+    }
+    *n_threads = filter_threads;
+    if (filter_threads > 1 && g_thread_supported ()) {
+        /* the calling thread takes a band too */
+        if (!filter_pool)
+            filter_pool = g_thread_pool_new (rsvg_filter_band_task_run, NULL,
+                                             filter_threads - 1, FALSE, NULL);
+        pool = filter_pool;
+    }
+    G_UNLOCK (filter_pool);
+
+    return pool;
+}
+
+static void
+rsvg_filter_run_bands (RsvgFilterBandFunc func, RsvgFilterBands * bands)
+{
+    RsvgFilterBandTask *tasks;
+    GThreadPool *pool;
+    GMutex *lock;
+    GCond *done;
+    gint rows, n_threads, n_bands, pending, i;
+
+    rows = bands->bounds.y1 - bands->bounds.y0;
+    if (rows <= 0 || bands->bounds.x1 <= bands->bounds.x0)
+        return;
+
+    pool = rsvg_filter_get_pool (&n_threads);
+    n_bands = MIN (n_threads, rows / RSVG_FILTER_MIN_BAND_ROWS);
+    if (pool == NULL || n_bands < 2) {
+        func (bands, bands->bounds.y0, bands->bounds.y1);
+        return;
+    }
+
+    lock = g_mutex_new ();
+    done = g_cond_new ();
+    pending = n_bands - 1;
+    tasks = g_new (RsvgFilterBandTask, n_bands);
+    for (i = 0; i < n_bands; i++) {
+        tasks[i].func = func;
+        tasks[i].bands = bands;
+        tasks[i].y0 = bands->bounds.y0 + rows * i / n_bands;
+        tasks[i].y1 = bands->bounds.y0 + rows * (i + 1) / n_bands;
+        tasks[i].lock = lock;
+        tasks[i].done = done;
+        tasks[i].pending = &pending;
+    }
+
+    for (i = 1; i < n_bands; i++)
+        g_thread_pool_push (pool, &tasks[i], NULL);
+    func (bands, tasks[0].y0, tasks[0].y1);
+
+    g_mutex_lock (lock);
+    while (pending > 0)
+        g_cond_wait (done, lock);
+    g_mutex_unlock (lock);
+
+    g_free (tasks);
+    g_cond_free (done);
+    g_mutex_free (lock);
+}
+
+/* the rows of a pointwise primitive, one render_span call each */
+static void
+rsvg_filter_pointwise_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgFilterPrimitive *self = bands->self;
+    gint x0 = bands->bounds.x0;
+    gint n = bands->bounds.x1 - bands->bounds.x0;
+    gint y;
+
+    for (y = y0; y < y1; y++) {
+        gsize offset = y * bands->rowstride + 4 * x0;
+
+        self->render_span (self, bands->ctx, bands->output_pixels + offset,
+                           bands->in_pixels + offset,
+                           bands->in2_pixels ? bands->in2_pixels + offset : NULL, n);
+    }
+}
+
 /*************************************************************/
 /*************************************************************/
 
@@ -85,6 +281,20 @@ rsvg_filter_primitive_render (RsvgFilterPrimitive * self, RsvgFilterContext * ct
     self->render (self, ctx);
 }
 
+static void
+rsvg_filter_primitive_get_inputs (RsvgFilterPrimitive * self, GPtrArray * names)
+{
+    if (self->get_inputs)
+        self->get_inputs (self, names);
+    else
+        g_ptr_array_add (names, self->in);
+}
+
+static void
+rsvg_filter_primitive_no_inputs (RsvgFilterPrimitive * self, GPtrArray * names)
+{
+}
+
 static RsvgIRect
 rsvg_filter_primitive_get_bounds (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
@@ -151,16 +361,91 @@ rsvg_filter_primitive_get_bounds (RsvgFilterPrimitive * self, RsvgFilterContext
     }
 }
 
-GdkPixbuf *
-_rsvg_pixbuf_new_cleared (GdkColorspace colorspace, gboolean has_alpha, int bits_per_sample,
-                          int width, int height)
+/* an image whose pixels are left as the pool had them */
+static RsvgFilterImage *
+rsvg_filter_image_new (RsvgFilterContext * ctx, gint width, gint height)
 {
-    GdkPixbuf *pb;
-    guchar *data;
+    RsvgFilterImage *image;
+
+    image = g_new (RsvgFilterImage, 1);
+    image->pixels = rsvg_buffer_pool_alloc (ctx->ctx->buffer_pool, (gsize) width * height * 4);
+    image->width = width;
+    image->height = height;
+    image->rowstride = width * 4;
+    image->ref_count = 1;
+
+    return image;
+}
+
+static RsvgFilterImage *
+rsvg_filter_image_new_cleared (RsvgFilterContext * ctx, gint width, gint height)
+{
+    RsvgFilterImage *image;
+
+    image = rsvg_filter_image_new (ctx, width, height);
+    memset (image->pixels, 0, (gsize) width * height * 4);
+
+    return image;
+}
+
+static RsvgFilterImage *
+rsvg_filter_image_ref (RsvgFilterImage * image)
+{
+    image->ref_count++;
+    return image;
+}
+
+static void
+rsvg_filter_image_unref (RsvgFilterImage * image)
+{
+    if (--image->ref_count > 0)
+        return;
+
+    rsvg_buffer_pool_free (image->pixels);
+    g_free (image);
+}
+
+static cairo_user_data_key_t rsvg_filter_image_key;
+
+/* a surface showing @image, which it keeps a reference to */
+static cairo_surface_t *
+rsvg_filter_image_to_surface (RsvgFilterImage * image)
+{
+    cairo_surface_t *surface;
+
+    surface = cairo_image_surface_create_for_data (image->pixels, CAIRO_FORMAT_ARGB32,
+                                                   image->width, image->height, image->rowstride);
+    cairo_surface_set_user_data (surface, &rsvg_filter_image_key, rsvg_filter_image_ref (image),
+                                 (cairo_destroy_func_t) rsvg_filter_image_unref);
 
-    pb = gdk_pixbuf_new (colorspace, has_alpha, bits_per_sample, width, height);
-    data = gdk_pixbuf_get_pixels (pb);
-    memset (data, 0, width * height * 4);
+    return surface;
+}
+
+/* The output of a primitive that writes every pixel of @bounds, with only
+   the pixels around them cleared. */
+static RsvgFilterImage *
+rsvg_filter_new_output (RsvgFilterContext * ctx, gint width, gint height, RsvgIRect bounds)
+{
+    RsvgFilterImage *pb;
+    guchar *data;
+    gint y;
+
+    pb = rsvg_filter_image_new (ctx, width, height);
+    data = pb->pixels;
+
+    bounds.x0 = CLAMP (bounds.x0, 0, width);
+    bounds.x1 = CLAMP (bounds.x1, bounds.x0, width);
+    bounds.y0 = CLAMP (bounds.y0, 0, height);
+    bounds.y1 = CLAMP (bounds.y1, bounds.y0, height);
+    if (bounds.x1 == bounds.x0)
+        bounds.y1 = bounds.y0;
+
+    memset (data, 0, (gsize) bounds.y0 * width * 4);
+    for (y = bounds.y0; y < bounds.y1; y++) {
+        memset (data + (gsize) y * width * 4, 0, bounds.x0 * 4);
+        memset (data + (gsize) y * width * 4 + bounds.x1 * 4, 0, (width - bounds.x1) * 4);
+    }
+    memset (data + (gsize) bounds.y1 * width * 4, 0, (gsize) (height - bounds.y1) * width * 4);
 
     return pb;
 }
@@ -221,9 +506,6 @@ rsvg_filter_fix_coordinate_system (RsvgFilterContext * ctx, RsvgState * state, R
     width = bbox.w;
     height = bbox.h;
 
-    ctx->width = gdk_pixbuf_get_width (ctx->source);
-    ctx->height = gdk_pixbuf_get_height (ctx->source);
-
     for (i = 0; i < 6; i++)
         ctx->affine[i] = state->affine[i];
     if (ctx->filter->filterunits == objectBoundingBox) {
@@ -238,9 +520,9 @@ rsvg_filter_fix_coordinate_system (RsvgFilterContext * ctx, RsvgState * state, R
     }
 }
 
-void
-rsvg_alpha_blt (GdkPixbuf * src, gint srcx, gint srcy, gint srcwidth,
-                gint srcheight, GdkPixbuf * dst, gint dstx, gint dsty)
+static void
+rsvg_alpha_blt (RsvgFilterImage * src, gint srcx, gint srcy, gint srcwidth,
+                gint srcheight, RsvgFilterImage * dst, gint dstx, gint dsty)
 {
     gint rightx;
     gint bottomy;
@@ -261,19 +543,19 @@ rsvg_alpha_blt (GdkPixbuf * src, gint srcx, gint srcy, gint srcwidth,
     rightx = srcx + srcwidth;
     bottomy = srcy + srcheight;
 
-    if (rightx > gdk_pixbuf_get_width (src))
-        rightx = gdk_pixbuf_get_width (src);
-    if (bottomy > gdk_pixbuf_get_height (src))
-        bottomy = gdk_pixbuf_get_height (src);
+    if (rightx > src->width)
+        rightx = src->width;
+    if (bottomy > src->height)
+        bottomy = src->height;
     srcwidth = rightx - srcx;
     srcheight = bottomy - srcy;
 
     rightx = dstx + dstwidth;
     bottomy = dsty + dstheight;
-    if (rightx > gdk_pixbuf_get_width (dst))
-        rightx = gdk_pixbuf_get_width (dst);
-    if (bottomy > gdk_pixbuf_get_height (dst))
-        bottomy = gdk_pixbuf_get_height (dst);
+    if (rightx > dst->width)
+        rightx = dst->width;
+    if (bottomy > dst->height)
+        bottomy = dst->height;
     dstwidth = rightx - dstx;
     dstheight = bottomy - dsty;
 
@@ -307,11 +589,11 @@ rsvg_alpha_blt (GdkPixbuf * src, gint srcx, gint srcy, gint srcwidth,
     if (dstoffsety > srcoffsety)
         srcoffsety = dstoffsety;
 
-    srcrowstride = gdk_pixbuf_get_rowstride (src);
-    dstrowstride = gdk_pixbuf_get_rowstride (dst);
+    srcrowstride = src->rowstride;
+    dstrowstride = dst->rowstride;
 
-    src_pixels = gdk_pixbuf_get_pixels (src);
-    dst_pixels = gdk_pixbuf_get_pixels (dst);
+    src_pixels = src->pixels;
+    dst_pixels = dst->pixels;
 
     for (y = srcoffsety; y < srcheight; y++)
         for (x = srcoffsetx; x < srcwidth; x++) {
@@ -431,13 +713,101 @@ rsvg_art_affine_image (const GdkPixbuf * img, GdkPixbuf * intermediate,
         }
 }
 
+static RsvgFilterAlpha *
+rsvg_filter_alpha_new (gint width, gint height)
+{
+    RsvgFilterAlpha *alpha;
+
+    alpha = g_new (RsvgFilterAlpha, 1);
+    alpha->pixels = g_new0 (guchar, (gsize) width * height);
+    alpha->width = width;
+    alpha->height = height;
+    alpha->ref_count = 1;
+
+    return alpha;
+}
+
+static RsvgFilterAlpha *
+rsvg_filter_alpha_ref (RsvgFilterAlpha * alpha)
+{
+    alpha->ref_count++;
+    return alpha;
+}
+
+static void
+rsvg_filter_alpha_unref (RsvgFilterAlpha * alpha)
+{
+    if (--alpha->ref_count > 0)
+        return;
+
+    g_free (alpha->pixels);
+    g_free (alpha);
+}
+
+static RsvgFilterAlpha *
+rsvg_filter_alpha_new_from_image (RsvgFilterImage * pb, RsvgFilterContext * ctx)
+{
+    RsvgFilterAlpha *alpha;
+    guchar *pbdata;
+    gint x, y, width, height, rowstride;
+
+    width = pb->width;
+    height = pb->height;
+    rowstride = pb->rowstride;
+    pbdata = pb->pixels;
+
+    alpha = rsvg_filter_alpha_new (width, height);
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            alpha->pixels[y * width + x] = pbdata[y * rowstride + x * 4 + RSVG_FILTER_ALPHA];
+
+    return alpha;
+}
+
+/* the image rsvg_filter_image_get_alpha() would have made */
+static RsvgFilterImage *
+rsvg_filter_alpha_to_image (RsvgFilterAlpha * alpha, RsvgFilterContext * ctx)
+{
+    RsvgFilterImage *output;
+    guchar *data;
+    gint x, y, rowstride;
+
+    output = rsvg_filter_image_new_cleared (ctx, alpha->width, alpha->height);
+    rowstride = output->rowstride;
+    data = output->pixels;
+
+    for (y = 0; y < alpha->height; y++)
+        for (x = 0; x < alpha->width; x++)
+            data[y * rowstride + x * 4 + RSVG_FILTER_ALPHA] = alpha->pixels[y * alpha->width + x];
+
+    return output;
+}
+
+static void
+rsvg_filter_output_ref (RsvgFilterPrimitiveOutput * output)
+{
+    if (output->result)
+        rsvg_filter_image_ref (output->result);
+    if (output->alpha)
+        rsvg_filter_alpha_ref (output->alpha);
+}
+
+static void
+rsvg_filter_output_unref (RsvgFilterPrimitiveOutput * output)
+{
+    if (output->result)
+        rsvg_filter_image_unref (output->result);
+    if (output->alpha)
+        rsvg_filter_alpha_unref (output->alpha);
+}
+
 static void
 rsvg_filter_free_pair (gpointer value)
 {
     RsvgFilterPrimitiveOutput *output;
 
     output = (RsvgFilterPrimitiveOutput *) value;
-    g_object_unref (output->result);
+    rsvg_filter_output_unref (output);
     g_free (output);
 }
 
@@ -448,187 +818,957 @@ rsvg_filter_context_free (RsvgFilterContext * ctx)
 	return;
 
     if (ctx->bg)
-	g_object_unref (ctx->bg);
+	rsvg_filter_image_unref (ctx->bg);
+    if (ctx->bg_alpha)
+	rsvg_filter_image_unref (ctx->bg_alpha);
 
     g_free (ctx);
 }
 
-/**
- * rsvg_filter_render: Create a new pixbuf applied the filter.
- * @self: a pointer to the filter to use
- * @source: a pointer to the source pixbuf
- * @context: the context
- *
- * This function will create a context for itself, set up the coordinate systems
- * execute all its little primatives and then clean up its own mess
- **/
-GdkPixbuf *
-rsvg_filter_render (RsvgFilter * self, GdkPixbuf * source,
-                    RsvgDrawingCtx * context, RsvgBbox * bounds, char *channelmap)
+static RsvgIRect
+rsvg_filter_primitive_get_input_bounds (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
-    RsvgFilterContext *ctx;
-    RsvgFilterPrimitive *current;
-    guint i;
-    GdkPixbuf *out;
-
+    RsvgIRect bounds;
 
-    ctx = g_new (RsvgFilterContext, 1);
-    ctx->filter = self;
-    ctx->source = source;
-    ctx->bg = NULL;
-    ctx->results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, rsvg_filter_free_pair);
-    ctx->ctx = context;
+    bounds = rsvg_filter_primitive_get_bounds (self, ctx);
+    if (self->get_input_bounds)
+        bounds = self->get_input_bounds (self, ctx, bounds);
 
-    g_object_ref (source);
+    return bounds;
+}
 
-    rsvg_filter_fix_coordinate_system (ctx, rsvg_current_state (context), *bounds);
+static gboolean
+rsvg_irect_is_empty (const RsvgIRect * rect)
+{
+    return rect->x1 <= rect->x0 || rect->y1 <= rect->y0;
+}
 
-    ctx->lastresult.result = source;
-    ctx->lastresult.Rused = 1;
-    ctx->lastresult.Gused = 1;
-    ctx->lastresult.Bused = 1;
-    ctx->lastresult.Aused = 1;
-    ctx->lastresult.bounds = rsvg_filter_primitive_get_bounds (NULL, ctx);
+static void
+rsvg_irect_union (RsvgIRect * dst, const RsvgIRect * src)
+{
+    if (rsvg_irect_is_empty (src))
+        return;
+    if (rsvg_irect_is_empty (dst)) {
+        *dst = *src;
+        return;
+    }
+    dst->x0 = MIN (dst->x0, src->x0);
+    dst->y0 = MIN (dst->y0, src->y0);
+    dst->x1 = MAX (dst->x1, src->x1);
+    dst->y1 = MAX (dst->y1, src->y1);
+}
 
-    for (i = 0; i < 4; i++)
-        ctx->channelmap[i] = channelmap[i] - '0';
+static void
+rsvg_irect_intersect (RsvgIRect * dst, const RsvgIRect * src)
+{
+    dst->x0 = MAX (dst->x0, src->x0);
+    dst->y0 = MAX (dst->y0, src->y0);
+    dst->x1 = MIN (dst->x1, src->x1);
+    dst->y1 = MIN (dst->y1, src->y1);
+}
 
-    for (i = 0; i < self->super.children->len; i++) {
-        current = g_ptr_array_index (self->super.children, i);
-        if (RSVG_NODE_IS_FILTER_PRIMITIVE (&current->super))
-            rsvg_filter_primitive_render (current, ctx);
-    }
+/* What the inputs of a primitive resolve to in the plan: the index of the
+   primitive whose result is read, or one of these. */
+#define RSVG_FILTER_INPUT_SOURCE_GRAPHIC -1
+#define RSVG_FILTER_INPUT_SOURCE_ALPHA -2
+#define RSVG_FILTER_INPUT_BACKGROUND -3
+
+/* A drop shadow, made by one of the two usual runs of primitives: blurring
+   and offsetting SourceAlpha, maybe tinting it with a flood, or tinting
+   SourceGraphic with a flood first and blurring and offsetting that, and
+   then putting SourceGraphic over the shadow. */
+typedef struct {
+    RsvgFilterPrimitive *members[5];
+    guint n_members;
+    RsvgFilterPrimitive *blur;
+    RsvgFilterPrimitive *offset;
+    RsvgFilterPrimitive *flood;     /* NULL for a black shadow */
+    gboolean tint_first;            /* the flood comes before the blur */
+} RsvgFilterDropShadow;
+
+typedef struct _RsvgFilterStep RsvgFilterStep;
+
+struct _RsvgFilterStep {
+    RsvgFilterPrimitive *primitive;
+    GPtrArray *release;         /* results nobody reads once this step is done */
+    /* A run of pointwise primitives that only feed each other is done in a
+       single pass. stages holds them in order, ending with @primitive, and
+       chained which of the inputs of each are the result of the one before,
+       bit 0 for in and bit 1 for in2. n_stages is 0 for a lone primitive. */
+    RsvgFilterPrimitive **stages;
+    guint *chained;
+    guint n_stages;
+    RsvgFilterDropShadow *shadow;   /* the primitives this step does at once, or NULL */
+};
 
-    out = ctx->lastresult.result;
+struct _RsvgFilterPlan {
+    RsvgFilterStep *steps;
+    guint n_steps;
+    GPtrArray *composed;        /* colour matrices standing in for two others */
+};
 
-    g_hash_table_destroy (ctx->results);
+static RsvgFilterPrimitive *rsvg_filter_primitive_colour_matrix_compose (RsvgFilterPrimitive * first,
+                                                                         RsvgFilterPrimitive * second);
+static void rsvg_filter_render_stages (RsvgFilterStep * step, RsvgFilterContext * ctx);
+static RsvgFilterDropShadow *rsvg_filter_drop_shadow_match (GPtrArray * primitives,
+                                                            GPtrArray ** inputs, gint * reads,
+                                                            guint first, gboolean fast);
+static void rsvg_filter_render_drop_shadow (RsvgFilterStep * step, RsvgFilterContext * ctx);
 
-    rsvg_filter_context_free (ctx);
+static gboolean
+rsvg_filter_is_unnamed (const char *name)
+{
+    return !strcmp (name, "") || !strcmp (name, "none");
+}
 
-    return out;
+static gboolean
+rsvg_filter_is_builtin_input (const char *name)
+{
+    return !strcmp (name, "SourceGraphic") || !strcmp (name, "SourceAlpha")
+        || !strcmp (name, "BackgroundImage") || !strcmp (name, "BackgroundAlpha");
 }
 
 /**
- * rsvg_filter_store_result: Files a result into a context.
- * @name: The name of the result
- * @result: The pointer to the result
- * @ctx: the context that this was called in
+ * rsvg_filter_plan_new: Compiles the primitives of a filter.
+ * @filter: the filter
+ * @fast: whether the output may be approximated
  *
- * Puts the new result into the hash for easy finding later, also
- * Stores it as the last result
+ * Resolves the in, in2 and result names of every primitive the same way
+ * rsvg_filter_get_result() will at render time, keeps only the primitives
+ * the final result depends on, and works out after which step each named
+ * result has been read for the last time, so that it can be dropped then
+ * rather than when the whole filter is done.
+ *
+ * A pointwise primitive whose result is only read by the pointwise primitive
+ * right after it is joined to it in one step, so that the pair is worked out
+ * a row at a time without the result in between ever filling a buffer.
+ * When @fast is set, colour matrices joined this way are also multiplied
+ * together, see rsvg_filter_primitive_colour_matrix_compose(). The
+ * primitives making up a drop shadow are likewise replaced by a single
+ * step, see rsvg_filter_drop_shadow_match().
+ *
+ * Setting RSVG_FILTER_NO_FUSION in the environment turns both off, for
+ * comparing against the primitives done one by one.
  **/
-static void
-rsvg_filter_store_output (GString * name, RsvgFilterPrimitiveOutput result, RsvgFilterContext * ctx)
+static RsvgFilterPlan *
+rsvg_filter_plan_new (RsvgFilter * filter, gboolean fast)
 {
-    RsvgFilterPrimitiveOutput *store;
-
-    g_object_unref (ctx->lastresult.result);
+    RsvgFilterPlan *plan;
+    GPtrArray *primitives, *names, **deps, **inputs;
+    GHashTable *defs;
+    gboolean *live, fuse;
+    gint *last_reader, *redefined_by, *step_of, *reads;
+    guint *chained;
+    guint i, j, n;
+
+    primitives = g_ptr_array_new ();
+    for (i = 0; i < filter->super.children->len; i++) {
+        RsvgFilterPrimitive *current = g_ptr_array_index (filter->super.children, i);
+        /* stray feMergeNodes render nothing */
+        if (RSVG_NODE_IS_FILTER_PRIMITIVE (&current->super)
+            && RSVG_NODE_TYPE (&current->super) != RSVG_NODE_TYPE_FILTER_PRIMITIVE_MERGE_NODE)
+            g_ptr_array_add (primitives, current);
+    }
+    n = primitives->len;
+
+    /* deps[i] holds 2 * producer + 1 for a read by name and 2 * producer for
+       a read of the previous result */
+    deps = g_new (GPtrArray *, n);
+    inputs = g_new (GPtrArray *, n);
+    live = g_new0 (gboolean, n);
+    last_reader = g_new (gint, n);
+    redefined_by = g_new (gint, n);
+    step_of = g_new (gint, n);
+    reads = g_new0 (gint, n);
+    chained = g_new0 (guint, n);
+    defs = g_hash_table_new (g_str_hash, g_str_equal);
+    names = g_ptr_array_new ();
+
+    for (i = 0; i < n; i++) {
+        RsvgFilterPrimitive *current = g_ptr_array_index (primitives, i);
+        const char *result = current->result->str;
+        gpointer producer;
+
+        deps[i] = g_ptr_array_new ();
+        inputs[i] = g_ptr_array_new ();
+        last_reader[i] = -1;
+        redefined_by[i] = -1;
+
+        g_ptr_array_set_size (names, 0);
+        rsvg_filter_primitive_get_inputs (current, names);
+        for (j = 0; j < names->len; j++) {
+            const char *name = ((GString *) g_ptr_array_index (names, j))->str;
+            gint input;
+
+            if (!strcmp (name, "SourceGraphic")) {
+                input = RSVG_FILTER_INPUT_SOURCE_GRAPHIC;
+            } else if (!strcmp (name, "SourceAlpha")) {
+                input = RSVG_FILTER_INPUT_SOURCE_ALPHA;
+            } else if (rsvg_filter_is_builtin_input (name)) {
+                input = RSVG_FILTER_INPUT_BACKGROUND;
+            } else if (!rsvg_filter_is_unnamed (name)
+                       && (producer = g_hash_table_lookup (defs, name))) {
+                input = GPOINTER_TO_INT (producer) - 1;
+                g_ptr_array_add (deps[i], GINT_TO_POINTER (2 * input + 1));
+            } else if (i > 0) {
+                /* unnamed and unknown inputs read the previous result */
+                input = i - 1;
+                g_ptr_array_add (deps[i], GINT_TO_POINTER (2 * input));
+            } else {
+                /* which before the first primitive is the source */
+                input = RSVG_FILTER_INPUT_SOURCE_GRAPHIC;
+            }
+            g_ptr_array_add (inputs[i], GINT_TO_POINTER (input));
 
-    store = g_new (RsvgFilterPrimitiveOutput, 1);
-    *store = result;
+            /* whether it is the result of the primitive before */
+            if (j < 2 && input >= 0 && input == (gint) i - 1)
+                chained[i] |= 1 << j;
+        }
 
-    if (strcmp (name->str, "")) {
-        g_object_ref (result.result);        /* increments the references for the table */
-        g_hash_table_insert (ctx->results, g_strdup (name->str), store);
+        if (strcmp (result, "")) {
+            if ((producer = g_hash_table_lookup (defs, result)))
+                redefined_by[GPOINTER_TO_INT (producer) - 1] = i;
+            g_hash_table_insert (defs, (gpointer) result, GINT_TO_POINTER (i + 1));
+        }
     }
 
-    g_object_ref (result.result);    /* increments the references for the last result */
-    ctx->lastresult = result;
-}
+    /* everything flows backwards, so one pass from the end finds what the
+       last primitive needs */
+    if (n > 0)
+        live[n - 1] = TRUE;
+    for (i = n; i > 0; i--) {
+        if (!live[i - 1])
+            continue;
+        for (j = 0; j < deps[i - 1]->len; j++) {
+            gint dep = GPOINTER_TO_INT (g_ptr_array_index (deps[i - 1], j));
+            live[dep / 2] = TRUE;
+            reads[dep / 2]++;
+            if (dep % 2)
+                last_reader[dep / 2] = MAX (last_reader[dep / 2], (gint) i - 1);
+        }
+    }
 
-static void
-rsvg_filter_store_result (GString * name, GdkPixbuf * result, RsvgFilterContext * ctx)
-{
-    RsvgFilterPrimitiveOutput output;
-    output.Rused = 1;
-    output.Gused = 1;
-    output.Bused = 1;
-    output.Aused = 1;
-    output.bounds.x0 = 0;
-    output.bounds.y0 = 0;
-    output.bounds.x1 = ctx->width;
-    output.bounds.y1 = ctx->height;
-    output.result = result;
+    plan = g_new (RsvgFilterPlan, 1);
+    plan->steps = g_new (RsvgFilterStep, n);
+    plan->n_steps = 0;
+    plan->composed = g_ptr_array_new ();
+    fuse = g_getenv ("RSVG_FILTER_NO_FUSION") == NULL;
 
-    rsvg_filter_store_output (name, output, ctx);
-}
+    for (i = 0; i < n; i++) {
+        RsvgFilterPrimitive *current = g_ptr_array_index (primitives, i);
+        RsvgFilterDropShadow *shadow;
+        RsvgFilterStep *step;
 
-static GdkPixbuf *
-pixbuf_get_alpha (GdkPixbuf * pb, RsvgFilterContext * ctx)
-{
-    guchar *data;
-    guchar *pbdata;
-    GdkPixbuf *output;
+        if (!live[i])
+            continue;
 
-    gsize i, pbsize;
+        if (fuse && (shadow = rsvg_filter_drop_shadow_match (primitives, inputs, reads, i, fast))) {
+            step = &plan->steps[plan->n_steps];
+            step->primitive = shadow->members[shadow->n_members - 1];
+            step->release = g_ptr_array_new ();
+            step->stages = NULL;
+            step->chained = NULL;
+            step->n_stages = 0;
+            step->shadow = shadow;
+            for (j = 0; j < shadow->n_members; j++)
+                step_of[i + j] = plan->n_steps;
+            plan->n_steps++;
+            i += shadow->n_members - 1;
+            continue;
+        }
 
-    pbsize = gdk_pixbuf_get_width (pb) * gdk_pixbuf_get_height (pb);
+        if (fuse && i > 0 && live[i - 1] && chained[i] && current->render_span
+            && ((RsvgFilterPrimitive *) g_ptr_array_index (primitives, i - 1))->render_span
+            && reads[i - 1] == (chained[i] == 3 ? 2 : 1)) {
+            /* nothing else reads the previous result, so do both at once */
+            step = &plan->steps[plan->n_steps - 1];
+            if (step->n_stages == 0) {
+                step->stages = g_new (RsvgFilterPrimitive *, n);
+                step->chained = g_new (guint, n);
+                step->stages[0] = step->primitive;
+                step->chained[0] = 0;
+                step->n_stages = 1;
+            }
+            step->stages[step->n_stages] = current;
+            step->chained[step->n_stages++] = chained[i];
+            step->primitive = current;
+            step_of[i] = plan->n_steps - 1;
+            continue;
+        }
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8,
-                                       gdk_pixbuf_get_width (pb), gdk_pixbuf_get_height (pb));
+        step = &plan->steps[plan->n_steps];
+        step->primitive = current;
+        step->release = g_ptr_array_new ();
+        step->stages = NULL;
+        step->chained = NULL;
+        step->n_stages = 0;
+        step->shadow = NULL;
+        step_of[i] = plan->n_steps++;
+    }
 
-    data = gdk_pixbuf_get_pixels (output);
-    pbdata = gdk_pixbuf_get_pixels (pb);
+    for (i = 0; i < plan->n_steps; i++) {
+        RsvgFilterStep *step = &plan->steps[i];
+        guint k = 0;
 
-    for (i = 0; i < pbsize; i++)
-        data[i * 4 + ctx->channelmap[3]] = pbdata[i * 4 + ctx->channelmap[3]];
+        for (j = 1; j < step->n_stages; j++) {
+            RsvgFilterPrimitive *composed = NULL;
 
-    return output;
-}
+            if (fast && step->chained[j] == 1)
+                composed = rsvg_filter_primitive_colour_matrix_compose (step->stages[k],
+                                                                        step->stages[j]);
+            if (composed) {
+                g_ptr_array_add (plan->composed, composed);
+                step->stages[k] = composed;
+            } else {
+                k++;
+                step->stages[k] = step->stages[j];
+                step->chained[k] = step->chained[j];
+            }
+        }
+        if (step->n_stages) {
+            step->n_stages = k + 1;
+            step->primitive = step->stages[k];
+        }
+    }
 
-static GdkPixbuf *
-rsvg_compile_bg (RsvgDrawingCtx * ctx)
-{
-    RsvgCairoRender *render = (RsvgCairoRender *) ctx->render;
-    cairo_t *cr;
-    cairo_surface_t *surface;
-    GList *i;
-    unsigned char *pixels = g_new0 (guint8, render->width * render->height * 4);
-    int rowstride = render->width * 4;
+    for (i = 0; i < n; i++) {
+        const char *result = ((RsvgFilterPrimitive *) g_ptr_array_index (primitives, i))->result->str;
+        gint release_at;
 
-    GdkPixbuf *output = gdk_pixbuf_new_from_data (pixels,
-                                                  GDK_COLORSPACE_RGB, TRUE, 8,
-                                                  render->width, render->height,
-                                                  rowstride,
-                                                  (GdkPixbufDestroyNotify) g_free,
-                                                  NULL);
+        /* unnamed results are only ever read through the last result */
+        if (!live[i] || !strcmp (result, ""))
+            continue;
 
-    surface = cairo_image_surface_create_for_data (pixels,
-                                                   CAIRO_FORMAT_ARGB32,
-                                                   render->width, render->height, rowstride);
+        release_at = rsvg_filter_is_unnamed (result) ? (gint) i : MAX (last_reader[i], (gint) i);
 
-    cr = cairo_create (surface);
-    cairo_surface_destroy (surface);
+        /* storing the redefinition already drops it from the table */
+        if (redefined_by[i] == release_at)
+            continue;
 
-    for (i = g_list_last (render->cr_stack); i != NULL; i = g_list_previous (i)) {
-        cairo_t *draw = i->data;
-        gboolean nest = draw != render->initial_cr;
-        cairo_set_source_surface (cr, cairo_get_target (draw),
-                                  nest ? 0 : -render->offset_x,
-                                  nest ? 0 : -render->offset_y);
-        cairo_paint (cr);
+        g_ptr_array_add (plan->steps[step_of[release_at]].release, (gpointer) result);
     }
 
-    cairo_destroy (cr);
-    return output;
+    for (i = 0; i < n; i++) {
+        g_ptr_array_free (deps[i], TRUE);
+        g_ptr_array_free (inputs[i], TRUE);
+    }
+    g_free (deps);
+    g_free (inputs);
+    g_free (live);
+    g_free (last_reader);
+    g_free (redefined_by);
+    g_free (step_of);
+    g_free (reads);
+    g_free (chained);
+    g_hash_table_destroy (defs);
+    g_ptr_array_free (names, TRUE);
+    g_ptr_array_free (primitives, TRUE);
+
+    return plan;
 }
 
-static GdkPixbuf *
-rsvg_filter_get_bg (RsvgFilterContext * ctx)
+static void
+rsvg_filter_plan_free (RsvgFilterPlan * plan)
 {
-    if (!ctx->bg)
-	ctx->bg = rsvg_compile_bg (ctx->ctx);
+    guint i;
+
+    if (!plan)
+        return;
+
+    for (i = 0; i < plan->n_steps; i++) {
+        g_ptr_array_free (plan->steps[i].release, TRUE);
+        g_free (plan->steps[i].stages);
+        g_free (plan->steps[i].chained);
+        g_free (plan->steps[i].shadow);
+    }
+    for (i = 0; i < plan->composed->len; i++) {
+        RsvgNode *node = g_ptr_array_index (plan->composed, i);
+        node->free (node);
+    }
+    g_ptr_array_free (plan->composed, TRUE);
+    g_free (plan->steps);
+    g_free (plan);
+}
+
+/* Walks the steps from the last one back to the first and collects the
+   area each of them writes and reads. Primitive subregions never leave the
+   filter region, so this is at most the filter region clipped to the source,
+   and often much less than the whole canvas. */
+static RsvgIRect
+rsvg_filter_get_roi (RsvgFilterPlan * plan, RsvgFilterContext * ctx)
+{
+    RsvgFilterPrimitive *current;
+    RsvgIRect region, roi, bounds;
+    guint i, j;
+
+    region = rsvg_filter_primitive_get_bounds (NULL, ctx);
+    roi.x0 = roi.y0 = roi.x1 = roi.y1 = 0;
+
+    for (i = plan->n_steps; i > 0; i--) {
+        RsvgFilterStep *step = &plan->steps[i - 1];
+
+        for (j = step->shadow ? step->shadow->n_members : MAX (step->n_stages, 1); j > 0; j--) {
+            if (step->shadow)
+                current = step->shadow->members[j - 1];
+            else
+                current = step->n_stages ? step->stages[j - 1] : step->primitive;
+
+            bounds = rsvg_filter_primitive_get_bounds (current, ctx);
+            rsvg_irect_union (&roi, &bounds);
+            bounds = rsvg_filter_primitive_get_input_bounds (current, ctx);
+            rsvg_irect_union (&roi, &bounds);
+        }
+    }
+
+    /* a filter without primitives passes the filter region through */
+    if (rsvg_irect_is_empty (&roi))
+        roi = region;
+
+    rsvg_irect_intersect (&roi, &region);
+    return roi;
+}
+
+/* Resampling, for filterRes and the fast filter quality. Every output
+   pixel is a weighted sum of source pixels along each axis: the ones it
+   covers, by how much it covers them, when shrinking, and the two nearest
+   ones when growing. The weights are never negative and add up to one, so
+   premultiplied pixels stay premultiplied. */
+
+#define RSVG_RESAMPLE_SHIFT 14
+
+typedef struct {
+    gint *first;                /* the first source pixel of each output pixel */
+    gint *weights;              /* n_taps of them for each output pixel */
+    gint n_taps;
+} RsvgResampleTaps;
+
+static void
+rsvg_resample_taps_init (RsvgResampleTaps * taps, gint src_len, gint dst_len)
+{
+    gdouble scale = (gdouble) src_len / dst_len;
+    gdouble *f;
+    gint i, j;
+
+    taps->n_taps = scale > 1 ? (gint) ceil (scale) + 1 : 2;
+    taps->first = g_new (gint, dst_len);
+    taps->weights = g_new0 (gint, dst_len * taps->n_taps);
+    f = g_new (gdouble, taps->n_taps);
+
+    for (i = 0; i < dst_len; i++) {
+        gint *w = taps->weights + i * taps->n_taps;
+        gint total = 0, largest = 0;
+
+        if (scale > 1) {
+            gdouble a = i * scale, b = MIN ((i + 1) * scale, src_len);
+
+            taps->first[i] = (gint) floor (a);
+            for (j = 0; j < taps->n_taps; j++) {
+                gdouble lo = MAX (a, taps->first[i] + j);
+                gdouble hi = MIN (b, taps->first[i] + j + 1);
+
+                f[j] = hi > lo ? (hi - lo) / scale : 0;
+            }
+        } else {
+            gdouble c = (i + 0.5) * scale - 0.5;
+
+            taps->first[i] = (gint) floor (c);
+            f[1] = c - taps->first[i];
+            f[0] = 1 - f[1];
+            if (taps->first[i] < 0) {
+                taps->first[i] = 0;
+                f[0] = 1;
+                f[1] = 0;
+            } else if (taps->first[i] >= src_len - 1) {
+                taps->first[i] = MAX (src_len - 2, 0);
+                f[0] = src_len > 1 ? 0 : 1;
+                f[1] = src_len > 1 ? 1 : 0;
+            }
+        }
+
+        /* so that a plain area comes out the same */
+        for (j = 0; j < taps->n_taps; j++) {
+            w[j] = (gint) (f[j] * (1 << RSVG_RESAMPLE_SHIFT) + 0.5);
+            total += w[j];
+            if (w[j] > w[largest])
+                largest = j;
+        }
+        w[largest] += (1 << RSVG_RESAMPLE_SHIFT) - total;
+    }
+
+    g_free (f);
+}
+
+static void
+rsvg_resample_taps_free (RsvgResampleTaps * taps)
+{
+    g_free (taps->first);
+    g_free (taps->weights);
+}
+
+/* Scales the @src_width x @src_height image at @src to @dst_width x
+   @dst_height at @dst. Both have @bpp bytes to a pixel. */
+static void
+rsvg_filter_resample (const guchar * src, gint src_stride, gint src_width, gint src_height,
+                      guchar * dst, gint dst_stride, gint dst_width, gint dst_height, gint bpp)
+{
+    RsvgResampleTaps xtaps, ytaps;
+    guchar *tmp;
+    gint tmp_stride = dst_width * bpp;
+    gint x, y, j, ch;
+
+    rsvg_resample_taps_init (&xtaps, src_width, dst_width);
+    rsvg_resample_taps_init (&ytaps, src_height, dst_height);
+    tmp = g_new (guchar, (gsize) tmp_stride * src_height);
+
+    for (y = 0; y < src_height; y++) {
+        const guchar *row = src + y * src_stride;
+        guchar *out = tmp + y * tmp_stride;
+
+        for (x = 0; x < dst_width; x++) {
+            const gint *w = xtaps.weights + x * xtaps.n_taps;
+            gint n = MIN (xtaps.n_taps, src_width - xtaps.first[x]);
+
+            for (ch = 0; ch < bpp; ch++) {
+                guint sum = 1 << (RSVG_RESAMPLE_SHIFT - 1);
+
+                for (j = 0; j < n; j++)
+                    sum += w[j] * row[(xtaps.first[x] + j) * bpp + ch];
+                out[x * bpp + ch] = sum >> RSVG_RESAMPLE_SHIFT;
+            }
+        }
+    }
+
+    for (y = 0; y < dst_height; y++) {
+        const gint *w = ytaps.weights + y * ytaps.n_taps;
+        gint n = MIN (ytaps.n_taps, src_height - ytaps.first[y]);
+        const guchar *in = tmp + ytaps.first[y] * tmp_stride;
+        guchar *out = dst + y * dst_stride;
+
+        for (x = 0; x < tmp_stride; x++) {
+            guint sum = 1 << (RSVG_RESAMPLE_SHIFT - 1);
+
+            for (j = 0; j < n; j++)
+                sum += w[j] * in[j * tmp_stride + x];
+            out[x] = sum >> RSVG_RESAMPLE_SHIFT;
+        }
+    }
+
+    g_free (tmp);
+    rsvg_resample_taps_free (&xtaps);
+    rsvg_resample_taps_free (&ytaps);
+}
+
+static RsvgFilterImage *
+rsvg_filter_scale_image (RsvgFilterImage * src, gint width, gint height, RsvgFilterContext * ctx)
+{
+    RsvgFilterImage *output;
+
+    output = rsvg_filter_image_new (ctx, width, height);
+    rsvg_filter_resample (src->pixels, src->rowstride, src->width, src->height,
+                          output->pixels, output->rowstride,
+                          width, height, 4);
+    return output;
+}
+
+/* How much smaller than the device pixels filterRes asks the intermediate
+   images to be along each axis. Both are 1 when it is not given, or when
+   it asks for more pixels than the filter region covers. */
+static void
+rsvg_filter_get_resolution_scale (RsvgFilterContext * ctx, gdouble * sx, gdouble * sy)
+{
+    RsvgFilter *filter = ctx->filter;
+    gdouble w, h;
+
+    *sx = *sy = 1.;
+    if (filter->filterres_x <= 0 || filter->filterres_y <= 0)
+        return;
+
+    if (filter->filterunits == objectBoundingBox)
+        _rsvg_push_view_box (ctx->ctx, 1., 1.);
+    w = _rsvg_css_normalize_length (&filter->width, ctx->ctx, 'h');
+    h = _rsvg_css_normalize_length (&filter->height, ctx->ctx, 'v');
+    if (filter->filterunits == objectBoundingBox)
+        _rsvg_pop_view_box (ctx->ctx);
+
+    /* the size of the whole filter region on the device */
+    w *= sqrt (ctx->affine[0] * ctx->affine[0] + ctx->affine[1] * ctx->affine[1]);
+    h *= sqrt (ctx->affine[2] * ctx->affine[2] + ctx->affine[3] * ctx->affine[3]);
+
+    if (w > filter->filterres_x)
+        *sx = filter->filterres_x / w;
+    if (h > filter->filterres_y)
+        *sy = filter->filterres_y / h;
+}
+
+static RsvgFilterImage *
+rsvg_filter_crop_source (cairo_surface_t * source, RsvgIRect roi, RsvgFilterContext * ctx)
+{
+    RsvgFilterImage *output;
+    guchar *src, *dst;
+    gint y, src_stride, dst_stride, width;
+
+    width = roi.x1 - roi.x0;
+    output = rsvg_filter_image_new (ctx, width, roi.y1 - roi.y0);
+
+    cairo_surface_flush (source);
+    src_stride = cairo_image_surface_get_stride (source);
+    dst_stride = output->rowstride;
+    src = cairo_image_surface_get_data (source) + roi.y0 * src_stride + roi.x0 * 4;
+    dst = output->pixels;
+
+    for (y = roi.y0; y < roi.y1; y++) {
+        memcpy (dst, src, width * 4);
+        src += src_stride;
+        dst += dst_stride;
+    }
+
+    return output;
+}
+
+/**
+ * rsvg_filter_render: Create a new surface applied the filter.
+ * @self: a pointer to the filter to use
+ * @source: a pointer to the source surface, an ARGB32 image surface
+ * @context: the context
+ * @roi: return location for the area of @source the result covers
+ *
+ * This function will create a context for itself, set up the coordinate systems
+ * execute all its little primatives and then clean up its own mess.
+ *
+ * The primitives only ever see the part of @source that the filter can
+ * touch, so every intermediate buffer is the size of @roi rather than the
+ * size of the canvas. The returned surface is that size too, and should be
+ * painted at (@roi->x0, @roi->y0). Returns %NULL if nothing is left to draw.
+ *
+ * Where filterRes asks for fewer pixels than that, the source is scaled
+ * down first, the primitives run on the smaller images, and the result is
+ * scaled back up to the size of @roi.
+ **/
+cairo_surface_t *
+rsvg_filter_render (RsvgFilter * self, cairo_surface_t * source,
+                    RsvgDrawingCtx * context, RsvgBbox * bounds, RsvgIRect * roi)
+{
+    RsvgFilterContext *ctx;
+    RsvgFilterPlan *plan;
+    guint i, j;
+    RsvgFilterImage *out;
+    cairo_surface_t *surface;
+    gdouble sx, sy;
+
+
+    ctx = g_new (RsvgFilterContext, 1);
+    ctx->filter = self;
+    ctx->width = cairo_image_surface_get_width (source);
+    ctx->height = cairo_image_surface_get_height (source);
+    ctx->source = NULL;
+    ctx->bg = NULL;
+    ctx->bg_alpha = NULL;
+    ctx->results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, rsvg_filter_free_pair);
+    ctx->ctx = context;
+
+    rsvg_filter_fix_coordinate_system (ctx, rsvg_current_state (context), *bounds);
+
+    if (context->filter_quality == RSVG_FILTER_QUALITY_FAST) {
+        if (!self->fast_plan)
+            self->fast_plan = rsvg_filter_plan_new (self, TRUE);
+        plan = self->fast_plan;
+    } else {
+        if (!self->plan)
+            self->plan = rsvg_filter_plan_new (self, FALSE);
+        plan = self->plan;
+    }
+
+    ctx->roi = rsvg_filter_get_roi (plan, ctx);
+    *roi = ctx->roi;
+    /* a filterRes of zero turns the element off */
+    if (rsvg_irect_is_empty (&ctx->roi) || self->filterres_x == 0 || self->filterres_y == 0) {
+        g_hash_table_destroy (ctx->results);
+        rsvg_filter_context_free (ctx);
+        return NULL;
+    }
+
+    /* from here on, pixel (0, 0) is the top left corner of the roi */
+    ctx->source = rsvg_filter_crop_source (source, ctx->roi, ctx);
+    ctx->width = ctx->roi.x1 - ctx->roi.x0;
+    ctx->height = ctx->roi.y1 - ctx->roi.y0;
+    ctx->affine[4] -= ctx->roi.x0;
+    ctx->affine[5] -= ctx->roi.y0;
+    ctx->paffine[4] -= ctx->roi.x0;
+    ctx->paffine[5] -= ctx->roi.y0;
+
+    rsvg_filter_get_resolution_scale (ctx, &sx, &sy);
+    if (sx < 1 || sy < 1) {
+        gint width = MAX (ceil (ctx->width * sx), 1);
+        gint height = MAX (ceil (ctx->height * sy), 1);
+        double scale[6] = { (double) width / ctx->width, 0, 0,
+            (double) height / ctx->height, 0, 0
+        };
+        RsvgFilterImage *scaled = rsvg_filter_scale_image (ctx->source, width, height, ctx);
+
+        rsvg_filter_image_unref (ctx->source);
+        ctx->source = scaled;
+        ctx->width = width;
+        ctx->height = height;
+        _rsvg_affine_multiply (ctx->affine, ctx->affine, scale);
+        _rsvg_affine_multiply (ctx->paffine, ctx->paffine, scale);
+    }
+
+    /* the last result holds a reference of its own, the context keeps the
+       one from cropping */
+    ctx->lastresult.result = rsvg_filter_image_ref (ctx->source);
+    ctx->lastresult.alpha = NULL;
+    ctx->lastresult.Rused = 1;
+    ctx->lastresult.Gused = 1;
+    ctx->lastresult.Bused = 1;
+    ctx->lastresult.Aused = 1;
+    ctx->lastresult.bounds = rsvg_filter_primitive_get_bounds (NULL, ctx);
+
+    for (i = 0; i < plan->n_steps; i++) {
+        RsvgFilterStep *step = &plan->steps[i];
+
+        if (step->shadow)
+            rsvg_filter_render_drop_shadow (step, ctx);
+        else if (step->n_stages)
+            rsvg_filter_render_stages (step, ctx);
+        else
+            rsvg_filter_primitive_render (step->primitive, ctx);
+        for (j = 0; j < step->release->len; j++)
+            g_hash_table_remove (ctx->results, g_ptr_array_index (step->release, j));
+    }
+
+    if (!ctx->lastresult.result)
+        ctx->lastresult.result = rsvg_filter_alpha_to_image (ctx->lastresult.alpha, ctx);
+    if (ctx->lastresult.alpha)
+        rsvg_filter_alpha_unref (ctx->lastresult.alpha);
+    out = ctx->lastresult.result;
+
+    if (ctx->width != roi->x1 - roi->x0 || ctx->height != roi->y1 - roi->y0) {
+        out = rsvg_filter_scale_image (ctx->lastresult.result,
+                                        roi->x1 - roi->x0, roi->y1 - roi->y0, ctx);
+        rsvg_filter_image_unref (ctx->lastresult.result);
+    }
+
+    g_hash_table_destroy (ctx->results);
+    rsvg_filter_image_unref (ctx->source);
+
+    rsvg_filter_context_free (ctx);
+
+    surface = rsvg_filter_image_to_surface (out);
+    rsvg_filter_image_unref (out);
+
+    return surface;
+}
+
+/**
+ * rsvg_filter_store_result: Files a result into a context.
+ * @name: The name of the result
+ * @result: The pointer to the result
+ * @ctx: the context that this was called in
+ *
+ * Puts the new result into the hash for easy finding later, also
+ * Stores it as the last result
+ **/
+static void
+rsvg_filter_store_output (GString * name, RsvgFilterPrimitiveOutput result, RsvgFilterContext * ctx)
+{
+    RsvgFilterPrimitiveOutput *store;
+
+    rsvg_filter_output_unref (&ctx->lastresult);
+
+    store = g_new (RsvgFilterPrimitiveOutput, 1);
+    *store = result;
+
+    if (strcmp (name->str, "")) {
+        rsvg_filter_output_ref (&result);      /* increments the references for the table */
+        g_hash_table_insert (ctx->results, g_strdup (name->str), store);
+    }
+
+    rsvg_filter_output_ref (&result);  /* increments the references for the last result */
+    ctx->lastresult = result;
+}
+
+static void
+rsvg_filter_store_result (GString * name, RsvgFilterImage * result, RsvgFilterContext * ctx)
+{
+    RsvgFilterPrimitiveOutput output;
+    output.Rused = 1;
+    output.Gused = 1;
+    output.Bused = 1;
+    output.Aused = 1;
+    output.bounds.x0 = 0;
+    output.bounds.y0 = 0;
+    output.bounds.x1 = ctx->width;
+    output.bounds.y1 = ctx->height;
+    output.result = result;
+    output.alpha = NULL;
+
+    rsvg_filter_store_output (name, output, ctx);
+}
+
+static RsvgFilterImage *
+rsvg_filter_image_get_alpha (RsvgFilterImage * pb, RsvgFilterContext * ctx)
+{
+    guchar *data;
+    guchar *pbdata;
+    RsvgFilterImage *output;
+
+    gsize i, pbsize;
+
+    pbsize = pb->width * pb->height;
+
+    output = rsvg_filter_image_new_cleared (ctx, pb->width, pb->height);
+
+    data = output->pixels;
+    pbdata = pb->pixels;
+
+    for (i = 0; i < pbsize; i++)
+        data[i * 4 + RSVG_FILTER_ALPHA] = pbdata[i * 4 + RSVG_FILTER_ALPHA];
+
+    return output;
+}
+
+/* paints the @roi part of @layer onto @cr */
+static void
+rsvg_compile_layer (cairo_t * cr, RsvgCairoRender * render, cairo_t * layer, RsvgIRect roi)
+{
+    gboolean nest = layer != render->initial_cr;
+
+    cairo_set_source_surface (cr, cairo_get_target (layer),
+                              (nest ? 0 : -render->offset_x) - roi.x0,
+                              (nest ? 0 : -render->offset_y) - roi.y0);
+    cairo_paint (cr);
+}
+
+/* Composites the @roi part of the layers from @bottom up to @top into
+   @output. The bottom layer is copied rather than composited, transparent
+   where it does not reach, so the pixels need no clearing first. */
+static void
+rsvg_compile_layers (RsvgCairoRender * render, GList * top, GList * bottom,
+                     RsvgIRect roi, RsvgFilterImage * output)
+{
+    cairo_t *cr;
+    cairo_surface_t *surface;
+    GList *i;
+
+    surface = rsvg_filter_image_to_surface (output);
+    cr = cairo_create (surface);
+    cairo_surface_destroy (surface);
+
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    for (i = bottom; i != top->prev; i = i->prev) {
+        rsvg_compile_layer (cr, render, i->data, roi);
+        cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+    }
+
+    cairo_destroy (cr);
+}
+
+/* The @roi part of the layers below the element being filtered. All but
+   the one the element is drawn into are kept composited in the renderer,
+   since nothing can draw into them while that one is open, and other
+   filters drawn into it reuse them. */
+static RsvgFilterImage *
+rsvg_compile_bg (RsvgFilterContext * ctx, RsvgIRect roi)
+{
+    RsvgCairoRender *render = (RsvgCairoRender *) ctx->ctx->render;
+    cairo_t *cr;
+    cairo_surface_t *surface;
+    GList *top = render->cr_stack;
+    guint depth = g_list_length (top);
+    RsvgIRect below_roi;
+    RsvgFilterImage *output = rsvg_filter_image_new (ctx, roi.x1 - roi.x0, roi.y1 - roi.y0);
+
+    if (depth == 0) {
+        memset (output->pixels, 0, (gsize) output->height * output->rowstride);
+        return output;
+    } else if (depth == 1) {
+        rsvg_compile_layers (render, top, top, roi, output);
+        return output;
+    }
+
+    below_roi = roi;
+    if (render->bg_below && render->bg_below_depth == depth - 1) {
+        /* grow it to cover what every filter at this level has asked for */
+        below_roi.x0 = MIN (render->bg_below_roi.x0, roi.x0);
+        below_roi.y0 = MIN (render->bg_below_roi.y0, roi.y0);
+        below_roi.x1 = MAX (render->bg_below_roi.x1, roi.x1);
+        below_roi.y1 = MAX (render->bg_below_roi.y1, roi.y1);
+    }
+
+    if (!render->bg_below || render->bg_below_depth != depth - 1
+        || below_roi.x0 != render->bg_below_roi.x0 || below_roi.y0 != render->bg_below_roi.y0
+        || below_roi.x1 != render->bg_below_roi.x1 || below_roi.y1 != render->bg_below_roi.y1) {
+        RsvgFilterImage *below = rsvg_filter_image_new (ctx, below_roi.x1 - below_roi.x0,
+                                                        below_roi.y1 - below_roi.y0);
+
+        rsvg_compile_layers (render, top->next, g_list_last (top), below_roi, below);
+        if (render->bg_below)
+            cairo_surface_destroy (render->bg_below);
+        render->bg_below = rsvg_filter_image_to_surface (below);
+        render->bg_below_roi = below_roi;
+        render->bg_below_depth = depth - 1;
+        rsvg_filter_image_unref (below);
+    }
+
+    surface = rsvg_filter_image_to_surface (output);
+    cr = cairo_create (surface);
+    cairo_surface_destroy (surface);
+
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface (cr, render->bg_below,
+                              render->bg_below_roi.x0 - roi.x0, render->bg_below_roi.y0 - roi.y0);
+    cairo_paint (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+    rsvg_compile_layer (cr, render, top->data, roi);
+
+    cairo_destroy (cr);
+    return output;
+}
+
+static RsvgFilterImage *
+rsvg_filter_get_bg (RsvgFilterContext * ctx)
+{
+    if (!ctx->bg) {
+        ctx->bg = rsvg_compile_bg (ctx, ctx->roi);
+
+        /* filterRes scales the background along with the source */
+        if (ctx->bg->width != ctx->width || ctx->bg->height != ctx->height) {
+            RsvgFilterImage *scaled = rsvg_filter_scale_image (ctx->bg, ctx->width, ctx->height, ctx);
+
+            rsvg_filter_image_unref (ctx->bg);
+            ctx->bg = scaled;
+        }
+    }
 
     return ctx->bg;
 }
 
+/* the stored output a name other than the four built in ones refers to */
+static RsvgFilterPrimitiveOutput *
+rsvg_filter_lookup_output (GString * name, RsvgFilterContext * ctx)
+{
+    RsvgFilterPrimitiveOutput *outputpointer;
+
+    if (!strcmp (name->str, "") || !strcmp (name->str, "none"))
+        return &ctx->lastresult;
+
+    outputpointer = (RsvgFilterPrimitiveOutput *) (g_hash_table_lookup (ctx->results, name->str));
+    if (outputpointer == NULL) {
+        g_warning (_("%s not found\n"), name->str);
+        outputpointer = &ctx->lastresult;
+    }
+
+    return outputpointer;
+}
+
 /**
- * rsvg_filter_get_in: Gets a pixbuf for a primative.
- * @name: The name of the pixbuf
+ * rsvg_filter_get_result: Gets an image for a primative.
+ * @name: The name of the image
  * @ctx: the context that this was called in
  *
- * Returns: a pointer to the result that the name refers to, a special
- * Pixbuf if the name is a special keyword or NULL if nothing was found
+ * Returns: the result that the name refers to, a special image if the
+ * name is a special keyword or the last result if nothing was found. The
+ * caller owns a reference to its image, and alpha is always %NULL.
  **/
 static RsvgFilterPrimitiveOutput
 rsvg_filter_get_result (GString * name, RsvgFilterContext * ctx)
@@ -636,54 +1776,200 @@ rsvg_filter_get_result (GString * name, RsvgFilterContext * ctx)
     RsvgFilterPrimitiveOutput output;
     RsvgFilterPrimitiveOutput *outputpointer;
     output.bounds.x0 = output.bounds.x1 = output.bounds.y0 = output.bounds.y1 = 0;
+    output.alpha = NULL;
 
     if (!strcmp (name->str, "SourceGraphic")) {
-        g_object_ref (ctx->source);
+        rsvg_filter_image_ref (ctx->source);
         output.result = ctx->source;
         output.Rused = output.Gused = output.Bused = output.Aused = 1;
         return output;
     } else if (!strcmp (name->str, "BackgroundImage")) {
-        output.result = g_object_ref (rsvg_filter_get_bg (ctx));
+        output.result = rsvg_filter_image_ref (rsvg_filter_get_bg (ctx));
         output.Rused = output.Gused = output.Bused = output.Aused = 1;
         return output;
-    } else if (!strcmp (name->str, "") || !strcmp (name->str, "none") || !name) {
-        g_object_ref (ctx->lastresult.result);
-        output = ctx->lastresult;
-        return output;
     } else if (!strcmp (name->str, "SourceAlpha")) {
         output.Rused = output.Gused = output.Bused = 0;
         output.Aused = 1;
-        output.result = pixbuf_get_alpha (ctx->source, ctx);
+        output.result = rsvg_filter_image_get_alpha (ctx->source, ctx);
         return output;
     } else if (!strcmp (name->str, "BackgroundAlpha")) {
         output.Rused = output.Gused = output.Bused = 0;
         output.Aused = 1;
-        output.result = pixbuf_get_alpha (rsvg_filter_get_bg (ctx), ctx);
+        if (!ctx->bg_alpha)
+            ctx->bg_alpha = rsvg_filter_image_get_alpha (rsvg_filter_get_bg (ctx), ctx);
+        output.result = rsvg_filter_image_ref (ctx->bg_alpha);
         return output;
     }
 
-    outputpointer = (RsvgFilterPrimitiveOutput *) (g_hash_table_lookup (ctx->results, name->str));
+    outputpointer = rsvg_filter_lookup_output (name, ctx);
 
-    if (outputpointer != NULL) {
-        output = *outputpointer;
-        g_object_ref (output.result);
+    /* spread out once, for every later reader too */
+    if (!outputpointer->result)
+        outputpointer->result = rsvg_filter_alpha_to_image (outputpointer->alpha, ctx);
+
+    output = *outputpointer;
+    output.alpha = NULL;
+    rsvg_filter_image_ref (output.result);
+    return output;
+}
+
+/* Like rsvg_filter_get_result(), for the primitives that can work on alpha
+   alone: inputs that only hold alpha come back as just alpha, with result
+   %NULL, and anything else as an image. The caller owns a reference to
+   whichever is set. */
+static RsvgFilterPrimitiveOutput
+rsvg_filter_get_alpha_result (GString * name, RsvgFilterContext * ctx)
+{
+    RsvgFilterPrimitiveOutput output;
+
+    if (!strcmp (name->str, "SourceAlpha") || !strcmp (name->str, "BackgroundAlpha")) {
+        output.bounds.x0 = output.bounds.x1 = output.bounds.y0 = output.bounds.y1 = 0;
+        output.Rused = output.Gused = output.Bused = 0;
+        output.Aused = 1;
+        output.result = NULL;
+        output.alpha =
+            rsvg_filter_alpha_new_from_image (!strcmp (name->str, "SourceAlpha") ?
+                                               ctx->source : rsvg_filter_get_bg (ctx), ctx);
         return output;
+    } else if (rsvg_filter_is_builtin_input (name->str)) {
+        return rsvg_filter_get_result (name, ctx);
     }
 
-    g_warning (_("%s not found\n"), name->str);
-
-    output = ctx->lastresult;
-    g_object_ref (ctx->lastresult.result);
+    output = *rsvg_filter_lookup_output (name, ctx);
+    if (output.alpha) {
+        output.result = NULL;
+        rsvg_filter_alpha_ref (output.alpha);
+    } else {
+        rsvg_filter_image_ref (output.result);
+    }
     return output;
 }
 
-
-static GdkPixbuf *
+static RsvgFilterImage *
 rsvg_filter_get_in (GString * name, RsvgFilterContext * ctx)
 {
     return rsvg_filter_get_result (name, ctx).result;
 }
 
+/* what every band of a step made of several stages needs */
+typedef struct {
+    RsvgFilterStep *step;
+    RsvgIRect *bounds;          /* of each stage */
+    guchar **pixels;            /* the in and in2 of each stage, NULL if chained or unused */
+    gint *rowstrides;
+} RsvgFilterStages;
+
+static void
+rsvg_filter_render_stages_rows (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgFilterStages *stages = bands->data;
+    RsvgFilterStep *step = stages->step;
+    gint width = bands->bounds.x1 - bands->bounds.x0;
+    guchar *rows[2], *row, *previous;
+    gint y;
+    guint s, k;
+
+    /* the results in between only ever take up a row */
+    rows[0] = g_new (guchar, 4 * width);
+    rows[1] = g_new (guchar, 4 * width);
+
+    for (y = y0; y < y1; y++) {
+        previous = NULL;
+        for (s = 0; s < step->n_stages; s++) {
+            RsvgFilterPrimitive *stage = step->stages[s];
+            RsvgIRect *bounds = &stages->bounds[s];
+            const guchar *in[2];
+            gint x0 = MAX (bounds->x0, bands->bounds.x0);
+            gint x1 = MIN (bounds->x1, bands->bounds.x1);
+
+            if (s == step->n_stages - 1) {
+                row = bands->output_pixels + y * bands->rowstride + 4 * bands->bounds.x0;
+            } else {
+                /* outside its subregion a result is transparent */
+                row = rows[s % 2];
+                memset (row, 0, 4 * width);
+            }
+
+            if (y >= bounds->y0 && y < bounds->y1 && x1 > x0) {
+                for (k = 0; k < 2; k++) {
+                    if (step->chained[s] & (1 << k))
+                        in[k] = previous + 4 * (x0 - bands->bounds.x0);
+                    else if (stages->pixels[2 * s + k])
+                        in[k] = stages->pixels[2 * s + k] + y * stages->rowstrides[2 * s + k]
+                            + 4 * x0;
+                    else
+                        in[k] = NULL;
+                }
+                stage->render_span (stage, bands->ctx, row + 4 * (x0 - bands->bounds.x0),
+                                    in[0], in[1], x1 - x0);
+            }
+
+            previous = row;
+        }
+    }
+
+    g_free (rows[0]);
+    g_free (rows[1]);
+}
+
+/* Renders the stages of a step in one pass over the subregion of the last
+   one, a row at a time, and stores only the final result. */
+static void
+rsvg_filter_render_stages (RsvgFilterStep * step, RsvgFilterContext * ctx)
+{
+    RsvgFilterStages stages;
+    RsvgFilterBands bands;
+    RsvgFilterImage **inputs, *output;
+    GPtrArray *names;
+    guint s, k;
+
+    stages.step = step;
+    stages.bounds = g_new (RsvgIRect, step->n_stages);
+    stages.pixels = g_new0 (guchar *, 2 * step->n_stages);
+    stages.rowstrides = g_new0 (gint, 2 * step->n_stages);
+    inputs = g_new0 (RsvgFilterImage *, 2 * step->n_stages);
+    names = g_ptr_array_new ();
+
+    for (s = 0; s < step->n_stages; s++) {
+        stages.bounds[s] = rsvg_filter_primitive_get_bounds (step->stages[s], ctx);
+
+        g_ptr_array_set_size (names, 0);
+        rsvg_filter_primitive_get_inputs (step->stages[s], names);
+        for (k = 0; k < MIN (names->len, 2); k++) {
+            if (step->chained[s] & (1 << k))
+                continue;
+            inputs[2 * s + k] = rsvg_filter_get_in (g_ptr_array_index (names, k), ctx);
+            stages.pixels[2 * s + k] = inputs[2 * s + k]->pixels;
+            stages.rowstrides[2 * s + k] = inputs[2 * s + k]->rowstride;
+        }
+    }
+
+    output = rsvg_filter_image_new_cleared (ctx, ctx->width, ctx->height);
+
+    bands.self = step->primitive;
+    bands.ctx = ctx;
+    bands.bounds = stages.bounds[step->n_stages - 1];
+    bands.in_pixels = NULL;
+    bands.in2_pixels = NULL;
+    bands.output_pixels = output->pixels;
+    bands.rowstride = output->rowstride;
+    bands.data = &stages;
+
+    rsvg_filter_run_bands (rsvg_filter_render_stages_rows, &bands);
+
+    rsvg_filter_store_result (step->primitive->result, output, ctx);
+
+    for (k = 0; k < 2 * step->n_stages; k++)
+        if (inputs[k])
+            rsvg_filter_image_unref (inputs[k]);
+    rsvg_filter_image_unref (output);
+    g_ptr_array_free (names, TRUE);
+    g_free (inputs);
+    g_free (stages.bounds);
+    g_free (stages.pixels);
+    g_free (stages.rowstrides);
+}
+
 /**
  * rsvg_filter_parse: Looks up an allready created filter.
  * @defs: a pointer to the hash of definitions
@@ -738,6 +2024,13 @@ rsvg_filter_set_args (RsvgNode * self, RsvgHandle * ctx, RsvgPropertyBag * atts)
             filter->width = _rsvg_css_parse_length (value);
         if ((value = rsvg_property_bag_lookup (atts, "height")))
             filter->height = _rsvg_css_parse_length (value);
+        if ((value = rsvg_property_bag_lookup (atts, "filterRes"))) {
+            rsvg_css_parse_number_optional_number (value, &filter->filterres_x,
+                                                   &filter->filterres_y);
+            /* negative values are an error, and leave the default */
+            if (filter->filterres_x < 0 || filter->filterres_y < 0)
+                filter->filterres_x = filter->filterres_y = -1;
+        }
         if ((value = rsvg_property_bag_lookup (atts, "id")))
             rsvg_defs_register_name (ctx->priv->defs, value, &filter->super);
     }
@@ -748,6 +2041,16 @@ rsvg_filter_set_args (RsvgNode * self, RsvgHandle * ctx, RsvgPropertyBag * atts)
  *
  * Creates a blank filter and assigns default values to everything
  **/
+static void
+rsvg_filter_free (RsvgNode * self)
+{
+    RsvgFilter *filter = (RsvgFilter *) self;
+
+    rsvg_filter_plan_free (filter->plan);
+    rsvg_filter_plan_free (filter->fast_plan);
+    _rsvg_node_free (self);
+}
+
 RsvgNode *
 rsvg_new_filter (void)
 {
@@ -761,7 +2064,11 @@ rsvg_new_filter (void)
     filter->y = _rsvg_css_parse_length ("-10%");
     filter->width = _rsvg_css_parse_length ("120%");
     filter->height = _rsvg_css_parse_length ("120%");
+    filter->filterres_x = filter->filterres_y = -1;
+    filter->plan = NULL;
+    filter->fast_plan = NULL;
     filter->super.set_atts = rsvg_filter_set_args;
+    filter->super.free = rsvg_filter_free;
     return (RsvgNode *) filter;
 }
 
@@ -782,24 +2089,110 @@ struct _RsvgFilterPrimitiveBlend {
 };
 
 static void
-rsvg_filter_blend (RsvgFilterPrimitiveBlendMode mode, GdkPixbuf * in, GdkPixbuf * in2,
-                   GdkPixbuf * output, RsvgIRect boundarys, int *channelmap)
+rsvg_filter_blend_span (RsvgFilterPrimitiveBlendMode mode, guchar * output_pixels,
+                        const guchar * in_pixels, const guchar * in2_pixels, gint n)
 {
     guchar i;
-    gint x, y;
+    gint x;
+
+    for (x = 0; x < n; x++) {
+        double qr, cr, qa, qb, ca, cb, bca, bcb;
+        int ch;
+
+        qa = (double) in_pixels[4 * x + RSVG_FILTER_ALPHA] / 255.0;
+        qb = (double) in2_pixels[4 * x + RSVG_FILTER_ALPHA] / 255.0;
+        qr = 1 - (1 - qa) * (1 - qb);
+        cr = 0;
+        for (ch = 0; ch < 3; ch++) {
+            i = RSVG_FILTER_CHANNEL (ch);
+            ca = (double) in_pixels[4 * x + i] / 255.0;
+            cb = (double) in2_pixels[4 * x + i] / 255.0;
+            /*these are the ca and cb that are used in the non-standard blend functions */
+            bcb = (1 - qa) * cb + ca;
+            bca = (1 - qb) * ca + cb;
+            switch (mode) {
+            case normal:
+                cr = (1 - qa) * cb + ca;
+                break;
+            case multiply:
+                cr = (1 - qa) * cb + (1 - qb) * ca + ca * cb;
+                break;
+            case screen:
+                cr = cb + ca - ca * cb;
+                break;
+            case darken:
+                cr = MIN ((1 - qa) * cb + ca, (1 - qb) * ca + cb);
+                break;
+            case lighten:
+                cr = MAX ((1 - qa) * cb + ca, (1 - qb) * ca + cb);
+                break;
+            case softlight:
+                if (bcb < 0.5)
+                    cr = 2 * bca * bcb + bca * bca * (1 - 2 * bcb);
+                else
+                    cr = sqrt (bca) * (2 * bcb - 1) + (2 * bca) * (1 - bcb);
+                break;
+            case hardlight:
+                if (cb < 0.5)
+                    cr = 2 * bca * bcb;
+                else
+                    cr = 1 - 2 * (1 - bca) * (1 - bcb);
+                break;
+            case colordodge:
+                if (bcb == 1)
+                    cr = 1;
+                else
+                    cr = MIN (bca / (1 - bcb), 1);
+                break;
+            case colorburn:
+                if (bcb == 0)
+                    cr = 0;
+                else
+                    cr = MAX (1 - (1 - bca) / bcb, 0);
+                break;
+            case overlay:
+                if (bca < 0.5)
+                    cr = 2 * bca * bcb;
+                else
+                    cr = 1 - 2 * (1 - bca) * (1 - bcb);
+                break;
+            case exclusion:
+                cr = bca + bcb - 2 * bca * bcb;
+                break;
+            case difference:
+                cr = abs (bca - bcb);
+                break;
+            }
+            cr *= 255.0;
+            if (cr > 255)
+                cr = 255;
+            if (cr < 0)
+                cr = 0;
+            output_pixels[4 * x + i] = (guchar) cr;
+
+        }
+        output_pixels[4 * x + RSVG_FILTER_ALPHA] = qr * 255.0;
+    }
+}
+
+static void
+rsvg_filter_blend (RsvgFilterPrimitiveBlendMode mode, RsvgFilterImage * in, RsvgFilterImage * in2,
+                   RsvgFilterImage * output, RsvgIRect boundarys)
+{
+    gint y;
     gint rowstride, rowstride2, rowstrideo, height, width;
     guchar *in_pixels;
     guchar *in2_pixels;
     guchar *output_pixels;
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
-    rowstride = gdk_pixbuf_get_rowstride (in);
-    rowstride2 = gdk_pixbuf_get_rowstride (in2);
-    rowstrideo = gdk_pixbuf_get_rowstride (output);
+    height = in->height;
+    width = in->width;
+    rowstride = in->rowstride;
+    rowstride2 = in2->rowstride;
+    rowstrideo = output->rowstride;
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
-    in_pixels = gdk_pixbuf_get_pixels (in);
-    in2_pixels = gdk_pixbuf_get_pixels (in2);
+    output_pixels = output->pixels;
+    in_pixels = in->pixels;
+    in2_pixels = in2->pixels;
 
     if (boundarys.x0 < 0)
         boundarys.x0 = 0;
@@ -810,85 +2203,22 @@ rsvg_filter_blend (RsvgFilterPrimitiveBlendMode mode, GdkPixbuf * in, GdkPixbuf
     if (boundarys.y1 >= height)
         boundarys.y1 = height;
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            double qr, cr, qa, qb, ca, cb, bca, bcb;
-            int ch;
+    if (boundarys.x1 <= boundarys.x0)
+        return;
 
-            qa = (double) in_pixels[4 * x + y * rowstride + channelmap[3]] / 255.0;
-            qb = (double) in2_pixels[4 * x + y * rowstride2 + channelmap[3]] / 255.0;
-            qr = 1 - (1 - qa) * (1 - qb);
-            cr = 0;
-            for (ch = 0; ch < 3; ch++) {
-                i = channelmap[ch];
-                ca = (double) in_pixels[4 * x + y * rowstride + i] / 255.0;
-                cb = (double) in2_pixels[4 * x + y * rowstride2 + i] / 255.0;
-                /*these are the ca and cb that are used in the non-standard blend functions */
-                bcb = (1 - qa) * cb + ca;
-                bca = (1 - qb) * ca + cb;
-                switch (mode) {
-                case normal:
-                    cr = (1 - qa) * cb + ca;
-                    break;
-                case multiply:
-                    cr = (1 - qa) * cb + (1 - qb) * ca + ca * cb;
-                    break;
-                case screen:
-                    cr = cb + ca - ca * cb;
-                    break;
-                case darken:
-                    cr = MIN ((1 - qa) * cb + ca, (1 - qb) * ca + cb);
-                    break;
-                case lighten:
-                    cr = MAX ((1 - qa) * cb + ca, (1 - qb) * ca + cb);
-                    break;
-                case softlight:
-                    if (bcb < 0.5)
-                        cr = 2 * bca * bcb + bca * bca * (1 - 2 * bcb);
-                    else
-                        cr = sqrt (bca) * (2 * bcb - 1) + (2 * bca) * (1 - bcb);
-                    break;
-                case hardlight:
-                    if (cb < 0.5)
-                        cr = 2 * bca * bcb;
-                    else
-                        cr = 1 - 2 * (1 - bca) * (1 - bcb);
-                    break;
-                case colordodge:
-                    if (bcb == 1)
-                        cr = 1;
-                    else
-                        cr = MIN (bca / (1 - bcb), 1);
-                    break;
-                case colorburn:
-                    if (bcb == 0)
-                        cr = 0;
-                    else
-                        cr = MAX (1 - (1 - bca) / bcb, 0);
-                    break;
-                case overlay:
-                    if (bca < 0.5)
-                        cr = 2 * bca * bcb;
-                    else
-                        cr = 1 - 2 * (1 - bca) * (1 - bcb);
-                    break;
-                case exclusion:
-                    cr = bca + bcb - 2 * bca * bcb;
-                    break;
-                case difference:
-                    cr = abs (bca - bcb);
-                    break;
-                }
-                cr *= 255.0;
-                if (cr > 255)
-                    cr = 255;
-                if (cr < 0)
-                    cr = 0;
-                output_pixels[4 * x + y * rowstrideo + i] = (guchar) cr;
+    for (y = boundarys.y0; y < boundarys.y1; y++)
+        rsvg_filter_blend_span (mode, output_pixels + 4 * boundarys.x0 + y * rowstrideo,
+                                in_pixels + 4 * boundarys.x0 + y * rowstride,
+                                in2_pixels + 4 * boundarys.x0 + y * rowstride2,
+                                boundarys.x1 - boundarys.x0);
+}
 
-            }
-            output_pixels[4 * x + y * rowstrideo + channelmap[3]] = qr * 255.0;
-        }
+static void
+rsvg_filter_primitive_blend_render_span (RsvgFilterPrimitive * self, RsvgFilterContext * ctx,
+                                         guchar * out, const guchar * in, const guchar * in2,
+                                         gint n)
+{
+    rsvg_filter_blend_span (((RsvgFilterPrimitiveBlend *) self)->mode, out, in, in2, n);
 }
 
 
@@ -899,9 +2229,9 @@ rsvg_filter_primitive_blend_render (RsvgFilterPrimitive * self, RsvgFilterContex
 
     RsvgFilterPrimitiveBlend *upself;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
-    GdkPixbuf *in2;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
+    RsvgFilterImage *in2;
 
     upself = (RsvgFilterPrimitiveBlend *) self;
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
@@ -909,17 +2239,22 @@ rsvg_filter_primitive_blend_render (RsvgFilterPrimitive * self, RsvgFilterContex
     in = rsvg_filter_get_in (self->in, ctx);
     in2 = rsvg_filter_get_in (upself->in2, ctx);
 
-    output =
-        _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, gdk_pixbuf_get_width (in),
-                                  gdk_pixbuf_get_height (in));
+    output = rsvg_filter_image_new_cleared (ctx, in->width, in->height);
 
-    rsvg_filter_blend (upself->mode, in, in2, output, boundarys, ctx->channelmap);
+    rsvg_filter_blend (upself->mode, in, in2, output, boundarys);
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (in2);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (in2);
+    rsvg_filter_image_unref (output);
+}
+
+static void
+rsvg_filter_primitive_blend_get_inputs (RsvgFilterPrimitive * self, GPtrArray * names)
+{
+    g_ptr_array_add (names, self->in);
+    g_ptr_array_add (names, ((RsvgFilterPrimitiveBlend *) self)->in2);
 }
 
 static void
@@ -986,6 +2321,9 @@ rsvg_new_filter_primitive_blend (void)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = &rsvg_filter_primitive_blend_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = &rsvg_filter_primitive_blend_get_inputs;
+    filter->super.render_span = &rsvg_filter_primitive_blend_render_span;
     filter->super.super.free = &rsvg_filter_primitive_blend_free;
     filter->super.super.set_atts = rsvg_filter_primitive_blend_set_atts;
     return (RsvgNode *) filter;
@@ -996,34 +2334,149 @@ rsvg_new_filter_primitive_blend (void)
 
 typedef struct _RsvgFilterPrimitiveConvolveMatrix RsvgFilterPrimitiveConvolveMatrix;
 
-struct _RsvgFilterPrimitiveConvolveMatrix {
-    RsvgFilterPrimitive super;
-    double *KernelMatrix;
-    double divisor;
-    gint orderx, ordery;
-    double dx, dy;
-    double bias;
-    gint targetx, targety;
-    gboolean preservealpha;
-    gint edgemode;
-};
+struct _RsvgFilterPrimitiveConvolveMatrix {
+    RsvgFilterPrimitive super;
+    double *KernelMatrix;
+    double divisor;
+    gint orderx, ordery;
+    double dx, dy;
+    double bias;
+    gint targetx, targety;
+    gboolean preservealpha;
+    gint edgemode;
+    /* the kernel matrix in fixed point, its weights NULL if it will not go */
+    RsvgConvolveFixed fixed;
+};
+
+typedef struct {
+    double targetx, targety, dx, dy;
+} RsvgConvolveMatrixBands;
+
+/* Where the taps in row or column @s read from, or -1 for nowhere. */
+static gint
+rsvg_filter_primitive_convolve_matrix_edge (gint edgemode, gint s, gint lo, gint hi)
+{
+    if (s >= lo && s < hi)
+        return s;
+
+    if (edgemode == 0)
+        return s < lo ? lo : hi - 1;
+    if (edgemode == 1)
+        return lo + ((s - lo) % (hi - lo) + (hi - lo)) % (hi - lo);
+    return -1;
+}
+
+/* The kernel in fixed point, for whole pixel kernel units and targets.
+   The unpremultiplied pixels the taps reach, with the edge mode already
+   applied, are laid out once for the band, and rsvg_convolve() sums them
+   up. */
+static void
+rsvg_filter_primitive_convolve_matrix_render_fixed (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgFilterPrimitiveConvolveMatrix *upself = (RsvgFilterPrimitiveConvolveMatrix *) bands->self;
+    RsvgConvolveMatrixBands *convolve = bands->data;
+    RsvgFilterContext *ctx = bands->ctx;
+    RsvgIRect boundarys = bands->bounds;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    gint targetx = convolve->targetx, targety = convolve->targety;
+    gint dx = convolve->dx, dy = convolve->dy;
+    gint width = boundarys.x1 - boundarys.x0;
+    gint in_width = width + (upself->orderx - 1) * dx;
+    gint in_height = y1 - y0 + (upself->ordery - 1) * dy;
+    gint *columns, *sums;
+    guchar *plane;
+    gint x, y, c, sx, sy, umch, tempresult;
+    guchar ch;
+
+    if (width <= 0 || y1 <= y0)
+        return;
+
+    columns = g_new (gint, in_width);
+    plane = g_new (guchar, (gsize) in_width * in_height * 4);
+    sums = g_new (gint, (gsize) width * (y1 - y0) * 4);
+
+    for (c = 0; c < in_width; c++)
+        columns[c] = rsvg_filter_primitive_convolve_matrix_edge (upself->edgemode,
+                                                                 boundarys.x0 - targetx + c,
+                                                                 boundarys.x0, boundarys.x1);
+
+    for (y = 0; y < in_height; y++) {
+        sy = rsvg_filter_primitive_convolve_matrix_edge (upself->edgemode, y0 - targety + y,
+                                                         boundarys.y0, boundarys.y1);
+        for (c = 0; c < in_width; c++) {
+            guchar *p = plane + ((gsize) y * in_width + c) * 4;
+            guchar *src;
+            int alpha;
+
+            sx = columns[c];
+            if (sx < 0 || sy < 0) {
+                p[0] = p[1] = p[2] = p[3] = 0;
+                continue;
+            }
+
+            src = in_pixels + 4 * sx + sy * rowstride;
+            alpha = src[3];
+            for (ch = 0; ch < 4; ch++) {
+                if (ch == 3)
+                    p[ch] = alpha;
+                else if (alpha)
+                    p[ch] = src[ch] * 255 / alpha;
+                else
+                    p[ch] = 0;
+            }
+        }
+    }
+
+    rsvg_convolve (rsvg_convolve_best_kernel (), &upself->fixed, plane, in_width * 4, sums,
+                   width, y1 - y0, dx, dy);
+
+    for (y = y0; y < y1; y++)
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            gint *sum = sums + ((gsize) (y - y0) * width + x - boundarys.x0) * 4;
+
+            for (umch = 0; umch < 3 + !upself->preservealpha; umch++) {
+                ch = RSVG_FILTER_CHANNEL (umch);
+                tempresult = ldexp ((double) sum[ch], -upself->fixed.shift) / upself->divisor +
+                    upself->bias;
+
+                if (tempresult > 255)
+                    tempresult = 255;
+                if (tempresult < 0)
+                    tempresult = 0;
+
+                output_pixels[4 * x + y * rowstride + ch] = tempresult;
+            }
+            if (upself->preservealpha)
+                output_pixels[4 * x + y * rowstride + RSVG_FILTER_ALPHA] =
+                    in_pixels[4 * x + y * rowstride + RSVG_FILTER_ALPHA];
+            for (umch = 0; umch < 3; umch++) {
+                ch = RSVG_FILTER_CHANNEL (umch);
+                output_pixels[4 * x + y * rowstride + ch] =
+                    output_pixels[4 * x + y * rowstride + ch] *
+                    output_pixels[4 * x + y * rowstride + RSVG_FILTER_ALPHA] / 255;
+            }
+        }
+
+    g_free (columns);
+    g_free (plane);
+    g_free (sums);
+}
 
 static void
-rsvg_filter_primitive_convolve_matrix_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+rsvg_filter_primitive_convolve_matrix_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
 {
+    RsvgFilterPrimitiveConvolveMatrix *upself = (RsvgFilterPrimitiveConvolveMatrix *) bands->self;
+    RsvgConvolveMatrixBands *convolve = bands->data;
+    RsvgFilterContext *ctx = bands->ctx;
+    RsvgIRect boundarys = bands->bounds;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
     guchar ch;
     gint x, y;
     gint i, j;
-    gint rowstride, height, width;
-    RsvgIRect boundarys;
-
-    guchar *in_pixels;
-    guchar *output_pixels;
-
-    RsvgFilterPrimitiveConvolveMatrix *upself;
-
-    GdkPixbuf *output;
-    GdkPixbuf *in;
 
     gint sx, sy, kx, ky;
     guchar sval;
@@ -1032,33 +2485,15 @@ rsvg_filter_primitive_convolve_matrix_render (RsvgFilterPrimitive * self, RsvgFi
 
     gint tempresult;
 
-    upself = (RsvgFilterPrimitiveConvolveMatrix *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
-
-    in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
-
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
-
-    targetx = upself->targetx * ctx->paffine[0];
-    targety = upself->targety * ctx->paffine[3];
-
-    if (upself->dx != 0 || upself->dy != 0) {
-        dx = upself->dx * ctx->paffine[0];
-        dy = upself->dy * ctx->paffine[3];
-    } else
-        dx = dy = 1;
-
-    rowstride = gdk_pixbuf_get_rowstride (in);
+    targetx = convolve->targetx;
+    targety = convolve->targety;
+    dx = convolve->dx;
+    dy = convolve->dy;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
-    output_pixels = gdk_pixbuf_get_pixels (output);
-
-    for (y = boundarys.y0; y < boundarys.y1; y++)
+    for (y = y0; y < y1; y++)
         for (x = boundarys.x0; x < boundarys.x1; x++) {
             for (umch = 0; umch < 3 + !upself->preservealpha; umch++) {
-                ch = ctx->channelmap[umch];
+                ch = RSVG_FILTER_CHANNEL (umch);
                 sum = 0;
                 for (i = 0; i < upself->ordery; i++)
                     for (j = 0; j < upself->orderx; j++) {
@@ -1075,12 +2510,10 @@ rsvg_filter_primitive_convolve_matrix_render (RsvgFilterPrimitive * self, RsvgFi
                             if (sy >= boundarys.y1)
                                 sy = boundarys.y1 - 1;
                         } else if (upself->edgemode == 1) {
-                            if (sx < boundarys.x0 || (sx >= boundarys.x1))
-                                sx = boundarys.x0 + (sx - boundarys.x0) %
-                                    (boundarys.x1 - boundarys.x0);
-                            if (sy < boundarys.y0 || (sy >= boundarys.y1))
-                                sy = boundarys.y0 + (sy - boundarys.y0) %
-                                    (boundarys.y1 - boundarys.y0);
+                            sx = rsvg_filter_primitive_convolve_matrix_edge (1, sx, boundarys.x0,
+                                                                             boundarys.x1);
+                            sy = rsvg_filter_primitive_convolve_matrix_edge (1, sy, boundarys.y0,
+                                                                             boundarys.y1);
                         } else if (upself->edgemode == 2)
                             if (sx < boundarys.x0 || (sx >= boundarys.x1) ||
                                 sy < boundarys.y0 || (sy >= boundarys.y1))
@@ -1108,19 +2541,71 @@ rsvg_filter_primitive_convolve_matrix_render (RsvgFilterPrimitive * self, RsvgFi
                 output_pixels[4 * x + y * rowstride + ch] = tempresult;
             }
             if (upself->preservealpha)
-                output_pixels[4 * x + y * rowstride + ctx->channelmap[3]] =
-                    in_pixels[4 * x + y * rowstride + ctx->channelmap[3]];
+                output_pixels[4 * x + y * rowstride + RSVG_FILTER_ALPHA] =
+                    in_pixels[4 * x + y * rowstride + RSVG_FILTER_ALPHA];
             for (umch = 0; umch < 3; umch++) {
-                ch = ctx->channelmap[umch];
+                ch = RSVG_FILTER_CHANNEL (umch);
                 output_pixels[4 * x + y * rowstride + ch] =
                     output_pixels[4 * x + y * rowstride + ch] *
-                    output_pixels[4 * x + y * rowstride + ctx->channelmap[3]] / 255;
+                    output_pixels[4 * x + y * rowstride + RSVG_FILTER_ALPHA] / 255;
             }
         }
+}
+
+static void
+rsvg_filter_primitive_convolve_matrix_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+{
+    gint height, width;
+    RsvgFilterBands bands;
+    RsvgConvolveMatrixBands convolve;
+
+    RsvgFilterPrimitiveConvolveMatrix *upself;
+
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
+
+    upself = (RsvgFilterPrimitiveConvolveMatrix *) self;
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.data = &convolve;
+
+    in = rsvg_filter_get_in (self->in, ctx);
+    bands.in_pixels = in->pixels;
+
+    height = in->height;
+    width = in->width;
+
+    convolve.targetx = upself->targetx * ctx->paffine[0];
+    convolve.targety = upself->targety * ctx->paffine[3];
+
+    if (upself->dx != 0 || upself->dy != 0) {
+        convolve.dx = upself->dx * ctx->paffine[0];
+        convolve.dy = upself->dy * ctx->paffine[3];
+    } else
+        convolve.dx = convolve.dy = 1;
+
+    bands.rowstride = in->rowstride;
+
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
+    bands.output_pixels = output->pixels;
+
+    /* Fixed point gives the same output as doubles when the weights are
+       exact, and can be out by a little otherwise. */
+    if (upself->fixed.weights &&
+        (upself->fixed.exact || ctx->ctx->filter_quality == RSVG_FILTER_QUALITY_FAST) &&
+        convolve.targetx == floor (convolve.targetx) &&
+        convolve.targety == floor (convolve.targety) &&
+        convolve.dx == floor (convolve.dx) && convolve.dx >= 1 &&
+        convolve.dy == floor (convolve.dy) && convolve.dy >= 1)
+        rsvg_filter_run_bands (rsvg_filter_primitive_convolve_matrix_render_fixed, &bands);
+    else
+        rsvg_filter_run_bands (rsvg_filter_primitive_convolve_matrix_render_rows, &bands);
+
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -1132,6 +2617,7 @@ rsvg_filter_primitive_convolve_matrix_free (RsvgNode * self)
     g_string_free (upself->super.result, TRUE);
     g_string_free (upself->super.in, TRUE);
     g_free (upself->KernelMatrix);
+    rsvg_convolve_fixed_free (&upself->fixed);
     _rsvg_node_free (self);
 }
 
@@ -1223,6 +2709,11 @@ rsvg_filter_primitive_convolve_matrix_set_atts (RsvgNode * self,
     if (!has_target_y) {
         filter->targety = floor (filter->ordery / 2);
     }
+
+    rsvg_convolve_fixed_free (&filter->fixed);
+    if (filter->orderx > 0 && filter->ordery > 0)
+        rsvg_convolve_fixed_init (&filter->fixed, filter->KernelMatrix,
+                                  filter->orderx, filter->ordery);
 }
 
 RsvgNode *
@@ -1241,7 +2732,11 @@ rsvg_new_filter_primitive_convolve_matrix (void)
     filter->dy = 0;
     filter->preservealpha = FALSE;
     filter->edgemode = 0;
+    filter->fixed.weights = filter->fixed.row = filter->fixed.column = NULL;
     filter->super.render = &rsvg_filter_primitive_convolve_matrix_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_convolve_matrix_free;
     filter->super.super.set_atts = rsvg_filter_primitive_convolve_matrix_set_atts;
     return (RsvgNode *) filter;
@@ -1258,138 +2753,104 @@ struct _RsvgFilterPrimitiveGaussianBlur {
     double sdx, sdy;
 };
 
+/* Deviations, in pixels, from which on an axis is blurred with the recursive
+   Gaussian rather than three box passes. Smaller blurs, drop shadows mostly,
+   keep the box passes and the exact output they have always had. */
+#define RSVG_IIR_BLUR_MIN_SIGMA 10.0
+
+/* @in and @output hold @bpp bytes per pixel, either RGBA with the bits of
+   @channels picking the bytes to blur, or alpha alone */
 static void
-box_blur (GdkPixbuf * in, GdkPixbuf * output, guchar * intermediate, gint kw,
-          gint kh, RsvgIRect boundarys, RsvgFilterPrimitiveOutput op)
+fast_blur (guchar * in_pixels, guchar * output_pixels, gint rowstride, gint bpp,
+           gfloat sx, gfloat sy, RsvgIRect boundarys, guint channels)
 {
-    gint ch;
-    gint x, y;
-    gint rowstride, height, width;
-
-    guchar *in_pixels;
-    guchar *output_pixels;
-
-    gint sum;
-
+    RsvgBoxBlurKernel kernel;
+    gint kx, ky, pass;
+    gboolean iir_x, iir_y;
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
-
-    in_pixels = gdk_pixbuf_get_pixels (in);
-    output_pixels = gdk_pixbuf_get_pixels (output);
-
-    rowstride = gdk_pixbuf_get_rowstride (in);
-
-    if (kw > boundarys.x1 - boundarys.x0)
-        kw = boundarys.x1 - boundarys.x0;
-
-    if (kh > boundarys.y1 - boundarys.y0)
-        kh = boundarys.y1 - boundarys.y0;
+    kx = floor (sx * 3 * sqrt (2 * M_PI) / 4 + 0.5);
+    ky = floor (sy * 3 * sqrt (2 * M_PI) / 4 + 0.5);
 
+    if (kx < 1 && ky < 1)
+        return;
 
-    if (kw >= 1) {
-        for (ch = 0; ch < 4; ch++) {
-            switch (ch) {
-            case 0:
-                if (!op.Rused)
-                    continue;
-            case 1:
-                if (!op.Gused)
-                    continue;
-            case 2:
-                if (!op.Bused)
-                    continue;
-            case 3:
-                if (!op.Aused)
-                    continue;
-            }
-            for (y = boundarys.y0; y < boundarys.y1; y++) {
-                sum = 0;
-                for (x = boundarys.x0; x < boundarys.x0 + kw; x++) {
-                    sum += (intermediate[x % kw] = in_pixels[4 * x + y * rowstride + ch]);
+    iir_x = sx >= RSVG_IIR_BLUR_MIN_SIGMA;
+    iir_y = sy >= RSVG_IIR_BLUR_MIN_SIGMA;
+    if (iir_x)
+        kx = 0;
+    if (iir_y)
+        ky = 0;
 
-                    if (x - kw / 2 >= 0 && x - kw / 2 < boundarys.x1)
-                        output_pixels[4 * (x - kw / 2) + y * rowstride + ch] = sum / kw;
-                }
-                for (x = boundarys.x0 + kw; x < boundarys.x1; x++) {
-                    sum -= intermediate[x % kw];
-                    sum += (intermediate[x % kw] = in_pixels[4 * x + y * rowstride + ch]);
-                    output_pixels[4 * (x - kw / 2) + y * rowstride + ch] = sum / kw;
-                }
-                for (x = boundarys.x1; x < boundarys.x1 + kw; x++) {
-                    sum -= intermediate[x % kw];
+    kernel = rsvg_box_blur_best_kernel ();
 
-                    if (x - kw / 2 >= 0 && x - kw / 2 < boundarys.x1)
-                        output_pixels[4 * (x - kw / 2) + y * rowstride + ch] = sum / kw;
-                }
-            }
+    if (kx >= 1 || ky >= 1) {
+        for (pass = 0; pass < 3; pass++) {
+            if (bpp == 1)
+                rsvg_box_blur_alpha (in_pixels, output_pixels, rowstride, kx, ky, boundarys);
+            else
+                rsvg_box_blur (kernel, in_pixels, output_pixels, rowstride, kx, ky, boundarys,
+                               channels);
+            in_pixels = output_pixels;
         }
-        in_pixels = output_pixels;
     }
 
-    if (kh >= 1) {
-        for (ch = 0; ch < 4; ch++) {
-            switch (ch) {
-            case 0:
-                if (!op.Rused)
-                    continue;
-            case 1:
-                if (!op.Gused)
-                    continue;
-            case 2:
-                if (!op.Bused)
-                    continue;
-            case 3:
-                if (!op.Aused)
-                    continue;
-            }
-
-
-            for (x = boundarys.x0; x < boundarys.x1; x++) {
-                sum = 0;
-
-                for (y = boundarys.y0; y < boundarys.y0 + kh; y++) {
-                    sum += (intermediate[y % kh] = in_pixels[4 * x + y * rowstride + ch]);
-
-                    if (y - kh / 2 >= 0 && y - kh / 2 < boundarys.y1)
-                        output_pixels[4 * x + (y - kh / 2) * rowstride + ch] = sum / kh;
-                }
-                for (; y < boundarys.y1; y++) {
-                    sum -= intermediate[y % kh];
-                    sum += (intermediate[y % kh] = in_pixels[4 * x + y * rowstride + ch]);
-                    output_pixels[4 * x + (y - kh / 2) * rowstride + ch] = sum / kh;
-                }
-                for (; y < boundarys.y1 + kh; y++) {
-                    sum -= intermediate[y % kh];
+    if (!iir_x && !iir_y)
+        return;
 
-                    if (y - kh / 2 >= 0 && y - kh / 2 < boundarys.y1)
-                        output_pixels[4 * x + (y - kh / 2) * rowstride + ch] = sum / kh;
-                }
-            }
-        }
-    }
+    if (bpp == 1)
+        rsvg_iir_blur_alpha (in_pixels, output_pixels, rowstride,
+                             iir_x ? sx : 0, iir_y ? sy : 0, boundarys);
+    else
+        rsvg_iir_blur (in_pixels, output_pixels, rowstride,
+                       iir_x ? sx : 0, iir_y ? sy : 0, boundarys, channels);
 }
 
+/* With the fast filter quality, a blur with a deviation of at least twice
+   this many pixels is worked out on an image shrunk until it is about this,
+   and then scaled back up. It stays in reach of the recursive Gaussian, so
+   the blur keeps its shape. Shrinking never goes beyond
+   RSVG_FAST_MAX_FACTOR. */
+#define RSVG_FAST_BLUR_SIGMA RSVG_IIR_BLUR_MIN_SIGMA
+#define RSVG_FAST_MAX_FACTOR 16
+
+/* fast_blur(), but at a lower resolution where the quality allows it */
 static void
-fast_blur (GdkPixbuf * in, GdkPixbuf * output, gfloat sx,
-           gfloat sy, RsvgIRect boundarys, RsvgFilterPrimitiveOutput op)
+rsvg_filter_blur (RsvgFilterContext * ctx, guchar * in_pixels, guchar * output_pixels,
+                  gint rowstride, gint bpp, gfloat sx, gfloat sy, RsvgIRect bounds,
+                  guint channels)
 {
-    gint kx, ky;
-    guchar *intermediate;
-
-    kx = floor (sx * 3 * sqrt (2 * M_PI) / 4 + 0.5);
-    ky = floor (sy * 3 * sqrt (2 * M_PI) / 4 + 0.5);
-
-    if (kx < 1 && ky < 1)
+    gint width = bounds.x1 - bounds.x0;
+    gint height = bounds.y1 - bounds.y0;
+    gint fx, fy, small_width, small_height;
+    RsvgIRect small_bounds;
+    guchar *small;
+
+    fx = CLAMP ((gint) (sx / RSVG_FAST_BLUR_SIGMA), 1, RSVG_FAST_MAX_FACTOR);
+    fy = CLAMP ((gint) (sy / RSVG_FAST_BLUR_SIGMA), 1, RSVG_FAST_MAX_FACTOR);
+
+    if (ctx->ctx->filter_quality != RSVG_FILTER_QUALITY_FAST || (fx == 1 && fy == 1) ||
+        width <= 0 || height <= 0) {
+        fast_blur (in_pixels, output_pixels, rowstride, bpp, sx, sy, bounds, channels);
         return;
+    }
 
-    intermediate = g_new (guchar, MAX (kx, ky));
-
-    box_blur (in, output, intermediate, kx, ky, boundarys, op);
-    box_blur (output, output, intermediate, kx, ky, boundarys, op);
-    box_blur (output, output, intermediate, kx, ky, boundarys, op);
-
-    g_free (intermediate);
+    small_width = (width + fx - 1) / fx;
+    small_height = (height + fy - 1) / fy;
+    small = g_new (guchar, (gsize) small_width * small_height * bpp);
+    small_bounds.x0 = small_bounds.y0 = 0;
+    small_bounds.x1 = small_width;
+    small_bounds.y1 = small_height;
+
+    rsvg_filter_resample (in_pixels + bounds.y0 * rowstride + bounds.x0 * bpp, rowstride,
+                          width, height, small, small_width * bpp, small_width, small_height,
+                          bpp);
+    fast_blur (small, small, small_width * bpp, bpp,
+               sx * small_width / width, sy * small_height / height, small_bounds, channels);
+    rsvg_filter_resample (small, small_width * bpp, small_width, small_height,
+                          output_pixels + bounds.y0 * rowstride + bounds.x0 * bpp, rowstride,
+                          width, height, bpp);
+
+    g_free (small);
 }
 
 static void
@@ -1397,33 +2858,52 @@ rsvg_filter_primitive_gaussian_blur_render (RsvgFilterPrimitive * self, RsvgFilt
 {
     RsvgFilterPrimitiveGaussianBlur *upself;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterImage *output;
+    RsvgFilterAlpha *alpha;
     RsvgIRect boundarys;
     gfloat sdx, sdy;
     RsvgFilterPrimitiveOutput op;
+    guint channels = 0;
 
     upself = (RsvgFilterPrimitiveGaussianBlur *) self;
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
 
-    op = rsvg_filter_get_result (self->in, ctx);
-    in = op.result;
-
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8,
-                                       gdk_pixbuf_get_width (in), gdk_pixbuf_get_height (in));
+    op = rsvg_filter_get_alpha_result (self->in, ctx);
 
     /* scale the SD values */
     sdx = upself->sdx * ctx->paffine[0];
     sdy = upself->sdy * ctx->paffine[3];
 
-    fast_blur (in, output, sdx, sdy, boundarys, op);
+    if (op.alpha) {
+        alpha = rsvg_filter_alpha_new (op.alpha->width, op.alpha->height);
+        rsvg_filter_blur (ctx, op.alpha->pixels, alpha->pixels, alpha->width, 1, sdx, sdy,
+                          boundarys, 1);
+        rsvg_filter_alpha_unref (op.alpha);
+        op.alpha = alpha;
+    } else {
+        /* a channel is only blurred if it and all the ones after it are used */
+        if (op.Aused) {
+            channels |= 1 << 3;
+            if (op.Bused) {
+                channels |= 1 << 2;
+                if (op.Gused) {
+                    channels |= 1 << 1;
+                    if (op.Rused)
+                        channels |= 1 << 0;
+                }
+            }
+        }
+
+        output = rsvg_filter_image_new_cleared (ctx, op.result->width, op.result->height);
+        rsvg_filter_blur (ctx, op.result->pixels, output->pixels,
+                          output->rowstride, 4, sdx, sdy, boundarys, channels);
+        rsvg_filter_image_unref (op.result);
+        op.result = output;
+    }
 
-    op.result = output;
     op.bounds = boundarys;
     rsvg_filter_store_output (self->result, op, ctx);
-
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_output_unref (&op);
 }
 
 static void
@@ -1479,6 +2959,9 @@ rsvg_new_filter_primitive_gaussian_blur (void)
     filter->sdx = 0;
     filter->sdy = 0;
     filter->super.render = &rsvg_filter_primitive_gaussian_blur_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_gaussian_blur_free;
     filter->super.super.set_atts = rsvg_filter_primitive_gaussian_blur_set_atts;
     return (RsvgNode *) filter;
@@ -1494,46 +2977,57 @@ struct _RsvgFilterPrimitiveOffset {
     RsvgLength dx, dy;
 };
 
+/* the shift of an feOffset, in whole pixels */
+static void
+rsvg_filter_primitive_offset_get_shift (RsvgFilterPrimitive * self, RsvgFilterContext * ctx,
+                                        gint * ox, gint * oy)
+{
+    RsvgFilterPrimitiveOffset *upself = (RsvgFilterPrimitiveOffset *) self;
+    double dx, dy;
+
+    dx = _rsvg_css_normalize_length (&upself->dx, ctx->ctx, 'w');
+    dy = _rsvg_css_normalize_length (&upself->dy, ctx->ctx, 'v');
+
+    *ox = ctx->paffine[0] * dx + ctx->paffine[2] * dy;
+    *oy = ctx->paffine[1] * dx + ctx->paffine[3] * dy;
+}
+
 static void
 rsvg_filter_primitive_offset_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
     guchar ch;
     gint x, y;
-    gint rowstride, height, width;
+    gint rowstride, bpp;
     RsvgIRect boundarys;
 
     guchar *in_pixels;
     guchar *output_pixels;
 
-    RsvgFilterPrimitiveOutput out;
-    RsvgFilterPrimitiveOffset *upself;
-
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterPrimitiveOutput in, out;
 
-    double dx, dy;
-    int ox, oy;
+    gint ox, oy;
 
-    upself = (RsvgFilterPrimitiveOffset *) self;
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
 
-    in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
-
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
-
-    rowstride = gdk_pixbuf_get_rowstride (in);
-
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
-
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    in = rsvg_filter_get_alpha_result (self->in, ctx);
+    out = in;
 
-    dx = _rsvg_css_normalize_length (&upself->dx, ctx->ctx, 'w');
-    dy = _rsvg_css_normalize_length (&upself->dy, ctx->ctx, 'v');
+    if (in.alpha) {
+        out.alpha = rsvg_filter_alpha_new (in.alpha->width, in.alpha->height);
+        in_pixels = in.alpha->pixels;
+        output_pixels = out.alpha->pixels;
+        rowstride = in.alpha->width;
+        bpp = 1;
+    } else {
+        out.result = rsvg_filter_image_new_cleared (ctx, in.result->width, in.result->height);
+        in_pixels = in.result->pixels;
+        output_pixels = out.result->pixels;
+        rowstride = in.result->rowstride;
+        bpp = 4;
+        out.Rused = out.Gused = out.Bused = 1;
+    }
 
-    ox = ctx->paffine[0] * dx + ctx->paffine[2] * dy;
-    oy = ctx->paffine[1] * dx + ctx->paffine[3] * dy;
+    rsvg_filter_primitive_offset_get_shift (self, ctx, &ox, &oy);
 
     for (y = boundarys.y0; y < boundarys.y1; y++)
         for (x = boundarys.x0; x < boundarys.x1; x++) {
@@ -1542,23 +3036,19 @@ rsvg_filter_primitive_offset_render (RsvgFilterPrimitive * self, RsvgFilterConte
             if (y - oy < boundarys.y0 || y - oy >= boundarys.y1)
                 continue;
 
-            for (ch = 0; ch < 4; ch++) {
-                output_pixels[y * rowstride + x * 4 + ch] =
-                    in_pixels[(y - oy) * rowstride + (x - ox) * 4 + ch];
+            for (ch = 0; ch < bpp; ch++) {
+                output_pixels[y * rowstride + x * bpp + ch] =
+                    in_pixels[(y - oy) * rowstride + (x - ox) * bpp + ch];
             }
         }
 
-    out.result = output;
-    out.Rused = 1;
-    out.Gused = 1;
-    out.Bused = 1;
     out.Aused = 1;
     out.bounds = boundarys;
 
     rsvg_filter_store_output (self->result, out, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_output_unref (&in);
+    rsvg_filter_output_unref (&out);
 }
 
 static void
@@ -1615,6 +3105,9 @@ rsvg_new_filter_primitive_offset (void)
     filter->dy = _rsvg_css_parse_length ("0");
     filter->dx = _rsvg_css_parse_length ("0");
     filter->super.render = &rsvg_filter_primitive_offset_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_offset_free;
     filter->super.super.set_atts = rsvg_filter_primitive_offset_set_atts;
     return (RsvgNode *) filter;
@@ -1637,13 +3130,13 @@ rsvg_filter_primitive_merge_render (RsvgFilterPrimitive * self, RsvgFilterContex
 
     RsvgFilterPrimitiveMerge *upself;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
 
     upself = (RsvgFilterPrimitiveMerge *) self;
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, ctx->width, ctx->height);
+    output = rsvg_filter_image_new_cleared (ctx, ctx->width, ctx->height);
 
     for (i = 0; i < upself->super.super.children->len; i++) {
         RsvgFilterPrimitive *mn;
@@ -1653,12 +3146,26 @@ rsvg_filter_primitive_merge_render (RsvgFilterPrimitive * self, RsvgFilterContex
         in = rsvg_filter_get_in (mn->in, ctx);
         rsvg_alpha_blt (in, boundarys.x0, boundarys.y0, boundarys.x1 - boundarys.x0,
                         boundarys.y1 - boundarys.y0, output, boundarys.x0, boundarys.y0);
-        g_object_unref (in);
+        rsvg_filter_image_unref (in);
     }
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (output);
+    rsvg_filter_image_unref (output);
+}
+
+static void
+rsvg_filter_primitive_merge_get_inputs (RsvgFilterPrimitive * self, GPtrArray * names)
+{
+    guint i;
+
+    for (i = 0; i < self->super.children->len; i++) {
+        RsvgFilterPrimitive *mn;
+        mn = g_ptr_array_index (self->super.children, i);
+        if (RSVG_NODE_TYPE (&mn->super) != RSVG_NODE_TYPE_FILTER_PRIMITIVE_MERGE_NODE)
+            continue;
+        g_ptr_array_add (names, mn->in);
+    }
 }
 
 static void
@@ -1706,6 +3213,9 @@ rsvg_new_filter_primitive_merge (void)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = &rsvg_filter_primitive_merge_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = &rsvg_filter_primitive_merge_get_inputs;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_merge_free;
 
     filter->super.super.set_atts = rsvg_filter_primitive_merge_set_atts;
@@ -1748,6 +3258,9 @@ rsvg_new_filter_primitive_merge_node (void)
     filter->in = g_string_new ("none");
     filter->super.free = rsvg_filter_primitive_merge_node_free;
     filter->render = &rsvg_filter_primitive_merge_node_render;
+    filter->get_input_bounds = NULL;
+    filter->get_inputs = NULL;
+    filter->render_span = NULL;
     filter->super.set_atts = rsvg_filter_primitive_merge_node_set_atts;
     return (RsvgNode *) filter;
 }
@@ -1764,87 +3277,94 @@ struct _RsvgFilterPrimitiveColourMatrix {
 };
 
 static void
-rsvg_filter_primitive_colour_matrix_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+rsvg_filter_primitive_colour_matrix_render_span (RsvgFilterPrimitive * self,
+                                                 RsvgFilterContext * ctx, guchar * output_pixels,
+                                                 const guchar * in_pixels, const guchar * in2_pixels,
+                                                 gint n)
 {
+    RsvgFilterPrimitiveColourMatrix *upself = (RsvgFilterPrimitiveColourMatrix *) self;
     guchar ch;
-    gint x, y;
+    gint x;
     gint i;
-    gint rowstride, height, width;
-    RsvgIRect boundarys;
 
-    guchar *in_pixels;
-    guchar *output_pixels;
+    int sum;
 
-    RsvgFilterPrimitiveColourMatrix *upself;
+    for (x = 0; x < n; x++) {
+        int umch;
+        int alpha = in_pixels[4 * x + RSVG_FILTER_ALPHA];
+        if (!alpha)
+            for (umch = 0; umch < 4; umch++) {
+                sum = upself->KernelMatrix[umch * 5 + 4];
+                if (sum > 255)
+                    sum = 255;
+                if (sum < 0)
+                    sum = 0;
+                output_pixels[4 * x + RSVG_FILTER_CHANNEL (umch)] = sum;
+        } else
+            for (umch = 0; umch < 4; umch++) {
+                int umi;
+                ch = RSVG_FILTER_CHANNEL (umch);
+                sum = 0;
+                for (umi = 0; umi < 4; umi++) {
+                    i = RSVG_FILTER_CHANNEL (umi);
+                    if (umi != 3)
+                        sum += upself->KernelMatrix[umch * 5 + umi] *
+                            in_pixels[4 * x + i] / alpha;
+                    else
+                        sum += upself->KernelMatrix[umch * 5 + umi] *
+                            in_pixels[4 * x + i] / 255;
+                }
+                sum += upself->KernelMatrix[umch * 5 + 4];
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
 
-    int sum;
 
-    upself = (RsvgFilterPrimitiveColourMatrix *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
+                if (sum > 255)
+                    sum = 255;
+                if (sum < 0)
+                    sum = 0;
 
-    in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
+                output_pixels[4 * x + ch] = sum;
+            }
+        for (umch = 0; umch < 3; umch++) {
+            ch = RSVG_FILTER_CHANNEL (umch);
+            output_pixels[4 * x + ch] =
+                output_pixels[4 * x + ch] *
+                output_pixels[4 * x + RSVG_FILTER_ALPHA] / 255;
+        }
+    }
+}
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
+static void
+rsvg_filter_primitive_colour_matrix_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+{
+    gint height, width;
+    RsvgFilterBands bands;
 
-    rowstride = gdk_pixbuf_get_rowstride (in);
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            int umch;
-            int alpha = in_pixels[4 * x + y * rowstride + ctx->channelmap[3]];
-            if (!alpha)
-                for (umch = 0; umch < 4; umch++) {
-                    sum = upself->KernelMatrix[umch * 5 + 4];
-                    if (sum > 255)
-                        sum = 255;
-                    if (sum < 0)
-                        sum = 0;
-                    output_pixels[4 * x + y * rowstride + ctx->channelmap[umch]] = sum;
-            } else
-                for (umch = 0; umch < 4; umch++) {
-                    int umi;
-                    ch = ctx->channelmap[umch];
-                    sum = 0;
-                    for (umi = 0; umi < 4; umi++) {
-                        i = ctx->channelmap[umi];
-                        if (umi != 3)
-                            sum += upself->KernelMatrix[umch * 5 + umi] *
-                                in_pixels[4 * x + y * rowstride + i] / alpha;
-                        else
-                            sum += upself->KernelMatrix[umch * 5 + umi] *
-                                in_pixels[4 * x + y * rowstride + i] / 255;
-                    }
-                    sum += upself->KernelMatrix[umch * 5 + 4];
+    in = rsvg_filter_get_in (self->in, ctx);
+    bands.in_pixels = in->pixels;
+    bands.in2_pixels = NULL;
 
+    height = in->height;
+    width = in->width;
 
+    bands.rowstride = in->rowstride;
 
-                    if (sum > 255)
-                        sum = 255;
-                    if (sum < 0)
-                        sum = 0;
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
+    bands.output_pixels = output->pixels;
 
-                    output_pixels[4 * x + y * rowstride + ch] = sum;
-                }
-            for (umch = 0; umch < 3; umch++) {
-                ch = ctx->channelmap[umch];
-                output_pixels[4 * x + y * rowstride + ch] =
-                    output_pixels[4 * x + y * rowstride + ch] *
-                    output_pixels[4 * x + y * rowstride + ctx->channelmap[3]] / 255;
-            }
-        }
+    rsvg_filter_run_bands (rsvg_filter_pointwise_render_rows, &bands);
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -1985,12 +3505,94 @@ rsvg_new_filter_primitive_colour_matrix (void)
         filter->super.height.factor = 'n';
     filter->KernelMatrix = NULL;
     filter->super.render = &rsvg_filter_primitive_colour_matrix_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = &rsvg_filter_primitive_colour_matrix_render_span;
     filter->super.super.free = &rsvg_filter_primitive_colour_matrix_free;
 
     filter->super.super.set_atts = rsvg_filter_primitive_colour_matrix_set_atts;
     return (RsvgNode *) filter;
 }
 
+static gboolean
+rsvg_filter_primitive_same_subregion (RsvgFilterPrimitive * a, RsvgFilterPrimitive * b)
+{
+    RsvgLength *la[4] = { &a->x, &a->y, &a->width, &a->height };
+    RsvgLength *lb[4] = { &b->x, &b->y, &b->width, &b->height };
+    gint i;
+
+    for (i = 0; i < 4; i++)
+        if (la[i]->factor != lb[i]->factor
+            || (la[i]->factor != 'n' && la[i]->length != lb[i]->length))
+            return FALSE;
+    return TRUE;
+}
+
+/* A colour matrix doing the work of @first followed by @second, or NULL if
+   @first could clamp or changes alpha. This is an approximation: the
+   product's coefficients are rounded, and the values between the two are
+   no longer rounded through the alpha channel, so translucent pixels can
+   come out a step or two off. It is only used for the fast filter quality. */
+static RsvgFilterPrimitive *
+rsvg_filter_primitive_colour_matrix_compose (RsvgFilterPrimitive * first,
+                                             RsvgFilterPrimitive * second)
+{
+    RsvgFilterPrimitiveColourMatrix *composed;
+    gint *m1, *m2, *m;
+    gint r, c, k, lo, hi;
+
+    if (RSVG_NODE_TYPE (&first->super) != RSVG_NODE_TYPE_FILTER_PRIMITIVE_COLOUR_MATRIX
+        || RSVG_NODE_TYPE (&second->super) != RSVG_NODE_TYPE_FILTER_PRIMITIVE_COLOUR_MATRIX
+        || !rsvg_filter_primitive_same_subregion (first, second))
+        return NULL;
+
+    m1 = ((RsvgFilterPrimitiveColourMatrix *) first)->KernelMatrix;
+    m2 = ((RsvgFilterPrimitiveColourMatrix *) second)->KernelMatrix;
+    if (m1 == NULL || m2 == NULL)
+        return NULL;
+
+    if (m1[15] || m1[16] || m1[17] || m1[18] != 255 || m1[19])
+        return NULL;
+
+    for (r = 0; r < 3; r++) {
+        /* an offset would show up on transparent pixels */
+        if (m1[r * 5 + 4])
+            return NULL;
+        lo = hi = 0;
+        for (c = 0; c < 4; c++) {
+            if (m1[r * 5 + c] < 0)
+                lo += m1[r * 5 + c];
+            else
+                hi += m1[r * 5 + c];
+        }
+        if (lo < 0 || hi > 255)
+            return NULL;
+    }
+
+    m = g_new (gint, 20);
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            double sum = 0;
+
+            for (k = 0; k < 4; k++)
+                sum += (double) m2[r * 5 + k] * m1[k * 5 + c];
+            m[r * 5 + c] = floor (sum / 255. + 0.5);
+        }
+        m[r * 5 + 4] = m2[r * 5 + 4];
+    }
+
+    composed = (RsvgFilterPrimitiveColourMatrix *) rsvg_new_filter_primitive_colour_matrix ();
+    g_string_assign (composed->super.in, first->in->str);
+    g_string_assign (composed->super.result, second->result->str);
+    composed->super.x = second->x;
+    composed->super.y = second->y;
+    composed->super.width = second->width;
+    composed->super.height = second->height;
+    composed->KernelMatrix = m;
+
+    return &composed->super;
+}
+
 
 /*************************************************************/
 /*************************************************************/
@@ -2013,6 +3615,7 @@ struct _RsvgNodeComponentTransferFunc {
     gint offset;
     gdouble exponent;
     char channel;
+    guchar table[256];          /* the function for every input, clamped */
 };
 
 struct _RsvgFilterPrimitiveComponentTransfer {
@@ -2037,7 +3640,8 @@ table_component_transfer_func (gint C, RsvgNodeComponentTransferFunc * user_data
     k = (C * (user_data->nbTableValues - 1)) / 255;
 
     vk = user_data->tableValues[k];
-    vk1 = user_data->tableValues[k + 1];
+    /* the last value is reached at C = 255, with nothing after it */
+    vk1 = k + 1 < user_data->nbTableValues ? user_data->tableValues[k + 1] : vk;
 
     distancefromlast = (C * (user_data->nbTableValues - 1)) - k * 255;
 
@@ -2052,7 +3656,7 @@ discrete_component_transfer_func (gint C, RsvgNodeComponentTransferFunc * user_d
     if (!user_data->nbTableValues)
         return C;
 
-    k = (C * user_data->nbTableValues) / 255;
+    k = MIN ((C * user_data->nbTableValues) / 255, user_data->nbTableValues - 1);
 
     return user_data->tableValues[k];
 }
@@ -2082,31 +3686,31 @@ gamma_component_transfer_func (gint C, RsvgNodeComponentTransferFunc * user_data
                                                     user_data->exponent) + user_data->offset;
 }
 
+/* The input of every function is a single byte, so it is run once for
+   each possible value when the attributes are set and the render only
+   looks the results up. */
 static void
-rsvg_filter_primitive_component_transfer_render (RsvgFilterPrimitive *
-                                                 self, RsvgFilterContext * ctx)
+rsvg_component_transfer_function_compile (RsvgNodeComponentTransferFunc * data)
 {
-    gint x, y, c;
-    guint i;
-    gint temp;
-    gint rowstride, height, width;
-    RsvgIRect boundarys;
-    RsvgNodeComponentTransferFunc *channels[4];
-    ComponentTransferFunc functions[4];
-    guchar *inpix, outpix[4];
-    gint achan = ctx->channelmap[3];
-    guchar *in_pixels;
-    guchar *output_pixels;
+    gint C;
 
-    RsvgFilterPrimitiveComponentTransfer *upself;
+    for (C = 0; C < 256; C++)
+        data->table[C] = CLAMP (data->function (C, data), 0, 255);
+}
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
-    upself = (RsvgFilterPrimitiveComponentTransfer *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
+/* the table of each byte of a pixel, NULL where it is left alone */
+static void
+rsvg_filter_primitive_component_transfer_get_tables (RsvgFilterPrimitive * self,
+                                                     RsvgFilterContext * ctx,
+                                                     const guchar * tables[4])
+{
+    gint c;
+    guint i;
 
     for (c = 0; c < 4; c++) {
         char channel = "RGBA"[c];
+
+        tables[RSVG_FILTER_CHANNEL (c)] = NULL;
         for (i = 0; i < self->super.children->len; i++) {
             RsvgNode *child_node;
 
@@ -2115,58 +3719,83 @@ rsvg_filter_primitive_component_transfer_render (RsvgFilterPrimitive *
                 RsvgNodeComponentTransferFunc *temp = (RsvgNodeComponentTransferFunc *) child_node;
 
                 if (temp->channel == channel) {
-                    functions[ctx->channelmap[c]] = temp->function;
-                    channels[ctx->channelmap[c]] = temp;
+                    tables[RSVG_FILTER_CHANNEL (c)] = temp->table;
                     break;
                 }
             }
         }
-        if (i == self->super.children->len)
-            functions[ctx->channelmap[c]] = identity_component_transfer_func;
+    }
+}
+
+static void
+rsvg_filter_primitive_component_transfer_render_span (RsvgFilterPrimitive * self,
+                                                      RsvgFilterContext * ctx,
+                                                      guchar * output_pixels,
+                                                      const guchar * in_pixels,
+                                                      const guchar * in2_pixels, gint n)
+{
+    const guchar *tables[4];
+    const guchar *inpix;
+    gint x, c;
+    guchar outpix[4];
+    gint achan = RSVG_FILTER_ALPHA;
+
+    rsvg_filter_primitive_component_transfer_get_tables (self, ctx, tables);
+
+    for (x = 0; x < n; x++) {
+        inpix = in_pixels + x * 4;
+        for (c = 0; c < 4; c++) {
+            int inval;
+            if (c != achan) {
+                if (inpix[achan] == 0)
+                    inval = 0;
+                else
+                    inval = MIN (inpix[c] * 255 / inpix[achan], 255);
+            } else
+                inval = inpix[c];
 
+            outpix[c] = tables[c] ? tables[c][inval] : inval;
+        }
+        for (c = 0; c < 3; c++)
+            output_pixels[x * 4 + RSVG_FILTER_CHANNEL (c)] =
+                outpix[RSVG_FILTER_CHANNEL (c)] * outpix[achan] / 255;
+        output_pixels[x * 4 + achan] = outpix[achan];
     }
+}
+
+static void
+rsvg_filter_primitive_component_transfer_render (RsvgFilterPrimitive *
+                                                 self, RsvgFilterContext * ctx)
+{
+    gint height, width;
+    RsvgFilterBands bands;
+
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
+
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
 
     in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
+    bands.in_pixels = in->pixels;
+    bands.in2_pixels = NULL;
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
+    height = in->height;
+    width = in->width;
 
-    rowstride = gdk_pixbuf_get_rowstride (in);
+    bands.rowstride = in->rowstride;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    bands.output_pixels = output->pixels;
+
+    rsvg_filter_run_bands (rsvg_filter_pointwise_render_rows, &bands);
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            inpix = in_pixels + (y * rowstride + x * 4);
-            for (c = 0; c < 4; c++) {
-                int inval;
-                if (c != achan) {
-                    if (inpix[achan] == 0)
-                        inval = 0;
-                    else
-                        inval = inpix[c] * 255 / inpix[achan];
-                } else
-                    inval = inpix[c];
-
-                temp = functions[c] (inval, channels[c]);
-                if (temp > 255)
-                    temp = 255;
-                else if (temp < 0)
-                    temp = 0;
-                outpix[c] = temp;
-            }
-            for (c = 0; c < 3; c++)
-                output_pixels[y * rowstride + x * 4 + ctx->channelmap[c]] =
-                    outpix[ctx->channelmap[c]] * outpix[achan] / 255;
-            output_pixels[y * rowstride + x * 4 + achan] = outpix[achan];
-        }
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -2208,6 +3837,9 @@ rsvg_new_filter_primitive_component_transfer (void)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = &rsvg_filter_primitive_component_transfer_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = &rsvg_filter_primitive_component_transfer_render_span;
 
     filter->super.super.set_atts = rsvg_filter_primitive_component_transfer_set_atts;
 
@@ -2259,6 +3891,8 @@ rsvg_node_component_transfer_function_set_atts (RsvgNode * self,
             data->offset = g_ascii_strtod (value, NULL) * 255.;
         }
     }
+
+    rsvg_component_transfer_function_compile (data);
 }
 
 static void
@@ -2281,6 +3915,7 @@ rsvg_new_node_component_transfer_function (char channel)
     filter->super.set_atts = rsvg_node_component_transfer_function_set_atts;
     filter->function = identity_component_transfer_func;
     filter->nbTableValues = 0;
+    rsvg_component_transfer_function_compile (filter);
     return (RsvgNode *) filter;
 }
 
@@ -2299,9 +3934,6 @@ struct _RsvgFilterPrimitiveErode {
 static void
 rsvg_filter_primitive_erode_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
-    guchar ch, extreme;
-    gint x, y;
-    gint i, j;
     gint rowstride, height, width;
     RsvgIRect boundarys;
 
@@ -2310,61 +3942,57 @@ rsvg_filter_primitive_erode_render (RsvgFilterPrimitive * self, RsvgFilterContex
 
     RsvgFilterPrimitiveErode *upself;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
 
     gint kx, ky;
-    guchar val;
 
     upself = (RsvgFilterPrimitiveErode *) self;
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
 
     in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
+    in_pixels = in->pixels;
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
+    height = in->height;
+    width = in->width;
 
-    rowstride = gdk_pixbuf_get_rowstride (in);
+    rowstride = in->rowstride;
 
     /* scale the radius values */
     kx = upself->rx * ctx->paffine[0];
     ky = upself->ry * ctx->paffine[3];
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
+    output = rsvg_filter_image_new_cleared (ctx, width, height);
+
+    output_pixels = output->pixels;
+
+    rsvg_morphology (in_pixels, output_pixels, rowstride, width, height, kx, ky,
+                     boundarys, upself->mode != 0);
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    rsvg_filter_store_result (self->result, output, ctx);
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++)
-            for (ch = 0; ch < 4; ch++) {
-                if (upself->mode == 0)
-                    extreme = 255;
-                else
-                    extreme = 0;
-                for (i = -ky; i < ky + 1; i++)
-                    for (j = -kx; j < kx + 1; j++) {
-                        if (y + i >= height || y + i < 0 || x + j >= width || x + j < 0)
-                            continue;
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
+}
 
-                        val = in_pixels[(y + i) * rowstride + (x + j) * 4 + ch];
+static RsvgIRect
+rsvg_filter_primitive_erode_get_input_bounds (RsvgFilterPrimitive * self,
+                                              RsvgFilterContext * ctx, RsvgIRect bounds)
+{
+    RsvgFilterPrimitiveErode *upself;
+    gint kx, ky;
 
+    upself = (RsvgFilterPrimitiveErode *) self;
 
-                        if (upself->mode == 0) {
-                            if (extreme > val)
-                                extreme = val;
-                        } else {
-                            if (extreme < val)
-                                extreme = val;
-                        }
+    kx = ABS (upself->rx * ctx->paffine[0]);
+    ky = ABS (upself->ry * ctx->paffine[3]);
 
-                    }
-                output_pixels[y * rowstride + x * 4 + ch] = extreme;
-            }
-    rsvg_filter_store_result (self->result, output, ctx);
+    bounds.x0 -= kx;
+    bounds.y0 -= ky;
+    bounds.x1 += kx;
+    bounds.y1 += ky;
 
-    g_object_unref (in);
-    g_object_unref (output);
+    return bounds;
 }
 
 static void
@@ -2427,6 +4055,9 @@ rsvg_new_filter_primitive_erode (void)
     filter->ry = 0;
     filter->mode = 0;
     filter->super.render = &rsvg_filter_primitive_erode_render;
+    filter->super.get_input_bounds = &rsvg_filter_primitive_erode_get_input_bounds;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_erode_free;
     filter->super.super.set_atts = rsvg_filter_primitive_erode_set_atts;
     return (RsvgNode *) filter;
@@ -2450,130 +4081,143 @@ struct _RsvgFilterPrimitiveComposite {
 };
 
 static void
-rsvg_filter_primitive_composite_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+rsvg_filter_primitive_composite_render_span (RsvgFilterPrimitive * self, RsvgFilterContext * ctx,
+                                             guchar * output_pixels, const guchar * in_pixels,
+                                             const guchar * in2_pixels, gint n)
 {
+    RsvgFilterPrimitiveComposite *upself = (RsvgFilterPrimitiveComposite *) self;
     guchar i;
-    gint x, y;
-    gint rowstride, height, width;
-    RsvgIRect boundarys;
-
-    guchar *in_pixels;
-    guchar *in2_pixels;
-    guchar *output_pixels;
+    gint x;
 
-    RsvgFilterPrimitiveComposite *upself;
+    if (upself->mode == COMPOSITE_MODE_ARITHMETIC)
+        for (x = 0; x < n; x++) {
+            int qr, qa, qb;
+
+            qa = in_pixels[4 * x + 3];
+            qb = in2_pixels[4 * x + 3];
+            qr = (upself->k1 * qa * qb / 255 + upself->k2 * qa + upself->k3 * qb) / 255;
+
+            if (qr > 255)
+                qr = 255;
+            if (qr < 0)
+                qr = 0;
+            output_pixels[4 * x + 3] = qr;
+            if (qr)
+                for (i = 0; i < 3; i++) {
+                    int ca, cb, cr;
+                    ca = in_pixels[4 * x + i];
+                    cb = in2_pixels[4 * x + i];
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
-    GdkPixbuf *in2;
+                    cr = (ca * cb * upself->k1 / 255 + ca * upself->k2 +
+                          cb * upself->k3 + upself->k4 * qr) / 255;
+                    if (cr > qr)
+                        cr = qr;
+                    if (cr < 0)
+                        cr = 0;
+                    output_pixels[4 * x + i] = cr;
 
-    upself = (RsvgFilterPrimitiveComposite *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
+                }
+        }
 
-    in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
-    in2 = rsvg_filter_get_in (upself->in2, ctx);
-    in2_pixels = gdk_pixbuf_get_pixels (in2);
+    else
+        for (x = 0; x < n; x++) {
+            int qr, cr, qa, qb, ca, cb, Fa, Fb, Fab, Fo;
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
+            qa = in_pixels[4 * x + 3];
+            qb = in2_pixels[4 * x + 3];
+            cr = 0;
+            Fa = Fb = Fab = Fo = 0;
+            switch (upself->mode) {
+            case COMPOSITE_MODE_OVER:
+                Fa = 255;
+                Fb = 255 - qa;
+                break;
+            case COMPOSITE_MODE_IN:
+                Fa = qb;
+                Fb = 0;
+                break;
+            case COMPOSITE_MODE_OUT:
+                Fa = 255 - qb;
+                Fb = 0;
+                break;
+            case COMPOSITE_MODE_ATOP:
+                Fa = qb;
+                Fb = 255 - qa;
+                break;
+            case COMPOSITE_MODE_XOR:
+                Fa = 255 - qb;
+                Fb = 255 - qa;
+                break;
+            default:
+                break;
+            }
 
-    rowstride = gdk_pixbuf_get_rowstride (in);
+            qr = (Fa * qa + Fb * qb) / 255;
+            if (qr > 255)
+                qr = 255;
+            if (qr < 0)
+                qr = 0;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
-    output_pixels = gdk_pixbuf_get_pixels (output);
+            for (i = 0; i < 3; i++) {
+                ca = in_pixels[4 * x + i];
+                cb = in2_pixels[4 * x + i];
 
-    if (upself->mode == COMPOSITE_MODE_ARITHMETIC)
-        for (y = boundarys.y0; y < boundarys.y1; y++)
-            for (x = boundarys.x0; x < boundarys.x1; x++) {
-                int qr, qa, qb;
-
-                qa = in_pixels[4 * x + y * rowstride + 3];
-                qb = in2_pixels[4 * x + y * rowstride + 3];
-                qr = (upself->k1 * qa * qb / 255 + upself->k2 * qa + upself->k3 * qb) / 255;
-
-                if (qr > 255)
-                    qr = 255;
-                if (qr < 0)
-                    qr = 0;
-                output_pixels[4 * x + y * rowstride + 3] = qr;
-                if (qr)
-                    for (i = 0; i < 3; i++) {
-                        int ca, cb, cr;
-                        ca = in_pixels[4 * x + y * rowstride + i];
-                        cb = in2_pixels[4 * x + y * rowstride + i];
-
-                        cr = (ca * cb * upself->k1 / 255 + ca * upself->k2 +
-                              cb * upself->k3 + upself->k4 * qr) / 255;
-                        if (cr > qr)
-                            cr = qr;
-                        if (cr < 0)
-                            cr = 0;
-                        output_pixels[4 * x + y * rowstride + i] = cr;
+                cr = (ca * Fa + cb * Fb + ca * cb * Fab + Fo) / 255;
+                if (cr > qr)
+                    cr = qr;
+                if (cr < 0)
+                    cr = 0;
+                output_pixels[4 * x + i] = cr;
 
-                    }
             }
+            output_pixels[4 * x + 3] = qr;
+        }
+}
 
-    else
-        for (y = boundarys.y0; y < boundarys.y1; y++)
-            for (x = boundarys.x0; x < boundarys.x1; x++) {
-                int qr, cr, qa, qb, ca, cb, Fa, Fb, Fab, Fo;
+static void
+rsvg_filter_primitive_composite_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+{
+    gint height, width;
+    RsvgFilterBands bands;
 
-                qa = in_pixels[4 * x + y * rowstride + 3];
-                qb = in2_pixels[4 * x + y * rowstride + 3];
-                cr = 0;
-                Fa = Fb = Fab = Fo = 0;
-                switch (upself->mode) {
-                case COMPOSITE_MODE_OVER:
-                    Fa = 255;
-                    Fb = 255 - qa;
-                    break;
-                case COMPOSITE_MODE_IN:
-                    Fa = qb;
-                    Fb = 0;
-                    break;
-                case COMPOSITE_MODE_OUT:
-                    Fa = 255 - qb;
-                    Fb = 0;
-                    break;
-                case COMPOSITE_MODE_ATOP:
-                    Fa = qb;
-                    Fb = 255 - qa;
-                    break;
-                case COMPOSITE_MODE_XOR:
-                    Fa = 255 - qb;
-                    Fb = 255 - qa;
-                    break;
-                default:
-                    break;
-                }
+    RsvgFilterPrimitiveComposite *upself;
 
-                qr = (Fa * qa + Fb * qb) / 255;
-                if (qr > 255)
-                    qr = 255;
-                if (qr < 0)
-                    qr = 0;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
+    RsvgFilterImage *in2;
 
-                for (i = 0; i < 3; i++) {
-                    ca = in_pixels[4 * x + y * rowstride + i];
-                    cb = in2_pixels[4 * x + y * rowstride + i];
+    upself = (RsvgFilterPrimitiveComposite *) self;
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
 
-                    cr = (ca * Fa + cb * Fb + ca * cb * Fab + Fo) / 255;
-                    if (cr > qr)
-                        cr = qr;
-                    if (cr < 0)
-                        cr = 0;
-                    output_pixels[4 * x + y * rowstride + i] = cr;
+    in = rsvg_filter_get_in (self->in, ctx);
+    bands.in_pixels = in->pixels;
+    in2 = rsvg_filter_get_in (upself->in2, ctx);
+    bands.in2_pixels = in2->pixels;
 
-                }
-                output_pixels[4 * x + y * rowstride + 3] = qr;
-            }
+    height = in->height;
+    width = in->width;
+
+    bands.rowstride = in->rowstride;
+
+    output = rsvg_filter_image_new_cleared (ctx, width, height);
+    bands.output_pixels = output->pixels;
+
+    rsvg_filter_run_bands (rsvg_filter_pointwise_render_rows, &bands);
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (in2);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (in2);
+    rsvg_filter_image_unref (output);
+}
+
+static void
+rsvg_filter_primitive_composite_get_inputs (RsvgFilterPrimitive * self, GPtrArray * names)
+{
+    g_ptr_array_add (names, self->in);
+    g_ptr_array_add (names, ((RsvgFilterPrimitiveComposite *) self)->in2);
 }
 
 static void
@@ -2655,6 +4299,9 @@ rsvg_new_filter_primitive_composite (void)
     filter->k3 = 0;
     filter->k4 = 0;
     filter->super.render = &rsvg_filter_primitive_composite_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = &rsvg_filter_primitive_composite_get_inputs;
+    filter->super.render_span = &rsvg_filter_primitive_composite_render_span;
     filter->super.super.free = &rsvg_filter_primitive_composite_free;
     filter->super.super.set_atts = rsvg_filter_primitive_composite_set_atts;
     return (RsvgNode *) filter;
@@ -2663,6 +4310,20 @@ rsvg_new_filter_primitive_composite (void)
 /*************************************************************/
 /*************************************************************/
 
+/* the premultiplied flood colour, in RGBA order */
+static void
+rsvg_filter_primitive_flood_get_colour (RsvgFilterPrimitive * self, guchar pixcolour[4])
+{
+    guchar i;
+    guint32 colour = self->super.state->flood_color;
+    guint8 opacity = self->super.state->flood_opacity;
+
+    for (i = 0; i < 3; i++)
+        pixcolour[i] = (int) (((unsigned char *)
+                               (&colour))[2 - i]) * opacity / 255;
+    pixcolour[3] = opacity;
+}
+
 static void
 rsvg_filter_primitive_flood_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
@@ -2671,33 +4332,28 @@ rsvg_filter_primitive_flood_render (RsvgFilterPrimitive * self, RsvgFilterContex
     gint rowstride, height, width;
     RsvgIRect boundarys;
     guchar *output_pixels;
-    GdkPixbuf *output;
-    char pixcolour[4];
+    RsvgFilterImage *output;
+    guchar pixcolour[4];
     RsvgFilterPrimitiveOutput out;
 
-    guint32 colour = self->super.state->flood_color;
-    guint8 opacity = self->super.state->flood_opacity;
-
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
 
     height = ctx->height;
     width = ctx->width;
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
-    rowstride = gdk_pixbuf_get_rowstride (output);
+    output = rsvg_filter_new_output (ctx, width, height, boundarys);
+    rowstride = output->rowstride;
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    output_pixels = output->pixels;
 
-    for (i = 0; i < 3; i++)
-        pixcolour[i] = (int) (((unsigned char *)
-                               (&colour))[2 - i]) * opacity / 255;
-    pixcolour[3] = opacity;
+    rsvg_filter_primitive_flood_get_colour (self, pixcolour);
 
     for (y = boundarys.y0; y < boundarys.y1; y++)
         for (x = boundarys.x0; x < boundarys.x1; x++)
             for (i = 0; i < 4; i++)
-                output_pixels[4 * x + y * rowstride + ctx->channelmap[i]] = pixcolour[i];
+                output_pixels[4 * x + y * rowstride + RSVG_FILTER_CHANNEL (i)] = pixcolour[i];
 
     out.result = output;
+    out.alpha = NULL;
     out.Rused = 1;
     out.Gused = 1;
     out.Bused = 1;
@@ -2706,7 +4362,23 @@ rsvg_filter_primitive_flood_render (RsvgFilterPrimitive * self, RsvgFilterContex
 
     rsvg_filter_store_output (self->result, out, ctx);
 
-    g_object_unref (output);
+    rsvg_filter_image_unref (output);
+}
+
+static void
+rsvg_filter_primitive_flood_render_span (RsvgFilterPrimitive * self, RsvgFilterContext * ctx,
+                                         guchar * output_pixels, const guchar * in_pixels,
+                                         const guchar * in2_pixels, gint n)
+{
+    guchar i;
+    gint x;
+    guchar pixcolour[4];
+
+    rsvg_filter_primitive_flood_get_colour (self, pixcolour);
+
+    for (x = 0; x < n; x++)
+        for (i = 0; i < 4; i++)
+            output_pixels[4 * x + RSVG_FILTER_CHANNEL (i)] = pixcolour[i];
 }
 
 static void
@@ -2753,6 +4425,9 @@ rsvg_new_filter_primitive_flood (void)
     filter->result = g_string_new ("none");
     filter->x.factor = filter->y.factor = filter->width.factor = filter->height.factor = 'n';
     filter->render = &rsvg_filter_primitive_flood_render;
+    filter->get_input_bounds = NULL;
+    filter->get_inputs = &rsvg_filter_primitive_no_inputs;
+    filter->render_span = &rsvg_filter_primitive_flood_render_span;
     filter->super.free = &rsvg_filter_primitive_flood_free;
     filter->super.set_atts = rsvg_filter_primitive_flood_set_atts;
     return (RsvgNode *) filter;
@@ -2761,6 +4436,261 @@ rsvg_new_filter_primitive_flood (void)
 /*************************************************************/
 /*************************************************************/
 
+#define RSVG_FILTER_PRIMITIVE_IS(p, t) \
+    (RSVG_NODE_TYPE (&(p)->super) == RSVG_NODE_TYPE_FILTER_PRIMITIVE_ ## t)
+
+/* the input @index of primitive @i, as resolved by rsvg_filter_plan_new() */
+static gint
+rsvg_filter_drop_shadow_input (GPtrArray ** inputs, guint i, guint index)
+{
+    if (index >= inputs[i]->len)
+        return G_MININT;
+    return GPOINTER_TO_INT (g_ptr_array_index (inputs[i], index));
+}
+
+static gboolean
+rsvg_filter_drop_shadow_is_in (RsvgFilterPrimitive * p)
+{
+    return RSVG_FILTER_PRIMITIVE_IS (p, COMPOSITE)
+        && ((RsvgFilterPrimitiveComposite *) p)->mode == COMPOSITE_MODE_IN;
+}
+
+/**
+ * rsvg_filter_drop_shadow_match: Spots a drop shadow.
+ * @primitives: the primitives of a filter
+ * @inputs: what each of their inputs resolves to
+ * @reads: how often each result is read
+ * @first: where to look
+ * @fast: whether the output may be approximated
+ *
+ * Looks for either of
+ *
+ *   feGaussianBlur in=SourceAlpha, feOffset,
+ *   [feFlood, feComposite operator=in with the offset as in2]
+ *
+ *   feFlood, feComposite operator=in with SourceGraphic as in2,
+ *   feGaussianBlur, feOffset
+ *
+ * the second being what Inkscape writes, starting at @first and followed
+ * by an feMerge of the shadow and SourceGraphic or an feComposite of
+ * SourceGraphic over the shadow. Every result in between has to be read
+ * once, by the next part, and all of them have to cover the same
+ * subregion. The second is only taken with a black flood unless @fast is
+ * set, as a coloured flood is put on after the blur and may come out off
+ * by one.
+ *
+ * Returns: the primitives found, or %NULL
+ **/
+static RsvgFilterDropShadow *
+rsvg_filter_drop_shadow_match (GPtrArray * primitives, GPtrArray ** inputs, gint * reads,
+                               guint first, gboolean fast)
+{
+    RsvgFilterDropShadow match;
+    RsvgFilterPrimitive *p[5], *tail;
+    guchar colour[4];
+    guint n, i, t;
+
+    n = MIN (primitives->len - first, 5);
+    for (i = 0; i < n; i++)
+        p[i] = g_ptr_array_index (primitives, first + i);
+
+    match.flood = NULL;
+    match.tint_first = FALSE;
+
+    if (n >= 3 && RSVG_FILTER_PRIMITIVE_IS (p[0], GAUSSIAN_BLUR)
+        && rsvg_filter_drop_shadow_input (inputs, first, 0) == RSVG_FILTER_INPUT_SOURCE_ALPHA
+        && RSVG_FILTER_PRIMITIVE_IS (p[1], OFFSET)
+        && rsvg_filter_drop_shadow_input (inputs, first + 1, 0) == (gint) first) {
+        match.blur = p[0];
+        match.offset = p[1];
+        t = 2;
+        if (n == 5 && RSVG_FILTER_PRIMITIVE_IS (p[2], FLOOD) && rsvg_filter_drop_shadow_is_in (p[3])
+            && rsvg_filter_drop_shadow_input (inputs, first + 3, 0) == (gint) first + 2
+            && rsvg_filter_drop_shadow_input (inputs, first + 3, 1) == (gint) first + 1) {
+            match.flood = p[2];
+            t = 4;
+        }
+    } else if (n == 5 && RSVG_FILTER_PRIMITIVE_IS (p[0], FLOOD)
+               && rsvg_filter_drop_shadow_is_in (p[1])
+               && rsvg_filter_drop_shadow_input (inputs, first + 1, 0) == (gint) first
+               && rsvg_filter_drop_shadow_input (inputs, first + 1, 1) ==
+               RSVG_FILTER_INPUT_SOURCE_GRAPHIC
+               && RSVG_FILTER_PRIMITIVE_IS (p[2], GAUSSIAN_BLUR)
+               && rsvg_filter_drop_shadow_input (inputs, first + 2, 0) == (gint) first + 1
+               && RSVG_FILTER_PRIMITIVE_IS (p[3], OFFSET)
+               && rsvg_filter_drop_shadow_input (inputs, first + 3, 0) == (gint) first + 2) {
+        rsvg_filter_primitive_flood_get_colour (p[0], colour);
+        if (!fast && (colour[0] || colour[1] || colour[2]))
+            return NULL;
+        match.flood = p[0];
+        match.blur = p[2];
+        match.offset = p[3];
+        match.tint_first = TRUE;
+        t = 4;
+    } else {
+        return NULL;
+    }
+
+    /* the shadow is the result of p[t - 1] */
+    tail = p[t];
+    if (RSVG_FILTER_PRIMITIVE_IS (tail, MERGE)) {
+        if (inputs[first + t]->len != 2
+            || rsvg_filter_drop_shadow_input (inputs, first + t, 0) != (gint) (first + t - 1)
+            || rsvg_filter_drop_shadow_input (inputs, first + t, 1) !=
+            RSVG_FILTER_INPUT_SOURCE_GRAPHIC)
+            return NULL;
+    } else if (RSVG_FILTER_PRIMITIVE_IS (tail, COMPOSITE)) {
+        if (((RsvgFilterPrimitiveComposite *) tail)->mode != COMPOSITE_MODE_OVER
+            || rsvg_filter_drop_shadow_input (inputs, first + t, 0) !=
+            RSVG_FILTER_INPUT_SOURCE_GRAPHIC
+            || rsvg_filter_drop_shadow_input (inputs, first + t, 1) != (gint) (first + t - 1))
+            return NULL;
+    } else {
+        return NULL;
+    }
+
+    for (i = 0; i < t; i++)
+        if (reads[first + i] != 1)
+            return NULL;
+    for (i = 1; i <= t; i++)
+        if (!rsvg_filter_primitive_same_subregion (p[0], p[i]))
+            return NULL;
+
+    for (i = 0; i <= t; i++)
+        match.members[i] = p[i];
+    match.n_members = t + 1;
+
+    return g_memdup (&match, sizeof (match));
+}
+
+/* what every band of a drop shadow needs */
+typedef struct {
+    RsvgFilterAlpha *alpha;     /* blurred, not yet shifted */
+    gint ox, oy;
+    guchar colour[4];           /* premultiplied, RGBA order */
+    gboolean tinted;
+    gboolean tint_first;
+    gboolean merge;
+} RsvgDropShadowBands;
+
+static void
+rsvg_filter_drop_shadow_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgDropShadowBands *shadow = bands->data;
+    RsvgFilterContext *ctx = bands->ctx;
+    RsvgIRect bounds = bands->bounds;
+    gint x, y, i;
+
+    for (y = y0; y < y1; y++) {
+        const guchar *src = bands->in_pixels + y * bands->rowstride;
+        guchar *out = bands->output_pixels + y * bands->rowstride;
+        gint sy = y - shadow->oy;
+
+        for (x = bounds.x0; x < bounds.x1; x++) {
+            gint sx = x - shadow->ox;
+            gint qa, qb, qr, cb[3];
+
+            /* the shadow, as the offset and flood and composite make it */
+            qb = 0;
+            if (sx >= bounds.x0 && sx < bounds.x1 && sy >= bounds.y0 && sy < bounds.y1)
+                qb = shadow->alpha->pixels[sy * shadow->alpha->width + sx];
+
+            if (!shadow->tinted) {
+                cb[0] = cb[1] = cb[2] = 0;
+            } else if (shadow->tint_first) {
+                /* the flood colour, scaled to the blurred alpha */
+                for (i = 0; i < 3; i++)
+                    cb[i] = shadow->colour[3] ?
+                        MIN (qb * shadow->colour[i] / shadow->colour[3], qb) : 0;
+            } else {
+                for (i = 0; i < 3; i++)
+                    cb[i] = shadow->colour[i] * qb / 255;
+                qb = shadow->colour[3] * qb / 255;
+                for (i = 0; i < 3; i++)
+                    cb[i] = MIN (cb[i], qb);
+            }
+
+            /* and SourceGraphic over it */
+            qa = src[4 * x + RSVG_FILTER_ALPHA];
+            if (shadow->merge && !qa) {
+                for (i = 0; i < 3; i++)
+                    out[4 * x + RSVG_FILTER_CHANNEL (i)] = cb[i];
+                out[4 * x + RSVG_FILTER_ALPHA] = qb;
+                continue;
+            }
+
+            qr = qa + (255 - qa) * qb / 255;
+            for (i = 0; i < 3; i++) {
+                gint ch = RSVG_FILTER_CHANNEL (i);
+                gint cr = src[4 * x + ch] + cb[i] * (255 - qa) / 255;
+
+                out[4 * x + ch] = shadow->merge ? cr : MIN (cr, qr);
+            }
+            out[4 * x + RSVG_FILTER_ALPHA] = qr;
+        }
+    }
+}
+
+/* Does the primitives of @step->shadow in one go: blurs the alpha of the
+   source once, and then works out the shifted and tinted shadow with the
+   source over it a pixel at a time. The shadow is the same as the separate
+   primitives make, except that a coloured flood in front of the blur is
+   put on after it instead, which may be off by one; that form is only
+   matched for the fast filter quality. */
+static void
+rsvg_filter_render_drop_shadow (RsvgFilterStep * step, RsvgFilterContext * ctx)
+{
+    RsvgFilterDropShadow *match = step->shadow;
+    RsvgFilterPrimitiveGaussianBlur *blur = (RsvgFilterPrimitiveGaussianBlur *) match->blur;
+    RsvgDropShadowBands shadow;
+    RsvgFilterBands bands;
+    RsvgFilterAlpha *alpha;
+    RsvgIRect bounds;
+    RsvgFilterImage *output;
+    gsize i, size;
+
+    bounds = rsvg_filter_primitive_get_bounds (step->primitive, ctx);
+
+    shadow.tinted = match->flood != NULL;
+    shadow.tint_first = match->tint_first;
+    shadow.merge = RSVG_FILTER_PRIMITIVE_IS (step->primitive, MERGE);
+    if (shadow.tinted)
+        rsvg_filter_primitive_flood_get_colour (match->flood, shadow.colour);
+    rsvg_filter_primitive_offset_get_shift (match->offset, ctx, &shadow.ox, &shadow.oy);
+
+    alpha = rsvg_filter_alpha_new_from_image (ctx->source, ctx);
+    if (shadow.tinted && shadow.tint_first) {
+        /* the alpha feComposite in gives the flood */
+        size = (gsize) alpha->width * alpha->height;
+        for (i = 0; i < size; i++)
+            alpha->pixels[i] = alpha->pixels[i] * shadow.colour[3] / 255;
+    }
+    shadow.alpha = rsvg_filter_alpha_new (alpha->width, alpha->height);
+    rsvg_filter_blur (ctx, alpha->pixels, shadow.alpha->pixels, alpha->width, 1,
+                      blur->sdx * ctx->paffine[0], blur->sdy * ctx->paffine[3], bounds, 1);
+    rsvg_filter_alpha_unref (alpha);
+
+    output = rsvg_filter_image_new_cleared (ctx, ctx->width, ctx->height);
+
+    bands.self = step->primitive;
+    bands.ctx = ctx;
+    bands.bounds = bounds;
+    bands.in_pixels = ctx->source->pixels;
+    bands.in2_pixels = NULL;
+    bands.output_pixels = output->pixels;
+    bands.rowstride = output->rowstride;
+    bands.data = &shadow;
+    rsvg_filter_run_bands (rsvg_filter_drop_shadow_render_rows, &bands);
+
+    rsvg_filter_store_result (step->primitive->result, output, ctx);
+
+    rsvg_filter_alpha_unref (shadow.alpha);
+    rsvg_filter_image_unref (output);
+}
+
+/*************************************************************/
+/*************************************************************/
+
 typedef struct _RsvgFilterPrimitiveDisplacementMap RsvgFilterPrimitiveDisplacementMap;
 
 struct _RsvgFilterPrimitiveDisplacementMap {
@@ -2771,43 +4701,82 @@ struct _RsvgFilterPrimitiveDisplacementMap {
     double scale;
 };
 
+typedef struct {
+    guchar xch, ych;
+} RsvgDisplacementMapBands;
+
 static void
-rsvg_filter_primitive_displacement_map_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+rsvg_filter_primitive_displacement_map_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
 {
+    RsvgFilterPrimitiveDisplacementMap *upself = (RsvgFilterPrimitiveDisplacementMap *) bands->self;
+    RsvgDisplacementMapBands *displacement = bands->data;
+    RsvgFilterContext *ctx = bands->ctx;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *in2_pixels = bands->in2_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
     guchar ch, xch, ych;
     gint x, y;
-    gint rowstride, height, width;
-    RsvgIRect boundarys;
 
-    guchar *in_pixels;
-    guchar *in2_pixels;
-    guchar *output_pixels;
+    double ox, oy;
 
-    RsvgFilterPrimitiveDisplacementMap *upself;
+    xch = displacement->xch;
+    ych = displacement->ych;
+    for (y = y0; y < y1; y++)
+        for (x = bands->bounds.x0; x < bands->bounds.x1; x++) {
+            if (xch != 4)
+                ox = x + upself->scale * ctx->paffine[0] *
+                    ((double) in2_pixels[y * rowstride + x * 4 + xch] / 255.0 - 0.5);
+            else
+                ox = x;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
-    GdkPixbuf *in2;
+            if (ych != 4)
+                oy = y + upself->scale * ctx->paffine[3] *
+                    ((double) in2_pixels[y * rowstride + x * 4 + ych] / 255.0 - 0.5);
+            else
+                oy = y;
 
-    double ox, oy;
+            for (ch = 0; ch < 4; ch++) {
+                output_pixels[y * rowstride + x * 4 + ch] =
+                    gdk_pixbuf_get_interp_pixel (in_pixels, ox, oy, ch, bands->bounds, rowstride);
+            }
+        }
+}
+
+static void
+rsvg_filter_primitive_displacement_map_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+{
+    guchar xch, ych;
+    gint height, width;
+    RsvgFilterBands bands;
+    RsvgDisplacementMapBands displacement;
+
+    RsvgFilterPrimitiveDisplacementMap *upself;
+
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
+    RsvgFilterImage *in2;
 
     upself = (RsvgFilterPrimitiveDisplacementMap *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.data = &displacement;
 
     in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
+    bands.in_pixels = in->pixels;
 
     in2 = rsvg_filter_get_in (upself->in2, ctx);
-    in2_pixels = gdk_pixbuf_get_pixels (in2);
+    bands.in2_pixels = in2->pixels;
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
+    height = in->height;
+    width = in->width;
 
-    rowstride = gdk_pixbuf_get_rowstride (in);
+    bands.rowstride = in->rowstride;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    bands.output_pixels = output->pixels;
 
     switch (upself->xChannelSelector) {
     case 'R':
@@ -2843,33 +4812,23 @@ rsvg_filter_primitive_displacement_map_render (RsvgFilterPrimitive * self, RsvgF
         ych = 4;
     };
 
-    xch = ctx->channelmap[xch];
-    ych = ctx->channelmap[ych];
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            if (xch != 4)
-                ox = x + upself->scale * ctx->paffine[0] *
-                    ((double) in2_pixels[y * rowstride + x * 4 + xch] / 255.0 - 0.5);
-            else
-                ox = x;
-
-            if (ych != 4)
-                oy = y + upself->scale * ctx->paffine[3] *
-                    ((double) in2_pixels[y * rowstride + x * 4 + ych] / 255.0 - 0.5);
-            else
-                oy = y;
+    displacement.xch = xch < 4 ? RSVG_FILTER_CHANNEL (xch) : 4;
+    displacement.ych = ych < 4 ? RSVG_FILTER_CHANNEL (ych) : 4;
 
-            for (ch = 0; ch < 4; ch++) {
-                output_pixels[y * rowstride + x * 4 + ch] =
-                    gdk_pixbuf_get_interp_pixel (in_pixels, ox, oy, ch, boundarys, rowstride);
-            }
-        }
+    rsvg_filter_run_bands (rsvg_filter_primitive_displacement_map_render_rows, &bands);
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (in2);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (in2);
+    rsvg_filter_image_unref (output);
+}
+
+static void
+rsvg_filter_primitive_displacement_map_get_inputs (RsvgFilterPrimitive * self, GPtrArray * names)
+{
+    g_ptr_array_add (names, self->in);
+    g_ptr_array_add (names, ((RsvgFilterPrimitiveDisplacementMap *) self)->in2);
 }
 
 static void
@@ -2934,6 +4893,9 @@ rsvg_new_filter_primitive_displacement_map (void)
     filter->yChannelSelector = ' ';
     filter->scale = 0;
     filter->super.render = &rsvg_filter_primitive_displacement_map_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = &rsvg_filter_primitive_displacement_map_get_inputs;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_displacement_map_free;
     filter->super.super.set_atts = rsvg_filter_primitive_displacement_map_set_atts;
     return (RsvgNode *) filter;
@@ -2942,304 +4904,249 @@ rsvg_new_filter_primitive_displacement_map (void)
 /*************************************************************/
 /*************************************************************/
 
-/* Produces results in the range [1, 2**31 - 2].
-   Algorithm is: r = (a * r) mod m
-   where a = 16807 and m = 2**31 - 1 = 2147483647
-   See [Park & Miller], CACM vol. 31 no. 10 p. 1195, Oct. 1988
-   To test: the algorithm should produce the result 1043618065
-   as the 10,000th generated number if the original seed is 1.
-*/
-#define feTurbulence_RAND_m 2147483647  /* 2**31 - 1 */
-#define feTurbulence_RAND_a 16807       /* 7**5; primitive root of m */
-#define feTurbulence_RAND_q 127773      /* m / a */
-#define feTurbulence_RAND_r 2836        /* m % a */
-#define feTurbulence_BSize 0x100
-#define feTurbulence_BM 0xff
-#define feTurbulence_PerlinN 0x1000
-#define feTurbulence_NP 12      /* 2^PerlinN */
-#define feTurbulence_NM 0xfff
+/* The noise is worked out by the kernels in rsvg-filter-turbulence.c. The
+   last subregion worked out is kept with the primitive, along with
+   everything it depends on, so that drawing the same document again at the
+   same size and position copies it instead. */
+
+typedef struct {
+    RsvgIRect bounds;
+    gdouble paffine[6];
+    gint step;
+    gint seed;
+    gdouble base_freq_x, base_freq_y;
+    gint octaves;
+    gboolean fractal_sum;
+    gboolean stitch;
+} RsvgTurbulenceCacheKey;
 
 typedef struct _RsvgFilterPrimitiveTurbulence RsvgFilterPrimitiveTurbulence;
 struct _RsvgFilterPrimitiveTurbulence {
     RsvgFilterPrimitive super;
-
-    int uLatticeSelector[feTurbulence_BSize + feTurbulence_BSize + 2];
-    double fGradient[4][feTurbulence_BSize + feTurbulence_BSize + 2][2];
-
+    RsvgTurbulence turbulence;
     int seed;
 
-    double fBaseFreqX;
-    double fBaseFreqY;
-
-    int nNumOctaves;
-    gboolean bFractalSum;
-    gboolean bDoStitching;
-};
-
-struct feTurbulence_StitchInfo {
-    int nWidth;                 /* How much to subtract to wrap for stitching. */
-    int nHeight;
-    int nWrapX;                 /* Minimum value to wrap. */
-    int nWrapY;
+    RsvgTurbulenceCacheKey cache_key;
+    guchar *cache;              /* the subregion, 4 * its width bytes to a row */
 };
 
-static long
-feTurbulence_setup_seed (int lSeed)
-{
-    if (lSeed <= 0)
-        lSeed = -(lSeed % (feTurbulence_RAND_m - 1)) + 1;
-    if (lSeed > feTurbulence_RAND_m - 1)
-        lSeed = feTurbulence_RAND_m - 1;
-    return lSeed;
-}
-
-static long
-feTurbulence_random (int lSeed)
+/* unpremultiplied RGBA from the kernels to premultiplied pixels */
+static void
+rsvg_filter_primitive_turbulence_store (const guchar * in, guchar * out, gint n)
 {
-    long result;
+    gint x, i;
 
-    result =
-        feTurbulence_RAND_a * (lSeed % feTurbulence_RAND_q) -
-        feTurbulence_RAND_r * (lSeed / feTurbulence_RAND_q);
-    if (result <= 0)
-        result += feTurbulence_RAND_m;
-    return result;
+    for (x = 0; x < n; x++, in += 4, out += 4) {
+        out[RSVG_FILTER_ALPHA] = in[3];
+        for (i = 0; i < 3; i++)
+            out[RSVG_FILTER_CHANNEL (i)] = in[i] * in[3] / 255;
+    }
 }
 
 static void
-feTurbulence_init (RsvgFilterPrimitiveTurbulence * filter)
-{
-    double s;
-    int i, j, k, lSeed;
-
-    lSeed = feTurbulence_setup_seed (filter->seed);
-    for (k = 0; k < 4; k++) {
-        for (i = 0; i < feTurbulence_BSize; i++) {
-            filter->uLatticeSelector[i] = i;
-            for (j = 0; j < 2; j++)
-                filter->fGradient[k][i][j] =
-                    (double) (((lSeed =
-                                feTurbulence_random (lSeed)) % (feTurbulence_BSize +
-                                                                feTurbulence_BSize)) -
-                              feTurbulence_BSize) / feTurbulence_BSize;
-            s = (double) (sqrt
-                          (filter->fGradient[k][i][0] * filter->fGradient[k][i][0] +
-                           filter->fGradient[k][i][1] * filter->fGradient[k][i][1]));
-            filter->fGradient[k][i][0] /= s;
-            filter->fGradient[k][i][1] /= s;
-        }
+rsvg_filter_primitive_turbulence_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgFilterPrimitiveTurbulence *upself = (RsvgFilterPrimitiveTurbulence *) bands->self;
+    RsvgIRect boundarys = bands->bounds;
+    RsvgTurbulenceKernel kernel = rsvg_turbulence_best_kernel ();
+    gint width = boundarys.x1 - boundarys.x0;
+    guchar *row;
+    gint y;
+
+    row = g_new (guchar, 4 * width);
+
+    for (y = y0; y < y1; y++) {
+        rsvg_turbulence_row (kernel, &upself->turbulence, bands->data, boundarys,
+                             boundarys.x0, y, 1, width, row);
+        rsvg_filter_primitive_turbulence_store (row, bands->output_pixels + y * bands->rowstride +
+                                                4 * boundarys.x0, width);
     }
 
-    while (--i) {
-        k = filter->uLatticeSelector[i];
-        filter->uLatticeSelector[i] = filter->uLatticeSelector[j =
-                                                               (lSeed =
-                                                                feTurbulence_random (lSeed)) %
-                                                               feTurbulence_BSize];
-        filter->uLatticeSelector[j] = k;
-    }
+    g_free (row);
+}
 
-    for (i = 0; i < feTurbulence_BSize + 2; i++) {
-        filter->uLatticeSelector[feTurbulence_BSize + i] = filter->uLatticeSelector[i];
-        for (k = 0; k < 4; k++)
-            for (j = 0; j < 2; j++)
-                filter->fGradient[k][feTurbulence_BSize + i][j] = filter->fGradient[k][i][j];
-    }
+/* With the fast filter quality, turbulence whose finest octave spans at
+   least this many pixels to a lattice cell is only worked out on a grid of
+   points and filled in between them. Octaves after the fourth add too
+   little to count. */
+#define RSVG_FAST_TURBULENCE_CELL 32.0
+#define RSVG_FAST_TURBULENCE_OCTAVES 4
+
+typedef struct {
+    gdouble *affine;
+    RsvgIRect bounds;           /* the primitive subregion */
+    gint step;                  /* pixels between grid points */
+    gint width, height;         /* grid points across and down */
+    guchar *samples;            /* unpremultiplied, in RGBA order */
+} RsvgTurbulenceGrid;
+
+/* the grid points of rows y0 to y1 */
+static void
+rsvg_filter_primitive_turbulence_render_grid (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgFilterPrimitiveTurbulence *upself = (RsvgFilterPrimitiveTurbulence *) bands->self;
+    RsvgTurbulenceKernel kernel = rsvg_turbulence_best_kernel ();
+    RsvgTurbulenceGrid *grid = bands->data;
+    gint gy;
+
+    for (gy = y0; gy < y1; gy++)
+        rsvg_turbulence_row (kernel, &upself->turbulence, grid->affine, grid->bounds,
+                             grid->bounds.x0, grid->bounds.y0 + gy * grid->step, grid->step,
+                             grid->width, grid->samples + 4 * gy * grid->width);
 }
 
-#define feTurbulence_s_curve(t) ( t * t * (3. - 2. * t) )
-#define feTurbulence_lerp(t, a, b) ( a + t * (b - a) )
-
-static double
-feTurbulence_noise2 (RsvgFilterPrimitiveTurbulence * filter,
-                     int nColorChannel, double vec[2], struct feTurbulence_StitchInfo *pStitchInfo)
-{
-    int bx0, bx1, by0, by1, b00, b10, b01, b11;
-    double rx0, rx1, ry0, ry1, *q, sx, sy, a, b, t, u, v;
-    register int i, j;
-
-    t = vec[0] + feTurbulence_PerlinN;
-    bx0 = (int) t;
-    bx1 = bx0 + 1;
-    rx0 = t - (int) t;
-    rx1 = rx0 - 1.0f;
-    t = vec[1] + feTurbulence_PerlinN;
-    by0 = (int) t;
-    by1 = by0 + 1;
-    ry0 = t - (int) t;
-    ry1 = ry0 - 1.0f;
-
-    /* If stitching, adjust lattice points accordingly. */
-    if (pStitchInfo != NULL) {
-        if (bx0 >= pStitchInfo->nWrapX)
-            bx0 -= pStitchInfo->nWidth;
-        if (bx1 >= pStitchInfo->nWrapX)
-            bx1 -= pStitchInfo->nWidth;
-        if (by0 >= pStitchInfo->nWrapY)
-            by0 -= pStitchInfo->nHeight;
-        if (by1 >= pStitchInfo->nWrapY)
-            by1 -= pStitchInfo->nHeight;
-    }
+/* fills in the pixels between the grid points and premultiplies them */
+static void
+rsvg_filter_primitive_turbulence_render_from_grid (RsvgFilterBands * bands, gint y0, gint y1)
+{
+    RsvgFilterContext *ctx = bands->ctx;
+    RsvgTurbulenceGrid *grid = bands->data;
+    gint step = grid->step;
+    gint area = step * step;
+    gint x, y, i;
+
+    for (y = y0; y < y1; y++) {
+        gint gy = (y - grid->bounds.y0) / step;
+        gint fy = (y - grid->bounds.y0) % step;
+        const guchar *row0 = grid->samples + 4 * gy * grid->width;
+        const guchar *row1 = row0 + 4 * grid->width;
+
+        for (x = grid->bounds.x0; x < grid->bounds.x1; x++) {
+            gint gx = (x - grid->bounds.x0) / step;
+            gint fx = (x - grid->bounds.x0) % step;
+            guchar *pixel = bands->output_pixels + y * bands->rowstride + 4 * x;
+            guchar value[4];
 
-    bx0 &= feTurbulence_BM;
-    bx1 &= feTurbulence_BM;
-    by0 &= feTurbulence_BM;
-    by1 &= feTurbulence_BM;
-    i = filter->uLatticeSelector[bx0];
-    j = filter->uLatticeSelector[bx1];
-    b00 = filter->uLatticeSelector[i + by0];
-    b10 = filter->uLatticeSelector[j + by0];
-    b01 = filter->uLatticeSelector[i + by1];
-    b11 = filter->uLatticeSelector[j + by1];
-    sx = (double) (feTurbulence_s_curve (rx0));
-    sy = (double) (feTurbulence_s_curve (ry0));
-    q = filter->fGradient[nColorChannel][b00];
-    u = rx0 * q[0] + ry0 * q[1];
-    q = filter->fGradient[nColorChannel][b10];
-    v = rx1 * q[0] + ry0 * q[1];
-    a = feTurbulence_lerp (sx, u, v);
-    q = filter->fGradient[nColorChannel][b01];
-    u = rx0 * q[0] + ry1 * q[1];
-    q = filter->fGradient[nColorChannel][b11];
-    v = rx1 * q[0] + ry1 * q[1];
-    b = feTurbulence_lerp (sx, u, v);
-
-    return feTurbulence_lerp (sy, a, b);
-}
-
-static double
-feTurbulence_turbulence (RsvgFilterPrimitiveTurbulence * filter,
-                         int nColorChannel, double *point,
-                         double fTileX, double fTileY, double fTileWidth, double fTileHeight)
-{
-    struct feTurbulence_StitchInfo stitch;
-    struct feTurbulence_StitchInfo *pStitchInfo = NULL; /* Not stitching when NULL. */
-
-    double fSum = 0.0f, vec[2], ratio = 1.;
-    int nOctave;
-
-    /* Adjust the base frequencies if necessary for stitching. */
-    if (filter->bDoStitching) {
-        /* When stitching tiled turbulence, the frequencies must be adjusted
-           so that the tile borders will be continuous. */
-        if (filter->fBaseFreqX != 0.0) {
-            double fLoFreq = (double) (floor (fTileWidth * filter->fBaseFreqX)) / fTileWidth;
-            double fHiFreq = (double) (ceil (fTileWidth * filter->fBaseFreqX)) / fTileWidth;
-            if (filter->fBaseFreqX / fLoFreq < fHiFreq / filter->fBaseFreqX)
-                filter->fBaseFreqX = fLoFreq;
-            else
-                filter->fBaseFreqX = fHiFreq;
-        }
+            for (i = 0; i < 4; i++) {
+                gint top = row0[4 * gx + i] * (step - fx) + row0[4 * gx + 4 + i] * fx;
+                gint bottom = row1[4 * gx + i] * (step - fx) + row1[4 * gx + 4 + i] * fx;
 
-        if (filter->fBaseFreqY != 0.0) {
-            double fLoFreq = (double) (floor (fTileHeight * filter->fBaseFreqY)) / fTileHeight;
-            double fHiFreq = (double) (ceil (fTileHeight * filter->fBaseFreqY)) / fTileHeight;
-            if (filter->fBaseFreqY / fLoFreq < fHiFreq / filter->fBaseFreqY)
-                filter->fBaseFreqY = fLoFreq;
-            else
-                filter->fBaseFreqY = fHiFreq;
-        }
+                value[i] = (top * (step - fy) + bottom * fy + area / 2) / area;
+            }
 
-        /* Set up initial stitch values. */
-        pStitchInfo = &stitch;
-        stitch.nWidth = (int) (fTileWidth * filter->fBaseFreqX + 0.5f);
-        stitch.nWrapX = fTileX * filter->fBaseFreqX + feTurbulence_PerlinN + stitch.nWidth;
-        stitch.nHeight = (int) (fTileHeight * filter->fBaseFreqY + 0.5f);
-        stitch.nWrapY = fTileY * filter->fBaseFreqY + feTurbulence_PerlinN + stitch.nHeight;
+            pixel[RSVG_FILTER_ALPHA] = value[3];
+            for (i = 0; i < 3; i++)
+                pixel[RSVG_FILTER_CHANNEL (i)] = value[i] * value[3] / 255;
+        }
     }
+}
 
-    vec[0] = point[0] * filter->fBaseFreqX;
-    vec[1] = point[1] * filter->fBaseFreqY;
+/* The pixels between grid points for the fast filter quality, or 1 where
+   the turbulence has to be worked out at every pixel. @affine takes pixels
+   to user space. */
+static gint
+rsvg_filter_primitive_turbulence_get_step (RsvgFilterPrimitiveTurbulence * upself,
+                                           RsvgFilterContext * ctx, gdouble * affine)
+{
+    gdouble freq;
 
-    for (nOctave = 0; nOctave < filter->nNumOctaves; nOctave++) {
-        if (filter->bFractalSum)
-            fSum +=
-                (double) (feTurbulence_noise2 (filter, nColorChannel, vec, pStitchInfo) / ratio);
-        else
-            fSum +=
-                (double) (fabs (feTurbulence_noise2 (filter, nColorChannel, vec, pStitchInfo)) /
-                          ratio);
-
-        vec[0] *= 2;
-        vec[1] *= 2;
-        ratio *= 2;
-
-        if (pStitchInfo != NULL) {
-            /* Update stitch values. Subtracting PerlinN before the multiplication and
-               adding it afterward simplifies to subtracting it once. */
-            stitch.nWidth *= 2;
-            stitch.nWrapX = 2 * stitch.nWrapX - feTurbulence_PerlinN;
-            stitch.nHeight *= 2;
-            stitch.nWrapY = 2 * stitch.nWrapY - feTurbulence_PerlinN;
-        }
-    }
+    if (ctx->ctx->filter_quality != RSVG_FILTER_QUALITY_FAST || upself->turbulence.octaves < 1)
+        return 1;
+
+    /* lattice cells to a pixel in the finest octave that counts */
+    freq = MAX (upself->turbulence.base_freq_x, upself->turbulence.base_freq_y) *
+        (1 << (MIN (upself->turbulence.octaves, RSVG_FAST_TURBULENCE_OCTAVES) - 1)) *
+        MAX (sqrt (affine[0] * affine[0] + affine[1] * affine[1]),
+             sqrt (affine[2] * affine[2] + affine[3] * affine[3]));
+    if (freq * RSVG_FAST_TURBULENCE_CELL * 2 > 1)
+        return 1;
 
-    return fSum;
+    return MIN ((gint) (1 / (freq * RSVG_FAST_TURBULENCE_CELL)), RSVG_FAST_MAX_FACTOR);
 }
 
 static void
 rsvg_filter_primitive_turbulence_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
     RsvgFilterPrimitiveTurbulence *upself;
-    gint x, y, tileWidth, tileHeight, rowstride, width, height;
-    RsvgIRect boundarys;
-    guchar *output_pixels;
-    GdkPixbuf *output;
+    RsvgTurbulenceCacheKey key;
+    gint width, height, row_bytes, y;
+    RsvgFilterBands bands;
+    RsvgTurbulenceGrid grid;
+    RsvgFilterImage *output;
     gdouble affine[6];
-    GdkPixbuf *in;
+    RsvgFilterImage *in;
+    gint i;
 
     in = rsvg_filter_get_in (self->in, ctx);
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
-    rowstride = gdk_pixbuf_get_rowstride (in);
-
-    upself = (RsvgFilterPrimitiveTurbulence *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
-
-    tileWidth = (boundarys.x1 - boundarys.x0);
-    tileHeight = (boundarys.y1 - boundarys.y0);
-
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
-    output_pixels = gdk_pixbuf_get_pixels (output);
-
-    _rsvg_affine_invert (affine, ctx->paffine);
+    height = in->height;
+    width = in->width;
 
-    for (y = 0; y < tileHeight; y++) {
-        for (x = 0; x < tileWidth; x++) {
-            gint i;
-            double point[2];
-            guchar *pixel;
-            point[0] = affine[0] * (x + boundarys.x0) + affine[2] * (y + boundarys.y0) + affine[4];
-            point[1] = affine[1] * (x + boundarys.x0) + affine[3] * (y + boundarys.y0) + affine[5];
+    upself = (RsvgFilterPrimitiveTurbulence *) self;
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.rowstride = in->rowstride;
+    bands.data = affine;
 
-            pixel = output_pixels + 4 * (x + boundarys.x0) + (y + boundarys.y0) * rowstride;
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
+    bands.output_pixels = output->pixels;
 
-            for (i = 0; i < 4; i++) {
-                double cr;
+    if (bands.bounds.x1 <= bands.bounds.x0 || bands.bounds.y1 <= bands.bounds.y0)
+        goto out;
 
-                cr = feTurbulence_turbulence (upself, i, point, (double) x, (double) y,
-                                              (double) tileWidth, (double) tileHeight);
+    _rsvg_affine_invert (affine, ctx->paffine);
 
-                if (upself->bFractalSum)
-                    cr = ((cr * 255.) + 255.) / 2.;
-                else
-                    cr = (cr * 255.);
+    /* done up front so that the bands only ever read the frequencies */
+    rsvg_turbulence_stitch_frequencies (&upself->turbulence, bands.bounds.x1 - bands.bounds.x0,
+                                        bands.bounds.y1 - bands.bounds.y0);
 
-                cr = CLAMP (cr, 0., 255.);
+    grid.step = rsvg_filter_primitive_turbulence_get_step (upself, ctx, affine);
 
-                pixel[ctx->channelmap[i]] = (guchar) cr;
-            }
-            for (i = 0; i < 3; i++)
-                pixel[ctx->channelmap[i]] =
-                    pixel[ctx->channelmap[i]] * pixel[ctx->channelmap[3]] / 255;
+    /* zeroed first so that the padding compares equal too */
+    memset (&key, 0, sizeof (key));
+    key.bounds = bands.bounds;
+    for (i = 0; i < 6; i++)
+        key.paffine[i] = ctx->paffine[i];
+    key.step = grid.step;
+    key.seed = upself->seed;
+    key.base_freq_x = upself->turbulence.base_freq_x;
+    key.base_freq_y = upself->turbulence.base_freq_y;
+    key.octaves = upself->turbulence.octaves;
+    key.fractal_sum = upself->turbulence.fractal_sum;
+    key.stitch = upself->turbulence.stitch;
+
+    row_bytes = 4 * (bands.bounds.x1 - bands.bounds.x0);
+
+    if (upself->cache && !memcmp (&key, &upself->cache_key, sizeof (key))) {
+        for (y = bands.bounds.y0; y < bands.bounds.y1; y++)
+            memcpy (bands.output_pixels + y * bands.rowstride + 4 * bands.bounds.x0,
+                    upself->cache + (y - bands.bounds.y0) * row_bytes, row_bytes);
+        goto out;
+    }
 
-        }
+    if (grid.step > 1) {
+        /* one more point past the last pixel, to fill in towards */
+        grid.affine = affine;
+        grid.bounds = bands.bounds;
+        grid.width = (grid.bounds.x1 - grid.bounds.x0 - 1) / grid.step + 2;
+        grid.height = (grid.bounds.y1 - grid.bounds.y0 - 1) / grid.step + 2;
+        grid.samples = g_new (guchar, (gsize) 4 * grid.width * grid.height);
+        bands.data = &grid;
+
+        bands.bounds.x0 = bands.bounds.y0 = 0;
+        bands.bounds.x1 = grid.width;
+        bands.bounds.y1 = grid.height;
+        rsvg_filter_run_bands (rsvg_filter_primitive_turbulence_render_grid, &bands);
+
+        bands.bounds = grid.bounds;
+        rsvg_filter_run_bands (rsvg_filter_primitive_turbulence_render_from_grid, &bands);
+        g_free (grid.samples);
+    } else {
+        rsvg_filter_run_bands (rsvg_filter_primitive_turbulence_render_rows, &bands);
     }
 
+    g_free (upself->cache);
+    upself->cache = g_new (guchar, (gsize) row_bytes * (bands.bounds.y1 - bands.bounds.y0));
+    upself->cache_key = key;
+    for (y = bands.bounds.y0; y < bands.bounds.y1; y++)
+        memcpy (upself->cache + (y - bands.bounds.y0) * row_bytes,
+                bands.output_pixels + y * bands.rowstride + 4 * bands.bounds.x0, row_bytes);
+
+  out:
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -3250,6 +5157,7 @@ rsvg_filter_primitive_turbulence_free (RsvgNode * self)
     upself = (RsvgFilterPrimitiveTurbulence *) self;
     g_string_free (upself->super.result, TRUE);
     g_string_free (upself->super.in, TRUE);
+    g_free (upself->cache);
     _rsvg_node_free (self);
 }
 
@@ -3276,15 +5184,16 @@ rsvg_filter_primitive_turbulence_set_atts (RsvgNode * self, RsvgHandle * ctx,
         if ((value = rsvg_property_bag_lookup (atts, "height")))
             filter->super.height = _rsvg_css_parse_length (value);
         if ((value = rsvg_property_bag_lookup (atts, "baseFrequency")))
-            rsvg_css_parse_number_optional_number (value, &filter->fBaseFreqX, &filter->fBaseFreqY);
+            rsvg_css_parse_number_optional_number (value, &filter->turbulence.base_freq_x,
+                                                   &filter->turbulence.base_freq_y);
         if ((value = rsvg_property_bag_lookup (atts, "numOctaves")))
-            filter->nNumOctaves = atoi (value);
+            filter->turbulence.octaves = atoi (value);
         if ((value = rsvg_property_bag_lookup (atts, "seed")))
             filter->seed = atoi (value);
         if ((value = rsvg_property_bag_lookup (atts, "stitchTiles")))
-            filter->bDoStitching = (!strcmp (value, "stitch"));
+            filter->turbulence.stitch = (!strcmp (value, "stitch"));
         if ((value = rsvg_property_bag_lookup (atts, "type")))
-            filter->bFractalSum = (!strcmp (value, "fractalNoise"));
+            filter->turbulence.fractal_sum = (!strcmp (value, "fractalNoise"));
         if ((value = rsvg_property_bag_lookup (atts, "id")))
             rsvg_defs_register_name (ctx->priv->defs, value, &filter->super.super);
     }
@@ -3300,14 +5209,18 @@ rsvg_new_filter_primitive_turbulence (void)
     filter->super.result = g_string_new ("none");
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
-    filter->fBaseFreqX = 0;
-    filter->fBaseFreqY = 0;
-    filter->nNumOctaves = 1;
+    filter->turbulence.base_freq_x = 0;
+    filter->turbulence.base_freq_y = 0;
+    filter->turbulence.octaves = 1;
     filter->seed = 0;
-    filter->bDoStitching = 0;
-    filter->bFractalSum = 0;
-    feTurbulence_init (filter);
+    filter->turbulence.stitch = 0;
+    filter->turbulence.fractal_sum = 0;
+    filter->cache = NULL;
+    rsvg_turbulence_init (&filter->turbulence, filter->seed);
     filter->super.render = &rsvg_filter_primitive_turbulence_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = &rsvg_filter_primitive_no_inputs;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_turbulence_free;
     filter->super.super.set_atts = rsvg_filter_primitive_turbulence_set_atts;
     return (RsvgNode *) filter;
@@ -3359,8 +5272,8 @@ rsvg_filter_primitive_image_render_ext (RsvgFilterPrimitive * self, RsvgFilterCo
     int i;
     GdkPixbuf *intermediate;
     unsigned char *pixels;
-    int channelmap[4];
     int length;
+    double affine[6];
 
     upself = (RsvgFilterPrimitiveImage *) self;
 
@@ -3380,8 +5293,15 @@ rsvg_filter_primitive_image_render_ext (RsvgFilterPrimitive * self, RsvgFilterCo
                                    boundarys.y1 - boundarys.y0);
 
 
+    /* the image is sampled as if the canvas had not been cropped to the roi,
+       at whatever scale filterRes set */
+    for (i = 0; i < 6; i++)
+        affine[i] = ctx->paffine[i];
+    affine[4] += ctx->roi.x0 * (double) ctx->width / (ctx->roi.x1 - ctx->roi.x0);
+    affine[5] += ctx->roi.y0 * (double) ctx->height / (ctx->roi.y1 - ctx->roi.y0);
+
     rsvg_art_affine_image (img, intermediate,
-                           ctx->paffine,
+                           affine,
                            (boundarys.x1 - boundarys.x0) / ctx->paffine[0],
                            (boundarys.y1 - boundarys.y0) / ctx->paffine[3]);
 
@@ -3394,8 +5314,6 @@ rsvg_filter_primitive_image_render_ext (RsvgFilterPrimitive * self, RsvgFilterCo
     g_object_unref (img);
 
     length = gdk_pixbuf_get_height (intermediate) * gdk_pixbuf_get_rowstride (intermediate);
-    for (i = 0; i < 4; i++)
-        channelmap[i] = ctx->channelmap[i];
     pixels = gdk_pixbuf_get_pixels (intermediate);
     for (i = 0; i < length; i += 4) {
         unsigned char alpha;
@@ -3403,13 +5321,13 @@ rsvg_filter_primitive_image_render_ext (RsvgFilterPrimitive * self, RsvgFilterCo
         int ch;
         alpha = pixels[i + 3];
 
-        pixel[channelmap[3]] = alpha;
+        pixel[RSVG_FILTER_ALPHA] = alpha;
         if (alpha)
             for (ch = 0; ch < 3; ch++)
-                pixel[channelmap[ch]] = pixels[i + ch] * alpha / 255;
+                pixel[RSVG_FILTER_CHANNEL (ch)] = pixels[i + ch] * alpha / 255;
         else
             for (ch = 0; ch < 3; ch++)
-                pixel[channelmap[ch]] = 0;
+                pixel[RSVG_FILTER_CHANNEL (ch)] = 0;
         for (ch = 0; ch < 4; ch++)
             pixels[i + ch] = pixel[ch];
     }
@@ -3418,6 +5336,21 @@ rsvg_filter_primitive_image_render_ext (RsvgFilterPrimitive * self, RsvgFilterCo
 
 }
 
+/* copies the pixels of @img from (@srcx, @srcy) on into @area of @dst,
+   as they are already in the filters' layout */
+static void
+rsvg_filter_image_copy_pixbuf (GdkPixbuf * img, gint srcx, gint srcy,
+                               RsvgFilterImage * dst, RsvgIRect area)
+{
+    guchar *src;
+    gint y, stride;
+
+    stride = gdk_pixbuf_get_rowstride (img);
+    src = gdk_pixbuf_get_pixels (img) + srcy * stride + srcx * 4;
+    for (y = area.y0; y < area.y1; y++, src += stride)
+        memcpy (dst->pixels + y * dst->rowstride + area.x0 * 4, src, (area.x1 - area.x0) * 4);
+}
+
 static void
 rsvg_filter_primitive_image_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
 {
@@ -3425,7 +5358,8 @@ rsvg_filter_primitive_image_render (RsvgFilterPrimitive * self, RsvgFilterContex
     RsvgFilterPrimitiveImage *upself;
     RsvgFilterPrimitiveOutput op;
 
-    GdkPixbuf *output, *img;
+    RsvgFilterImage *output;
+    GdkPixbuf *img;
 
     upself = (RsvgFilterPrimitiveImage *) self;
 
@@ -3434,24 +5368,22 @@ rsvg_filter_primitive_image_render (RsvgFilterPrimitive * self, RsvgFilterContex
 
     boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, ctx->width, ctx->height);
+    output = rsvg_filter_image_new_cleared (ctx, ctx->width, ctx->height);
 
     img = rsvg_filter_primitive_image_render_in (self, ctx);
     if (img == NULL) {
         img = rsvg_filter_primitive_image_render_ext (self, ctx);
         if (img) {
-            gdk_pixbuf_copy_area (img, 0, 0,
-                                  boundarys.x1 - boundarys.x0,
-                                  boundarys.y1 - boundarys.y0, output, boundarys.x0, boundarys.y0);
+            rsvg_filter_image_copy_pixbuf (img, 0, 0, output, boundarys);
             g_object_unref (img);
         }
     } else {
-        gdk_pixbuf_copy_area (img, boundarys.x0, boundarys.y0, boundarys.x1 - boundarys.x0,
-                              boundarys.y1 - boundarys.y0, output, boundarys.x0, boundarys.y0);
+        rsvg_filter_image_copy_pixbuf (img, boundarys.x0, boundarys.y0, output, boundarys);
         g_object_unref (img);
     }
 
     op.result = output;
+    op.alpha = NULL;
     op.bounds = boundarys;
     op.Rused = 1;
     op.Gused = 1;
@@ -3460,7 +5392,7 @@ rsvg_filter_primitive_image_render (RsvgFilterPrimitive * self, RsvgFilterContex
 
     rsvg_filter_store_output (self->result, op, ctx);
 
-    g_object_unref (output);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -3520,6 +5452,9 @@ rsvg_new_filter_primitive_image (void)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = &rsvg_filter_primitive_image_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = &rsvg_filter_primitive_no_inputs;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_image_free;
     filter->super.super.set_atts = rsvg_filter_primitive_image_set_atts;
     return (RsvgNode *) filter;
@@ -3795,85 +5730,6 @@ struct _RsvgNodeLightSource {
     gdouble limitingconeAngle;
 };
 
-static vector3
-get_light_direction (RsvgNodeLightSource * source, gdouble x1, gdouble y1, gdouble z,
-                     gdouble * affine, RsvgDrawingCtx * ctx)
-{
-    vector3 output;
-
-    switch (source->type) {
-    case DISTANTLIGHT:
-        output.x = cos (source->azimuth) * cos (source->elevation);
-        output.y = sin (source->azimuth) * cos (source->elevation);
-        output.z = sin (source->elevation);
-        break;
-    default:
-        {
-            double x, y;
-            x = affine[0] * x1 + affine[2] * y1 + affine[4];
-            y = affine[1] * x1 + affine[3] * y1 + affine[5];
-            output.x = _rsvg_css_normalize_length (&source->x, ctx, 'h') - x;
-            output.y = _rsvg_css_normalize_length (&source->y, ctx, 'v') - y;
-            output.z = _rsvg_css_normalize_length (&source->z, ctx, 'o') - z;
-            output = normalise (output);
-        }
-        break;
-    }
-    return output;
-}
-
-static vector3
-get_light_colour (RsvgNodeLightSource * source, vector3 colour,
-                  gdouble x1, gdouble y1, gdouble z, gdouble * affine, RsvgDrawingCtx * ctx)
-{
-    double base, angle, x, y;
-    vector3 s;
-    vector3 L;
-    vector3 output;
-    double sx, sy, sz, spx, spy, spz;
-
-    if (source->type != SPOTLIGHT)
-        return colour;
-
-    sx = _rsvg_css_normalize_length (&source->x, ctx, 'h');
-    sy = _rsvg_css_normalize_length (&source->y, ctx, 'v');
-    sz = _rsvg_css_normalize_length (&source->z, ctx, 'o');
-    spx = _rsvg_css_normalize_length (&source->pointsAtX, ctx, 'h');
-    spy = _rsvg_css_normalize_length (&source->pointsAtY, ctx, 'v');
-    spz = _rsvg_css_normalize_length (&source->pointsAtZ, ctx, 'o');
-
-    x = affine[0] * x1 + affine[2] * y1 + affine[4];
-    y = affine[1] * x1 + affine[3] * y1 + affine[5];
-
-    L.x = sx - x;
-    L.y = sy - y;
-    L.z = sz - z;
-    L = normalise (L);
-
-    s.x = spx - sx;
-    s.y = spy - sy;
-    s.z = spz - sz;
-    s = normalise (s);
-
-    base = -dotproduct (L, s);
-
-    angle = acos (base) * 180.0 / M_PI;
-
-    if (base < 0 || angle > source->limitingconeAngle) {
-        output.x = 0;
-        output.y = 0;
-        output.z = 0;
-        return output;
-    }
-
-    output.x = colour.x * pow (base, source->specularExponent);
-    output.y = colour.y * pow (base, source->specularExponent);
-    output.z = colour.z * pow (base, source->specularExponent);
-
-    return output;
-}
-
-
 static void
 rsvg_node_light_source_set_atts (RsvgNode * self,
                                  RsvgHandle * ctx, RsvgPropertyBag * atts)
@@ -3939,27 +5795,316 @@ struct _RsvgFilterPrimitiveDiffuseLighting {
     guint32 lightingcolour;
 };
 
+typedef struct {
+    RsvgNodeLightSource *source;
+    vector3 colour;
+    gdouble surfaceScale;
+    gdouble iaffine[6];
+    float dx, dy, rawdx, rawdy;
+    /* towards a distant light, or where a point or spot light sits in
+       user space; worked out once rather than for every pixel */
+    vector3 light;
+    /* the way a spot light points */
+    vector3 spot;
+} RsvgLightingBands;
+
 static void
-rsvg_filter_primitive_diffuse_lighting_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+rsvg_lighting_bands_init (RsvgLightingBands * lighting, RsvgNodeLightSource * source,
+                          RsvgFilterContext * ctx)
+{
+    RsvgDrawingCtx *dc = ctx->ctx;
+
+    lighting->source = source;
+    _rsvg_affine_invert (lighting->iaffine, ctx->paffine);
+
+    if (source->type == DISTANTLIGHT) {
+        lighting->light.x = cos (source->azimuth) * cos (source->elevation);
+        lighting->light.y = sin (source->azimuth) * cos (source->elevation);
+        lighting->light.z = sin (source->elevation);
+        return;
+    }
+
+    lighting->light.x = _rsvg_css_normalize_length (&source->x, dc, 'h');
+    lighting->light.y = _rsvg_css_normalize_length (&source->y, dc, 'v');
+    lighting->light.z = _rsvg_css_normalize_length (&source->z, dc, 'o');
+
+    if (source->type == SPOTLIGHT) {
+        lighting->spot.x = _rsvg_css_normalize_length (&source->pointsAtX, dc, 'h') -
+            lighting->light.x;
+        lighting->spot.y = _rsvg_css_normalize_length (&source->pointsAtY, dc, 'v') -
+            lighting->light.y;
+        lighting->spot.z = _rsvg_css_normalize_length (&source->pointsAtZ, dc, 'o') -
+            lighting->light.z;
+        lighting->spot = normalise (lighting->spot);
+    }
+}
+
+/* The unit vector from pixel @x1 of a row at height @z to the light. The
+   row's share of the pixel's user space position, @row_x and @row_y, is
+   worked out once by the caller. */
+static vector3
+rsvg_lighting_direction (const RsvgLightingBands * lighting, gdouble x1,
+                         gdouble row_x, gdouble row_y, gdouble z)
+{
+    vector3 output;
+    double x, y;
+
+    if (lighting->source->type == DISTANTLIGHT)
+        return lighting->light;
+
+    x = lighting->iaffine[0] * x1 + row_x + lighting->iaffine[4];
+    y = lighting->iaffine[1] * x1 + row_y + lighting->iaffine[5];
+    output.x = lighting->light.x - x;
+    output.y = lighting->light.y - y;
+    output.z = lighting->light.z - z;
+
+    return normalise (output);
+}
+
+/* The colour of the light reaching a pixel, @L being the direction to the
+   light from rsvg_lighting_direction(). */
+static vector3
+rsvg_lighting_colour (const RsvgLightingBands * lighting, vector3 L)
+{
+    RsvgNodeLightSource *source = lighting->source;
+    double base, angle, strength;
+    vector3 output;
+
+    if (source->type != SPOTLIGHT)
+        return lighting->colour;
+
+    base = -dotproduct (L, lighting->spot);
+
+    angle = acos (base) * 180.0 / M_PI;
+
+    if (base < 0 || angle > source->limitingconeAngle) {
+        output.x = 0;
+        output.y = 0;
+        output.z = 0;
+        return output;
+    }
+
+    strength = pow (base, source->specularExponent);
+    output.x = lighting->colour.x * strength;
+    output.y = lighting->colour.y * strength;
+    output.z = lighting->colour.z * strength;
+
+    return output;
+}
+
+/* Scratch space for the surface normals of one row. */
+typedef struct {
+    gint width;
+    guchar *height[3];
+    gint *gx, *gy;
+    vector3 *normals;
+} RsvgLightingRow;
+
+static void
+rsvg_lighting_row_init (RsvgLightingRow * row, RsvgIRect boundarys)
+{
+    gint i;
+
+    row->width = boundarys.x1 - boundarys.x0;
+    for (i = 0; i < 3; i++)
+        row->height[i] = g_new (guchar, row->width + 2);
+    row->gx = g_new (gint, row->width);
+    row->gy = g_new (gint, row->width);
+    row->normals = g_new (vector3, row->width);
+}
+
+static void
+rsvg_lighting_row_free (RsvgLightingRow * row)
+{
+    gint i;
+
+    for (i = 0; i < 3; i++)
+        g_free (row->height[i]);
+    g_free (row->gx);
+    g_free (row->gy);
+    g_free (row->normals);
+}
+
+/* The Sobel sums of pixel column @c of the row for one pair of matrices,
+   with the three rows of heights starting at the column to its left. */
+static void
+rsvg_lighting_row_sobel (RsvgLightingRow * row, const FactorAndMatrix * fnmx,
+                         const FactorAndMatrix * fnmy, gint c)
+{
+    gint gx = 0, gy = 0, i, j;
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++) {
+            gx += fnmx->matrix[i * 3 + j] * row->height[i][c + j];
+            gy += fnmy->matrix[i * 3 + j] * row->height[i][c + j];
+        }
+
+    row->gx[c] = gx;
+    row->gy[c] = gy;
+}
+
+/*
+ * Works out the surface normals of row @y into @row->normals. With the
+ * kernel unit a whole pixel, which is the case unless the filter is
+ * scaled, every sample falls on a pixel, so the Sobel sums are taken in
+ * integers straight from the heights, most of the row with one pair of
+ * matrices; the normals come out exactly as get_surface_normal() would
+ * give them. Otherwise it falls back to get_surface_normal() per pixel.
+ */
+static void
+rsvg_lighting_row_normals (RsvgLightingRow * row, guchar * I, RsvgIRect boundarys, gint y,
+                           gdouble dx, gdouble dy, gdouble rawdx, gdouble rawdy,
+                           gdouble surfaceScale, gint rowstride, int chan)
+{
+    FactorAndMatrix fnmx, fnmy;
+    gdouble factorx[3], factory[3];
+    gint k0, k1, k2, k3, k4, k5, k6, k7, k8, l0, l1, l2, l3, l4, l5, l6, l7, l8;
+    gint mrow, mcol, x, c, i;
+    gint w = row->width;
+
+    if (dx != 1 || dy != 1) {
+        for (x = boundarys.x0; x < boundarys.x1; x++)
+            row->normals[x - boundarys.x0] =
+                get_surface_normal (I, boundarys, x, y, dx, dy, rawdx, rawdy, surfaceScale,
+                                    rowstride, chan);
+        return;
+    }
+
+    if (y + 1 >= boundarys.y1 - 1)
+        mrow = 2;
+    else if (y - 1 < boundarys.y0 + 1)
+        mrow = 0;
+    else
+        mrow = 1;
+
+    /* gdk_pixbuf_get_interp_pixel() reads the first row and column of the
+       bounds, and anything outside them, as 0 */
+    for (i = 0; i < 3; i++) {
+        gint sy = y - 1 + i;
+        guchar *h = row->height[i];
+
+        memset (h, 0, w + 2);
+        if (sy > boundarys.y0 && sy < boundarys.y1)
+            for (x = boundarys.x0 + 1; x < boundarys.x1; x++)
+                h[x - boundarys.x0 + 1] = I[sy * rowstride + x * 4 + chan];
+    }
+
+    /* the whole row with the middle column's matrices, unrolled so the
+       compiler can vectorise the loop */
+    fnmx = get_light_normal_matrix_x (mrow * 3 + 1);
+    fnmy = get_light_normal_matrix_y (mrow * 3 + 1);
+    k0 = fnmx.matrix[0], k1 = fnmx.matrix[1], k2 = fnmx.matrix[2];
+    k3 = fnmx.matrix[3], k4 = fnmx.matrix[4], k5 = fnmx.matrix[5];
+    k6 = fnmx.matrix[6], k7 = fnmx.matrix[7], k8 = fnmx.matrix[8];
+    l0 = fnmy.matrix[0], l1 = fnmy.matrix[1], l2 = fnmy.matrix[2];
+    l3 = fnmy.matrix[3], l4 = fnmy.matrix[4], l5 = fnmy.matrix[5];
+    l6 = fnmy.matrix[6], l7 = fnmy.matrix[7], l8 = fnmy.matrix[8];
+    {
+        const guchar *h0 = row->height[0], *h1 = row->height[1], *h2 = row->height[2];
+
+        for (c = 0; c < w; c++) {
+            row->gx[c] = k0 * h0[c] + k1 * h0[c + 1] + k2 * h0[c + 2] +
+                k3 * h1[c] + k4 * h1[c + 1] + k5 * h1[c + 2] +
+                k6 * h2[c] + k7 * h2[c + 1] + k8 * h2[c + 2];
+            row->gy[c] = l0 * h0[c] + l1 * h0[c + 1] + l2 * h0[c + 2] +
+                l3 * h1[c] + l4 * h1[c + 1] + l5 * h1[c + 2] +
+                l6 * h2[c] + l7 * h2[c + 1] + l8 * h2[c + 2];
+        }
+    }
+
+    for (mcol = 0; mcol < 3; mcol++) {
+        fnmx = get_light_normal_matrix_x (mrow * 3 + mcol);
+        fnmy = get_light_normal_matrix_y (mrow * 3 + mcol);
+        factorx[mcol] = fnmx.factor / rawdx;
+        factory[mcol] = fnmy.factor / rawdy;
+    }
+
+    for (c = 0; c < w; c++) {
+        gdouble Nx, Ny;
+        vector3 N;
+
+        x = boundarys.x0 + c;
+        if (x + 1 >= boundarys.x1 - 1)
+            mcol = 2;
+        else if (x - 1 < boundarys.x0 + 1)
+            mcol = 0;
+        else
+            mcol = 1;
+
+        if (mcol != 1) {
+            fnmx = get_light_normal_matrix_x (mrow * 3 + mcol);
+            fnmy = get_light_normal_matrix_y (mrow * 3 + mcol);
+            rsvg_lighting_row_sobel (row, &fnmx, &fnmy, c);
+        }
+
+        Nx = -surfaceScale * factorx[mcol] * ((gdouble) row->gx[c]) / 255.0;
+        Ny = -surfaceScale * factory[mcol] * ((gdouble) row->gy[c]) / 255.0;
+
+        N.x = Nx;
+        N.y = Ny;
+        N.z = 1;
+        row->normals[c] = normalise (N);
+    }
+}
+
+static void
+rsvg_filter_primitive_diffuse_lighting_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
 {
+    RsvgFilterPrimitiveDiffuseLighting *upself = (RsvgFilterPrimitiveDiffuseLighting *) bands->self;
+    RsvgLightingBands *lighting = bands->data;
+    RsvgFilterContext *ctx = bands->ctx;
+    RsvgIRect boundarys = bands->bounds;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    RsvgLightingRow row;
     gint x, y;
-    float dy, dx, rawdy, rawdx;
-    gdouble z;
-    gint rowstride, height, width;
-    gdouble factor, surfaceScale;
+    gdouble z, row_x, row_y;
+    gdouble factor;
     vector3 lightcolour, L, N;
-    vector3 colour;
-    gdouble iaffine[6];
-    RsvgNodeLightSource *source = NULL;
-    RsvgIRect boundarys;
 
-    guchar *in_pixels;
-    guchar *output_pixels;
+    rsvg_lighting_row_init (&row, boundarys);
+
+    for (y = y0; y < y1; y++) {
+        rsvg_lighting_row_normals (&row, in_pixels, boundarys, y,
+                                   lighting->dx, lighting->dy, lighting->rawdx, lighting->rawdy,
+                                   upself->surfaceScale, rowstride, RSVG_FILTER_ALPHA);
+        row_x = lighting->iaffine[2] * y;
+        row_y = lighting->iaffine[3] * y;
+
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            z = lighting->surfaceScale *
+                (double) in_pixels[y * rowstride + x * 4 + RSVG_FILTER_ALPHA];
+            L = rsvg_lighting_direction (lighting, x, row_x, row_y, z);
+            N = row.normals[x - boundarys.x0];
+            lightcolour = rsvg_lighting_colour (lighting, L);
+            factor = dotproduct (N, L);
+
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_CHANNEL (0)] =
+                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolour.x * 255.0));
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_CHANNEL (1)] =
+                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolour.y * 255.0));
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_CHANNEL (2)] =
+                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolour.z * 255.0));
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_ALPHA] = 255;
+        }
+    }
+
+    rsvg_lighting_row_free (&row);
+}
+
+static void
+rsvg_filter_primitive_diffuse_lighting_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+{
+    gint height, width;
+    RsvgFilterBands bands;
+    RsvgLightingBands lighting;
+    RsvgNodeLightSource *source = NULL;
 
     RsvgFilterPrimitiveDiffuseLighting *upself;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
     unsigned int i;
 
     for (i = 0; i < self->super.children->len; i++) {
@@ -3974,63 +6119,48 @@ rsvg_filter_primitive_diffuse_lighting_render (RsvgFilterPrimitive * self, RsvgF
         return;
 
     upself = (RsvgFilterPrimitiveDiffuseLighting *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.data = &lighting;
+    rsvg_lighting_bands_init (&lighting, source, ctx);
 
     in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
+    bands.in_pixels = in->pixels;
 
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
+    height = in->height;
+    width = in->width;
 
-    rowstride = gdk_pixbuf_get_rowstride (in);
+    bands.rowstride = in->rowstride;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    bands.output_pixels = output->pixels;
 
-    colour.x = ((guchar *) (&upself->lightingcolour))[2] / 255.0;
-    colour.y = ((guchar *) (&upself->lightingcolour))[1] / 255.0;
-    colour.z = ((guchar *) (&upself->lightingcolour))[0] / 255.0;
+    lighting.colour.x = ((guchar *) (&upself->lightingcolour))[2] / 255.0;
+    lighting.colour.y = ((guchar *) (&upself->lightingcolour))[1] / 255.0;
+    lighting.colour.z = ((guchar *) (&upself->lightingcolour))[0] / 255.0;
 
-    surfaceScale = upself->surfaceScale / 255.0;
+    lighting.surfaceScale = upself->surfaceScale / 255.0;
 
     if (upself->dy < 0 || upself->dx < 0) {
-        dx = 1;
-        dy = 1;
-        rawdx = 1;
-        rawdy = 1;
+        lighting.dx = 1;
+        lighting.dy = 1;
+        lighting.rawdx = 1;
+        lighting.rawdy = 1;
     } else {
-        dx = upself->dx * ctx->paffine[0];
-        dy = upself->dy * ctx->paffine[3];
-        rawdx = upself->dx;
-        rawdy = upself->dy;
+        lighting.dx = upself->dx * ctx->paffine[0];
+        lighting.dy = upself->dy * ctx->paffine[3];
+        lighting.rawdx = upself->dx;
+        lighting.rawdy = upself->dy;
     }
 
-    _rsvg_affine_invert (iaffine, ctx->paffine);
-
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            z = surfaceScale * (double) in_pixels[y * rowstride + x * 4 + ctx->channelmap[3]];
-            L = get_light_direction (source, x, y, z, iaffine, ctx->ctx);
-            N = get_surface_normal (in_pixels, boundarys, x, y,
-                                    dx, dy, rawdx, rawdy, upself->surfaceScale,
-                                    rowstride, ctx->channelmap[3]);
-            lightcolour = get_light_colour (source, colour, x, y, z, iaffine, ctx->ctx);
-            factor = dotproduct (N, L);
-
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[0]] =
-                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolour.x * 255.0));
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[1]] =
-                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolour.y * 255.0));
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[2]] =
-                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolour.z * 255.0));
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[3]] = 255;
-        }
+    rsvg_filter_run_bands (rsvg_filter_primitive_diffuse_lighting_render_rows, &bands);
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -4096,6 +6226,9 @@ rsvg_new_filter_primitive_diffuse_lighting (void)
     filter->dy = 1;
     filter->lightingcolour = 0xFFFFFFFF;
     filter->super.render = &rsvg_filter_primitive_diffuse_lighting_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_diffuse_lighting_free;
     filter->super.super.set_atts = rsvg_filter_primitive_diffuse_lighting_set_atts;
     return (RsvgNode *) filter;
@@ -4115,25 +6248,80 @@ struct _RsvgFilterPrimitiveSpecularLighting {
 };
 
 static void
-rsvg_filter_primitive_specular_lighting_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+rsvg_filter_primitive_specular_lighting_render_rows (RsvgFilterBands * bands, gint y0, gint y1)
 {
+    RsvgFilterPrimitiveSpecularLighting *upself =
+        (RsvgFilterPrimitiveSpecularLighting *) bands->self;
+    RsvgLightingBands *lighting = bands->data;
+    RsvgFilterContext *ctx = bands->ctx;
+    RsvgIRect boundarys = bands->bounds;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    RsvgLightingRow row;
     gint x, y;
-    gdouble z, surfaceScale;
-    gint rowstride, height, width;
+    gdouble z, row_x, row_y;
     gdouble factor, max, base;
-    vector3 lightcolour, colour;
-    vector3 L;
-    gdouble iaffine[6];
-    RsvgIRect boundarys;
-    RsvgNodeLightSource *source = NULL;
+    vector3 lightcolour;
+    vector3 L, H;
 
-    guchar *in_pixels;
-    guchar *output_pixels;
+    rsvg_lighting_row_init (&row, boundarys);
+
+    for (y = y0; y < y1; y++) {
+        rsvg_lighting_row_normals (&row, in_pixels, boundarys, y,
+                                   1, 1, 1.0 / ctx->paffine[0], 1.0 / ctx->paffine[3],
+                                   upself->surfaceScale, rowstride, RSVG_FILTER_ALPHA);
+        row_x = lighting->iaffine[2] * y;
+        row_y = lighting->iaffine[3] * y;
+
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            z = in_pixels[y * rowstride + x * 4 + 3] * lighting->surfaceScale;
+            L = rsvg_lighting_direction (lighting, x, row_x, row_y, z);
+            H = L;
+            H.z += 1;
+            H = normalise (H);
+
+            lightcolour = rsvg_lighting_colour (lighting, L);
+            base = dotproduct (row.normals[x - boundarys.x0], H);
+
+            factor = upself->specularConstant * pow (base, upself->specularExponent) * 255;
+
+            max = 0;
+            if (max < lightcolour.x)
+                max = lightcolour.x;
+            if (max < lightcolour.y)
+                max = lightcolour.y;
+            if (max < lightcolour.z)
+                max = lightcolour.z;
+
+            max *= factor;
+            if (max > 255)
+                max = 255;
+            if (max < 0)
+                max = 0;
+
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_CHANNEL (0)] = lightcolour.x * max;
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_CHANNEL (1)] = lightcolour.y * max;
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_CHANNEL (2)] = lightcolour.z * max;
+            output_pixels[y * rowstride + x * 4 + RSVG_FILTER_ALPHA] = max;
+        }
+    }
+
+    rsvg_lighting_row_free (&row);
+}
+
+static void
+rsvg_filter_primitive_specular_lighting_render (RsvgFilterPrimitive * self, RsvgFilterContext * ctx)
+{
+    gint height, width;
+    RsvgFilterBands bands;
+    RsvgLightingBands lighting;
+    RsvgNodeLightSource *source = NULL;
 
     RsvgFilterPrimitiveSpecularLighting *upself;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
 
     unsigned int i;
 
@@ -4148,68 +6336,36 @@ rsvg_filter_primitive_specular_lighting_render (RsvgFilterPrimitive * self, Rsvg
         return;
 
     upself = (RsvgFilterPrimitiveSpecularLighting *) self;
-    boundarys = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.bounds = rsvg_filter_primitive_get_bounds (self, ctx);
+    bands.data = &lighting;
+    rsvg_lighting_bands_init (&lighting, source, ctx);
 
     in = rsvg_filter_get_in (self->in, ctx);
-    in_pixels = gdk_pixbuf_get_pixels (in);
-
-    height = gdk_pixbuf_get_height (in);
-    width = gdk_pixbuf_get_width (in);
-
-    rowstride = gdk_pixbuf_get_rowstride (in);
-
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, width, height);
+    bands.in_pixels = in->pixels;
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    height = in->height;
+    width = in->width;
 
-    colour.x = ((guchar *) (&upself->lightingcolour))[2] / 255.0;
-    colour.y = ((guchar *) (&upself->lightingcolour))[1] / 255.0;
-    colour.z = ((guchar *) (&upself->lightingcolour))[0] / 255.0;
+    bands.rowstride = in->rowstride;
 
-    surfaceScale = upself->surfaceScale / 255.0;
+    output = rsvg_filter_new_output (ctx, width, height, bands.bounds);
 
-    _rsvg_affine_invert (iaffine, ctx->paffine);
-
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            z = in_pixels[y * rowstride + x * 4 + 3] * surfaceScale;
-            L = get_light_direction (source, x, y, z, iaffine, ctx->ctx);
-            L.z += 1;
-            L = normalise (L);
-
-            lightcolour = get_light_colour (source, colour, x, y, z, iaffine, ctx->ctx);
-            base = dotproduct (get_surface_normal (in_pixels, boundarys, x, y,
-                                                   1, 1, 1.0 / ctx->paffine[0],
-                                                   1.0 / ctx->paffine[3], upself->surfaceScale,
-                                                   rowstride, ctx->channelmap[3]), L);
-
-            factor = upself->specularConstant * pow (base, upself->specularExponent) * 255;
-
-            max = 0;
-            if (max < lightcolour.x)
-                max = lightcolour.x;
-            if (max < lightcolour.y)
-                max = lightcolour.y;
-            if (max < lightcolour.z)
-                max = lightcolour.z;
+    bands.output_pixels = output->pixels;
 
-            max *= factor;
-            if (max > 255)
-                max = 255;
-            if (max < 0)
-                max = 0;
+    lighting.colour.x = ((guchar *) (&upself->lightingcolour))[2] / 255.0;
+    lighting.colour.y = ((guchar *) (&upself->lightingcolour))[1] / 255.0;
+    lighting.colour.z = ((guchar *) (&upself->lightingcolour))[0] / 255.0;
 
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[0]] = lightcolour.x * max;
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[1]] = lightcolour.y * max;
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[2]] = lightcolour.z * max;
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[3]] = max;
+    lighting.surfaceScale = upself->surfaceScale / 255.0;
 
-        }
+    rsvg_filter_run_bands (rsvg_filter_primitive_specular_lighting_render_rows, &bands);
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (in);
-    g_object_unref (output);
+    rsvg_filter_image_unref (in);
+    rsvg_filter_image_unref (output);
 }
 
 static void
@@ -4274,6 +6430,9 @@ rsvg_new_filter_primitive_specular_lighting (void)
     filter->specularExponent = 1;
     filter->lightingcolour = 0xFFFFFFFF;
     filter->super.render = &rsvg_filter_primitive_specular_lighting_render;
+    filter->super.get_input_bounds = NULL;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_specular_lighting_free;
     filter->super.super.set_atts = rsvg_filter_primitive_specular_lighting_set_atts;
     return (RsvgNode *) filter;
@@ -4309,8 +6468,8 @@ rsvg_filter_primitive_tile_render (RsvgFilterPrimitive * self, RsvgFilterContext
     guchar *in_pixels;
     guchar *output_pixels;
 
-    GdkPixbuf *output;
-    GdkPixbuf *in;
+    RsvgFilterImage *output;
+    RsvgFilterImage *in;
 
     RsvgFilterPrimitiveTile *upself;
 
@@ -4322,12 +6481,12 @@ rsvg_filter_primitive_tile_render (RsvgFilterPrimitive * self, RsvgFilterContext
     boundarys = input.bounds;
 
 
-    in_pixels = gdk_pixbuf_get_pixels (in);
+    in_pixels = in->pixels;
 
-    output = _rsvg_pixbuf_new_cleared (GDK_COLORSPACE_RGB, 1, 8, ctx->width, ctx->height);
-    rowstride = gdk_pixbuf_get_rowstride (output);
+    output = rsvg_filter_image_new_cleared (ctx, ctx->width, ctx->height);
+    rowstride = output->rowstride;
 
-    output_pixels = gdk_pixbuf_get_pixels (output);
+    output_pixels = output->pixels;
 
     for (y = oboundarys.y0; y < oboundarys.y1; y++)
         for (x = oboundarys.x0; x < oboundarys.x1; x++)
@@ -4341,7 +6500,16 @@ rsvg_filter_primitive_tile_render (RsvgFilterPrimitive * self, RsvgFilterContext
 
     rsvg_filter_store_result (self->result, output, ctx);
 
-    g_object_unref (output);
+    rsvg_filter_image_unref (output);
+}
+
+static RsvgIRect
+rsvg_filter_primitive_tile_get_input_bounds (RsvgFilterPrimitive * self, RsvgFilterContext * ctx,
+                                             RsvgIRect bounds)
+{
+    /* the tile is whatever the input covers, which is only known once it has
+       been rendered; keep the whole filter region so the period stays put */
+    return rsvg_filter_primitive_get_bounds (NULL, ctx);
 }
 
 static void
@@ -4392,6 +6560,9 @@ rsvg_new_filter_primitive_tile (void)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = &rsvg_filter_primitive_tile_render;
+    filter->super.get_input_bounds = &rsvg_filter_primitive_tile_get_input_bounds;
+    filter->super.get_inputs = NULL;
+    filter->super.render_span = NULL;
     filter->super.super.free = &rsvg_filter_primitive_tile_free;
     filter->super.super.set_atts = rsvg_filter_primitive_tile_set_atts;
     return (RsvgNode *) filter;
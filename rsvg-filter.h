@@ -34,16 +34,25 @@ G_BEGIN_DECLS
 
 typedef RsvgCoordUnits RsvgFilterUnits;
 
+typedef struct _RsvgFilterPlan RsvgFilterPlan;
+
 struct _RsvgFilter {
     RsvgNode super;
     int refcnt;
     RsvgLength x, y, width, height;
     RsvgFilterUnits filterunits;
     RsvgFilterUnits primitiveunits;
+    double filterres_x, filterres_y;    /* filterRes, negative when not given */
+    RsvgFilterPlan *plan;       /* compiled from the primitives on first render */
+    RsvgFilterPlan *fast_plan;  /* the same, for RSVG_FILTER_QUALITY_FAST */
 };
 
-GdkPixbuf   *rsvg_filter_render	    (RsvgFilter * self, GdkPixbuf * source,
-                                     RsvgDrawingCtx * context, RsvgBbox * dimentions, char *channelmap);
+cairo_surface_t *rsvg_filter_render (RsvgFilter * self, cairo_surface_t * source,
+                                     RsvgDrawingCtx * context, RsvgBbox * dimentions,
+                                     RsvgIRect * roi);
+
+/* backs rsvg_set_filter_threads() */
+void             rsvg_filter_set_threads (gint n_threads);
 
 RsvgNode    *rsvg_new_filter	    (void);
 RsvgFilter  *rsvg_filter_parse	    (const RsvgDefs * defs, const char *str);
@@ -68,9 +77,6 @@ RsvgNode    *rsvg_new_node_light_source	                    (char type);
 RsvgNode    *rsvg_new_filter_primitive_specular_lighting    (void);
 RsvgNode    *rsvg_new_filter_primitive_tile                 (void);
 
-void         rsvg_alpha_blt         (GdkPixbuf * src, gint srcx, gint srcy,
-                                     gint srcwidth, gint srcheight,
-                                     GdkPixbuf * dst, gint dstx, gint dsty);
 void         rsvg_art_affine_image	(const GdkPixbuf * img, GdkPixbuf * intermediate,
                                      double *affine, double w, double h);
 
@@ -39,6 +39,7 @@
 
 #include "rsvg-private.h"
 #include "rsvg-defs.h"
+#include "rsvg-pattern-cache.h"
 
 enum {
     PROP_0,
@@ -69,6 +70,8 @@ instance_init (RsvgHandle * self)
     self->priv->entities = g_hash_table_new (g_str_hash, g_str_equal);
     self->priv->dpi_x = rsvg_internal_dpi_x;
     self->priv->dpi_y = rsvg_internal_dpi_y;
+    self->priv->filter_quality = RSVG_FILTER_QUALITY_EXACT;
+    self->priv->pattern_cache = rsvg_pattern_cache_new ();
 
     self->priv->css_props = g_hash_table_new_full (g_str_hash,
                                                    g_str_equal,
@@ -119,6 +122,7 @@ instance_dispose (GObject * instance)
 
     g_hash_table_foreach (self->priv->entities, rsvg_ctx_free_helper, NULL);
     g_hash_table_destroy (self->priv->entities);
+    rsvg_pattern_cache_free (self->priv->pattern_cache);
     rsvg_defs_free (self->priv->defs);
     g_hash_table_destroy (self->priv->css_props);
 
@@ -207,7 +207,8 @@ rsvg_marker_parse (const RsvgDefs * defs, const char *str)
 void
 rsvg_render_markers (const RsvgBpathDef * bpath_def, RsvgDrawingCtx * ctx)
 {
-    int i;
+    RsvgBpathIter iter;
+    RsvgBpath seg, nextseg;
 
     double x, y;
     double lastx, lasty;
@@ -233,23 +234,31 @@ rsvg_render_markers (const RsvgBpathDef * bpath_def, RsvgDrawingCtx * ctx)
     if (!startmarker && !middlemarker && !endmarker)
         return;
 
+    rsvg_bpath_iter_init (&iter, bpath_def);
+    if (!rsvg_bpath_iter_next (&iter, &nextseg))
+        return;
+
     x = 0;
     y = 0;
     code = RSVG_END;
-    nextx = bpath_def->bpath[0].x3;
-    nexty = bpath_def->bpath[0].y3;
-    nextcode = bpath_def->bpath[0].code;
+    nextx = nextseg.x3;
+    nexty = nextseg.y3;
+    nextcode = nextseg.code;
+
+    for (;;) {
+        seg = nextseg;
+        if (!rsvg_bpath_iter_next (&iter, &nextseg))
+            break;
 
-    for (i = 0; i < bpath_def->n_bpath - 1; i++) {
         lastx = x;
         lasty = y;
         lastcode = code;
         x = nextx;
         y = nexty;
         code = nextcode;
-        nextx = bpath_def->bpath[i + 1].x3;
-        nexty = bpath_def->bpath[i + 1].y3;
-        nextcode = bpath_def->bpath[i + 1].code;
+        nextx = nextseg.x3;
+        nexty = nextseg.y3;
+        nextcode = nextseg.code;
 
         if (nextcode == RSVG_MOVETO ||
             nextcode == RSVG_MOVETO_OPEN ||
@@ -257,8 +266,8 @@ rsvg_render_markers (const RsvgBpathDef * bpath_def, RsvgDrawingCtx * ctx)
             if (endmarker) {
                 if (code == RSVG_CURVETO) {
                     rsvg_marker_render (endmarker, x, y,
-                                        atan2 (y - bpath_def->bpath[i].y2,
-                                               x - bpath_def->bpath[i].x2),
+                                        atan2 (y - seg.y2,
+                                               x - seg.x2),
                                         linewidth, ctx);
                 } else {
                     rsvg_marker_render (endmarker, x, y,
@@ -271,8 +280,8 @@ rsvg_render_markers (const RsvgBpathDef * bpath_def, RsvgDrawingCtx * ctx)
             if (startmarker) {
                 if (nextcode == RSVG_CURVETO) {
                     rsvg_marker_render (startmarker, x, y,
-                                        atan2 (bpath_def->bpath[i + 1].y1 - y,
-                                               bpath_def->bpath[i + 1].x1 - x),
+                                        atan2 (nextseg.y1 - y,
+                                               nextseg.x1 - x),
                                         linewidth,
                                         ctx);
                 } else {
@@ -287,15 +296,15 @@ rsvg_render_markers (const RsvgBpathDef * bpath_def, RsvgDrawingCtx * ctx)
                 double xdifin, ydifin, xdifout, ydifout, intot, outtot, angle;
 
                 if (code == RSVG_CURVETO) {
-                    xdifin = x - bpath_def->bpath[i].x2;
-                    ydifin = y - bpath_def->bpath[i].y2;
+                    xdifin = x - seg.x2;
+                    ydifin = y - seg.y2;
                 } else {
                     xdifin = x - lastx;
                     ydifin = y - lasty;
                 }
                 if (nextcode == RSVG_CURVETO) {
-                    xdifout = bpath_def->bpath[i+1].x1 - x;
-                    ydifout = bpath_def->bpath[i+1].y1 - y;
+                    xdifout = nextseg.x1 - x;
+                    ydifout = nextseg.y1 - y;
                 } else {
                     xdifout = nextx - x;
                     ydifout = nexty - y;
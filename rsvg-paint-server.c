@@ -94,7 +94,6 @@ rsvg_paint_server_pattern (RsvgPattern * pattern)
 
     result->refcnt = 1;
     result->type = RSVG_PAINT_SERVER_PATTERN;
-    rsvg_pattern_fix_fallback (pattern);
     result->core.pattern = pattern;
 
     return result;
@@ -287,6 +286,24 @@ rsvg_linear_gradient_set_atts (RsvgNode * self, RsvgHandle * ctx, RsvgPropertyBa
     }
 }
 
+static void
+rsvg_gradient_stops_free (RsvgGradientStops * stops)
+{
+    if (stops == NULL)
+        return;
+    g_free (stops->stops);
+    g_free (stops);
+}
+
+static void
+rsvg_linear_gradient_free (RsvgNode * self)
+{
+    RsvgLinearGradient *grad = (RsvgLinearGradient *) self;
+
+    g_free (grad->resolved);
+    rsvg_gradient_stops_free (grad->stops);
+    _rsvg_node_free (self);
+}
 
 RsvgNode *
 rsvg_new_linear_gradient (void)
@@ -294,11 +311,14 @@ rsvg_new_linear_gradient (void)
     RsvgLinearGradient *grad = NULL;
     grad = g_new (RsvgLinearGradient, 1);
     _rsvg_node_init (&grad->super, RSVG_NODE_TYPE_LINEAR_GRADIENT);
+    grad->super.free = rsvg_linear_gradient_free;
     _rsvg_affine_identity (grad->affine);
     grad->has_current_color = FALSE;
     grad->x1 = grad->y1 = grad->y2 = _rsvg_css_parse_length ("0");
     grad->x2 = _rsvg_css_parse_length ("1");
     grad->fallback = NULL;
+    grad->resolved = NULL;
+    grad->stops = NULL;
     grad->obj_bbox = TRUE;
     grad->spread = RSVG_GRADIENT_PAD;
     grad->super.set_atts = rsvg_linear_gradient_set_atts;
@@ -371,17 +391,30 @@ rsvg_radial_gradient_set_atts (RsvgNode * self, RsvgHandle * ctx, RsvgPropertyBa
     }
 }
 
+static void
+rsvg_radial_gradient_free (RsvgNode * self)
+{
+    RsvgRadialGradient *grad = (RsvgRadialGradient *) self;
+
+    g_free (grad->resolved);
+    rsvg_gradient_stops_free (grad->stops);
+    _rsvg_node_free (self);
+}
+
 RsvgNode *
 rsvg_new_radial_gradient (void)
 {
 
     RsvgRadialGradient *grad = g_new (RsvgRadialGradient, 1);
     _rsvg_node_init (&grad->super, RSVG_NODE_TYPE_RADIAL_GRADIENT);
+    grad->super.free = rsvg_radial_gradient_free;
     _rsvg_affine_identity (grad->affine);
     grad->has_current_color = FALSE;
     grad->obj_bbox = TRUE;
     grad->spread = RSVG_GRADIENT_PAD;
     grad->fallback = NULL;
+    grad->resolved = NULL;
+    grad->stops = NULL;
     grad->cx = grad->cy = grad->r = grad->fx = grad->fy = _rsvg_css_parse_length ("0.5");
     grad->super.set_atts = rsvg_radial_gradient_set_atts;
     grad->hascx = grad->hascy = grad->hasfx = grad->hasfy = grad->hasr = grad->hasbbox =
@@ -453,16 +486,24 @@ rsvg_pattern_set_atts (RsvgNode * self, RsvgHandle * ctx, RsvgPropertyBag * atts
     }
 }
 
+static void
+rsvg_pattern_free (RsvgNode * self)
+{
+    g_free (((RsvgPattern *) self)->resolved);
+    _rsvg_node_free (self);
+}
 
 RsvgNode *
 rsvg_new_pattern (void)
 {
     RsvgPattern *pattern = g_new (RsvgPattern, 1);
     _rsvg_node_init (&pattern->super, RSVG_NODE_TYPE_PATTERN);
+    pattern->super.free = rsvg_pattern_free;
     pattern->obj_bbox = TRUE;
     pattern->obj_cbbox = FALSE;
     pattern->x = pattern->y = pattern->width = pattern->height = _rsvg_css_parse_length ("0");
     pattern->fallback = NULL;
+    pattern->resolved = NULL;
     pattern->preserve_aspect_ratio = RSVG_ASPECT_RATIO_XMID_YMID;
     pattern->vbox.active = FALSE;
     _rsvg_affine_identity (pattern->affine);
@@ -666,3 +707,75 @@ rsvg_pattern_fix_fallback (RsvgPattern * pattern)
         }
     }
 }
+
+static RsvgGradientStops *
+rsvg_gradient_stops_new (GPtrArray * children)
+{
+    RsvgGradientStops *stops = g_new (RsvgGradientStops, 1);
+    guint i;
+
+    stops->n_stops = 0;
+    stops->stops = g_new (RsvgGradientColorStop, children->len);
+    for (i = 0; i < children->len; i++) {
+        RsvgNode *node = g_ptr_array_index (children, i);
+
+        if (RSVG_NODE_TYPE (node) != RSVG_NODE_TYPE_STOP)
+            continue;
+        stops->stops[stops->n_stops].offset = ((RsvgGradientStop *) node)->offset;
+        stops->stops[stops->n_stops].rgba = ((RsvgGradientStop *) node)->rgba;
+        stops->n_stops++;
+    }
+
+    return stops;
+}
+
+void
+rsvg_paint_server_resolve (RsvgNode * node)
+{
+    switch (RSVG_NODE_TYPE (node)) {
+    case RSVG_NODE_TYPE_LINEAR_GRADIENT:
+        {
+            RsvgLinearGradient *grad = (RsvgLinearGradient *) node;
+
+            g_free (grad->resolved);
+            rsvg_gradient_stops_free (grad->stops);
+
+            grad->resolved = g_new (RsvgLinearGradient, 1);
+            *grad->resolved = *grad;
+            grad->resolved->resolved = NULL;
+            grad->resolved->stops = NULL;
+            rsvg_linear_gradient_fix_fallback (grad->resolved);
+            grad->stops = rsvg_gradient_stops_new (grad->resolved->super.children);
+        }
+        break;
+    case RSVG_NODE_TYPE_RADIAL_GRADIENT:
+        {
+            RsvgRadialGradient *grad = (RsvgRadialGradient *) node;
+
+            g_free (grad->resolved);
+            rsvg_gradient_stops_free (grad->stops);
+
+            grad->resolved = g_new (RsvgRadialGradient, 1);
+            *grad->resolved = *grad;
+            grad->resolved->resolved = NULL;
+            grad->resolved->stops = NULL;
+            rsvg_radial_gradient_fix_fallback (grad->resolved);
+            grad->stops = rsvg_gradient_stops_new (grad->resolved->super.children);
+        }
+        break;
+    case RSVG_NODE_TYPE_PATTERN:
+        {
+            RsvgPattern *pattern = (RsvgPattern *) node;
+
+            g_free (pattern->resolved);
+
+            pattern->resolved = g_new (RsvgPattern, 1);
+            *pattern->resolved = *pattern;
+            pattern->resolved->resolved = NULL;
+            rsvg_pattern_fix_fallback (pattern->resolved);
+        }
+        break;
+    default:
+        break;
+    }
+}
@@ -55,6 +55,17 @@ struct _RsvgGradientStop {
     guint32 rgba;
 };
 
+typedef struct {
+    double offset;
+    guint32 rgba;
+} RsvgGradientColorStop;
+
+/* the stops a gradient ends up with, fallbacks and all */
+struct _RsvgGradientStops {
+    guint n_stops;
+    RsvgGradientColorStop *stops;
+};
+
 struct _RsvgLinearGradient {
     RsvgNode super;
     gboolean obj_bbox;
@@ -71,6 +82,10 @@ struct _RsvgLinearGradient {
     int hasspread:1;
     int hastransform:1;
     RsvgNode *fallback;
+    /* this gradient with what it takes from its fallbacks, and its
+       stops, worked out once every reference is known */
+    RsvgLinearGradient *resolved;
+    RsvgGradientStops *stops;
 };
 
 struct _RsvgRadialGradient {
@@ -90,6 +105,9 @@ struct _RsvgRadialGradient {
     int hasbbox:1;
     int hastransform:1;
     RsvgNode *fallback;
+    /* as for RsvgLinearGradient */
+    RsvgRadialGradient *resolved;
+    RsvgGradientStops *stops;
 };
 
 struct _RsvgPattern {
@@ -110,6 +128,7 @@ struct _RsvgPattern {
     int hasbbox:1;
     int hastransform:1;
     RsvgPattern *fallback;
+    RsvgPattern *resolved;      /* with what it takes from its fallbacks */
 };
 
 struct _RsvgSolidColour {
@@ -158,6 +177,10 @@ void rsvg_pattern_fix_fallback          (RsvgPattern * pattern);
 void rsvg_linear_gradient_fix_fallback	(RsvgLinearGradient * grad);
 void rsvg_radial_gradient_fix_fallback	(RsvgRadialGradient * grad);
 
+/* Folds what the gradient or pattern @node takes from its fallbacks into
+   its resolved copy, once the references of every node are known. */
+void rsvg_paint_server_resolve          (RsvgNode * node);
+
 G_END_DECLS
 
 #endif
@@ -58,7 +58,7 @@ struct _RSVGParsePathCtx {
 };
 
 static void
-rsvg_path_arc_segment (RSVGParsePathCtx * ctx,
+rsvg_path_arc_segment (RsvgBpathDef * bpath,
                        double xc, double yc,
                        double th0, double th1, double rx, double ry,
                        double x_axis_rotation)
@@ -81,7 +81,7 @@ rsvg_path_arc_segment (RSVGParsePathCtx * ctx,
     x2 = x3 + rx*(t * sin (th1));
     y2 = y3 + ry*(-t * cos (th1));
 
-    rsvg_bpath_def_curveto (ctx->bpath,
+    rsvg_bpath_def_curveto (bpath,
                             xc + cosf*x1 - sinf*y1,
                             yc + sinf*x1 + cosf*y1,
                             xc + cosf*x2 - sinf*y2,
@@ -91,8 +91,10 @@ rsvg_path_arc_segment (RSVGParsePathCtx * ctx,
 }
 
 /**
- * rsvg_path_arc: Add an RSVG arc to the path context.
- * @ctx: Path context.
+ * rsvg_path_arc: Add an RSVG arc to a path.
+ * @bpath: Path to append the arc segments to.
+ * @x1: Current x coordinate.
+ * @y1: Current y coordinate.
  * @rx: Radius in x direction (before rotation).
  * @ry: Radius in y direction (before rotation).
  * @x_axis_rotation: Rotation angle for axes.
@@ -101,9 +103,10 @@ rsvg_path_arc_segment (RSVGParsePathCtx * ctx,
  * @x: New x coordinate.
  * @y: New y coordinate.
  *
+ * Returns: %TRUE if the arc was emitted as curves ending at (@x, @y).
  **/
-static void
-rsvg_path_arc (RSVGParsePathCtx * ctx,
+gboolean
+rsvg_path_arc (RsvgBpathDef * bpath, double x1, double y1,
                double rx, double ry, double x_axis_rotation,
                int large_arc_flag, int sweep_flag, double x, double y)
 {
@@ -112,7 +115,7 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
        http://www.w3.org/TR/SVG/implnote.html#ArcImplementationNotes */
 
     double f, sinf, cosf;
-    double x1, y1, x2, y2;
+    double x2, y2;
     double x1_, y1_;
     double cx_, cy_, cx, cy;
     double gamma;
@@ -121,15 +124,12 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
 
     int i, n_segs;
 
-    /* Start and end of path segment */
-    x1 = ctx->cpx;
-    y1 = ctx->cpy;
-
+    /* End of path segment */
     x2 = x;
     y2 = y;
 
     if(x1 == x2 && y1 == y2)
-        return;
+        return FALSE;
 
     /* X-axis */
     f = x_axis_rotation * M_PI / 180.0;
@@ -139,8 +139,8 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
     /* Check the radius against floading point underflow.
        See http://bugs.debian.org/508443 */
     if ((fabs(rx) < DBL_EPSILON) || (fabs(ry) < DBL_EPSILON)) {
-        rsvg_bpath_def_lineto (ctx->bpath, x, y);
-        return;
+        rsvg_bpath_def_lineto (bpath, x, y);
+        return FALSE;
     }
 
     if(rx < 0)rx = -rx;
@@ -162,7 +162,7 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
 
     k1 = rx*rx*y1_*y1_ + ry*ry*x1_*x1_;
     if(k1 == 0)    
-        return;
+        return FALSE;
 
     k1 = sqrt(fabs((rx*rx*ry*ry)/k1 - 1));
     if(sweep_flag == large_arc_flag)
@@ -182,7 +182,7 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
     k4 = (-y1_ - cy_)/ry;
 
     k5 = sqrt(fabs(k1*k1 + k2*k2));
-    if(k5 == 0)return;
+    if(k5 == 0)return FALSE;
 
     k5 = k1/k5;
     if(k5 < -1)k5 = -1;
@@ -193,7 +193,7 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
     /* Compute delta_theta */
 
     k5 = sqrt(fabs((k1*k1 + k2*k2)*(k3*k3 + k4*k4)));
-    if(k5 == 0)return;
+    if(k5 == 0)return FALSE;
 
     k5 = (k1*k3 + k2*k4)/k5;
     if(k5 < -1)k5 = -1;
@@ -211,13 +211,12 @@ rsvg_path_arc (RSVGParsePathCtx * ctx,
     n_segs = ceil (fabs (delta_theta / (M_PI * 0.5 + 0.001)));
 
     for (i = 0; i < n_segs; i++)
-        rsvg_path_arc_segment (ctx, cx, cy,
+        rsvg_path_arc_segment (bpath, cx, cy,
 			                   theta1 + i * delta_theta / n_segs,
                                theta1 + (i + 1) * delta_theta / n_segs,
                                rx, ry, x_axis_rotation);
 
-    ctx->cpx = x;
-    ctx->cpy = y;
+    return TRUE;
 }
 
 
@@ -393,9 +392,12 @@ rsvg_parse_path_do_cmd (RSVGParsePathCtx * ctx, gboolean final)
         break;
     case 'a':
         if (ctx->param == 7 || final) {
-            rsvg_path_arc (ctx,
-                           ctx->params[0], ctx->params[1], ctx->params[2],
-                           ctx->params[3], ctx->params[4], ctx->params[5], ctx->params[6]);
+            if (rsvg_path_arc (ctx->bpath, ctx->cpx, ctx->cpy,
+                               ctx->params[0], ctx->params[1], ctx->params[2],
+                               ctx->params[3], ctx->params[4], ctx->params[5], ctx->params[6])) {
+                ctx->cpx = ctx->params[5];
+                ctx->cpy = ctx->params[6];
+            }
             ctx->param = 0;
         }
         break;
@@ -535,8 +537,10 @@ rsvg_parse_path_data (RSVGParsePathCtx * ctx, const char *data)
                 rsvg_parse_path_do_cmd (ctx, TRUE);
             rsvg_bpath_def_closepath (ctx->bpath);
 
-            ctx->cpx = ctx->rpx = ctx->bpath->bpath[ctx->bpath->n_bpath - 1].x3;
-            ctx->cpy = ctx->rpy = ctx->bpath->bpath[ctx->bpath->n_bpath - 1].y3;
+            if (rsvg_bpath_def_get_last_point (ctx->bpath, &ctx->cpx, &ctx->cpy)) {
+                ctx->rpx = ctx->cpx;
+                ctx->rpy = ctx->cpy;
+            }
         } else if (c >= 'A' && c <= 'Z' && c != 'E') {
             if (ctx->param)
                 rsvg_parse_path_do_cmd (ctx, TRUE);
@@ -32,6 +32,9 @@
 G_BEGIN_DECLS 
 
 RsvgBpathDef *rsvg_parse_path (const char *path_str);
+gboolean      rsvg_path_arc   (RsvgBpathDef * bpath, double x1, double y1,
+                               double rx, double ry, double x_axis_rotation,
+                               int large_arc_flag, int sweep_flag, double x, double y);
 
 G_END_DECLS
 
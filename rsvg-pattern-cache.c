@@ -0,0 +1,315 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-pattern-cache.c : Pattern tiles, gradients and clips kept between renders
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#include "config.h"
+
+#include "rsvg-pattern-cache.h"
+
+/* how much a cache holds on to */
+#define RSVG_PATTERN_CACHE_MAX_TILES 256
+#define RSVG_PATTERN_CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define RSVG_PATTERN_CACHE_MAX_PER_GRADIENT 4
+#define RSVG_PATTERN_CACHE_MAX_PER_CLIP 4
+
+typedef struct {
+    RsvgPatternTileKey key;
+    cairo_surface_t *tile;
+    gsize size;
+} RsvgPatternTile;
+
+typedef struct {
+    RsvgGradientKey key;
+    cairo_pattern_t *pattern;
+} RsvgGradientEntry;
+
+typedef struct {
+    RsvgClipKey key;
+    RsvgClipOutline outline;
+} RsvgClipEntry;
+
+struct _RsvgPatternCache {
+    GList *tiles;               /* most recently used first */
+    guint n_tiles;
+    gsize bytes;
+
+    /* each gradient's list of entries, most recently used first */
+    GHashTable *gradients;
+    /* and each clip path's */
+    GHashTable *clips;
+};
+
+static gboolean
+rsvg_pattern_tile_key_equal (const RsvgPatternTileKey * a, const RsvgPatternTileKey * b)
+{
+    gint i;
+
+    if (a->pattern != b->pattern
+        || a->width != b->width || a->height != b->height
+        || a->vb_w != b->vb_w || a->vb_h != b->vb_h || a->filter_quality != b->filter_quality)
+        return FALSE;
+
+    for (i = 0; i < 6; i++)
+        if (a->affine[i] != b->affine[i])
+            return FALSE;
+
+    return TRUE;
+}
+
+static void
+rsvg_pattern_tile_free (RsvgPatternTile * tile)
+{
+    cairo_surface_destroy (tile->tile);
+    g_free (tile);
+}
+
+static void
+rsvg_gradient_entries_free (GSList * entries)
+{
+    GSList *l;
+
+    for (l = entries; l; l = l->next) {
+        RsvgGradientEntry *entry = l->data;
+
+        cairo_pattern_destroy (entry->pattern);
+        g_free (entry);
+    }
+    g_slist_free (entries);
+}
+
+static void
+rsvg_clip_entries_free (GSList * entries)
+{
+    GSList *l;
+
+    for (l = entries; l; l = l->next) {
+        RsvgClipEntry *entry = l->data;
+
+        if (entry->outline.path)
+            cairo_path_destroy (entry->outline.path);
+        g_free (entry);
+    }
+    g_slist_free (entries);
+}
+
+static gboolean
+rsvg_clip_key_equal (const RsvgClipKey * a, const RsvgClipKey * b)
+{
+    gint i;
+
+    if (a->vb_w != b->vb_w || a->vb_h != b->vb_h
+        || a->font_size != b->font_size || a->clip_rule != b->clip_rule)
+        return FALSE;
+
+    for (i = 0; i < 6; i++)
+        if (a->affine[i] != b->affine[i])
+            return FALSE;
+
+    return TRUE;
+}
+
+RsvgPatternCache *
+rsvg_pattern_cache_new (void)
+{
+    RsvgPatternCache *cache = g_new0 (RsvgPatternCache, 1);
+
+    cache->gradients = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                              (GDestroyNotify) rsvg_gradient_entries_free);
+    cache->clips = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                          (GDestroyNotify) rsvg_clip_entries_free);
+    return cache;
+}
+
+void
+rsvg_pattern_cache_free (RsvgPatternCache * cache)
+{
+    rsvg_pattern_cache_clear (cache);
+    g_hash_table_destroy (cache->gradients);
+    g_hash_table_destroy (cache->clips);
+    g_free (cache);
+}
+
+void
+rsvg_pattern_cache_clear (RsvgPatternCache * cache)
+{
+    GList *l;
+
+    for (l = cache->tiles; l; l = l->next)
+        rsvg_pattern_tile_free (l->data);
+    g_list_free (cache->tiles);
+
+    cache->tiles = NULL;
+    cache->n_tiles = 0;
+    cache->bytes = 0;
+
+    g_hash_table_remove_all (cache->gradients);
+    g_hash_table_remove_all (cache->clips);
+}
+
+cairo_surface_t *
+rsvg_pattern_cache_lookup (RsvgPatternCache * cache, const RsvgPatternTileKey * key)
+{
+    GList *l;
+
+    for (l = cache->tiles; l; l = l->next) {
+        RsvgPatternTile *tile = l->data;
+
+        if (rsvg_pattern_tile_key_equal (&tile->key, key)) {
+            cache->tiles = g_list_remove_link (cache->tiles, l);
+            cache->tiles = g_list_concat (l, cache->tiles);
+            return cairo_surface_reference (tile->tile);
+        }
+    }
+
+    return NULL;
+}
+
+void
+rsvg_pattern_cache_insert (RsvgPatternCache * cache, const RsvgPatternTileKey * key,
+                           cairo_surface_t * tile)
+{
+    RsvgPatternTile *entry;
+    gsize size = (gsize) key->width * key->height * 4;
+
+    if (size > RSVG_PATTERN_CACHE_MAX_BYTES)
+        return;
+
+    while (cache->tiles && (cache->n_tiles >= RSVG_PATTERN_CACHE_MAX_TILES
+                            || cache->bytes + size > RSVG_PATTERN_CACHE_MAX_BYTES)) {
+        GList *last = g_list_last (cache->tiles);
+
+        entry = last->data;
+        cache->bytes -= entry->size;
+        cache->n_tiles--;
+        rsvg_pattern_tile_free (entry);
+        cache->tiles = g_list_delete_link (cache->tiles, last);
+    }
+
+    entry = g_new (RsvgPatternTile, 1);
+    entry->key = *key;
+    entry->tile = cairo_surface_reference (tile);
+    entry->size = size;
+
+    cache->tiles = g_list_prepend (cache->tiles, entry);
+    cache->n_tiles++;
+    cache->bytes += size;
+}
+
+cairo_pattern_t *
+rsvg_pattern_cache_lookup_gradient (RsvgPatternCache * cache, const RsvgGradientKey * key)
+{
+    GSList *entries, *l;
+    gint i;
+
+    entries = g_hash_table_lookup (cache->gradients, key->gradient);
+    for (l = entries; l; l = l->next) {
+        RsvgGradientEntry *entry = l->data;
+
+        if (entry->key.opacity != key->opacity)
+            continue;
+        for (i = 0; i < 6; i++)
+            if (entry->key.coords[i] != key->coords[i])
+                break;
+        if (i < 6)
+            continue;
+
+        if (l != entries) {
+            entries = g_slist_remove_link (entries, l);
+            entries = g_slist_concat (l, entries);
+            g_hash_table_steal (cache->gradients, key->gradient);
+            g_hash_table_insert (cache->gradients, key->gradient, entries);
+        }
+        return cairo_pattern_reference (entry->pattern);
+    }
+
+    return NULL;
+}
+
+void
+rsvg_pattern_cache_insert_gradient (RsvgPatternCache * cache, const RsvgGradientKey * key,
+                                    cairo_pattern_t * pattern)
+{
+    RsvgGradientEntry *entry;
+    GSList *entries;
+
+    entries = g_hash_table_lookup (cache->gradients, key->gradient);
+    g_hash_table_steal (cache->gradients, key->gradient);
+
+    if (g_slist_length (entries) >= RSVG_PATTERN_CACHE_MAX_PER_GRADIENT) {
+        GSList *last = g_slist_last (entries);
+
+        entries = g_slist_remove_link (entries, last);
+        rsvg_gradient_entries_free (last);
+    }
+
+    entry = g_new (RsvgGradientEntry, 1);
+    entry->key = *key;
+    entry->pattern = cairo_pattern_reference (pattern);
+
+    g_hash_table_insert (cache->gradients, key->gradient, g_slist_prepend (entries, entry));
+}
+
+const RsvgClipOutline *
+rsvg_pattern_cache_lookup_clip (RsvgPatternCache * cache, const RsvgClipKey * key)
+{
+    GSList *entries, *l;
+
+    entries = g_hash_table_lookup (cache->clips, key->clip);
+    for (l = entries; l; l = l->next) {
+        RsvgClipEntry *entry = l->data;
+
+        if (!rsvg_clip_key_equal (&entry->key, key))
+            continue;
+
+        if (l != entries) {
+            entries = g_slist_remove_link (entries, l);
+            entries = g_slist_concat (l, entries);
+            g_hash_table_steal (cache->clips, key->clip);
+            g_hash_table_insert (cache->clips, key->clip, entries);
+        }
+        return &entry->outline;
+    }
+
+    return NULL;
+}
+
+void
+rsvg_pattern_cache_insert_clip (RsvgPatternCache * cache, const RsvgClipKey * key,
+                                const RsvgClipOutline * outline)
+{
+    RsvgClipEntry *entry;
+    GSList *entries;
+
+    entries = g_hash_table_lookup (cache->clips, key->clip);
+    g_hash_table_steal (cache->clips, key->clip);
+
+    if (g_slist_length (entries) >= RSVG_PATTERN_CACHE_MAX_PER_CLIP) {
+        GSList *last = g_slist_last (entries);
+
+        entries = g_slist_remove_link (entries, last);
+        rsvg_clip_entries_free (last);
+    }
+
+    entry = g_new (RsvgClipEntry, 1);
+    entry->key = *key;
+    entry->outline = *outline;
+
+    g_hash_table_insert (cache->clips, key->clip, g_slist_prepend (entries, entry));
+}
@@ -0,0 +1,101 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+   rsvg-pattern-cache.h : Pattern tiles, gradients and clips kept between renders
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+*/
+
+#ifndef RSVG_PATTERN_CACHE_H
+#define RSVG_PATTERN_CACHE_H
+
+#include "rsvg-private.h"
+#include "rsvg-paint-server.h"
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+/* everything a tile's pixels depend on */
+typedef struct {
+    RsvgPattern *pattern;
+    gint width, height;         /* of the tile in pixels */
+    gdouble affine[6];          /* from the pattern contents to the tile */
+    gdouble vb_w, vb_h;         /* what percentages in the contents are of */
+    RsvgFilterQuality filter_quality;
+} RsvgPatternTileKey;
+
+/* everything the cairo pattern of a userSpaceOnUse gradient depends on */
+typedef struct {
+    RsvgNode *gradient;
+    gdouble coords[6];          /* its points and radius, in user space */
+    guint8 opacity;
+} RsvgGradientKey;
+
+/* everything the outline of a userSpaceOnUse clip path depends on */
+typedef struct {
+    RsvgNode *clip;
+    gdouble affine[6];          /* from its user space to the one it is kept in */
+    gdouble vb_w, vb_h;         /* what percentages in it are of */
+    gdouble font_size;          /* what ems in it are of */
+    gint clip_rule;             /* inherited by its children */
+} RsvgClipKey;
+
+/* the outline of a clip path, in the space the key's affine maps into */
+typedef struct {
+    gboolean is_rect;           /* if so, just the rectangle is kept */
+    gdouble x, y, w, h;
+    cairo_path_t *path;
+    cairo_fill_rule_t fill_rule;
+} RsvgClipOutline;
+
+RsvgPatternCache   *rsvg_pattern_cache_new      (void);
+void                rsvg_pattern_cache_free     (RsvgPatternCache * cache);
+
+/* Drops everything, as when the DPI it was made for changes. */
+void                rsvg_pattern_cache_clear    (RsvgPatternCache * cache);
+
+/* A reference to the tile drawn for @key, or NULL. */
+cairo_surface_t    *rsvg_pattern_cache_lookup   (RsvgPatternCache * cache,
+                                                 const RsvgPatternTileKey * key);
+
+/* Keeps @tile for @key, if it fits, dropping the tiles least recently
+   used to make room. */
+void                rsvg_pattern_cache_insert   (RsvgPatternCache * cache,
+                                                 const RsvgPatternTileKey * key,
+                                                 cairo_surface_t * tile);
+
+/* A reference to the cairo pattern made for @key, or NULL. */
+cairo_pattern_t    *rsvg_pattern_cache_lookup_gradient  (RsvgPatternCache * cache,
+                                                         const RsvgGradientKey * key);
+
+/* Keeps @pattern for @key. It must not be changed after. */
+void                rsvg_pattern_cache_insert_gradient  (RsvgPatternCache * cache,
+                                                         const RsvgGradientKey * key,
+                                                         cairo_pattern_t * pattern);
+
+/* The outline kept for @key, or NULL. It is the cache's, and is only
+   good until something else is kept in it. */
+const RsvgClipOutline *rsvg_pattern_cache_lookup_clip   (RsvgPatternCache * cache,
+                                                         const RsvgClipKey * key);
+
+/* Keeps @outline for @key, taking over its path. */
+void                rsvg_pattern_cache_insert_clip      (RsvgPatternCache * cache,
+                                                         const RsvgClipKey * key,
+                                                         const RsvgClipOutline * outline);
+
+G_END_DECLS
+
+#endif                          /* RSVG_PATTERN_CACHE_H */
@@ -53,6 +53,8 @@ typedef struct _RsvgNode RsvgNode;
 typedef struct _RsvgFilter RsvgFilter;
 typedef struct _RsvgNodeChars RsvgNodeChars;
 typedef struct _RsvgIRect RsvgIRect;
+typedef struct _RsvgBufferPool RsvgBufferPool;
+typedef struct _RsvgPatternCache RsvgPatternCache;
 
 /* prepare for gettext */
 #ifndef _
@@ -157,6 +159,10 @@ struct RsvgHandlePrivate {
     double dpi_x;
     double dpi_y;
 
+    RsvgFilterQuality filter_quality;
+
+    RsvgPatternCache *pattern_cache;
+
     GString *title;
     GString *desc;
     GString *metadata;
@@ -191,10 +197,13 @@ struct RsvgDrawingCtx {
     gchar *base_uri;
     PangoContext *pango_context;
     double dpi_x, dpi_y;
+    RsvgFilterQuality filter_quality;
     RsvgViewBox vb;
     GSList *vb_stack;
     GSList *drawsub_stack;
     GSList *ptrs;
+    RsvgBufferPool *buffer_pool;    /* where layer and filter pixels come from */
+    RsvgPatternCache *pattern_cache;    /* the handle's, or NULL */
 };
 
 /*Abstract base class for context for our backends (one as yet)*/
@@ -214,6 +223,10 @@ struct RsvgRender {
                                                  double w, double h);
     GdkPixbuf       *(*get_image_of_node)       (RsvgDrawingCtx * ctx, RsvgNode * drawable,
                                                  double w, double h);
+    /* optional, called around the drawing of every node */
+    void             (*begin_node)              (RsvgDrawingCtx * ctx, RsvgNode * node,
+                                                 int dominate);
+    void             (*end_node)                (RsvgDrawingCtx * ctx, RsvgNode * node);
 };
 
 
@@ -344,8 +357,6 @@ GdkPixbuf *rsvg_pixbuf_from_data_with_size_data (const guchar * buff,
                                                  const char *base_uri, GError ** error);
 
 gboolean     rsvg_eval_switch_attributes	(RsvgPropertyBag * atts, gboolean * p_has_cond);
-GdkPixbuf   *_rsvg_pixbuf_new_cleared       (GdkColorspace colorspace, gboolean has_alpha,
-                                             int bits_per_sample, int width, int height);
 
 gchar       *rsvg_get_base_uri_from_filename    (const gchar * file_name);
 GByteArray  *_rsvg_acquire_xlink_href_resource  (const char *href,
@@ -354,6 +365,7 @@ GByteArray  *_rsvg_acquire_xlink_href_resource  (const char *href,
 void rsvg_pop_discrete_layer    (RsvgDrawingCtx * ctx);
 void rsvg_push_discrete_layer   (RsvgDrawingCtx * ctx);
 void rsvg_render_path           (RsvgDrawingCtx * ctx, const char *d);
+void rsvg_render_bpath          (RsvgDrawingCtx * ctx, const RsvgBpathDef * bpath_def);
 void rsvg_render_image          (RsvgDrawingCtx * ctx, GdkPixbuf * pb,
                                  double x, double y, double w, double h);
 void rsvg_render_free           (RsvgRender * render);
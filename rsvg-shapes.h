@@ -47,7 +47,7 @@ typedef struct _RsvgNodePath RsvgNodePath;
 
 struct _RsvgNodePath {
     RsvgNode super;
-    char *d;
+    RsvgBpathDef *path;        /* parsed and finished once, from the d attribute */
 };
 
 G_END_DECLS
@@ -39,6 +39,7 @@ rsvg_node_draw (RsvgNode * self, RsvgDrawingCtx * ctx, int dominate)
 {
     RsvgState *state;
     GSList *stacksave;
+    RsvgRender *render;
 
     state = self->state;
 
@@ -66,7 +67,12 @@ rsvg_node_draw (RsvgNode * self, RsvgDrawingCtx * ctx, int dominate)
     }
     ctx->ptrs = g_slist_append(ctx->ptrs, self);
 
+    render = ctx->render;
+    if (render->begin_node)
+        render->begin_node (ctx, self, dominate);
     self->draw (self, ctx, dominate);
+    if (render->end_node)
+        render->end_node (ctx, self);
     ctx->drawsub_stack = stacksave;
 
     ctx->ptrs = g_slist_remove(ctx->ptrs, self);
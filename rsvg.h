@@ -115,9 +115,25 @@ void rsvg_term (void);
 
 void rsvg_set_default_dpi	(double dpi);
 void rsvg_set_default_dpi_x_y	(double dpi_x, double dpi_y);
+void rsvg_set_filter_threads	(int n_threads);
+
+/**
+ * RsvgFilterQuality:
+ * @RSVG_FILTER_QUALITY_EXACT: every filter primitive is worked out at the
+ *   resolution it is drawn at
+ * @RSVG_FILTER_QUALITY_FAST: wide blurs and coarse turbulence are worked out
+ *   at a lower resolution and scaled up, and colour matrices, convolutions
+ *   and coloured drop shadows are approximated; see
+ *   rsvg_handle_set_filter_quality()
+ */
+typedef enum {
+    RSVG_FILTER_QUALITY_EXACT,
+    RSVG_FILTER_QUALITY_FAST
+} RsvgFilterQuality;
 
 void rsvg_handle_set_dpi	(RsvgHandle * handle, double dpi);
 void rsvg_handle_set_dpi_x_y	(RsvgHandle * handle, double dpi_x, double dpi_y);
+void rsvg_handle_set_filter_quality (RsvgHandle * handle, RsvgFilterQuality quality);
 
 RsvgHandle  *rsvg_handle_new		(void);
 gboolean     rsvg_handle_write		(RsvgHandle * handle, const guchar * buf, 
@@ -0,0 +1,83 @@
+/* vim: set ts=4 nowrap ai expandtab sw=4: */
+
+#include <glib.h>
+#include "rsvg.h"
+#include "rsvg-cairo.h"
+#include "test-utils.h"
+
+typedef struct _FixtureData
+{
+    const gchar *test_name;
+    const gchar *file_path;
+    gint x;
+    gint y;
+    guint alpha;                /* expected at x, y, give or take 2 */
+} FixtureData;
+
+static void
+test_layers (FixtureData *fixture)
+{
+    RsvgHandle *handle;
+    RsvgDimensionData dimension;
+    cairo_surface_t *surface;
+    cairo_t *cr;
+    gchar *target_file;
+    GError *error = NULL;
+    guint32 pixel;
+    gint alpha;
+
+    target_file = g_build_filename (test_utils_get_test_data_path (),
+                                    fixture->file_path, NULL);
+    handle = rsvg_handle_new_from_file (target_file, &error);
+    g_free (target_file);
+    g_assert_no_error (error);
+
+    rsvg_handle_get_dimensions (handle, &dimension);
+    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                          dimension.width, dimension.height);
+    cr = cairo_create (surface);
+    rsvg_handle_render_cairo (handle, cr);
+    cairo_destroy (cr);
+    cairo_surface_flush (surface);
+
+    pixel = *(guint32 *) (cairo_image_surface_get_data (surface)
+                          + fixture->y * cairo_image_surface_get_stride (surface)
+                          + fixture->x * 4);
+    alpha = pixel >> 24;
+    g_assert_cmpint (ABS (alpha - (gint) fixture->alpha), <=, 2);
+
+    cairo_surface_destroy (surface);
+    g_object_unref (handle);
+}
+
+static FixtureData fixtures[] =
+{
+    {"/layers/filtered shape in translucent group/shifted", "layers/filtered-shape-in-translucent-group.svg", 70, 70, 128},
+    {"/layers/filtered shape in translucent group/source", "layers/filtered-shape-in-translucent-group.svg", 20, 20, 0},
+    {"/layers/filtered shape in masked group/shifted", "layers/filtered-shape-in-masked-group.svg", 70, 70, 255},
+    {"/layers/filtered shape in masked group/source", "layers/filtered-shape-in-masked-group.svg", 20, 20, 0},
+    {"/layers/pattern fill in translucent group", "layers/pattern-fill-in-translucent-group.svg", 50, 50, 128},
+    {"/layers/reused group in translucent group/first", "layers/reused-group-in-translucent-group.svg", 25, 25, 64},
+    {"/layers/reused group in translucent group/second", "layers/reused-group-in-translucent-group.svg", 75, 75, 64},
+    {"/layers/overlapping group in translucent group", "layers/overlapping-group-in-translucent-group.svg", 50, 50, 64}
+};
+
+static const gint n_fixtures = G_N_ELEMENTS (fixtures);
+
+int
+main (int argc, char *argv[])
+{
+    gint i;
+    int result;
+
+    rsvg_init ();
+    g_test_init (&argc, &argv, NULL);
+
+    for (i = 0; i < n_fixtures; i++)
+        g_test_add_data_func (fixtures[i].test_name, &fixtures[i], (void*)test_layers);
+
+    result = g_test_run ();
+    rsvg_term ();
+
+    return result;
+}
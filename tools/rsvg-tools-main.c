@@ -83,6 +83,7 @@ rsvg_tools_main (int *argc, char ***argv)
     int width = -1;
     int height = -1;
     int bVersion = 0;
+    int bReuse = 0;
 
     char **args;
     gint n_args = 0;
@@ -100,6 +101,8 @@ rsvg_tools_main (int *argc, char ***argv)
         {"width", 'w', 0, G_OPTION_ARG_INT, &width, "width", "<int>"},
         {"height", 'h', 0, G_OPTION_ARG_INT, &height, "height", "<int>"},
         {"count", 'c', 0, G_OPTION_ARG_INT, &count, "number of times to render the SVG", "<int>"},
+        {"reuse", 'r', 0, G_OPTION_ARG_NONE, &bReuse,
+         "load the SVG once and only time repeated renders of the same handle", NULL},
         {"version", 'v', 0, G_OPTION_ARG_NONE, &bVersion, "show version information", NULL},
         {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &args, NULL, N_("[FILE...]")},
         {NULL}
@@ -153,7 +156,8 @@ rsvg_tools_main (int *argc, char ***argv)
             if (dimensions.height * y_zoom < height)
                 height = dimensions.height * y_zoom;
         }
-        g_object_unref (handle);
+        if (!bReuse)
+            g_object_unref (handle);
 
         image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
         cr = cairo_create (image);
@@ -163,14 +167,19 @@ rsvg_tools_main (int *argc, char ***argv)
         g_timer_start (timer);
 
         for (i = 0; i < count; i++) {
-            handle = rsvg_handle_new_from_data (contents, length, NULL);
+            if (!bReuse)
+                handle = rsvg_handle_new_from_data (contents, length, NULL);
             cairo_save (cr);
             cairo_scale (cr, (double) width / dimensions.width, (double) height / dimensions.height);
             rsvg_handle_render_cairo (handle, cr);
             cairo_restore (cr);
-            g_object_unref (handle);
+            if (!bReuse)
+                g_object_unref (handle);
         }
 
+        if (bReuse)
+            g_object_unref (handle);
+
         g_print ("%-50s\t\t%g(s)\n", args[j], g_timer_elapsed (timer, NULL) / count);
         g_timer_destroy (timer);
 
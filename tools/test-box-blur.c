@@ -0,0 +1,114 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+
+*/
+
+/*
+ * Times the box blur kernels behind feGaussianBlur against each other on
+ * random premultiplied pixels, and checks they agree byte for byte.
+ *
+ * usage: test-box-blur [width [height [box size [count]]]]
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsvg-filter-blur.h"
+
+static const char *kernel_names[] = { "scalar", "sse2", "avx2" };
+
+static void
+fill_random (guchar * pixels, gint width, gint height)
+{
+    gint i;
+
+    for (i = 0; i < width * height; i++) {
+        guchar alpha = g_random_int_range (0, 256);
+        gint ch;
+
+        for (ch = 0; ch < 3; ch++)
+            pixels[4 * i + ch] = g_random_int_range (0, alpha + 1);
+        pixels[4 * i + 3] = alpha;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    gint width = argc > 1 ? atoi (argv[1]) : 1024;
+    gint height = argc > 2 ? atoi (argv[2]) : 1024;
+    gint box = argc > 3 ? atoi (argv[3]) : 15;
+    gint count = argc > 4 ? atoi (argv[4]) : 10;
+    gsize size = (gsize) width * height * 4;
+    guchar *source, *reference, *pixels;
+    RsvgIRect bounds = { 0, 0, width, height };
+    gdouble scalar_time = 0;
+    gint kernel, i, failed = 0;
+
+    source = g_malloc (size);
+    reference = g_malloc (size);
+    pixels = g_malloc (size);
+    g_random_set_seed (1);
+    fill_random (source, width, height);
+
+    g_print ("%dx%d, box %d, %d runs\n", width, height, box, count);
+
+    for (kernel = RSVG_BOX_BLUR_SCALAR; kernel <= RSVG_BOX_BLUR_AVX2; kernel++) {
+        GTimer *timer;
+        gdouble elapsed;
+
+        if (!rsvg_box_blur_kernel_supported (kernel)) {
+            g_print ("%-8s\tnot supported\n", kernel_names[kernel]);
+            continue;
+        }
+
+        timer = g_timer_new ();
+        elapsed = 0;
+        for (i = 0; i < count; i++) {
+            /* the three passes fast_blur() makes */
+            memcpy (pixels, source, size);
+            g_timer_start (timer);
+            rsvg_box_blur (kernel, pixels, pixels, width * 4, box, box, bounds, 0xf);
+            rsvg_box_blur (kernel, pixels, pixels, width * 4, box, box, bounds, 0xf);
+            rsvg_box_blur (kernel, pixels, pixels, width * 4, box, box, bounds, 0xf);
+            elapsed += g_timer_elapsed (timer, NULL);
+        }
+        elapsed /= count;
+        g_timer_destroy (timer);
+
+        if (kernel == RSVG_BOX_BLUR_SCALAR) {
+            scalar_time = elapsed;
+            memcpy (reference, pixels, size);
+        } else if (memcmp (reference, pixels, size)) {
+            failed = 1;
+        }
+
+        g_print ("%-8s\t%g(s)\t%.2fx%s\n", kernel_names[kernel], elapsed,
+                 scalar_time / elapsed,
+                 memcmp (reference, pixels, size) ? "\tMISMATCH" : "");
+    }
+
+    g_free (source);
+    g_free (reference);
+    g_free (pixels);
+
+    return failed;
+}
@@ -0,0 +1,127 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+
+*/
+
+/*
+ * Times each feConvolveMatrix kernel the machine supports against visiting
+ * every tap of every pixel, for a separable and a general matrix of a
+ * range of orders, and checks they agree exactly.
+ *
+ * usage: test-convolve [width [height [max order]]]
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsvg-filter-convolve.h"
+
+static const char *kernel_names[] = { "scalar", "sse2" };
+
+/* the naive path, as kernel -1 */
+static gdouble
+time_kernel (gint kernel, const RsvgConvolveFixed * fixed, const guchar * in, gint in_stride,
+             gint * out, gint width, gint height)
+{
+    GTimer *timer;
+    gdouble elapsed;
+
+    timer = g_timer_new ();
+    if (kernel < 0)
+        rsvg_convolve_naive (fixed, in, in_stride, out, width, height, 1, 1);
+    else
+        rsvg_convolve (kernel, fixed, in, in_stride, out, width, height, 1, 1);
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    return elapsed;
+}
+
+int
+main (int argc, char **argv)
+{
+    gint width = argc > 1 ? atoi (argv[1]) : 1000;
+    gint height = argc > 2 ? atoi (argv[2]) : 1000;
+    gint max_order = argc > 3 ? atoi (argv[3]) : 9;
+    gint in_width = width + max_order - 1, in_height = height + max_order - 1;
+    gsize size = (gsize) width * height * 4;
+    gint order, separable, kernel, failed = 0;
+    guchar *source;
+    gint *naive, *fast;
+    gsize i;
+
+    source = g_malloc ((gsize) in_width * in_height * 4);
+    naive = g_new (gint, size);
+    fast = g_new (gint, size);
+    g_random_set_seed (1);
+    for (i = 0; i < (gsize) in_width * in_height * 4; i++)
+        source[i] = g_random_int_range (0, 256);
+
+    g_print ("%dx%d\norder\tmatrix\tkernel\tnaive(s)\tkernel(s)\n", width, height);
+
+    for (order = 3; order <= max_order; order += 2)
+        for (separable = 1; separable >= 0; separable--) {
+            RsvgConvolveFixed fixed;
+            gdouble *matrix = g_new (gdouble, order * order);
+            gdouble naive_time;
+            gint x, y;
+
+            /* a binomial blur, or one with its middle picked out */
+            for (y = 0; y < order; y++)
+                for (x = 0; x < order; x++)
+                    matrix[y * order + x] = (MIN (x, order - 1 - x) + 1) *
+                        (MIN (y, order - 1 - y) + 1) / 16.0;
+            if (!separable)
+                matrix[order * order / 2] = -matrix[order * order / 2];
+
+            rsvg_convolve_fixed_init (&fixed, matrix, order, order);
+            if ((fixed.row != NULL) != separable) {
+                g_print ("%d\tseparable matrix not spotted\n", order);
+                failed = 1;
+            }
+
+            naive_time = time_kernel (-1, &fixed, source, in_width * 4, naive, width, height);
+
+            for (kernel = RSVG_CONVOLVE_SCALAR; kernel <= RSVG_CONVOLVE_SSE2; kernel++) {
+                gdouble fast_time;
+
+                if (!rsvg_convolve_kernel_supported (kernel))
+                    continue;
+
+                fast_time = time_kernel (kernel, &fixed, source, in_width * 4, fast, width, height);
+                g_print ("%d\t%s\t%s\t%g\t%g\t%.1fx%s\n", order,
+                         separable ? "rank 1" : "general", kernel_names[kernel],
+                         naive_time, fast_time, naive_time / fast_time,
+                         memcmp (naive, fast, size * sizeof (gint)) ? "\tMISMATCH" : "");
+                if (memcmp (naive, fast, size * sizeof (gint)))
+                    failed = 1;
+            }
+
+            rsvg_convolve_fixed_free (&fixed);
+            g_free (matrix);
+        }
+
+    g_free (source);
+    g_free (naive);
+    g_free (fast);
+
+    return failed;
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+
+*/
+
+/*
+ * Times the feMorphology kernel against the naive neighbourhood scan for a
+ * range of radii, and checks they agree byte for byte.
+ *
+ * usage: test-morphology [width [height [max radius]]]
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsvg-filter-morphology.h"
+
+typedef void (*MorphologyFunc) (const guchar * in, guchar * out, gint rowstride,
+                                gint width, gint height, gint kx, gint ky,
+                                RsvgIRect bounds, gboolean dilate);
+
+static gdouble
+time_kernel (MorphologyFunc func, const guchar * in, guchar * out,
+             gint width, gint height, gint radius)
+{
+    RsvgIRect bounds = { 0, 0, width, height };
+    GTimer *timer;
+    gdouble elapsed;
+
+    timer = g_timer_new ();
+    func (in, out, width * 4, width, height, radius, radius, bounds, TRUE);
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    return elapsed;
+}
+
+int
+main (int argc, char **argv)
+{
+    gint width = argc > 1 ? atoi (argv[1]) : 1000;
+    gint height = argc > 2 ? atoi (argv[2]) : 1000;
+    gint max_radius = argc > 3 ? atoi (argv[3]) : 20;
+    gsize size = (gsize) width * height * 4;
+    guchar *source, *naive, *fast;
+    gint radius, failed = 0;
+    gsize i;
+
+    source = g_malloc (size);
+    naive = g_malloc (size);
+    fast = g_malloc (size);
+    g_random_set_seed (1);
+    for (i = 0; i < size; i++)
+        source[i] = g_random_int_range (0, 256);
+
+    g_print ("%dx%d dilate\nradius\tnaive(s)\tseparable(s)\n", width, height);
+
+    for (radius = 1; radius <= max_radius; radius = radius < 5 ? radius + 1 : radius * 2) {
+        gdouble naive_time, fast_time;
+
+        naive_time = time_kernel (rsvg_morphology_naive, source, naive, width, height, radius);
+        fast_time = time_kernel (rsvg_morphology, source, fast, width, height, radius);
+
+        g_print ("%d\t%g\t%g\t%.1fx%s\n", radius, naive_time, fast_time,
+                 naive_time / fast_time, memcmp (naive, fast, size) ? "\tMISMATCH" : "");
+        if (memcmp (naive, fast, size))
+            failed = 1;
+    }
+
+    g_free (source);
+    g_free (naive);
+    g_free (fast);
+
+    return failed;
+}
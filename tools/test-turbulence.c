@@ -0,0 +1,112 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/* vim: set sw=4 sts=4 ts=4 expandtab: */
+/*
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+   Boston, MA 02111-1307, USA.
+
+*/
+
+/*
+ * Times each feTurbulence kernel the machine supports against working the
+ * channels out one by one, and checks they agree byte for byte.
+ *
+ * usage: test-turbulence [width [height [max octaves]]]
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rsvg-filter-turbulence.h"
+
+static const char *kernel_names[] = { "scalar", "sse2", "avx" };
+
+/* the naive path, as kernel -1 */
+static gdouble
+time_kernel (gint kernel, const RsvgTurbulence * turbulence, guchar * out,
+             gint width, gint height)
+{
+    const gdouble affine[6] = { 1, 0, 0, 1, 0, 0 };
+    RsvgIRect tile = { 0, 0, width, height };
+    GTimer *timer;
+    gdouble elapsed;
+    gint y;
+
+    timer = g_timer_new ();
+    for (y = 0; y < height; y++) {
+        if (kernel < 0)
+            rsvg_turbulence_row_naive (turbulence, affine, tile, 0, y, 1, width,
+                                       out + (gsize) y * width * 4);
+        else
+            rsvg_turbulence_row (kernel, turbulence, affine, tile, 0, y, 1, width,
+                                 out + (gsize) y * width * 4);
+    }
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    return elapsed;
+}
+
+int
+main (int argc, char **argv)
+{
+    gint width = argc > 1 ? atoi (argv[1]) : 500;
+    gint height = argc > 2 ? atoi (argv[2]) : 500;
+    gint max_octaves = argc > 3 ? atoi (argv[3]) : 8;
+    gsize size = (gsize) width * height * 4;
+    RsvgTurbulence turbulence;
+    guchar *naive, *fast;
+    gint octaves, kernel, failed = 0;
+
+    naive = g_malloc (size);
+    fast = g_malloc (size);
+
+    rsvg_turbulence_init (&turbulence, 1);
+    turbulence.base_freq_x = 0.05;
+    turbulence.base_freq_y = 0.03;
+    turbulence.fractal_sum = TRUE;
+    turbulence.stitch = TRUE;
+    rsvg_turbulence_stitch_frequencies (&turbulence, width, height);
+
+    g_print ("%dx%d fractal noise\noctaves\tkernel\tnaive(s)\tkernel(s)\n", width, height);
+
+    for (octaves = 1; octaves <= max_octaves; octaves *= 2) {
+        gdouble naive_time;
+
+        turbulence.octaves = octaves;
+        naive_time = time_kernel (-1, &turbulence, naive, width, height);
+
+        for (kernel = RSVG_TURBULENCE_SCALAR; kernel <= RSVG_TURBULENCE_AVX; kernel++) {
+            gdouble fast_time;
+
+            if (!rsvg_turbulence_kernel_supported (kernel))
+                continue;
+
+            fast_time = time_kernel (kernel, &turbulence, fast, width, height);
+            g_print ("%d\t%s\t%g\t%g\t%.1fx%s\n", octaves, kernel_names[kernel],
+                     naive_time, fast_time, naive_time / fast_time,
+                     memcmp (naive, fast, size) ? "\tMISMATCH" : "");
+            if (memcmp (naive, fast, size))
+                failed = 1;
+        }
+    }
+
+    g_free (naive);
+    g_free (fast);
+
+    return failed;
+}